@@ -0,0 +1,93 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+
+#include "hash.h"
+#include "main.h"
+#include "primitives/block.h"
+#include "undo.h"
+#include "util.h"
+
+bool fAddressIndex = false;
+bool fSpentIndex = false;
+
+bool GetAddressKey(const CScript& script, unsigned char& nType, uint160& hashBytes)
+{
+    if (script.IsPayToScriptHash()) {
+        nType = ADDRESS_SCRIPTHASH;
+        hashBytes = uint160(std::vector<unsigned char>(script.begin() + 2, script.begin() + 22));
+        return true;
+    }
+
+    // pay to pubkey hash
+    if (script.size() == 25 && script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == 20 &&
+        script[23] == OP_EQUALVERIFY && script[24] == OP_CHECKSIG) {
+        nType = ADDRESS_PUBKEYHASH;
+        hashBytes = uint160(std::vector<unsigned char>(script.begin() + 3, script.begin() + 23));
+        return true;
+    }
+
+    // pay to pubkey, used by the coinstakes, indexed under the address of the key
+    if ((script.size() == 35 && script[0] == 33) || (script.size() == 67 && script[0] == 65)) {
+        if (script.back() != OP_CHECKSIG)
+            return false;
+        nType = ADDRESS_PUBKEYHASH;
+        hashBytes = Hash160(script.begin() + 1, script.end() - 1);
+        return true;
+    }
+
+    return false;
+}
+
+bool GetAddressIndexChanges(const CBlock& block, const CBlockUndo& blockundo, int nHeight, CAddressIndexChanges& changes)
+{
+    if (blockundo.vtxundo.size() + 1 != block.vtx.size())
+        return error("%s : block %s and undo data inconsistent", __func__, block.GetHash().GetHex());
+
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        const uint256 txhash = tx.GetHash();
+        unsigned char nType;
+        uint160 hashBytes;
+
+        // zerocoin spends have no outputs to spend
+        if (i > 0 && !tx.HasZerocoinSpendInputs()) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            if (txundo.vprevout.size() != tx.vin.size())
+                return error("%s : tx %s and undo data inconsistent", __func__, txhash.GetHex());
+
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const COutPoint& prevout = tx.vin[j].prevout;
+                const CTxInUndo& undo = txundo.vprevout[j];
+                bool fHasAddress = GetAddressKey(undo.txout.scriptPubKey, nType, hashBytes);
+
+                if (fAddressIndex && fHasAddress) {
+                    changes.vAddressIndex.push_back(std::make_pair(CAddressIndexKey(nType, hashBytes, nHeight, i, txhash, j, true), -undo.txout.nValue));
+                    changes.vUnspentSpent.push_back(std::make_pair(CAddressUnspentKey(nType, hashBytes, prevout.hash, prevout.n),
+                                                                   CAddressUnspentValue(undo.txout.nValue, undo.txout.scriptPubKey, undo.nHeight)));
+                }
+                if (fSpentIndex) {
+                    changes.vSpentIndex.push_back(std::make_pair(CSpentIndexKey(prevout.hash, prevout.n),
+                                                                 CSpentIndexValue(txhash, j, nHeight, undo.txout.nValue, fHasAddress ? nType : (unsigned char)ADDRESS_NONE, fHasAddress ? hashBytes : uint160(0))));
+                }
+            }
+        }
+
+        if (!fAddressIndex)
+            continue;
+
+        for (unsigned int k = 0; k < tx.vout.size(); k++) {
+            const CTxOut& out = tx.vout[k];
+            if (!GetAddressKey(out.scriptPubKey, nType, hashBytes))
+                continue;
+
+            changes.vAddressIndex.push_back(std::make_pair(CAddressIndexKey(nType, hashBytes, nHeight, i, txhash, k, false), out.nValue));
+            changes.vUnspentCreated.push_back(std::make_pair(CAddressUnspentKey(nType, hashBytes, txhash, k),
+                                                             CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight)));
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,201 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SIMPLICITY_ADDRESSINDEX_H
+#define SIMPLICITY_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "crypto/common.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <utility>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+static const bool DEFAULT_ADDRESSINDEX = false;
+static const bool DEFAULT_SPENTINDEX = false;
+
+//! Address types of the index keys
+enum AddressType {
+    ADDRESS_NONE = 0,
+    ADDRESS_PUBKEYHASH = 1,
+    ADDRESS_SCRIPTHASH = 2,
+};
+
+/** Big-endian heights and positions make LevelDB iterate the index in chain order */
+template <typename Stream>
+inline void SerializeBE32(Stream& s, uint32_t n)
+{
+    unsigned char buf[4];
+    WriteBE32(buf, n);
+    s.write((char*)buf, sizeof(buf));
+}
+
+template <typename Stream>
+inline uint32_t UnserializeBE32(Stream& s)
+{
+    unsigned char buf[4];
+    s.read((char*)buf, sizeof(buf));
+    return ReadBE32(buf);
+}
+
+/** Balance change of an address by a transaction output or input, ordered by address then chain position */
+struct CAddressIndexKey {
+    unsigned char type;
+    uint160 hashBytes;
+    int nBlockHeight;
+    unsigned int nTxIndex;
+    uint256 txhash;
+    unsigned int nIndex;
+    bool fSpending;
+
+    CAddressIndexKey() : type(ADDRESS_NONE), hashBytes(0), nBlockHeight(0), nTxIndex(0), txhash(0), nIndex(0), fSpending(false) {}
+    CAddressIndexKey(unsigned char typeIn, const uint160& hashBytesIn, int nBlockHeightIn, unsigned int nTxIndexIn, const uint256& txhashIn, unsigned int nIndexIn, bool fSpendingIn)
+        : type(typeIn), hashBytes(hashBytesIn), nBlockHeight(nBlockHeightIn), nTxIndex(nTxIndexIn), txhash(txhashIn), nIndex(nIndexIn), fSpending(fSpendingIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 1 + 20 + 4 + 4 + 32 + 4 + 1;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        s << type;
+        s << hashBytes;
+        SerializeBE32(s, nBlockHeight);
+        SerializeBE32(s, nTxIndex);
+        s << txhash;
+        s << nIndex;
+        s << fSpending;
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        s >> type;
+        s >> hashBytes;
+        nBlockHeight = UnserializeBE32(s);
+        nTxIndex = UnserializeBE32(s);
+        s >> txhash;
+        s >> nIndex;
+        s >> fSpending;
+    }
+};
+
+/** Unspent output of an address */
+struct CAddressUnspentKey {
+    unsigned char type;
+    uint160 hashBytes;
+    uint256 txhash;
+    unsigned int nIndex;
+
+    CAddressUnspentKey() : type(ADDRESS_NONE), hashBytes(0), txhash(0), nIndex(0) {}
+    CAddressUnspentKey(unsigned char typeIn, const uint160& hashBytesIn, const uint256& txhashIn, unsigned int nIndexIn)
+        : type(typeIn), hashBytes(hashBytesIn), txhash(txhashIn), nIndex(nIndexIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(type);
+        READWRITE(hashBytes);
+        READWRITE(txhash);
+        READWRITE(nIndex);
+    }
+};
+
+struct CAddressUnspentValue {
+    CAmount nSatoshis;
+    CScript script;
+    int nBlockHeight;
+
+    CAddressUnspentValue() : nSatoshis(0), nBlockHeight(0) {}
+    CAddressUnspentValue(CAmount nSatoshisIn, const CScript& scriptIn, int nBlockHeightIn) : nSatoshis(nSatoshisIn), script(scriptIn), nBlockHeight(nBlockHeightIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nSatoshis);
+        READWRITE(script);
+        READWRITE(nBlockHeight);
+    }
+};
+
+/** Spent output, the key of the spent index */
+struct CSpentIndexKey {
+    uint256 txid;
+    unsigned int nOutputIndex;
+
+    CSpentIndexKey() : txid(0), nOutputIndex(0) {}
+    CSpentIndexKey(const uint256& txidIn, unsigned int nOutputIndexIn) : txid(txidIn), nOutputIndex(nOutputIndexIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(txid);
+        READWRITE(nOutputIndex);
+    }
+};
+
+/** Input spending an output */
+struct CSpentIndexValue {
+    uint256 txid;
+    unsigned int nInputIndex;
+    int nBlockHeight;
+    CAmount nSatoshis;
+    unsigned char nAddressType;
+    uint160 addressHash;
+
+    CSpentIndexValue() : txid(0), nInputIndex(0), nBlockHeight(0), nSatoshis(0), nAddressType(ADDRESS_NONE), addressHash(0) {}
+    CSpentIndexValue(const uint256& txidIn, unsigned int nInputIndexIn, int nBlockHeightIn, CAmount nSatoshisIn, unsigned char nAddressTypeIn, const uint160& addressHashIn)
+        : txid(txidIn), nInputIndex(nInputIndexIn), nBlockHeight(nBlockHeightIn), nSatoshis(nSatoshisIn), nAddressType(nAddressTypeIn), addressHash(addressHashIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(txid);
+        READWRITE(nInputIndex);
+        READWRITE(nBlockHeight);
+        READWRITE(nSatoshis);
+        READWRITE(nAddressType);
+        READWRITE(addressHash);
+    }
+};
+
+typedef std::vector<std::pair<CAddressIndexKey, CAmount> > AddressIndex;
+typedef std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > AddressUnspentIndex;
+typedef std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > SpentIndex;
+
+/** Index entries of a block, written in one batch when it is connected and erased when it is disconnected */
+struct CAddressIndexChanges {
+    AddressIndex vAddressIndex;
+    //! outputs created by the block
+    AddressUnspentIndex vUnspentCreated;
+    //! outputs spent by the block, with their values for the undo
+    AddressUnspentIndex vUnspentSpent;
+    SpentIndex vSpentIndex;
+};
+
+/** Address type and hash paying to a script, false if the script has no address */
+bool GetAddressKey(const CScript& script, unsigned char& nType, uint160& hashBytes);
+
+/** Changes of the enabled indexes by a block, from the block and its undo data */
+bool GetAddressIndexChanges(const CBlock& block, const CBlockUndo& blockundo, int nHeight, CAddressIndexChanges& changes);
+
+extern bool fAddressIndex;
+extern bool fSpentIndex;
+
+#endif // SIMPLICITY_ADDRESSINDEX_H
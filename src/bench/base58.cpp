@@ -0,0 +1,36 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "base58.h"
+
+/** The size of an address payload with its version byte */
+static const std::vector<unsigned char> vchBench(21, 0x5a);
+
+static void Base58Encode(benchmark::State& state)
+{
+    while (state.KeepRunning())
+        EncodeBase58(vchBench);
+}
+
+static void Base58CheckEncode(benchmark::State& state)
+{
+    while (state.KeepRunning())
+        EncodeBase58Check(vchBench);
+}
+
+static void Base58Decode(benchmark::State& state)
+{
+    const std::string str = EncodeBase58(vchBench);
+    std::vector<unsigned char> vch;
+    while (state.KeepRunning()) {
+        vch.clear();
+        DecodeBase58(str, vch);
+    }
+}
+
+BENCHMARK(Base58Encode);
+BENCHMARK(Base58CheckEncode);
+BENCHMARK(Base58Decode);
@@ -0,0 +1,129 @@
+// Copyright (c) 2015-2016 The Bitcoin Core developers
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "tinyformat.h"
+#include "utiltime.h"
+
+#include <iostream>
+#include <limits>
+
+#include <univalue.h>
+
+namespace benchmark
+{
+/** Intervals between clock reads are grown up to this, so reading it costs little */
+static const int64_t CHECK_INTERVAL_MICROS = 1000;
+
+BenchRunner::BenchmarkMap& BenchRunner::benchmarks()
+{
+    static std::map<std::string, BenchFunction> benchmarks_map;
+    return benchmarks_map;
+}
+
+BenchRunner::BenchRunner(const std::string& strName, BenchFunction func)
+{
+    benchmarks().insert(std::make_pair(strName, func));
+}
+
+std::vector<Result> BenchRunner::RunAll(const Options& options)
+{
+    std::vector<Result> vResults;
+    for (const std::pair<const std::string, BenchFunction>& bench : benchmarks()) {
+        if (bench.first.find(options.strFilter) == std::string::npos)
+            continue;
+        State state(bench.first, options);
+        bench.second(state);
+        vResults.push_back(state.GetResult());
+        std::cerr << bench.first << ": " << state.GetResult().nIterations << " iterations" << std::endl;
+    }
+    return vResults;
+}
+
+State::State(const std::string& strName, const Options& optionsIn) : options(optionsIn), nWarmupLeft(optionsIn.nWarmup), nCount(0), nCheckMask(0), nLastCount(0), nBegin(0), nLast(0)
+{
+    result.strName = strName;
+    result.nIterations = 0;
+    result.nTotalMicros = 0;
+    result.dMinNanos = std::numeric_limits<double>::max();
+    result.dMaxNanos = 0;
+    result.dAvgNanos = 0;
+}
+
+void State::Finish(int64_t nNow)
+{
+    if (nCount > nLastCount) {
+        double dNanos = (nNow - nLast) * 1000.0 / (nCount - nLastCount);
+        result.dMinNanos = std::min(result.dMinNanos, dNanos);
+        result.dMaxNanos = std::max(result.dMaxNanos, dNanos);
+    }
+    result.nIterations = nCount;
+    result.nTotalMicros = nNow - nBegin;
+    result.dAvgNanos = nCount ? result.nTotalMicros * 1000.0 / nCount : 0;
+    if (!nCount)
+        result.dMinNanos = 0;
+}
+
+bool State::KeepRunning()
+{
+    if (nWarmupLeft) {
+        nWarmupLeft--;
+        return true;
+    }
+    if (options.nIterations && nCount == options.nIterations) {
+        Finish(GetTimeMicros());
+        return false;
+    }
+    if (nCount & nCheckMask) {
+        nCount++;
+        return true;
+    }
+
+    int64_t nNow = GetTimeMicros();
+    if (nCount == 0) {
+        nBegin = nNow;
+    } else {
+        double dNanos = (nNow - nLast) * 1000.0 / (nCount - nLastCount);
+        result.dMinNanos = std::min(result.dMinNanos, dNanos);
+        result.dMaxNanos = std::max(result.dMaxNanos, dNanos);
+        if (!options.nIterations && nNow - nBegin >= options.nMaxMicros) {
+            Finish(nNow);
+            return false;
+        }
+        // read the clock less often for fast benchmarks
+        if (nNow - nLast < CHECK_INTERVAL_MICROS && nCheckMask < (1U << 30))
+            nCheckMask = (nCheckMask << 1) | 1;
+    }
+    nLast = nNow;
+    nLastCount = nCount;
+    nCount++;
+    return true;
+}
+
+std::string FormatCSV(const std::vector<Result>& vResults)
+{
+    std::string strOut = "name,iterations,total_us,min_ns,max_ns,avg_ns\n";
+    for (const Result& result : vResults)
+        strOut += strprintf("%s,%u,%d,%.1f,%.1f,%.1f\n", result.strName, result.nIterations, result.nTotalMicros, result.dMinNanos, result.dMaxNanos, result.dAvgNanos);
+    return strOut;
+}
+
+std::string FormatJSON(const std::vector<Result>& vResults)
+{
+    UniValue arr(UniValue::VARR);
+    for (const Result& result : vResults) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("name", result.strName));
+        obj.push_back(Pair("iterations", (uint64_t)result.nIterations));
+        obj.push_back(Pair("total_us", result.nTotalMicros));
+        obj.push_back(Pair("min_ns", result.dMinNanos));
+        obj.push_back(Pair("max_ns", result.dMaxNanos));
+        obj.push_back(Pair("avg_ns", result.dAvgNanos));
+        arr.push_back(obj);
+    }
+    return arr.write(2) + "\n";
+}
+}
@@ -0,0 +1,107 @@
+// Copyright (c) 2015-2016 The Bitcoin Core developers
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SIMPLICITY_BENCH_BENCH_H
+#define SIMPLICITY_BENCH_BENCH_H
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/preprocessor/cat.hpp>
+#include <boost/preprocessor/stringize.hpp>
+
+// Simple micro-benchmarking framework; API mostly matches a subset of the Google Benchmark
+// framework (see https://github.com/google/benchmark)
+// Why not use the Google Benchmark framework? Because adding Yet Another Dependency
+// (that uses cmake as its build system and has lots of features we don't need) isn't
+// worth it.
+
+/*
+ * Usage:
+
+static void CODE_TO_TIME(benchmark::State& state)
+{
+    ... do any setup needed...
+    while (state.KeepRunning()) {
+       ... do stuff you want to time...
+    }
+    ... do any cleanup needed...
+}
+
+BENCHMARK(CODE_TO_TIME);
+
+ */
+
+namespace benchmark
+{
+/** How each benchmark is run, from the command line of bench_simplicity */
+struct Options {
+    //! only run benchmarks whose name contains this
+    std::string strFilter;
+    //! iterations run before measuring
+    uint64_t nWarmup;
+    //! measured iterations, 0 to run for nMaxMicros instead
+    uint64_t nIterations;
+    int64_t nMaxMicros;
+
+    Options() : nWarmup(1), nIterations(0), nMaxMicros(1000000) {}
+};
+
+struct Result {
+    std::string strName;
+    uint64_t nIterations;
+    int64_t nTotalMicros;
+    //! per iteration, over the intervals between clock reads
+    double dMinNanos;
+    double dMaxNanos;
+    double dAvgNanos;
+};
+
+class State
+{
+private:
+    Options options;
+    uint64_t nWarmupLeft;
+    uint64_t nCount;
+    //! the clock is read when the count has none of these bits set
+    uint64_t nCheckMask;
+    uint64_t nLastCount;
+    int64_t nBegin;
+    int64_t nLast;
+    Result result;
+
+    void Finish(int64_t nNow);
+
+public:
+    State(const std::string& strName, const Options& optionsIn);
+    bool KeepRunning();
+    const Result& GetResult() const { return result; }
+};
+
+typedef boost::function<void(State&)> BenchFunction;
+
+class BenchRunner
+{
+    typedef std::map<std::string, BenchFunction> BenchmarkMap;
+    static BenchmarkMap& benchmarks();
+
+public:
+    BenchRunner(const std::string& strName, BenchFunction func);
+
+    static std::vector<Result> RunAll(const Options& options);
+};
+
+std::string FormatCSV(const std::vector<Result>& vResults);
+std::string FormatJSON(const std::vector<Result>& vResults);
+}
+
+// BENCHMARK(foo) expands to:  benchmark::BenchRunner bench_11foo("foo", foo);
+#define BENCHMARK(n) \
+    benchmark::BenchRunner BOOST_PP_CAT(bench_, BOOST_PP_CAT(__LINE__, n))(BOOST_PP_STRINGIZE(n), n);
+
+#endif // SIMPLICITY_BENCH_BENCH_H
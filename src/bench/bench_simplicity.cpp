@@ -0,0 +1,71 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "crypto/sha256.h"
+#include "guiinterface.h"
+#include "key.h"
+#include "util.h"
+
+#include <stdio.h>
+
+CClientUIInterface uiInterface;
+CWallet* pwalletMain;
+
+void StartShutdown()
+{
+    exit(0);
+}
+
+bool ShutdownRequested()
+{
+    return false;
+}
+
+int main(int argc, char** argv)
+{
+    SetupEnvironment();
+    ParseParameters(argc, argv);
+
+    if (mapArgs.count("-?") || mapArgs.count("-help")) {
+        std::string strUsage = "Usage:\n  bench_simplicity [options]\n\n";
+        strUsage += HelpMessageGroup("Options:");
+        strUsage += HelpMessageOpt("-?", "This help message");
+        strUsage += HelpMessageOpt("-filter=<str>", "Only run benchmarks whose name contains <str>");
+        strUsage += HelpMessageOpt("-warmup=<n>", "Run each benchmark <n> times before measuring (default: 1)");
+        strUsage += HelpMessageOpt("-iterations=<n>", "Measure <n> iterations of each benchmark, instead of running it for -maxtime");
+        strUsage += HelpMessageOpt("-maxtime=<n>", "Run each benchmark for about <n> milliseconds (default: 1000)");
+        strUsage += HelpMessageOpt("-output=<format>", "Print the results as csv or json (default: csv)");
+        fprintf(stdout, "%s", strUsage.c_str());
+        return EXIT_SUCCESS;
+    }
+
+    benchmark::Options options;
+    options.strFilter = GetArg("-filter", "");
+    options.nWarmup = std::max((int64_t)0, GetArg("-warmup", 1));
+    options.nIterations = std::max((int64_t)0, GetArg("-iterations", 0));
+    options.nMaxMicros = std::max((int64_t)1, GetArg("-maxtime", 1000)) * 1000;
+    std::string strOutput = GetArg("-output", "csv");
+    if (strOutput != "csv" && strOutput != "json") {
+        fprintf(stderr, "Error: Unknown output format %s\n", strOutput.c_str());
+        return EXIT_FAILURE;
+    }
+
+    SHA256AutoDetect();
+    // on stderr, so the results stay machine readable
+    fprintf(stderr, "Using the '%s' SHA-256 implementation\n", SHA256Implementation().c_str());
+    ECC_Start();
+    fPrintToDebugLog = false;
+    SelectParams(CBaseChainParams::MAIN);
+
+    std::vector<benchmark::Result> vResults = benchmark::BenchRunner::RunAll(options);
+    std::string strResults = strOutput == "json" ? benchmark::FormatJSON(vResults) : benchmark::FormatCSV(vResults);
+    fprintf(stdout, "%s", strResults.c_str());
+
+    ECC_Stop();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "primitives/block.h"
+#include "random.h"
+#include "streams.h"
+#include "version.h"
+
+/** A block of 2000 two-input, two-output pay-to-pubkey-hash transactions */
+static CBlock CreateBenchBlock()
+{
+    CBlock block;
+    block.nVersion = CBlockHeader::CURRENT_VERSION;
+    for (int i = 0; i < 2000; i++) {
+        CMutableTransaction tx;
+        for (int j = 0; j < 2; j++) {
+            tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), j)));
+            tx.vin.back().scriptSig << std::vector<unsigned char>(72, 0x30) << std::vector<unsigned char>(33, 0x02);
+            tx.vout.push_back(CTxOut(i * 1000 + j, CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, j) << OP_EQUALVERIFY << OP_CHECKSIG));
+        }
+        block.vtx.push_back(tx);
+    }
+    return block;
+}
+
+static void BuildMerkleTree_2000(benchmark::State& state)
+{
+    CBlock block = CreateBenchBlock();
+    while (state.KeepRunning())
+        block.BuildMerkleTree();
+}
+
+static void SerializeBlock(benchmark::State& state)
+{
+    CBlock block = CreateBenchBlock();
+    while (state.KeepRunning()) {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << block;
+    }
+}
+
+static void DeserializeBlock(benchmark::State& state)
+{
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << CreateBenchBlock();
+    while (state.KeepRunning()) {
+        CDataStream ss(ssBlock.begin(), ssBlock.end(), SER_NETWORK, PROTOCOL_VERSION);
+        CBlock block;
+        ss >> block;
+    }
+}
+
+static void SerializeTransaction(benchmark::State& state)
+{
+    CBlock block = CreateBenchBlock();
+    const CTransaction& tx = block.vtx[0];
+    while (state.KeepRunning()) {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << tx;
+    }
+}
+
+static void DeserializeTransaction(benchmark::State& state)
+{
+    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+    ssTx << CreateBenchBlock().vtx[0];
+    while (state.KeepRunning()) {
+        CDataStream ss(ssTx.begin(), ssTx.end(), SER_NETWORK, PROTOCOL_VERSION);
+        CTransaction tx;
+        ss >> tx;
+    }
+}
+
+BENCHMARK(BuildMerkleTree_2000);
+BENCHMARK(SerializeBlock);
+BENCHMARK(DeserializeBlock);
+BENCHMARK(SerializeTransaction);
+BENCHMARK(DeserializeTransaction);
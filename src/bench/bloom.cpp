@@ -0,0 +1,37 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "bloom.h"
+
+static void BloomFilterInsert(benchmark::State& state)
+{
+    CBloomFilter filter(10000, 0.0001, 0, BLOOM_UPDATE_ALL);
+    std::vector<unsigned char> vKey(32, 0);
+    while (state.KeepRunning()) {
+        vKey[0]++;
+        vKey[1] += !vKey[0];
+        filter.insert(vKey);
+    }
+}
+
+static void BloomFilterContains(benchmark::State& state)
+{
+    CBloomFilter filter(10000, 0.0001, 0, BLOOM_UPDATE_ALL);
+    std::vector<unsigned char> vKey(32, 0);
+    for (int i = 0; i < 10000; i++) {
+        vKey[0] = i & 0xff;
+        vKey[1] = i >> 8;
+        filter.insert(vKey);
+    }
+    while (state.KeepRunning()) {
+        vKey[0]++;
+        vKey[1] += !vKey[0];
+        filter.contains(vKey);
+    }
+}
+
+BENCHMARK(BloomFilterInsert);
+BENCHMARK(BloomFilterContains);
@@ -0,0 +1,129 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "checkqueue.h"
+#include "hash.h"
+#include "key.h"
+#include "keystore.h"
+#include "main.h"
+#include "pubkey.h"
+#include "script/sign.h"
+#include "script/standard.h"
+
+#include <assert.h>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+/** 1000 inputs spending the pay-to-pubkey-hash outputs of 100 keys */
+static void CreateSpend(CCoins& coins, CTransaction& tx)
+{
+    CBasicKeyStore keystore;
+    CMutableTransaction txFrom;
+    for (int i = 0; i < 100; i++) {
+        CKey key;
+        key.MakeNewKey(true);
+        keystore.AddKey(key);
+        for (int j = 0; j < 10; j++)
+            txFrom.vout.push_back(CTxOut(COIN, GetScriptForDestination(key.GetPubKey().GetID())));
+    }
+    coins = CCoins(txFrom, 0);
+    CMutableTransaction txTo;
+    for (unsigned int i = 0; i < txFrom.vout.size(); i++)
+        txTo.vin.push_back(CTxIn(COutPoint(txFrom.GetHash(), i)));
+    txTo.vout.push_back(CTxOut(COIN, CScript() << OP_TRUE));
+    for (unsigned int i = 0; i < txTo.vin.size(); i++)
+        assert(SignSignature(keystore, txFrom, txTo, i));
+    tx = CTransaction(txTo);
+}
+
+/** Verify the inputs of the spend on nThreads threads, the master joining as the last one */
+template <typename Batch>
+static void CheckQueueP2PKH(benchmark::State& state, int nThreads)
+{
+    ECCVerifyHandle verifyHandle;
+    CCoins coins;
+    CTransaction tx;
+    CreateSpend(coins, tx);
+
+    typedef CCheckQueue<CScriptCheck, Batch> Queue;
+    Queue queue(128);
+    boost::thread_group workers;
+    for (int i = 1; i < nThreads; i++)
+        workers.create_thread(boost::bind(&Queue::Thread, &queue));
+
+    while (state.KeepRunning()) {
+        std::vector<CScriptCheck> vChecks(tx.vin.size());
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            CScriptCheck check(coins, tx, i, MANDATORY_SCRIPT_VERIFY_FLAGS, false);
+            check.swap(vChecks[i]);
+        }
+        CCheckQueueControl<CScriptCheck, Batch> control(&queue);
+        control.Add(vChecks);
+        assert(control.Wait());
+    }
+
+    workers.interrupt_all();
+    workers.join_all();
+}
+
+static void CheckQueueP2PKH_1Thread(benchmark::State& state) { CheckQueueP2PKH<CCheckQueueNoBatch>(state, 1); }
+static void CheckQueueP2PKH_4Threads(benchmark::State& state) { CheckQueueP2PKH<CCheckQueueNoBatch>(state, 4); }
+static void CheckQueueP2PKH_16Threads(benchmark::State& state) { CheckQueueP2PKH<CCheckQueueNoBatch>(state, 16); }
+static void CheckQueueP2PKHBatched_1Thread(benchmark::State& state) { CheckQueueP2PKH<CSignatureBatch>(state, 1); }
+static void CheckQueueP2PKHBatched_4Threads(benchmark::State& state) { CheckQueueP2PKH<CSignatureBatch>(state, 4); }
+static void CheckQueueP2PKHBatched_16Threads(benchmark::State& state) { CheckQueueP2PKH<CSignatureBatch>(state, 16); }
+
+/** About the cost of a zerocoin accumulator step or a stake kernel hash, not of a signature */
+struct CHashCheck {
+    uint256 hash;
+
+    bool operator()()
+    {
+        for (int i = 0; i < 16; i++)
+            hash = Hash(hash.begin(), hash.end());
+        return true;
+    }
+
+    void swap(CHashCheck& check) { std::swap(hash, check.hash); }
+};
+
+/** A block of 2000 transactions with 1 to 4 cheap checks each, on nThreads threads */
+static void CheckQueueScaling(benchmark::State& state, int nThreads)
+{
+    CCheckQueue<CHashCheck> queue(128);
+    boost::thread_group workers;
+    for (int i = 1; i < nThreads; i++)
+        workers.create_thread(boost::bind(&CCheckQueue<CHashCheck>::Thread, &queue));
+
+    while (state.KeepRunning()) {
+        CCheckQueueControl<CHashCheck> control(&queue);
+        for (int nTx = 0; nTx < 2000; nTx++) {
+            std::vector<CHashCheck> vChecks(nTx % 4 + 1);
+            control.Add(vChecks);
+        }
+        assert(control.Wait());
+    }
+
+    workers.interrupt_all();
+    workers.join_all();
+}
+
+static void CheckQueueScaling_1Thread(benchmark::State& state) { CheckQueueScaling(state, 1); }
+static void CheckQueueScaling_4Threads(benchmark::State& state) { CheckQueueScaling(state, 4); }
+static void CheckQueueScaling_16Threads(benchmark::State& state) { CheckQueueScaling(state, 16); }
+static void CheckQueueScaling_64Threads(benchmark::State& state) { CheckQueueScaling(state, 64); }
+
+BENCHMARK(CheckQueueP2PKH_1Thread);
+BENCHMARK(CheckQueueP2PKH_4Threads);
+BENCHMARK(CheckQueueP2PKH_16Threads);
+BENCHMARK(CheckQueueP2PKHBatched_1Thread);
+BENCHMARK(CheckQueueP2PKHBatched_4Threads);
+BENCHMARK(CheckQueueP2PKHBatched_16Threads);
+BENCHMARK(CheckQueueScaling_1Thread);
+BENCHMARK(CheckQueueScaling_4Threads);
+BENCHMARK(CheckQueueScaling_16Threads);
+BENCHMARK(CheckQueueScaling_64Threads);
@@ -0,0 +1,84 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "random.h"
+
+namespace
+{
+/** Accepts and drops every flush */
+class CCoinsViewBench : public CCoinsView
+{
+public:
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsCommitment& delta)
+    {
+        mapCoins.clear();
+        return true;
+    }
+};
+
+std::vector<uint256> AddBenchCoins(CCoinsViewCache& cache, int nCount)
+{
+    std::vector<uint256> vTxid;
+    for (int i = 0; i < nCount; i++) {
+        CMutableTransaction tx;
+        tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+        tx.vout.push_back(CTxOut(i, CScript() << OP_TRUE));
+        tx.vout.push_back(CTxOut(i, CScript() << OP_TRUE));
+        vTxid.push_back(tx.GetHash());
+        *cache.ModifyCoins(vTxid.back()) = CCoins(tx, 1);
+    }
+    return vTxid;
+}
+}
+
+static void CoinsCacheModify(benchmark::State& state)
+{
+    CCoinsViewBench base;
+    CCoinsViewCache cache(&base);
+    std::vector<uint256> vTxid = AddBenchCoins(cache, 10000);
+    unsigned int n = 0;
+    while (state.KeepRunning()) {
+        CCoinsModifier coins = cache.ModifyCoins(vTxid[n++ % vTxid.size()]);
+        coins->vout[0].nValue++;
+    }
+}
+
+static void CoinsCacheAccess(benchmark::State& state)
+{
+    CCoinsViewBench base;
+    CCoinsViewCache cache(&base);
+    std::vector<uint256> vTxid = AddBenchCoins(cache, 10000);
+    unsigned int n = 0;
+    while (state.KeepRunning())
+        cache.AccessCoins(vTxid[n++ % vTxid.size()]);
+}
+
+static void CoinsCacheMiss(benchmark::State& state)
+{
+    CCoinsViewBench base;
+    CCoinsViewCache cache(&base);
+    uint256 txid = GetRandHash();
+    while (state.KeepRunning()) {
+        cache.HaveCoins(txid);
+        txid = Hash(txid.begin(), txid.end());
+    }
+}
+
+static void CoinsCacheAddFlush_1000(benchmark::State& state)
+{
+    CCoinsViewBench base;
+    CCoinsViewCache cache(&base);
+    while (state.KeepRunning()) {
+        AddBenchCoins(cache, 1000);
+        cache.Flush();
+    }
+}
+
+BENCHMARK(CoinsCacheModify);
+BENCHMARK(CoinsCacheAccess);
+BENCHMARK(CoinsCacheMiss);
+BENCHMARK(CoinsCacheAddFlush_1000);
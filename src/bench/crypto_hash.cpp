@@ -0,0 +1,57 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "crypto/sha256.h"
+#include "hash.h"
+#include "primitives/block.h"
+
+static void SHA256_1MB(benchmark::State& state)
+{
+    std::vector<unsigned char> vIn(1 << 20, 0x5a);
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    while (state.KeepRunning())
+        CSHA256().Write(&vIn[0], vIn.size()).Finalize(hash);
+}
+
+static void SHA256_32b(benchmark::State& state)
+{
+    unsigned char hash[CSHA256::OUTPUT_SIZE] = {0};
+    while (state.KeepRunning())
+        CSHA256().Write(hash, sizeof(hash)).Finalize(hash);
+}
+
+static void SHA256D64_1024(benchmark::State& state)
+{
+    std::vector<unsigned char> vIn(64 * 1024, 0x5a), vOut(32 * 1024);
+    while (state.KeepRunning())
+        SHA256D64(&vOut[0], &vIn[0], 1024);
+}
+
+static void HashQuark_Header(benchmark::State& state)
+{
+    CBlockHeader header;
+    header.nVersion = CBlockHeader::CURRENT_VERSION;
+    while (state.KeepRunning()) {
+        header.hashPrevBlock = HashQuark(BEGIN(header.nVersion), END(header.nNonce));
+        header.nNonce++;
+    }
+}
+
+static void HashScryptSquared_Header(benchmark::State& state)
+{
+    CBlockHeader header;
+    header.nVersion = CBlockHeader::CURRENT_VERSION;
+    while (state.KeepRunning()) {
+        header.hashPrevBlock = HashScryptSquared(BEGIN(header.nVersion), END(header.nNonce));
+        header.nNonce++;
+    }
+}
+
+BENCHMARK(SHA256_1MB);
+BENCHMARK(SHA256_32b);
+BENCHMARK(SHA256D64_1024);
+BENCHMARK(HashQuark_Header);
+BENCHMARK(HashScryptSquared_Header);
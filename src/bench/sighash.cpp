@@ -0,0 +1,51 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "amount.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "script/interpreter.h"
+#include "script/standard.h"
+
+/** A spend of 1000 pay-to-pubkey-hash outputs, with typical signature and public key pushes */
+static CTransaction CreateSpend(CScript& scriptCode)
+{
+    uint160 hashKey;
+    GetRandBytes((unsigned char*)&hashKey, sizeof(hashKey));
+    scriptCode = GetScriptForDestination(CKeyID(hashKey));
+    CMutableTransaction txTo;
+    for (int i = 0; i < 1000; i++) {
+        txTo.vin.push_back(CTxIn(COutPoint(GetRandHash(), i % 4)));
+        txTo.vin.back().scriptSig << std::vector<unsigned char>(72, 0x30) << std::vector<unsigned char>(33, 0x02);
+    }
+    for (int i = 0; i < 2; i++)
+        txTo.vout.push_back(CTxOut(COIN, scriptCode));
+    return CTransaction(txTo);
+}
+
+static void SignatureHash_1000Inputs(benchmark::State& state)
+{
+    CScript scriptCode;
+    const CTransaction tx = CreateSpend(scriptCode);
+    while (state.KeepRunning()) {
+        for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++)
+            SignatureHash(scriptCode, tx, nIn, SIGHASH_ALL);
+    }
+}
+
+static void SignatureHashPrecomputed_1000Inputs(benchmark::State& state)
+{
+    CScript scriptCode;
+    const CTransaction tx = CreateSpend(scriptCode);
+    while (state.KeepRunning()) {
+        PrecomputedTransactionData txdata(tx);
+        for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++)
+            SignatureHash(scriptCode, tx, nIn, SIGHASH_ALL, &txdata);
+    }
+}
+
+BENCHMARK(SignatureHash_1000Inputs);
+BENCHMARK(SignatureHashPrecomputed_1000Inputs);
@@ -0,0 +1,59 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "amount.h"
+#include "chainparams.h"
+#include "kernel.h"
+#include "primitives/transaction.h"
+#include "stakeinput.h"
+
+#include <limits>
+
+namespace
+{
+/** A transparent stake whose origin is a fixed block index */
+class CBenchStake : public CStakeInput
+{
+private:
+    COutPoint prevout;
+
+public:
+    CBenchStake(CBlockIndex* pindexFromIn, const COutPoint& prevoutIn) : prevout(prevoutIn) { pindexFrom = pindexFromIn; }
+
+    CBlockIndex* GetIndexFrom() override { return pindexFrom; }
+    bool CreateTxIn(CWallet* pwallet, CTxIn& txIn, uint256 hashTxOut = 0) override { return false; }
+    bool GetTxFrom(CTransaction& tx) override { return false; }
+    CAmount GetValue() override { return 1000 * COIN; }
+    bool CreateTxOuts(CWallet* pwallet, std::vector<CTxOut>& vout, CAmount nTotal) override { return false; }
+    bool GetModifier(uint64_t& nStakeModifier) override { return false; }
+    bool IsZSPL() override { return false; }
+    uint256 GetSerialHash() const override { return uint256(0); }
+    CDataStream GetUniqueness() override
+    {
+        CDataStream ss(SER_GETHASH, 0);
+        ss << prevout.n << prevout.hash;
+        return ss;
+    }
+};
+}
+
+static void CheckStakeKernelHash_V2(benchmark::State& state)
+{
+    CBlockIndex indexFrom;
+    indexFrom.nTime = 1546300800;
+    CBlockIndex indexPrev;
+    // past every stake modifier upgrade, so the kernel hashes the v2 modifier of the previous block
+    indexPrev.nHeight = std::numeric_limits<int>::max() - 1;
+    indexPrev.nStakeModifierV2 = uint256(12345);
+    CBenchStake stake(&indexFrom, COutPoint(uint256(1), 0));
+
+    unsigned int nTimeTx = indexFrom.nTime + 3600;
+    uint256 hashProofOfStake;
+    while (state.KeepRunning())
+        CheckStakeKernelHash(&indexPrev, 0x1d00ffff, &stake, nTimeTx++, hashProofOfStake);
+}
+
+BENCHMARK(CheckStakeKernelHash_V2);
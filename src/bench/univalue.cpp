@@ -0,0 +1,43 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "uint256.h"
+
+#include <univalue.h>
+
+/** Shaped like a getblock reply with 2000 transactions */
+static UniValue CreateBenchJSON()
+{
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("hash", uint256(1).GetHex()));
+    result.push_back(Pair("height", 1000000));
+    result.push_back(Pair("time", (int64_t)1546300800));
+    result.push_back(Pair("difficulty", 12345.678));
+    UniValue txs(UniValue::VARR);
+    for (int i = 0; i < 2000; i++)
+        txs.push_back(uint256(i).GetHex());
+    result.push_back(Pair("tx", txs));
+    return result;
+}
+
+static void UniValueWrite(benchmark::State& state)
+{
+    UniValue value = CreateBenchJSON();
+    while (state.KeepRunning())
+        value.write();
+}
+
+static void UniValueParse(benchmark::State& state)
+{
+    const std::string str = CreateBenchJSON().write();
+    while (state.KeepRunning()) {
+        UniValue value;
+        value.read(str);
+    }
+}
+
+BENCHMARK(UniValueWrite);
+BENCHMARK(UniValueParse);
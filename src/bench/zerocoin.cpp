@@ -0,0 +1,29 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "libzerocoin/Accumulator.h"
+#include "libzerocoin/CoinSpend.h"
+
+static void CoinSpendVerify(benchmark::State& state)
+{
+    libzerocoin::ZerocoinParams* params = Params().Zerocoin_Params(false);
+    libzerocoin::Accumulator accumulator(params, libzerocoin::CoinDenomination::ZQ_ONE);
+    for (int i = 0; i < 3; i++) {
+        libzerocoin::PrivateCoin coin(params, libzerocoin::CoinDenomination::ZQ_ONE);
+        accumulator += coin.getPublicCoin();
+    }
+
+    libzerocoin::PrivateCoin coin(params, libzerocoin::CoinDenomination::ZQ_ONE);
+    libzerocoin::AccumulatorWitness witness(params, accumulator, coin.getPublicCoin());
+    accumulator += coin.getPublicCoin();
+    libzerocoin::CoinSpend spend(params, params, coin, accumulator, 0, witness, 0, libzerocoin::SpendType::SPEND);
+
+    while (state.KeepRunning())
+        spend.Verify(accumulator);
+}
+
+BENCHMARK(CoinSpendVerify);
@@ -0,0 +1,201 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "protocol.h"
+#include "streams.h"
+#include "util.h"
+
+CBlockImportReader::CBlockImportReader(FILE* fileIn, int nFile, unsigned int nWorkers, size_t nWindowIn,
+    const std::function<void(const CBlock&)>& fnDeserializedIn) : nWindow(std::max<size_t>(nWindowIn, 1)),
+                                                                  nBytesInFlight(0),
+                                                                  fEndOfFile(false),
+                                                                  fReading(true),
+                                                                  fSeek(false),
+                                                                  nSeekPos(0),
+                                                                  fStop(false),
+                                                                  fnDeserialized(fnDeserializedIn)
+{
+    nWorkers = std::max(nWorkers, 1U);
+    for (unsigned int i = 0; i < nWorkers; i++)
+        vWorkers.push_back(std::thread(&CBlockImportReader::ThreadDeserialize, this));
+    threadReader = std::thread(&CBlockImportReader::ThreadRead, this, fileIn, nFile);
+}
+
+CBlockImportReader::~CBlockImportReader()
+{
+    Stop();
+    threadReader.join();
+    for (std::thread& worker : vWorkers)
+        worker.join();
+}
+
+void CBlockImportReader::Stop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    fStop = true;
+    condWork.notify_all();
+    condDone.notify_all();
+}
+
+void CBlockImportReader::ThreadRead(FILE* fileIn, int nFile)
+{
+    RenameThread("simplicity-importread");
+    try {
+        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION);
+        uint64_t nRewind = blkdat.GetPos();
+        // the position asked for by the caller is usually out of the buffer's reach
+        auto seek = [&]() {
+            fSeek = false;
+            nRewind = nSeekPos;
+            if (!blkdat.Seek(nRewind))
+                throw std::ios_base::failure("CBlockImportReader::ThreadRead : seek failed");
+        };
+        while (true) {
+            while (!blkdat.eof()) {
+                blkdat.SetPos(nRewind);
+                nRewind++; // start one byte further next time, in case of failure
+                blkdat.SetLimit(); // remove former limit
+                unsigned int nSize = 0;
+                try {
+                    // locate a header
+                    unsigned char buf[MESSAGE_START_SIZE];
+                    blkdat.FindByte(Params().MessageStart()[0]);
+                    nRewind = blkdat.GetPos() + 1;
+                    blkdat >> FLATDATA(buf);
+                    if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
+                        continue;
+                    // read size
+                    blkdat >> nSize;
+                    if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
+                        continue;
+                } catch (const std::exception&) {
+                    // no valid block header found; don't complain
+                    break;
+                }
+
+                std::shared_ptr<CImportedBlock> pblock = std::make_shared<CImportedBlock>();
+                try {
+                    // read the raw block, a worker deserializes it
+                    uint64_t nBlockPos = blkdat.GetPos();
+                    pblock->pos = CDiskBlockPos(nFile, nBlockPos);
+                    pblock->nSize = nSize;
+                    pblock->nResyncPos = nRewind;
+                    pblock->vchData.resize(nSize);
+                    blkdat.SetLimit(nBlockPos + nSize);
+                    blkdat.read(&pblock->vchData[0], nSize);
+                    nRewind = blkdat.GetPos();
+                } catch (const std::exception& e) {
+                    LogPrintf("%s : I/O error - %s\n", __func__, e.what());
+                    // a size field reaching past the end of the file leaves blocks to find behind the magic
+                    blkdat.SetPos(nRewind);
+                    continue;
+                }
+
+                std::unique_lock<std::mutex> lock(mutex);
+                while (!fStop && !fSeek && !queueOrdered.empty() && (queueOrdered.size() >= nWindow || nBytesInFlight + nSize > MAX_IMPORT_BYTES_IN_FLIGHT))
+                    condWork.wait(lock);
+                if (fStop)
+                    break;
+                if (fSeek) {
+                    // this block was found behind one whose size field was wrong
+                    seek();
+                    continue;
+                }
+                nBytesInFlight += nSize;
+                queueOrdered.push_back(pblock);
+                queueWork.push_back(pblock);
+                condWork.notify_all();
+            }
+
+            // a block that turns out to be shorter than its size field can still move the scan back
+            std::unique_lock<std::mutex> lock(mutex);
+            fEndOfFile = true;
+            condDone.notify_all();
+            while (!fStop && !fSeek)
+                condWork.wait(lock);
+            if (fStop)
+                break;
+            fEndOfFile = false;
+            seek();
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("%s : %s\n", __func__, e.what());
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    fEndOfFile = true;
+    fReading = false;
+    condWork.notify_all();
+    condDone.notify_all();
+}
+
+void CBlockImportReader::ThreadDeserialize()
+{
+    RenameThread("simplicity-importdes");
+    while (true) {
+        std::shared_ptr<CImportedBlock> pblock;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!fStop && queueWork.empty())
+                condWork.wait(lock);
+            if (fStop)
+                return;
+            pblock = queueWork.front();
+            queueWork.pop_front();
+        }
+
+        // transaction hashes are computed as the transactions are deserialized
+        try {
+            CDataStream ss(pblock->vchData, SER_DISK, CLIENT_VERSION);
+            ss >> pblock->block;
+            pblock->hash = pblock->block.GetHash();
+            pblock->fValid = true;
+            if (!ss.empty()) {
+                // the size field was too large, the scan goes on right after the block
+                pblock->fResync = true;
+                pblock->nResyncPos = pblock->pos.nPos + pblock->nSize - ss.size();
+            }
+            if (fnDeserialized)
+                fnDeserialized(pblock->block);
+        } catch (const std::exception& e) {
+            LogPrintf("%s : Deserialize error - %s\n", __func__, e.what());
+            // rescan from just after the magic, as the size field may be wrong
+            pblock->fResync = true;
+        }
+        std::vector<char>().swap(pblock->vchData);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        pblock->fDone = true;
+        condDone.notify_all();
+    }
+}
+
+bool CBlockImportReader::Next(std::shared_ptr<CImportedBlock>& pblock)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!fStop && !(queueOrdered.empty() ? fEndOfFile : queueOrdered.front()->fDone))
+        condDone.wait(lock);
+    if (fStop || queueOrdered.empty())
+        return false;
+    pblock = queueOrdered.front();
+    queueOrdered.pop_front();
+    nBytesInFlight -= pblock->nSize;
+    if (pblock->fResync && fReading) {
+        // the blocks behind it were found by trusting its size field, scan for them again
+        for (const std::shared_ptr<CImportedBlock>& pblockDropped : queueOrdered)
+            nBytesInFlight -= pblockDropped->nSize;
+        queueOrdered.clear();
+        queueWork.clear();
+        nSeekPos = pblock->nResyncPos;
+        fSeek = true;
+        fEndOfFile = false;
+    }
+    condWork.notify_all();
+    return true;
+}
@@ -0,0 +1,101 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SIMPLICITY_BLOCKIMPORT_H
+#define SIMPLICITY_BLOCKIMPORT_H
+
+#include "chain.h"
+#include "primitives/block.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+/** Default number of blocks read and deserialized ahead of validation during an import */
+static const unsigned int DEFAULT_IMPORT_WINDOW = 64;
+/** Serialized bytes of the blocks in flight, the window shrinks when they are large */
+static const size_t MAX_IMPORT_BYTES_IN_FLIGHT = 64 << 20;
+
+/** A block found in a block file, deserialized and hashed ahead of validation */
+struct CImportedBlock {
+    //! position of the block data, the file number is -1 for external files
+    CDiskBlockPos pos;
+    std::vector<char> vchData;
+    size_t nSize;
+    CBlock block;
+    uint256 hash;
+    bool fDone;
+    bool fValid;
+    //! the block did not take up its size field, the scan goes on from nResyncPos
+    bool fResync;
+    uint64_t nResyncPos;
+
+    CImportedBlock() : nSize(0), fDone(false), fValid(false), fResync(false), nResyncPos(0) {}
+};
+
+/**
+ * Pipelined reader of a block file for -reindex and -loadblock. A reader thread scans the
+ * file for the network magic and block size and queues the raw blocks, worker threads
+ * deserialize and hash them, and the caller takes them in file order for validation.
+ * At most nWindow blocks, and about MAX_IMPORT_BYTES_IN_FLIGHT bytes, are in flight.
+ * When a block does not deserialize to exactly its size field, the blocks queued behind
+ * it are dropped and the scan resumes after its magic, or after the block if it was
+ * shorter, like the sequential reader did.
+ */
+class CBlockImportReader
+{
+private:
+    // Disallow copies
+    CBlockImportReader(const CBlockImportReader&);
+    CBlockImportReader& operator=(const CBlockImportReader&);
+
+    std::mutex mutex;
+    //! signals new work for the workers, and free space in the window for the reader
+    std::condition_variable condWork;
+    //! signals blocks that are done for the caller
+    std::condition_variable condDone;
+
+    //! blocks in file order, until the caller takes them
+    std::deque<std::shared_ptr<CImportedBlock> > queueOrdered;
+    //! blocks waiting for a worker
+    std::deque<std::shared_ptr<CImportedBlock> > queueWork;
+
+    size_t nWindow;
+    size_t nBytesInFlight;
+    bool fEndOfFile;
+    //! the reader thread is running and can still seek
+    bool fReading;
+    //! the caller asks the reader to scan again from nSeekPos
+    bool fSeek;
+    uint64_t nSeekPos;
+    bool fStop;
+
+    std::thread threadReader;
+    std::vector<std::thread> vWorkers;
+
+    //! called by the workers for each block they deserialized
+    std::function<void(const CBlock&)> fnDeserialized;
+
+    void ThreadRead(FILE* fileIn, int nFile);
+    void ThreadDeserialize();
+
+public:
+    /** Takes over fileIn and closes it */
+    CBlockImportReader(FILE* fileIn, int nFile, unsigned int nWorkers, size_t nWindowIn = DEFAULT_IMPORT_WINDOW,
+        const std::function<void(const CBlock&)>& fnDeserializedIn = std::function<void(const CBlock&)>());
+    ~CBlockImportReader();
+
+    /** Next block in file order, waits for it. Returns false at the end of the file */
+    bool Next(std::shared_ptr<CImportedBlock>& pblock);
+
+    /** Stop reading and return from pending and later Next calls */
+    void Stop();
+};
+
+#endif // SIMPLICITY_BLOCKIMPORT_H
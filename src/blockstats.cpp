@@ -0,0 +1,260 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockstats.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "libzerocoin/Denominations.h"
+#include "primitives/block.h"
+#include "txdb.h"
+#include "undo.h"
+#include "util.h"
+#include "zsplchain.h"
+
+#include <algorithm>
+
+#include <boost/thread.hpp>
+
+CBlockStatsIndex blockStatsIndex;
+bool fBlockStatsIndex = true;
+
+namespace
+{
+unsigned int DenominationPos(libzerocoin::CoinDenomination denom)
+{
+    return std::find(libzerocoin::zerocoinDenomList.begin(), libzerocoin::zerocoinDenomList.end(), denom) - libzerocoin::zerocoinDenomList.begin();
+}
+
+void CountDenomination(std::vector<uint32_t>& vCount, libzerocoin::CoinDenomination denom)
+{
+    unsigned int nPos = DenominationPos(denom);
+    if (nPos < vCount.size())
+        vCount[nPos]++;
+}
+
+bool ReadBlockStatsFromDisk(const CBlockIndex* pindex, CBlockStats& stats)
+{
+    CBlockRef pblock;
+    if (!ReadBlockFromDisk(pblock, pindex))
+        return false;
+    const CBlock& block = *pblock;
+
+    // the genesis block has no undo data, and needs none
+    CBlockUndo blockundo;
+    if (pindex->pprev) {
+        CDiskBlockPos pos = pindex->GetUndoPos();
+        if (pos.IsNull())
+            return error("%s : no undo data for block %s", __func__, pindex->GetBlockHash().GetHex());
+        if (!blockundo.ReadFromDisk(pos, pindex->pprev->GetBlockHash()))
+            return false;
+    }
+
+    return ComputeBlockStats(block, blockundo, stats);
+}
+} // namespace
+
+void CBlockStats::SetNull()
+{
+    nTxCount = 0;
+    nTxCountAll = 0;
+    nTxBytes = 0;
+    nFee = 0;
+    nFeeAll = 0;
+    vMints.assign(libzerocoin::zerocoinDenomList.size(), 0);
+    vSpends.assign(libzerocoin::zerocoinDenomList.size(), 0);
+    vPublicSpends.assign(libzerocoin::zerocoinDenomList.size(), 0);
+    vFeeRatePercentiles.assign(BLOCKSTATS_NUM_PERCENTILES, 0);
+}
+
+bool ComputeBlockStats(const CBlock& block, const CBlockUndo& blockundo, CBlockStats& stats)
+{
+    stats.SetNull();
+    if (blockundo.vtxundo.size() + 1 != block.vtx.size())
+        return error("%s : block %s and undo data inconsistent", __func__, block.GetHash().GetHex());
+
+    stats.nTxCountAll = block.vtx.size();
+    stats.nTxCount = block.vtx.size() - (block.IsProofOfStake() ? 2 : 1);
+
+    std::vector<std::pair<CAmount, int64_t> > vFeeRates;
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+
+        for (const CTxOut& out : tx.vout) {
+            if (!out.IsZerocoinMint())
+                continue;
+            libzerocoin::PublicCoin coin(Params().Zerocoin_Params(false));
+            CValidationState state;
+            if (TxOutToPublicCoin(out, coin, state))
+                CountDenomination(stats.vMints, coin.getDenomination());
+        }
+
+        if (tx.IsCoinBase() || (tx.IsCoinStake() && !tx.HasZerocoinSpendInputs()))
+            continue;
+
+        // zc spends have no fee
+        if (tx.HasZerocoinSpendInputs()) {
+            for (const CTxIn& in : tx.vin) {
+                if (in.IsZerocoinSpend())
+                    CountDenomination(stats.vSpends, libzerocoin::IntToZerocoinDenomination(in.nSequence));
+                else if (in.IsZerocoinPublicSpend())
+                    CountDenomination(stats.vPublicSpends, libzerocoin::IntToZerocoinDenomination(in.nSequence));
+            }
+            continue;
+        }
+
+        const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+        if (txundo.vprevout.size() != tx.vin.size())
+            return error("%s : tx %s and undo data inconsistent", __func__, tx.GetHash().GetHex());
+
+        CAmount nValueIn = 0;
+        for (const CTxInUndo& undo : txundo.vprevout)
+            nValueIn += undo.txout.nValue;
+        CAmount nTxFee = nValueIn - tx.GetValueOut();
+
+        stats.nFeeAll += nTxFee;
+        if (!tx.HasZerocoinMintOutputs()) {
+            int64_t nSize = tx.GetSerializeSize(SER_NETWORK, CLIENT_VERSION);
+            stats.nFee += nTxFee;
+            stats.nTxBytes += nSize;
+            vFeeRates.push_back(std::make_pair(CFeeRate(nTxFee, nSize).GetFeePerK(), nSize));
+        }
+    }
+
+    stats.vFeeRatePercentiles = GetFeeRatePercentiles(vFeeRates);
+    return true;
+}
+
+std::vector<CAmount> GetFeeRatePercentiles(std::vector<std::pair<CAmount, int64_t> >& vFeeRates)
+{
+    std::vector<CAmount> vResult(BLOCKSTATS_NUM_PERCENTILES, 0);
+    std::sort(vFeeRates.begin(), vFeeRates.end());
+
+    int64_t nTotalWeight = 0;
+    for (const std::pair<CAmount, int64_t>& feeRate : vFeeRates)
+        nTotalWeight += feeRate.second;
+    if (nTotalWeight <= 0)
+        return vResult;
+
+    int64_t nWeight = 0;
+    unsigned int nPercentile = 0;
+    for (const std::pair<CAmount, int64_t>& feeRate : vFeeRates) {
+        nWeight += feeRate.second;
+        while (nPercentile < BLOCKSTATS_NUM_PERCENTILES && nWeight * 100 >= nTotalWeight * BLOCKSTATS_PERCENTILES[nPercentile])
+            vResult[nPercentile++] = feeRate.first;
+    }
+    return vResult;
+}
+
+void CBlockStatsIndex::AddToCache(const uint256& hashBlock, const CBlockStats& stats)
+{
+    if (!mapCache.insert(std::make_pair(hashBlock, stats)).second)
+        return;
+    dequeCache.push_back(hashBlock);
+    while (dequeCache.size() > BLOCKSTATS_CACHE_SIZE) {
+        mapCache.erase(dequeCache.front());
+        dequeCache.pop_front();
+    }
+}
+
+bool CBlockStatsIndex::Have(const CBlockIndex* pindex) const
+{
+    uint256 hashBlock = pindex->GetBlockHash();
+    {
+        LOCK(cs);
+        if (mapCache.count(hashBlock))
+            return true;
+    }
+    return pblocktree->HaveBlockStats(hashBlock);
+}
+
+bool CBlockStatsIndex::Get(const CBlockIndex* pindex, CBlockStats& stats)
+{
+    uint256 hashBlock = pindex->GetBlockHash();
+    {
+        LOCK(cs);
+        boost::unordered_map<uint256, CBlockStats, BlockHasher>::const_iterator it = mapCache.find(hashBlock);
+        if (it != mapCache.end()) {
+            stats = it->second;
+            return true;
+        }
+    }
+
+    if (!pblocktree->ReadBlockStats(hashBlock, stats)) {
+        if (!ReadBlockStatsFromDisk(pindex, stats))
+            return false;
+        if (fBlockStatsIndex)
+            return Put(pindex, stats);
+    }
+
+    LOCK(cs);
+    AddToCache(hashBlock, stats);
+    return true;
+}
+
+bool CBlockStatsIndex::Put(const CBlockIndex* pindex, const CBlockStats& stats)
+{
+    uint256 hashBlock = pindex->GetBlockHash();
+    if (!pblocktree->WriteBlockStats(hashBlock, stats))
+        return error("%s : failed to write stats of block %s", __func__, hashBlock.GetHex());
+
+    LOCK(cs);
+    AddToCache(hashBlock, stats);
+    return true;
+}
+
+void ThreadBlockStatsBackfill()
+{
+    RenameThread("simplicity-blockstats");
+
+    bool fComplete = false;
+    if (!fBlockStatsIndex || (pblocktree->ReadFlag("blockstatsindex", fComplete) && fComplete))
+        return;
+
+    while (fImporting || fReindex) {
+        boost::this_thread::interruption_point();
+        MilliSleep(1000);
+    }
+
+    // newest blocks first, they are the ones queried most
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = chainActive.Tip();
+    }
+    if (!pindex)
+        return;
+    LogPrintf("%s : backfilling block stats below height %d\n", __func__, pindex->nHeight);
+
+    // blocks without data, pruned or below a chainstate snapshot, are skipped rather than
+    // retried on every start, the stats are complete from the block above the highest of them
+    int nComputed = 0;
+    int nSkipped = 0;
+    int nStatsHeight = 0;
+    for (; pindex; pindex = pindex->pprev) {
+        boost::this_thread::interruption_point();
+        if (blockStatsIndex.Have(pindex))
+            continue;
+
+        bool fHaveData;
+        {
+            LOCK(cs_main);
+            fHaveData = pindex->nStatus & BLOCK_HAVE_DATA;
+        }
+        CBlockStats stats;
+        if (!fHaveData || !blockStatsIndex.Get(pindex, stats)) {
+            if (!nSkipped++)
+                LogPrintf("%s : no stats for block %d and the blocks below it without data\n", __func__, pindex->nHeight);
+            nStatsHeight = std::max(nStatsHeight, pindex->nHeight + 1);
+            continue;
+        }
+        if (++nComputed % 10000 == 0)
+            LogPrint("blockstats", "%s : computed %d, at height %d\n", __func__, nComputed, pindex->nHeight);
+    }
+
+    pblocktree->WriteInt("blockstatsheight", nStatsHeight);
+    pblocktree->WriteFlag("blockstatsindex", true);
+    LogPrintf("%s : done, computed the stats of %d blocks, skipped %d, complete from height %d\n", __func__, nComputed, nSkipped, nStatsHeight);
+}
@@ -0,0 +1,110 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SIMPLICITY_BLOCKSTATS_H
+#define SIMPLICITY_BLOCKSTATS_H
+
+#include "amount.h"
+#include "main.h"
+#include "serialize.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+
+//! Fee rate percentiles kept per block, in percent of the transaction bytes
+static const int BLOCKSTATS_PERCENTILES[] = {10, 25, 50, 75, 90};
+static const unsigned int BLOCKSTATS_NUM_PERCENTILES = sizeof(BLOCKSTATS_PERCENTILES) / sizeof(BLOCKSTATS_PERCENTILES[0]);
+//! Number of block stats kept in memory
+static const unsigned int BLOCKSTATS_CACHE_SIZE = 10000;
+
+/** Transaction and fee statistics of a block, as reported by getblockindexstats */
+class CBlockStats
+{
+public:
+    //! transactions, without and with the coinbase and coinstake
+    uint32_t nTxCount;
+    uint32_t nTxCountAll;
+    //! size of the transactions paying fees, zSPL mints excluded
+    int64_t nTxBytes;
+    //! fees, without and with the zSPL mints
+    CAmount nFee;
+    CAmount nFeeAll;
+    //! zSPL mints, spends and public spends by position in zerocoinDenomList
+    std::vector<uint32_t> vMints;
+    std::vector<uint32_t> vSpends;
+    std::vector<uint32_t> vPublicSpends;
+    //! fee per kB at BLOCKSTATS_PERCENTILES of the bytes counted in nTxBytes
+    std::vector<CAmount> vFeeRatePercentiles;
+
+    CBlockStats()
+    {
+        SetNull();
+    }
+
+    void SetNull();
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(VARINT(nTxCount));
+        READWRITE(VARINT(nTxCountAll));
+        READWRITE(nTxBytes);
+        READWRITE(nFee);
+        READWRITE(nFeeAll);
+        READWRITE(vMints);
+        READWRITE(vSpends);
+        READWRITE(vPublicSpends);
+        READWRITE(vFeeRatePercentiles);
+    }
+};
+
+/** Compute the stats of a connected block from the block and its undo data */
+bool ComputeBlockStats(const CBlock& block, const CBlockUndo& blockundo, CBlockStats& stats);
+
+/**
+ * Fee rates at BLOCKSTATS_PERCENTILES of the total weight of (fee per kB, weight) pairs.
+ * Sorts vFeeRates.
+ */
+std::vector<CAmount> GetFeeRatePercentiles(std::vector<std::pair<CAmount, int64_t> >& vFeeRates);
+
+/**
+ * Block stats computed when a block is connected and stored in the block tree database by
+ * block hash, so they stay valid across reorgs. Stats of blocks connected before the index
+ * existed are computed from the block and undo files on first use and by the backfill thread.
+ */
+class CBlockStatsIndex
+{
+private:
+    mutable CCriticalSection cs;
+    boost::unordered_map<uint256, CBlockStats, BlockHasher> mapCache;
+    //! cached hashes, oldest first
+    std::deque<uint256> dequeCache;
+
+    void AddToCache(const uint256& hashBlock, const CBlockStats& stats);
+
+public:
+    bool Have(const CBlockIndex* pindex) const;
+    /** Read the stats of a block, computing and storing them if they are missing */
+    bool Get(const CBlockIndex* pindex, CBlockStats& stats);
+    bool Put(const CBlockIndex* pindex, const CBlockStats& stats);
+};
+
+extern CBlockStatsIndex blockStatsIndex;
+extern bool fBlockStatsIndex;
+
+/** Compute the stats of the active chain blocks connected before the index was enabled */
+void ThreadBlockStatsBackfill();
+
+#endif // SIMPLICITY_BLOCKSTATS_H
@@ -0,0 +1,340 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockstore.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "crypto/common.h"
+#include "main.h"
+#include "streams.h"
+#include "util.h"
+
+#include <string.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CBlockStore blockstore;
+
+/** Read-only mapping of a whole block file */
+class CMappedBlockFile
+{
+private:
+    // Disallow copies
+    CMappedBlockFile(const CMappedBlockFile&);
+    CMappedBlockFile& operator=(const CMappedBlockFile&);
+
+public:
+    const char* pbegin;
+    size_t nSize;
+    uint64_t nLastUse;
+
+    CMappedBlockFile() : pbegin(NULL), nSize(0), nLastUse(0) {}
+
+    ~CMappedBlockFile()
+    {
+#ifndef WIN32
+        if (pbegin)
+            munmap((void*)pbegin, nSize);
+#endif
+    }
+
+    bool Map(const boost::filesystem::path& path)
+    {
+#ifndef WIN32
+        int fd = open(path.string().c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+            close(fd);
+            return false;
+        }
+        void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED)
+            return false;
+        pbegin = (const char*)p;
+        nSize = st.st_size;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void Prefetch(size_t nBegin, size_t nEnd) const
+    {
+#ifndef WIN32
+        static const size_t nPageSize = sysconf(_SC_PAGESIZE);
+        nBegin -= nBegin % nPageSize;
+        nEnd = std::min(nEnd, nSize);
+        if (nEnd > nBegin)
+            madvise((void*)(pbegin + nBegin), nEnd - nBegin, MADV_WILLNEED);
+#endif
+    }
+};
+
+/** Stream subset over a block in a mapped file */
+class CMappedBlockReader
+{
+private:
+    const char* pcur;
+    const char* pend;
+    int nType;
+    int nVersion;
+
+public:
+    CMappedBlockReader(const char* pbegin, const char* pendIn, int nTypeIn, int nVersionIn) : pcur(pbegin), pend(pendIn), nType(nTypeIn), nVersion(nVersionIn) {}
+
+    int GetType() { return nType; }
+    int GetVersion() { return nVersion; }
+
+    CMappedBlockReader& read(char* pch, size_t nSize)
+    {
+        if (nSize > (size_t)(pend - pcur))
+            throw std::ios_base::failure("CMappedBlockReader::read : end of data");
+        memcpy(pch, pcur, nSize);
+        pcur += nSize;
+        return (*this);
+    }
+
+    CMappedBlockReader& ignore(size_t nSize)
+    {
+        if (nSize > (size_t)(pend - pcur))
+            throw std::ios_base::failure("CMappedBlockReader::ignore : end of data");
+        pcur += nSize;
+        return (*this);
+    }
+
+    template <typename T>
+    CMappedBlockReader& operator>>(T& obj)
+    {
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
+CBlockStore::CBlockStore() : nMaxCacheBytes(DEFAULT_BLOCK_CACHE << 20),
+                             nMaxMappedFiles(DEFAULT_BLOCK_MMAP_FILES),
+                             nReadahead(DEFAULT_BLOCK_READAHEAD << 20),
+                             nCacheBytes(0),
+                             nUseCounter(0),
+                             nWriteFile(0)
+{
+}
+
+void CBlockStore::SetLimits(size_t nMaxCacheBytesIn, int nMaxMappedFilesIn, unsigned int nReadaheadIn)
+{
+    LOCK(cs);
+    nMaxCacheBytes = nMaxCacheBytesIn;
+#ifdef WIN32
+    nMaxMappedFilesIn = 0;
+#endif
+    nMaxMappedFiles = nMaxMappedFilesIn;
+    nReadahead = nReadaheadIn;
+    EvictCache();
+    while ((int)mapMapped.size() > nMaxMappedFiles)
+        mapMapped.erase(mapMapped.begin());
+}
+
+std::shared_ptr<CMappedBlockFile> CBlockStore::GetMapping(int nFile)
+{
+    AssertLockHeld(cs);
+    if (nFile >= nWriteFile || nMaxMappedFiles <= 0)
+        return std::shared_ptr<CMappedBlockFile>();
+
+    std::map<int, std::shared_ptr<CMappedBlockFile> >::iterator it = mapMapped.find(nFile);
+    if (it != mapMapped.end()) {
+        it->second->nLastUse = ++nUseCounter;
+        return it->second;
+    }
+
+    std::shared_ptr<CMappedBlockFile> pmapped = std::make_shared<CMappedBlockFile>();
+    if (!pmapped->Map(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"))) {
+        LogPrint("blockstore", "%s : unable to map block file %d, reading it instead\n", __func__, nFile);
+        return std::shared_ptr<CMappedBlockFile>();
+    }
+    pmapped->nLastUse = ++nUseCounter;
+
+    // readers still holding an evicted mapping keep it alive until they are done
+    if ((int)mapMapped.size() >= nMaxMappedFiles) {
+        std::map<int, std::shared_ptr<CMappedBlockFile> >::iterator itOldest = mapMapped.begin();
+        for (it = mapMapped.begin(); it != mapMapped.end(); ++it) {
+            if (it->second->nLastUse < itOldest->second->nLastUse)
+                itOldest = it;
+        }
+        mapMapped.erase(itOldest);
+    }
+    mapMapped[nFile] = pmapped;
+    return pmapped;
+}
+
+bool CBlockStore::IsSequential(const CDiskBlockPos& pos, unsigned int nSize, unsigned int& nPrefetchFrom, unsigned int& nPrefetchTo)
+{
+    AssertLockHeld(cs);
+    // skipping a few blocks that are not part of the scan still counts as sequential
+    static const unsigned int MAX_SCAN_GAP = 1 << 20;
+
+    CFileScan& scan = mapScans[pos.nFile];
+    bool fSequential = scan.nLastEnd != 0 && pos.nPos >= scan.nLastEnd && pos.nPos - scan.nLastEnd <= MAX_SCAN_GAP;
+    scan.nLastEnd = pos.nPos + nSize;
+
+    nPrefetchFrom = nPrefetchTo = 0;
+    if (fSequential && nReadahead > 0 && scan.nLastEnd + nReadahead / 2 > scan.nPrefetchedTo) {
+        // prefetch a whole window once half of the previous one was consumed
+        nPrefetchFrom = std::max(scan.nLastEnd, scan.nPrefetchedTo);
+        nPrefetchTo = scan.nLastEnd + nReadahead;
+        scan.nPrefetchedTo = nPrefetchTo;
+    }
+    return fSequential;
+}
+
+CBlockRef CBlockStore::Lookup(const CDiskBlockPos& pos)
+{
+    LOCK(cs);
+    std::map<std::pair<int, unsigned int>, std::list<CCacheEntry>::iterator>::iterator it = mapCache.find(std::make_pair(pos.nFile, pos.nPos));
+    if (it == mapCache.end()) {
+        stats.nCacheMisses++;
+        return CBlockRef();
+    }
+    stats.nCacheHits++;
+    lruCache.splice(lruCache.begin(), lruCache, it->second);
+    return it->second->pblock;
+}
+
+bool CBlockStore::Read(const CDiskBlockPos& pos, CBlock& block, bool& fSequential)
+{
+    block.SetNull();
+    fSequential = false;
+
+    std::shared_ptr<CMappedBlockFile> pmapped;
+    {
+        LOCK(cs);
+        pmapped = GetMapping(pos.nFile);
+    }
+
+    // each block is preceded by the network magic and its size
+    if (pmapped && pos.nPos >= 8 && pos.nPos <= pmapped->nSize &&
+        memcmp(pmapped->pbegin + pos.nPos - 8, Params().MessageStart(), MESSAGE_START_SIZE) == 0) {
+        unsigned int nSize = ReadLE32((const unsigned char*)pmapped->pbegin + pos.nPos - 4);
+        if (nSize <= pmapped->nSize - pos.nPos) {
+            unsigned int nPrefetchFrom, nPrefetchTo;
+            {
+                LOCK(cs);
+                fSequential = IsSequential(pos, nSize, nPrefetchFrom, nPrefetchTo);
+                stats.nMappedReads++;
+                stats.nSequentialReads += fSequential;
+                stats.nBytesRead += nSize;
+            }
+            if (nPrefetchTo > nPrefetchFrom)
+                pmapped->Prefetch(nPrefetchFrom, nPrefetchTo);
+
+            try {
+                CMappedBlockReader reader(pmapped->pbegin + pos.nPos, pmapped->pbegin + pos.nPos + nSize, SER_DISK, CLIENT_VERSION);
+                reader >> block;
+            } catch (std::exception& e) {
+                return error("%s : Deserialize error - %s", __func__, e.what());
+            }
+            return true;
+        }
+    }
+
+    // Open history file to read
+    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s : OpenBlockFile failed", __func__);
+
+    // Read block
+    try {
+        filein >> block;
+    } catch (std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+
+    long nEnd = ftell(filein.Get());
+    unsigned int nSize = nEnd > (long)pos.nPos ? nEnd - pos.nPos : 0;
+    unsigned int nPrefetchFrom, nPrefetchTo;
+    {
+        LOCK(cs);
+        fSequential = IsSequential(pos, nSize, nPrefetchFrom, nPrefetchTo);
+        stats.nSequentialReads += fSequential;
+        stats.nBytesRead += nSize;
+    }
+#ifdef POSIX_FADV_WILLNEED
+    if (nPrefetchTo > nPrefetchFrom)
+        posix_fadvise(fileno(filein.Get()), nPrefetchFrom, nPrefetchTo - nPrefetchFrom, POSIX_FADV_WILLNEED);
+#endif
+    return true;
+}
+
+void CBlockStore::Insert(const CDiskBlockPos& pos, const CBlockRef& pblock)
+{
+    size_t nSize = ::GetSerializeSize(*pblock, SER_DISK, CLIENT_VERSION);
+    LOCK(cs);
+    if (nSize > nMaxCacheBytes / 4)
+        return;
+    std::pair<int, unsigned int> key = std::make_pair(pos.nFile, pos.nPos);
+    if (mapCache.count(key))
+        return;
+    CCacheEntry entry;
+    entry.pos = pos;
+    entry.pblock = pblock;
+    entry.nSize = nSize;
+    lruCache.push_front(entry);
+    mapCache[key] = lruCache.begin();
+    nCacheBytes += nSize;
+    EvictCache();
+}
+
+void CBlockStore::EvictCache()
+{
+    AssertLockHeld(cs);
+    while (nCacheBytes > nMaxCacheBytes && !lruCache.empty()) {
+        const CCacheEntry& entry = lruCache.back();
+        mapCache.erase(std::make_pair(entry.pos.nFile, entry.pos.nPos));
+        nCacheBytes -= entry.nSize;
+        lruCache.pop_back();
+    }
+}
+
+void CBlockStore::ForgetFile(int nFile)
+{
+    LOCK(cs);
+    mapMapped.erase(nFile);
+    mapScans.erase(nFile);
+    for (std::list<CCacheEntry>::iterator it = lruCache.begin(); it != lruCache.end();) {
+        if (it->pos.nFile == nFile) {
+            mapCache.erase(std::make_pair(it->pos.nFile, it->pos.nPos));
+            nCacheBytes -= it->nSize;
+            it = lruCache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void CBlockStore::Clear()
+{
+    LOCK(cs);
+    lruCache.clear();
+    mapCache.clear();
+    nCacheBytes = 0;
+    mapMapped.clear();
+    mapScans.clear();
+}
+
+CBlockStoreStats CBlockStore::GetStats() const
+{
+    LOCK(cs);
+    CBlockStoreStats ret = stats;
+    ret.nCacheBlocks = lruCache.size();
+    ret.nCacheBytes = nCacheBytes;
+    ret.nMappedFiles = mapMapped.size();
+    return ret;
+}
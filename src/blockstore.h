@@ -0,0 +1,123 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SIMPLICITY_BLOCKSTORE_H
+#define SIMPLICITY_BLOCKSTORE_H
+
+#include "chain.h"
+#include "primitives/block.h"
+#include "sync.h"
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+
+/** Default size of the deserialized block cache, in megabytes of serialized blocks */
+static const int64_t DEFAULT_BLOCK_CACHE = 32;
+/** Default number of finalized block files kept memory-mapped */
+static const int DEFAULT_BLOCK_MMAP_FILES = sizeof(void*) > 4 ? 64 : 0;
+/** Default window read ahead of sequential scans through a block file, in megabytes */
+static const int64_t DEFAULT_BLOCK_READAHEAD = 4;
+
+typedef std::shared_ptr<const CBlock> CBlockRef;
+
+/** Counters of the block store, for getblockstoreinfo */
+struct CBlockStoreStats {
+    uint64_t nCacheHits;
+    uint64_t nCacheMisses;
+    //! reads served from a mapping rather than with fread
+    uint64_t nMappedReads;
+    //! reads that continued a sequential scan of a file, these bypass the cache
+    uint64_t nSequentialReads;
+    //! serialized block bytes read from the files
+    uint64_t nBytesRead;
+    size_t nCacheBlocks;
+    size_t nCacheBytes;
+    size_t nMappedFiles;
+
+    CBlockStoreStats() : nCacheHits(0), nCacheMisses(0), nMappedReads(0), nSequentialReads(0), nBytesRead(0), nCacheBlocks(0), nCacheBytes(0), nMappedFiles(0) {}
+};
+
+class CMappedBlockFile;
+
+/**
+ * Read side of the blk?????.dat files. Files that are no longer written to are memory-mapped
+ * and blocks are deserialized straight from the mapping. Blocks read at random are kept in
+ * an LRU cache, bounded by their serialized size and shared with the callers. Reads that
+ * continue a scan through a file prefetch the data ahead of them and bypass the cache.
+ */
+class CBlockStore
+{
+private:
+    struct CCacheEntry {
+        CDiskBlockPos pos;
+        CBlockRef pblock;
+        size_t nSize;
+    };
+
+    struct CFileScan {
+        //! end of the last block read from the file
+        unsigned int nLastEnd;
+        //! end of the range already prefetched
+        unsigned int nPrefetchedTo;
+
+        CFileScan() : nLastEnd(0), nPrefetchedTo(0) {}
+    };
+
+    mutable CCriticalSection cs;
+
+    size_t nMaxCacheBytes;
+    int nMaxMappedFiles;
+    unsigned int nReadahead;
+
+    //! most recently used first
+    std::list<CCacheEntry> lruCache;
+    std::map<std::pair<int, unsigned int>, std::list<CCacheEntry>::iterator> mapCache;
+    size_t nCacheBytes;
+
+    std::map<int, std::shared_ptr<CMappedBlockFile> > mapMapped;
+    std::map<int, CFileScan> mapScans;
+    uint64_t nUseCounter;
+
+    //! block files from this one on may still be written to
+    std::atomic<int> nWriteFile;
+
+    CBlockStoreStats stats;
+
+    std::shared_ptr<CMappedBlockFile> GetMapping(int nFile);
+    bool IsSequential(const CDiskBlockPos& pos, unsigned int nSize, unsigned int& nPrefetchFrom, unsigned int& nPrefetchTo);
+    void EvictCache();
+
+public:
+    CBlockStore();
+
+    void SetLimits(size_t nMaxCacheBytesIn, int nMaxMappedFilesIn, unsigned int nReadaheadIn);
+
+    /** Files numbered nFile and up are still being appended to and are never mapped */
+    void SetWriteFile(int nFile) { nWriteFile = nFile; }
+
+    /** Cached block at pos, or NULL */
+    CBlockRef Lookup(const CDiskBlockPos& pos);
+
+    /**
+     * Deserialize the block at pos from its file. fSequential is set if the read continues
+     * a scan through the file, so the caller can leave it out of the cache.
+     */
+    bool Read(const CDiskBlockPos& pos, CBlock& block, bool& fSequential);
+
+    /** Cache a block read from pos, after the caller checked it */
+    void Insert(const CDiskBlockPos& pos, const CBlockRef& pblock);
+
+    /** Drop the mapping and cached blocks of a file, before it is removed or rewritten */
+    void ForgetFile(int nFile);
+
+    void Clear();
+
+    CBlockStoreStats GetStats() const;
+};
+
+extern CBlockStore blockstore;
+
+#endif // SIMPLICITY_BLOCKSTORE_H
@@ -99,6 +99,12 @@ static const Checkpoints::CCheckpointData dataRegtest = {
     0,
     100};
 
+// Snapshot hashes are added here once a snapshot made with dumptxoutset has been
+// reproduced independently; until then -loadtxoutset refuses snapshots on these networks.
+static const MapSnapshotHashes mapSnapshotHashes;
+static const MapSnapshotHashes mapSnapshotHashesTestnet;
+static const MapSnapshotHashes mapSnapshotHashesRegtest;
+
 libzerocoin::ZerocoinParams* CChainParams::Zerocoin_Params(bool useModulusV1) const
 {
     assert(this);
@@ -296,6 +302,11 @@ public:
         return data;
     }
 
+    const MapSnapshotHashes& SnapshotHashes() const
+    {
+        return mapSnapshotHashes;
+    }
+
 };
 
 static CMainParams mainParams;
@@ -410,6 +421,11 @@ public:
     {
         return dataTestnet;
     }
+
+    const MapSnapshotHashes& SnapshotHashes() const
+    {
+        return mapSnapshotHashesTestnet;
+    }
 };
 static CTestNetParams testNetParams;
 
@@ -498,6 +514,11 @@ public:
     {
         return dataRegtest;
     }
+
+    const MapSnapshotHashes& SnapshotHashes() const
+    {
+        return mapSnapshotHashesRegtest;
+    }
 };
 static CRegTestParams regTestParams;
 
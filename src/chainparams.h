@@ -16,10 +16,14 @@
 #include "uint256.h"
 
 #include "libzerocoin/Params.h"
+#include <map>
 #include <vector>
 
 typedef unsigned char MessageStartChars[MESSAGE_START_SIZE];
 
+/** Snapshot hash by the height of the snapshot base block */
+typedef std::map<int, uint256> MapSnapshotHashes;
+
 struct CDNSSeedData {
     std::string name, host;
     CDNSSeedData(const std::string& strName, const std::string& strHost) : name(strName), host(strHost) {}
@@ -101,6 +105,8 @@ public:
     const std::vector<unsigned char>& Base58Prefix(Base58Type type) const { return base58Prefixes[type]; }
     const std::vector<CAddress>& FixedSeeds() const { return vFixedSeeds; }
     virtual const Checkpoints::CCheckpointData& Checkpoints() const = 0;
+    /** Hashes of the chainstate snapshots -loadtxoutset accepts, by the height of their base block */
+    virtual const MapSnapshotHashes& SnapshotHashes() const = 0;
     int PoolMaxTransactions() const { return nPoolMaxTransactions; }
     /** Return the number of blocks in a budget cycle */
     int GetBudgetCycleBlocks() const { return nBudgetCycleBlocks; }
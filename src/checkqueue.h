@@ -5,16 +5,32 @@
 #ifndef BITCOIN_CHECKQUEUE_H
 #define BITCOIN_CHECKQUEUE_H
 
+#include "utiltime.h"
+
 #include <algorithm>
+#include <atomic>
+#include <deque>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
 
-template <typename T>
+/** Worker-local state of checks that defer nothing */
+struct CCheckQueueNoBatch
+{
+    bool Verify() { return true; }
+    void Clear() {}
+};
+
+template <typename T, typename B = CCheckQueueNoBatch>
 class CCheckQueueControl;
 
+/** Worker queues of a CCheckQueue, threads beyond them share one */
+static const unsigned int CHECKQUEUE_MAX_WORKER_QUEUES = 65;
+/** Workers aim for batches that take this long, so they finish close together */
+static const int64_t CHECKQUEUE_BATCH_TARGET_MICROS = 200;
+
 /** 
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -24,110 +40,160 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker has its own queue. Added checks are spread over them, a
+  * worker takes batches from the back of its own queue and, once it is
+  * empty, steals half of another queue from its front. The batch size
+  * adapts to the measured cost of a check, up to nBatchSize. The shared
+  * mutex is only taken to sleep when there is no work, and to wake up.
+  *
+  * Each worker keeps a batch of type B, which a check may hand part of its
+  * work to by providing operator()(B&). The batch is verified, or cleared
+  * after a failure, before the worker reports the checks it ran as done.
   */
-template <typename T>
+template <typename T, typename B = CCheckQueueNoBatch>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
-    boost::mutex mutex;
-
-    //! Worker threads block on this when out of work
-    boost::condition_variable condWorker;
-
-    //! Master thread blocks on this when out of work
-    boost::condition_variable condMaster;
+    struct CWorkerQueue {
+        boost::mutex mutex;
+        std::deque<T> queue;
+    };
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The queue of the master first, then those of the workers
+    CWorkerQueue vWorkerQueues[CHECKQUEUE_MAX_WORKER_QUEUES];
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of worker queues in use
+    std::atomic<unsigned int> nWorkerQueues;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! Where Add puts the next checks
+    std::atomic<unsigned int> nNextQueue;
 
-    //! The temporary evaluation result.
-    bool fAllOk;
+    //! Checks waiting in the worker queues
+    std::atomic<unsigned int> nQueued;
 
     /**
      * Number of verifications that haven't completed yet.
-     * This includes elements that are not anymore in queue, but still in
-     * worker's own batches.
+     * This includes elements that are not anymore in a queue, but still in
+     * a worker's own batch.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
+
+    //! The temporary evaluation result.
+    std::atomic<bool> fAllOk;
+
+    //! Mutex to sleep on when there is no work
+    boost::mutex mutex;
+
+    //! Worker threads block on this when out of work
+    boost::condition_variable condWorker;
+
+    //! Master thread blocks on this when out of work
+    boost::condition_variable condMaster;
 
-    //! Whether we're shutting down.
-    bool fQuit;
+    //! The number of worker threads that were started
+    unsigned int nWorkers;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    static bool Run(T& check, CCheckQueueNoBatch& batch) { return check(); }
+    template <typename Batch>
+    static bool Run(T& check, Batch& batch) { return check(batch); }
+
+    unsigned int RegisterWorker()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        unsigned int nQueue = 1 + nWorkers % (CHECKQUEUE_MAX_WORKER_QUEUES - 1);
+        nWorkers++;
+        nWorkerQueues = std::min(nWorkers + 1, CHECKQUEUE_MAX_WORKER_QUEUES);
+        return nQueue;
+    }
+
+    /** Move up to nMax checks of a worker queue to vChecks, half of them when stealing */
+    unsigned int Take(CWorkerQueue& worker, std::vector<T>& vChecks, unsigned int nMax, bool fSteal)
+    {
+        boost::unique_lock<boost::mutex> lock(worker.mutex);
+        unsigned int nNow = fSteal ? (worker.queue.size() + 1) / 2 : worker.queue.size();
+        nNow = std::min(nNow, nMax);
+        vChecks.resize(nNow);
+        for (unsigned int i = 0; i < nNow; i++) {
+            // the owner works from the back, thieves from the front
+            if (fSteal) {
+                vChecks[i].swap(worker.queue.front());
+                worker.queue.pop_front();
+            } else {
+                vChecks[i].swap(worker.queue.back());
+                worker.queue.pop_back();
+            }
+        }
+        nQueued -= nNow;
+        return nNow;
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        unsigned int nQueue = fMaster ? 0 : RegisterWorker();
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
+        B batch;
+        //! moving average of the time a check takes
+        int64_t nNanosPerCheck = 0;
         do {
-            {
+            unsigned int nMax = nBatchSize;
+            if (nNanosPerCheck > 0)
+                nMax = std::max<int64_t>(1, std::min<int64_t>(nMax, CHECKQUEUE_BATCH_TARGET_MICROS * 1000 / nNanosPerCheck));
+            unsigned int nQueues = nWorkerQueues;
+            unsigned int nNow = Take(vWorkerQueues[nQueue], vChecks, nMax, false);
+            for (unsigned int i = 1; nNow == 0 && i < nQueues; i++)
+                nNow = Take(vWorkerQueues[(nQueue + i) % nQueues], vChecks, nMax, true);
+
+            if (nNow == 0) {
                 boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master he can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
+                if (fMaster) {
+                    while (nQueued == 0 && nTodo != 0)
+                        condMaster.wait(lock);
+                    if (nTodo == 0) {
+                        // reset the status for new work later, and return the current one
+                        return fAllOk.exchange(true);
                     }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+                } else {
+                    while (nQueued == 0)
+                        condWorker.wait(lock);
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                continue;
             }
-            // execute work
+
+            // execute work, unless a check already failed
+            int64_t nStart = GetTimeMicros();
+            bool fOk = fAllOk;
             for (T& check : vChecks)
                 if (fOk)
-                    fOk = check();
+                    fOk = Run(check, batch);
+            if (fOk)
+                fOk = batch.Verify();
+            else
+                batch.Clear();
             vChecks.clear();
+            int64_t nNanos = (GetTimeMicros() - nStart) * 1000 / nNow;
+            nNanosPerCheck = nNanosPerCheck ? (3 * nNanosPerCheck + nNanos) / 4 : std::max<int64_t>(nNanos, 1);
+
+            if (!fOk)
+                fAllOk = false;
+            if ((nTodo -= nNow) == 0) {
+                // We processed the last element; inform the master he can exit and return the result
+                boost::unique_lock<boost::mutex> lock(mutex);
+                condMaster.notify_one();
+            }
         } while (true);
     }
 
 public:
+    typedef B Batch;
+
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn) : nWorkerQueues(1), nNextQueue(0), nQueued(0), nTodo(0), fAllOk(true), nWorkers(0), nBatchSize(nBatchSizeIn) {}
 
     //! Worker thread
     void Thread()
@@ -144,15 +210,30 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
         nTodo += vChecks.size();
+        // spread the checks over the worker queues, a single large vector too
+        unsigned int nQueues = nWorkerQueues;
+        unsigned int nChunk = (vChecks.size() + nQueues - 1) / nQueues;
+        for (unsigned int nPos = 0; nPos < vChecks.size(); nPos += nChunk) {
+            unsigned int nEnd = std::min<unsigned int>(vChecks.size(), nPos + nChunk);
+            CWorkerQueue& worker = vWorkerQueues[nNextQueue++ % nQueues];
+            {
+                boost::unique_lock<boost::mutex> lock(worker.mutex);
+                for (unsigned int i = nPos; i < nEnd; i++) {
+                    worker.queue.push_back(T());
+                    vChecks[i].swap(worker.queue.back());
+                }
+                // counted before a thief can take them
+                nQueued += nEnd - nPos;
+            }
+        }
+
+        boost::unique_lock<boost::mutex> lock(mutex);
         if (vChecks.size() == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
@@ -162,8 +243,7 @@ public:
 
     bool IsIdle()
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
+        return nTodo == 0 && fAllOk;
     }
 };
 
@@ -171,15 +251,15 @@ public:
  * RAII-style controller object for a CCheckQueue that guarantees the passed
  * queue is finished before continuing.
  */
-template <typename T>
+template <typename T, typename B>
 class CCheckQueueControl
 {
 private:
-    CCheckQueue<T>* pqueue;
+    CCheckQueue<T, B>* pqueue;
     bool fDone;
 
 public:
-    CCheckQueueControl(CCheckQueue<T>* pqueueIn) : pqueue(pqueueIn), fDone(false)
+    CCheckQueueControl(CCheckQueue<T, B>* pqueueIn) : pqueue(pqueueIn), fDone(false)
     {
         // passed queue is supposed to be unused, or NULL
         if (pqueue != NULL) {
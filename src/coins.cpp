@@ -6,6 +6,7 @@
 #include "coins.h"
 
 #include "random.h"
+#include "streams.h"
 
 #include <assert.h>
 
@@ -59,11 +60,71 @@ bool CCoins::Spend(int nPos)
 }
 
 
+namespace
+{
+std::vector<unsigned char> CommitmentElement(const COutPoint& out, const CTxOut& txout, int nHeight, bool fCoinBase)
+{
+    CDataStream ss(SER_DISK, 0);
+    ss << out;
+    ss << VARINT(nHeight * 2 + (fCoinBase ? 1 : 0));
+    ss << txout;
+    return std::vector<unsigned char>(ss.begin(), ss.end());
+}
+} // namespace
+
+void CCoinsCommitment::AddOutput(const COutPoint& out, const CTxOut& txout, int nHeight, bool fCoinBase)
+{
+    muhash.Insert(CommitmentElement(out, txout, nHeight, fCoinBase));
+    nTransactionOutputs++;
+    nTotalAmount += txout.nValue;
+}
+
+void CCoinsCommitment::RemoveOutput(const COutPoint& out, const CTxOut& txout, int nHeight, bool fCoinBase)
+{
+    muhash.Remove(CommitmentElement(out, txout, nHeight, fCoinBase));
+    nTransactionOutputs--;
+    nTotalAmount -= txout.nValue;
+}
+
+void CCoinsCommitment::AddCoins(const uint256& txid, const CCoins& coins)
+{
+    if (coins.IsPruned())
+        return;
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        if (!coins.vout[i].IsNull())
+            AddOutput(COutPoint(txid, i), coins.vout[i], coins.nHeight, coins.fCoinBase);
+    }
+    nTransactions++;
+}
+
+void CCoinsCommitment::RemoveCoins(const uint256& txid, const CCoins& coins)
+{
+    if (coins.IsPruned())
+        return;
+    for (unsigned int i = 0; i < coins.vout.size(); i++) {
+        if (!coins.vout[i].IsNull())
+            RemoveOutput(COutPoint(txid, i), coins.vout[i], coins.nHeight, coins.fCoinBase);
+    }
+    nTransactions--;
+}
+
+CCoinsCommitment& CCoinsCommitment::operator+=(const CCoinsCommitment& delta)
+{
+    muhash *= delta.muhash;
+    nTransactions += delta.nTransactions;
+    nTransactionOutputs += delta.nTransactionOutputs;
+    nTotalAmount += delta.nTotalAmount;
+    return *this;
+}
+
+
 bool CCoinsView::GetCoins(const uint256& txid, CCoins& coins) const { return false; }
 bool CCoinsView::HaveCoins(const uint256& txid) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(0); }
-bool CCoinsView::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) { return false; }
+bool CCoinsView::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsCommitment& delta) { return false; }
 bool CCoinsView::GetStats(CCoinsStats& stats) const { return false; }
+bool CCoinsView::GetCommitment(CCoinsCommitment& commitment) const { return false; }
+CCoinsViewCursor* CCoinsView::Cursor() const { return NULL; }
 
 
 CCoinsViewBacked::CCoinsViewBacked(CCoinsView* viewIn) : base(viewIn) {}
@@ -71,8 +132,10 @@ bool CCoinsViewBacked::GetCoins(const uint256& txid, CCoins& coins) const { retu
 bool CCoinsViewBacked::HaveCoins(const uint256& txid) const { return base->HaveCoins(txid); }
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 void CCoinsViewBacked::SetBackend(CCoinsView& viewIn) { base = &viewIn; }
-bool CCoinsViewBacked::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
+bool CCoinsViewBacked::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsCommitment& delta) { return base->BatchWrite(mapCoins, hashBlock, delta); }
 bool CCoinsViewBacked::GetStats(CCoinsStats& stats) const { return base->GetStats(stats); }
+bool CCoinsViewBacked::GetCommitment(CCoinsCommitment& commitment) const { return base->GetCommitment(commitment); }
+CCoinsViewCursor* CCoinsViewBacked::Cursor() const { return base->Cursor(); }
 
 CCoinsKeyHasher::CCoinsKeyHasher() : salt(GetRandHash()) {}
 
@@ -130,6 +193,18 @@ CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256& txid)
     return CCoinsModifier(*this, ret.first);
 }
 
+bool CCoinsViewCache::WarmCoins(const uint256& txid, const CCoins& coins)
+{
+    assert(!hasModifier);
+    std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
+    if (!ret.second)
+        return false;
+    ret.first->second.coins = coins;
+    if (coins.IsPruned())
+        ret.first->second.flags = CCoinsCacheEntry::FRESH;
+    return true;
+}
+
 const CCoins* CCoinsViewCache::AccessCoins(const uint256& txid) const
 {
     CCoinsMap::const_iterator it = FetchCoins(txid);
@@ -162,7 +237,7 @@ void CCoinsViewCache::SetBestBlock(const uint256& hashBlockIn)
     hashBlock = hashBlockIn;
 }
 
-bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlockIn)
+bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlockIn, const CCoinsCommitment& delta)
 {
     assert(!hasModifier);
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
@@ -196,13 +271,23 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlockIn
         mapCoins.erase(itOld);
     }
     hashBlock = hashBlockIn;
+    commitmentDelta += delta;
+    return true;
+}
+
+bool CCoinsViewCache::GetCommitment(CCoinsCommitment& commitment) const
+{
+    if (!base->GetCommitment(commitment))
+        return false;
+    commitment += commitmentDelta;
     return true;
 }
 
 bool CCoinsViewCache::Flush()
 {
-    bool fOk = base->BatchWrite(cacheCoins, hashBlock);
+    bool fOk = base->BatchWrite(cacheCoins, hashBlock, commitmentDelta);
     cacheCoins.clear();
+    commitmentDelta = CCoinsCommitment();
     return fOk;
 }
 
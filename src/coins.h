@@ -9,6 +9,7 @@
 
 //#include "chainparams.h"
 #include "compressor.h"
+#include "muhash.h"
 #include "script/standard.h"
 #include "serialize.h"
 #include "uint256.h"
@@ -319,6 +320,43 @@ struct CCoinsCacheEntry {
 
 typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
 
+/**
+ * Rolling commitment to the unspent output set: the MuHash3072 of its outputs and running
+ * totals, updated as blocks are connected and disconnected. Also used for the change of a
+ * cache since its last flush, with totals that may be negative.
+ */
+class CCoinsCommitment
+{
+public:
+    CMuHash3072 muhash;
+    int64_t nTransactions;
+    int64_t nTransactionOutputs;
+    CAmount nTotalAmount;
+
+    CCoinsCommitment() : nTransactions(0), nTransactionOutputs(0), nTotalAmount(0) {}
+
+    /** Add or remove one output, the transaction count is left to the caller */
+    void AddOutput(const COutPoint& out, const CTxOut& txout, int nHeight, bool fCoinBase);
+    void RemoveOutput(const COutPoint& out, const CTxOut& txout, int nHeight, bool fCoinBase);
+
+    /** Add or remove all unspent outputs of a transaction and the transaction itself */
+    void AddCoins(const uint256& txid, const CCoins& coins);
+    void RemoveCoins(const uint256& txid, const CCoins& coins);
+
+    CCoinsCommitment& operator+=(const CCoinsCommitment& delta);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(muhash);
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nTotalAmount);
+    }
+};
+
 struct CCoinsStats {
     int nHeight;
     uint256 hashBlock;
@@ -327,11 +365,41 @@ struct CCoinsStats {
     uint64_t nSerializedSize;
     uint256 hashSerialized;
     CAmount nTotalAmount;
+    uint256 hashMuHash;
+    //! the incremental commitment of the scanned state, if the database has one
+    bool fCommitment;
+    CCoinsCommitment commitment;
 
-    CCoinsStats() : nHeight(0), hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), hashSerialized(0), nTotalAmount(0) {}
+    CCoinsStats() : nHeight(0), hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), hashSerialized(0), nTotalAmount(0), hashMuHash(0), fCommitment(false) {}
 };
 
 
+/** Iterates over the transactions with unspent outputs of a view, in one consistent state */
+class CCoinsViewCursor
+{
+public:
+    CCoinsViewCursor(const uint256& hashBlockIn, bool fCommitmentIn, const CCoinsCommitment& commitmentIn) : hashBlock(hashBlockIn), fCommitment(fCommitmentIn), commitment(commitmentIn) {}
+    virtual ~CCoinsViewCursor() {}
+
+    virtual bool GetKey(uint256& txid) const = 0;
+    virtual bool GetValue(CCoins& coins) const = 0;
+    virtual bool Valid() const = 0;
+    virtual void Next() = 0;
+
+    //! Block and commitment of the state iterated over
+    const uint256& GetBestBlock() const { return hashBlock; }
+    bool GetCommitment(CCoinsCommitment& commitmentOut) const
+    {
+        commitmentOut = commitment;
+        return fCommitment;
+    }
+
+private:
+    uint256 hashBlock;
+    bool fCommitment;
+    CCoinsCommitment commitment;
+};
+
 /** Abstract view on the open txout dataset. */
 class CCoinsView
 {
@@ -346,13 +414,20 @@ public:
     //! Retrieve the block hash whose state this CCoinsView currently represents
     virtual uint256 GetBestBlock() const;
 
-    //! Do a bulk modification (multiple CCoins changes + BestBlock change).
+    //! Do a bulk modification (multiple CCoins changes + BestBlock change + commitment change).
     //! The passed mapCoins can be modified.
-    virtual bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    virtual bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsCommitment& delta);
 
-    //! Calculate statistics about the unspent transaction output set
+    //! Calculate statistics about the unspent transaction output set with a full scan
     virtual bool GetStats(CCoinsStats& stats) const;
 
+    //! Retrieve the incremental commitment to the unspent transaction output set, if there is one
+    virtual bool GetCommitment(CCoinsCommitment& commitment) const;
+
+    //! Get a cursor over the unspent transactions, or NULL if the view cannot iterate them.
+    //! Caches pass this on to their base, so flush them first
+    virtual CCoinsViewCursor* Cursor() const;
+
     //! As we use CCoinsViews polymorphically, have a virtual destructor
     virtual ~CCoinsView() {}
 };
@@ -370,8 +445,10 @@ public:
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
     void SetBackend(CCoinsView& viewIn);
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsCommitment& delta);
     bool GetStats(CCoinsStats& stats) const;
+    bool GetCommitment(CCoinsCommitment& commitment) const;
+    CCoinsViewCursor* Cursor() const;
 };
 
 class CCoinsViewCache;
@@ -422,6 +499,9 @@ protected:
     mutable uint256 hashBlock;
     mutable CCoinsMap cacheCoins;
 
+    //! change of the commitment since the last flush
+    CCoinsCommitment commitmentDelta;
+
 public:
     CCoinsViewCache(CCoinsView* baseIn);
     ~CCoinsViewCache();
@@ -431,7 +511,14 @@ public:
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
     void SetBestBlock(const uint256& hashBlock);
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsCommitment& delta);
+    bool GetCommitment(CCoinsCommitment& commitment) const;
+
+    /**
+     * The commitment change pushed to the base on the next flush. Whoever spends or
+     * creates outputs through ModifyCoins records them here.
+     */
+    CCoinsCommitment& GetCommitmentDelta() { return commitmentDelta; }
 
     /**
      * Return a pointer to CCoins in the cache, or NULL if not found. This is
@@ -447,6 +534,12 @@ public:
      */
     CCoinsModifier ModifyCoins(const uint256& txid);
 
+    /**
+     * Insert coins read from the base ahead of time, unless the cache has an entry for
+     * txid already. The caller makes sure the base did not change since they were read.
+     */
+    bool WarmCoins(const uint256& txid, const CCoins& coins);
+
     /**
      * Push the modifications applied to this cache to its base.
      * Failure to call this method before destruction will cause the changes to be forgotten.
@@ -0,0 +1,188 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsprefetch.h"
+
+#include "blockstore.h"
+#include "main.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <algorithm>
+
+#include <boost/thread.hpp>
+
+CCoinsPrefetcher coinsprefetcher;
+
+/** Blocks remembered to ignore repeated requests */
+static const size_t MAX_PREFETCH_BLOCKS_SEEN = 1024;
+
+std::vector<uint256> GetBlockPrevouts(const CBlock& block)
+{
+    std::set<uint256> setCreated;
+    for (const CTransaction& tx : block.vtx)
+        setCreated.insert(tx.GetHash());
+
+    std::vector<uint256> vTxid;
+    for (const CTransaction& tx : block.vtx) {
+        if (tx.IsCoinBase() || tx.HasZerocoinSpendInputs())
+            continue;
+        for (const CTxIn& txin : tx.vin) {
+            if (txin.prevout.hash != 0 && !setCreated.count(txin.prevout.hash))
+                vTxid.push_back(txin.prevout.hash);
+        }
+    }
+    std::sort(vTxid.begin(), vTxid.end());
+    vTxid.erase(std::unique(vTxid.begin(), vTxid.end()), vTxid.end());
+    return vTxid;
+}
+
+CCoinsPrefetcher::CCoinsPrefetcher() : pdb(NULL), nPendingCoins(0)
+{
+}
+
+void CCoinsPrefetcher::SetView(CCoinsViewDB* pdbIn)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    pdb = pdbIn;
+    queueJobs.clear();
+    vResults.clear();
+    nPendingCoins = 0;
+    setBlocks.clear();
+    queueBlocks.clear();
+}
+
+bool CCoinsPrefetcher::Queue(CPrefetchJob& job)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (!pdb)
+        return false;
+    if (setBlocks.count(job.hashBlock))
+        return false;
+    // a block read by the worker is counted as one transaction until its prevouts are known
+    size_t nCoins = std::max<size_t>(job.vTxid.size(), 1);
+    if (nPendingCoins + nCoins > MAX_PREFETCH_COINS) {
+        stats.nDropped++;
+        return false;
+    }
+
+    setBlocks.insert(job.hashBlock);
+    queueBlocks.push_back(job.hashBlock);
+    if (queueBlocks.size() > MAX_PREFETCH_BLOCKS_SEEN) {
+        setBlocks.erase(queueBlocks.front());
+        queueBlocks.pop_front();
+    }
+    nPendingCoins += nCoins;
+    stats.nBlocks++;
+    queueJobs.push_back(CPrefetchJob());
+    queueJobs.back().hashBlock = job.hashBlock;
+    queueJobs.back().pos = job.pos;
+    queueJobs.back().vTxid.swap(job.vTxid);
+    condWorker.notify_one();
+    return true;
+}
+
+bool CCoinsPrefetcher::Prefetch(const CBlock& block)
+{
+    CPrefetchJob job;
+    job.hashBlock = block.GetHash();
+    job.vTxid = GetBlockPrevouts(block);
+    if (job.vTxid.empty())
+        return false;
+    return Queue(job);
+}
+
+bool CCoinsPrefetcher::Prefetch(const uint256& hashBlock, const CDiskBlockPos& pos)
+{
+    CPrefetchJob job;
+    job.hashBlock = hashBlock;
+    job.pos = pos;
+    return Queue(job);
+}
+
+void CCoinsPrefetcher::Thread()
+{
+    while (true) {
+        CPrefetchJob job;
+        CCoinsViewDB* pdbJob;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queueJobs.empty())
+                condWorker.wait(lock);
+            job = queueJobs.front();
+            queueJobs.pop_front();
+            pdbJob = pdb;
+        }
+        size_t nQueued = std::max<size_t>(job.vTxid.size(), 1);
+
+        if (job.vTxid.empty() && !job.pos.IsNull()) {
+            // ConnectTip finds the block in the block store
+            CBlockRef pblock;
+            if (ReadBlockFromDisk(pblock, job.pos) && pblock->GetHash() == job.hashBlock) {
+                blockstore.Insert(job.pos, pblock);
+                job.vTxid = GetBlockPrevouts(*pblock);
+            }
+        }
+
+        CPrefetchResult result;
+        if (pdbJob && !job.vTxid.empty()) {
+            // coins read after the write count was taken are at least that recent
+            result.nWriteCount = pdbJob->GetWriteCount();
+            pdbJob->GetCoinsMany(job.vTxid, result.vCoins);
+        }
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nPendingCoins -= std::min(nPendingCoins, nQueued);
+        if (pdb != pdbJob || !pdb)
+            continue;
+        stats.nRequested += job.vTxid.size();
+        stats.nFound += result.vCoins.size();
+        if (!result.vCoins.empty()) {
+            nPendingCoins += result.vCoins.size();
+            vResults.push_back(CPrefetchResult());
+            vResults.back().nWriteCount = result.nWriteCount;
+            vResults.back().vCoins.swap(result.vCoins);
+        }
+    }
+}
+
+unsigned int CCoinsPrefetcher::Apply(CCoinsViewCache& cache)
+{
+    std::vector<CPrefetchResult> vReady;
+    CCoinsViewDB* pdbApply;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (vResults.empty())
+            return 0;
+        vReady.swap(vResults);
+        for (const CPrefetchResult& result : vReady)
+            nPendingCoins -= std::min(nPendingCoins, result.vCoins.size());
+        pdbApply = pdb;
+    }
+    if (!pdbApply)
+        return 0;
+
+    uint64_t nWriteCount = pdbApply->GetWriteCount();
+    unsigned int nApplied = 0;
+    uint64_t nOutdated = 0;
+    for (const CPrefetchResult& result : vReady) {
+        if (result.nWriteCount != nWriteCount) {
+            nOutdated += result.vCoins.size();
+            continue;
+        }
+        for (const std::pair<uint256, CCoins>& entry : result.vCoins)
+            nApplied += cache.WarmCoins(entry.first, entry.second);
+    }
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    stats.nApplied += nApplied;
+    stats.nOutdated += nOutdated;
+    return nApplied;
+}
+
+CCoinsPrefetchStats CCoinsPrefetcher::GetStats() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return stats;
+}
@@ -0,0 +1,107 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SIMPLICITY_COINSPREFETCH_H
+#define SIMPLICITY_COINSPREFETCH_H
+
+#include "chain.h"
+#include "coins.h"
+#include "primitives/block.h"
+#include "uint256.h"
+
+#include <deque>
+#include <set>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class CCoinsViewDB;
+
+/** -prefetchthreads default, 0 disables prefetching */
+static const int DEFAULT_PREFETCH_THREADS = 2;
+static const int MAX_PREFETCH_THREADS = 16;
+/** Blocks ahead of the tip whose coins are prefetched while connecting a chain */
+static const unsigned int PREFETCH_BLOCKS_AHEAD = 16;
+/** Transactions queued or waiting to be applied, further requests are dropped */
+static const size_t MAX_PREFETCH_COINS = 200000;
+
+struct CCoinsPrefetchStats {
+    uint64_t nBlocks;
+    uint64_t nDropped;
+    uint64_t nRequested;
+    uint64_t nFound;
+    uint64_t nApplied;
+    uint64_t nOutdated;
+
+    CCoinsPrefetchStats() : nBlocks(0), nDropped(0), nRequested(0), nFound(0), nApplied(0), nOutdated(0) {}
+};
+
+/**
+ * Warms the coins cache ahead of ConnectBlock. Once a block is known, its prevouts are
+ * queued and worker threads read their coins from the coin database in batches, without
+ * holding cs_main. The validating thread moves the results into the coins cache before it
+ * connects the next block, and drops those read before the database was last written to.
+ */
+class CCoinsPrefetcher
+{
+private:
+    struct CPrefetchJob {
+        uint256 hashBlock;
+        //! read the block from here when vTxid was not filled in yet
+        CDiskBlockPos pos;
+        std::vector<uint256> vTxid;
+    };
+
+    struct CPrefetchResult {
+        uint64_t nWriteCount;
+        std::vector<std::pair<uint256, CCoins> > vCoins;
+    };
+
+    mutable boost::mutex mutex;
+    boost::condition_variable condWorker;
+
+    CCoinsViewDB* pdb;
+    std::deque<CPrefetchJob> queueJobs;
+    std::vector<CPrefetchResult> vResults;
+    //! transactions queued or waiting in vResults
+    size_t nPendingCoins;
+
+    //! blocks queued recently, so repeated requests for them are ignored
+    std::set<uint256> setBlocks;
+    std::deque<uint256> queueBlocks;
+
+    CCoinsPrefetchStats stats;
+
+    bool Queue(CPrefetchJob& job);
+
+public:
+    CCoinsPrefetcher();
+
+    /** Start prefetching from the given database, or stop with NULL */
+    void SetView(CCoinsViewDB* pdbIn);
+
+    /** Worker thread, runs until interrupted */
+    void Thread();
+
+    /** Queue the coins spent by a block. Returns false if they are not prefetched */
+    bool Prefetch(const CBlock& block);
+    /** Queue a block that is on disk, a worker reads it and keeps it in the block store */
+    bool Prefetch(const uint256& hashBlock, const CDiskBlockPos& pos);
+
+    /**
+     * Move the coins read so far into the cache, returns how many were added. Called with
+     * cs_main held, so the coin database is not written to meanwhile.
+     */
+    unsigned int Apply(CCoinsViewCache& cache);
+
+    CCoinsPrefetchStats GetStats() const;
+};
+
+/** The transactions whose coins a block spends, except those it creates itself */
+std::vector<uint256> GetBlockPrevouts(const CBlock& block);
+
+extern CCoinsPrefetcher coinsprefetcher;
+
+#endif // SIMPLICITY_COINSPREFETCH_H
@@ -7,8 +7,28 @@
 
 #include "crypto/common.h"
 
+#include <assert.h>
 #include <string.h>
 
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+}
+
+namespace sha256d64_sse41
+{
+void Transform_4way(unsigned char* out, const unsigned char* in);
+}
+
+namespace sha256d64_avx2
+{
+void Transform_8way(unsigned char* out, const unsigned char* in);
+}
+
 // Internal implementation code.
 /*namespace
 {
@@ -132,6 +152,103 @@ uint32_t inline sigma1(uint32_t x) { return (x >> 17 | x << 15) ^ (x >> 19 | x <
 }*/ // namespace
 
 
+namespace
+{
+/** The block transform of scrypt_opt, assembly where the platform has it. */
+void TransformStandard(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    while (blocks--) {
+        sha256_transform(s, (const uint32_t*)chunk, 1);
+        chunk += 64;
+    }
+}
+
+/** Double SHA-256 of a 64-byte input using a single-stream transform. */
+template <void (*tr)(uint32_t*, const unsigned char*, size_t)>
+void TransformD64Wrapper(unsigned char* out, const unsigned char* in)
+{
+    static const unsigned char padding1[64] = {
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0
+    };
+    unsigned char buffer2[64] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0
+    };
+    uint32_t s[8];
+
+    sha256_init(s);
+    tr(s, in, 1);
+    tr(s, padding1, 1);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(buffer2 + 4 * i, s[i]);
+
+    sha256_init(s);
+    tr(s, buffer2, 1);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(out + 4 * i, s[i]);
+}
+
+typedef void (*TransformType)(uint32_t*, const unsigned char*, size_t);
+typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
+
+TransformType Transform = TransformStandard;
+TransformD64Type TransformD64 = TransformD64Wrapper<TransformStandard>;
+TransformD64Type TransformD64_4way = NULL;
+TransformD64Type TransformD64_8way = NULL;
+
+bool SelfTest()
+{
+    // double SHA-256 of 0..255 as 64-byte inputs, compared over every way the dispatch splits them
+    unsigned char in[64 * 9];
+    for (int i = 0; i < (int)sizeof(in); i++)
+        in[i] = i;
+
+    unsigned char expected[32 * 9];
+    for (int i = 0; i < 9; i++) {
+        CSHA256 sha;
+        unsigned char buf[CSHA256::OUTPUT_SIZE];
+        sha.Write(in + 64 * i, 64).Finalize(buf);
+        sha.Reset().Write(buf, sizeof(buf)).Finalize(expected + 32 * i);
+    }
+
+    // the standard transform is the reference for the single-stream one
+    uint32_t s1[8], s2[8];
+    sha256_init(s1);
+    sha256_init(s2);
+    TransformStandard(s1, in, 9);
+    Transform(s2, in, 9);
+    if (memcmp(s1, s2, sizeof(s1)))
+        return false;
+
+    for (int n = 0; n <= 9; n++) {
+        unsigned char out[32 * 9];
+        SHA256D64(out, in, n);
+        if (memcmp(out, expected, 32 * n))
+            return false;
+    }
+
+    return true;
+}
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+/** Whether the OS saves the AVX registers on context switches */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+//! set by SHA256AutoDetect, before any other thread hashes
+std::string strImplementation = "standard";
+} // namespace
+
 ////// SHA-256
 
 CSHA256::CSHA256() : bytes(0)
@@ -149,16 +266,15 @@ CSHA256& CSHA256::Write(const unsigned char* data, size_t len)
         memcpy(buf + bufsize, data, 64 - bufsize);
         bytes += 64 - bufsize;
         data += 64 - bufsize;
-        //sha256::Transform(s, buf);
-        sha256_transform(s, (uint32_t*)buf, 1);
+        Transform(s, buf, 1);
         bufsize = 0;
     }
-    while (end >= data + 64) {
+    if (end - data >= 64) {
         // Process full chunks directly from the source.
-        //sha256::Transform(s, data);
-        sha256_transform(s, (uint32_t*)data, 1);
-        bytes += 64;
-        data += 64;
+        size_t blocks = (end - data) / 64;
+        Transform(s, data, blocks);
+        bytes += 64 * blocks;
+        data += 64 * blocks;
     }
     if (end > data) {
         // Fill the buffer with what remains.
@@ -192,3 +308,85 @@ CSHA256& CSHA256::Reset()
     sha256_init(s);
     return *this;
 }
+
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (TransformD64_8way) {
+        while (blocks >= 8) {
+            TransformD64_8way(out, in);
+            out += 256;
+            in += 512;
+            blocks -= 8;
+        }
+    }
+    if (TransformD64_4way) {
+        while (blocks >= 4) {
+            TransformD64_4way(out, in);
+            out += 128;
+            in += 256;
+            blocks -= 4;
+        }
+    }
+    while (blocks) {
+        TransformD64(out, in);
+        out += 32;
+        in += 64;
+        --blocks;
+    }
+}
+
+std::string SHA256AutoDetect()
+{
+    std::string ret = "standard";
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+    uint32_t eax, ebx, ecx, edx;
+    bool have_sse4 = false, have_avx = false, have_avx2 = false, have_shani = false, use_shani = false;
+
+    __cpuid(1, eax, ebx, ecx, edx);
+    have_sse4 = (ecx >> 19) & 1;
+    // AVX needs the OS to save the registers too
+    have_avx = ((ecx >> 27) & 1) && ((ecx >> 28) & 1) && AVXEnabled();
+    if (__get_cpuid_max(0, NULL) >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        have_avx2 = (ebx >> 5) & 1;
+        have_shani = (ebx >> 29) & 1;
+    }
+
+#if defined(ENABLE_SHANI) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_shani && have_sse4) {
+        Transform = sha256_shani::Transform;
+        TransformD64 = TransformD64Wrapper<sha256_shani::Transform>;
+        ret = "shani(1way)";
+        use_shani = true;
+    }
+#endif
+#if defined(ENABLE_SSE41) && !defined(BUILD_BITCOIN_INTERNAL)
+    // a single SHA-NI stream outruns four SSE lanes but not eight AVX2 ones
+    if (have_sse4 && !use_shani) {
+        TransformD64_4way = sha256d64_sse41::Transform_4way;
+        ret += ",sse41(4way)";
+    }
+#endif
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_avx2 && have_avx) {
+        TransformD64_8way = sha256d64_avx2::Transform_8way;
+        ret += ",avx2(8way)";
+    }
+#endif
+    // not every flag is read when an implementation is left out of the build
+    (void)have_sse4;
+    (void)have_avx;
+    (void)have_avx2;
+    (void)have_shani;
+    (void)use_shani;
+#endif
+
+    assert(SelfTest());
+    strImplementation = ret;
+    return ret;
+}
+
+std::string SHA256Implementation()
+{
+    return strImplementation;
+}
@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -25,4 +26,17 @@ public:
     CSHA256& Reset();
 };
 
+/** Pick the fastest SHA-256 implementations the CPU supports and self-test them.
+ *  Returns a description of the ones in use. Call once at startup, before any other thread hashes.
+ */
+std::string SHA256AutoDetect();
+
+/** The description SHA256AutoDetect returned, "standard" if it was not called. */
+std::string SHA256Implementation();
+
+/** Compute the double SHA-256 of each of blocks 64-byte inputs, in as many lanes as the CPU allows.
+ *  out holds blocks * 32 bytes, in holds blocks * 64 bytes.
+ */
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -0,0 +1,60 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include "config/simplicity-config.h"
+#endif
+
+#ifdef ENABLE_AVX2
+
+#include "crypto/common.h"
+#include "crypto/sha256_multiway.h"
+
+#include <immintrin.h>
+#include <stdint.h>
+
+namespace
+{
+/** 8-way lanes of an AVX register */
+struct AVX2Lanes {
+    typedef __m256i Vec;
+    static const int WAYS = 8;
+
+    static inline Vec Set(uint32_t x) { return _mm256_set1_epi32(x); }
+    static inline Vec Add(Vec x, Vec y) { return _mm256_add_epi32(x, y); }
+    static inline Vec Xor(Vec x, Vec y) { return _mm256_xor_si256(x, y); }
+    static inline Vec And(Vec x, Vec y) { return _mm256_and_si256(x, y); }
+    static inline Vec Or(Vec x, Vec y) { return _mm256_or_si256(x, y); }
+    static inline Vec ShR(Vec x, int n) { return _mm256_srli_epi32(x, n); }
+    static inline Vec ShL(Vec x, int n) { return _mm256_slli_epi32(x, n); }
+
+    static inline Vec Load(const unsigned char* in, int offset)
+    {
+        return _mm256_set_epi32(ReadBE32(in + 448 + offset), ReadBE32(in + 384 + offset), ReadBE32(in + 320 + offset), ReadBE32(in + 256 + offset),
+                                ReadBE32(in + 192 + offset), ReadBE32(in + 128 + offset), ReadBE32(in + 64 + offset), ReadBE32(in + offset));
+    }
+
+    static inline void Store(unsigned char* out, int offset, Vec v)
+    {
+        WriteBE32(out + offset, _mm256_extract_epi32(v, 0));
+        WriteBE32(out + 32 + offset, _mm256_extract_epi32(v, 1));
+        WriteBE32(out + 64 + offset, _mm256_extract_epi32(v, 2));
+        WriteBE32(out + 96 + offset, _mm256_extract_epi32(v, 3));
+        WriteBE32(out + 128 + offset, _mm256_extract_epi32(v, 4));
+        WriteBE32(out + 160 + offset, _mm256_extract_epi32(v, 5));
+        WriteBE32(out + 192 + offset, _mm256_extract_epi32(v, 6));
+        WriteBE32(out + 224 + offset, _mm256_extract_epi32(v, 7));
+    }
+};
+} // namespace
+
+namespace sha256d64_avx2
+{
+void Transform_8way(unsigned char* out, const unsigned char* in)
+{
+    sha256_multiway::DoubleSHA256<AVX2Lanes>::Transform(out, in);
+}
+} // namespace sha256d64_avx2
+
+#endif
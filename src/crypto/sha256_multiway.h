@@ -0,0 +1,138 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_SHA256_MULTIWAY_H
+#define BITCOIN_CRYPTO_SHA256_MULTIWAY_H
+
+// Internal to the SHA-256 implementations, only included by the files built with the matching
+// instruction set flags.
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace sha256_multiway
+{
+static const uint32_t INIT[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/** Round constants plus message schedule of the padding block of a 64-byte message */
+static const uint32_t PADDING_KW[64] = {
+    0xc28a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf374,
+    0x649b69c1, 0xf0fe4786, 0x0fe1edc6, 0x240cf254, 0x4fe9346f, 0x6cc984be, 0x61b9411e, 0x16f988fa,
+    0xf2c65152, 0xa88e5a6d, 0xb019fc65, 0xb9d99ec7, 0x9a1231c3, 0xe70eeaa0, 0xfdb1232b, 0xc7353eb0,
+    0x3069bad5, 0xcb976d5f, 0x5a0f118f, 0xdc1eeefd, 0x0a35b689, 0xde0b7a04, 0x58f4ca9d, 0xe15d5b16,
+    0x007f3e86, 0x37088980, 0xa507ea32, 0x6fab9537, 0x17406110, 0x0d8cd6f1, 0xcdaa3b6d, 0xc0bbbe37,
+    0x83613bda, 0xdb48a363, 0x0b02e931, 0x6fd15ca7, 0x521afaca, 0x31338431, 0x6ed41a95, 0x6d437890,
+    0xc39c91f2, 0x9eccabbd, 0xb5c9a0e6, 0x532fb63c, 0xd2c741c6, 0x07237ea3, 0xa4954b68, 0x4c191d76,
+};
+
+/** Double SHA-256 of 64-byte inputs, one input per lane of a SIMD vector.
+ *
+ * T supplies the vector type Vec, the lane count WAYS and the lane-wise 32-bit operations Set, Add,
+ * Xor, And, Or, ShR and ShL, plus Load and Store to move big-endian words between the lanes and
+ * the inputs (64 bytes apart) and outputs (32 bytes apart).
+ */
+template <typename T>
+struct DoubleSHA256
+{
+    typedef typename T::Vec Vec;
+
+    static inline Vec Rotr(Vec x, int n) { return T::Or(T::ShR(x, n), T::ShL(x, 32 - n)); }
+    static inline Vec Ch(Vec x, Vec y, Vec z) { return T::Xor(z, T::And(x, T::Xor(y, z))); }
+    static inline Vec Maj(Vec x, Vec y, Vec z) { return T::Or(T::And(x, y), T::And(z, T::Or(x, y))); }
+    static inline Vec Sigma0(Vec x) { return T::Xor(T::Xor(Rotr(x, 2), Rotr(x, 13)), Rotr(x, 22)); }
+    static inline Vec Sigma1(Vec x) { return T::Xor(T::Xor(Rotr(x, 6), Rotr(x, 11)), Rotr(x, 25)); }
+    static inline Vec sigma0(Vec x) { return T::Xor(T::Xor(Rotr(x, 7), Rotr(x, 18)), T::ShR(x, 3)); }
+    static inline Vec sigma1(Vec x) { return T::Xor(T::Xor(Rotr(x, 17), Rotr(x, 19)), T::ShR(x, 10)); }
+
+    /** One round, kw is the round constant plus the message word */
+    static inline void Round(Vec a, Vec b, Vec c, Vec& d, Vec e, Vec f, Vec g, Vec& h, Vec kw)
+    {
+        Vec t1 = T::Add(T::Add(h, Sigma1(e)), T::Add(Ch(e, f, g), kw));
+        Vec t2 = T::Add(Sigma0(a), Maj(a, b, c));
+        d = T::Add(d, t1);
+        h = T::Add(t1, t2);
+    }
+
+    /** Round constant plus message word i, extending the message schedule past the block */
+    static inline Vec KW(Vec* w, int i)
+    {
+        if (i >= 16) {
+            Vec& wi = w[i & 15];
+            wi = T::Add(T::Add(wi, sigma1(w[(i - 2) & 15])), T::Add(w[(i - 7) & 15], sigma0(w[(i - 15) & 15])));
+        }
+        return T::Add(T::Set(K[i]), w[i & 15]);
+    }
+
+    /** Compress a block into the state, given its 16 message words or, without them, the padding block */
+    static inline void Compress(Vec* s, Vec* w)
+    {
+        Vec a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+
+        // the variables are back in place every eight rounds
+        for (int i = 0; i < 64; i += 8) {
+            Round(a, b, c, d, e, f, g, h, w ? KW(w, i) : T::Set(PADDING_KW[i]));
+            Round(h, a, b, c, d, e, f, g, w ? KW(w, i + 1) : T::Set(PADDING_KW[i + 1]));
+            Round(g, h, a, b, c, d, e, f, w ? KW(w, i + 2) : T::Set(PADDING_KW[i + 2]));
+            Round(f, g, h, a, b, c, d, e, w ? KW(w, i + 3) : T::Set(PADDING_KW[i + 3]));
+            Round(e, f, g, h, a, b, c, d, w ? KW(w, i + 4) : T::Set(PADDING_KW[i + 4]));
+            Round(d, e, f, g, h, a, b, c, w ? KW(w, i + 5) : T::Set(PADDING_KW[i + 5]));
+            Round(c, d, e, f, g, h, a, b, w ? KW(w, i + 6) : T::Set(PADDING_KW[i + 6]));
+            Round(b, c, d, e, f, g, h, a, w ? KW(w, i + 7) : T::Set(PADDING_KW[i + 7]));
+        }
+
+        s[0] = T::Add(s[0], a);
+        s[1] = T::Add(s[1], b);
+        s[2] = T::Add(s[2], c);
+        s[3] = T::Add(s[3], d);
+        s[4] = T::Add(s[4], e);
+        s[5] = T::Add(s[5], f);
+        s[6] = T::Add(s[6], g);
+        s[7] = T::Add(s[7], h);
+    }
+
+    /** Hash T::WAYS inputs of 64 bytes into T::WAYS outputs of 32 bytes */
+    static void Transform(unsigned char* out, const unsigned char* in)
+    {
+        Vec s[8], w[16];
+
+        for (int i = 0; i < 8; i++)
+            s[i] = T::Set(INIT[i]);
+        for (int i = 0; i < 16; i++)
+            w[i] = T::Load(in, 4 * i);
+        Compress(s, w);
+        Compress(s, NULL);
+
+        // hash the 32-byte digests
+        for (int i = 0; i < 8; i++) {
+            w[i] = s[i];
+            s[i] = T::Set(INIT[i]);
+        }
+        w[8] = T::Set(0x80000000);
+        for (int i = 9; i < 15; i++)
+            w[i] = T::Set(0);
+        w[15] = T::Set(0x100);
+        Compress(s, w);
+
+        for (int i = 0; i < 8; i++)
+            T::Store(out, 4 * i, s[i]);
+    }
+};
+
+} // namespace sha256_multiway
+
+#endif // BITCOIN_CRYPTO_SHA256_MULTIWAY_H
@@ -0,0 +1,55 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include "config/simplicity-config.h"
+#endif
+
+#ifdef ENABLE_SSE41
+
+#include "crypto/common.h"
+#include "crypto/sha256_multiway.h"
+
+#include <immintrin.h>
+#include <stdint.h>
+
+namespace
+{
+/** 4-way lanes of an SSE register */
+struct SSE41Lanes {
+    typedef __m128i Vec;
+    static const int WAYS = 4;
+
+    static inline Vec Set(uint32_t x) { return _mm_set1_epi32(x); }
+    static inline Vec Add(Vec x, Vec y) { return _mm_add_epi32(x, y); }
+    static inline Vec Xor(Vec x, Vec y) { return _mm_xor_si128(x, y); }
+    static inline Vec And(Vec x, Vec y) { return _mm_and_si128(x, y); }
+    static inline Vec Or(Vec x, Vec y) { return _mm_or_si128(x, y); }
+    static inline Vec ShR(Vec x, int n) { return _mm_srli_epi32(x, n); }
+    static inline Vec ShL(Vec x, int n) { return _mm_slli_epi32(x, n); }
+
+    static inline Vec Load(const unsigned char* in, int offset)
+    {
+        return _mm_set_epi32(ReadBE32(in + 192 + offset), ReadBE32(in + 128 + offset), ReadBE32(in + 64 + offset), ReadBE32(in + offset));
+    }
+
+    static inline void Store(unsigned char* out, int offset, Vec v)
+    {
+        WriteBE32(out + offset, _mm_extract_epi32(v, 0));
+        WriteBE32(out + 32 + offset, _mm_extract_epi32(v, 1));
+        WriteBE32(out + 64 + offset, _mm_extract_epi32(v, 2));
+        WriteBE32(out + 96 + offset, _mm_extract_epi32(v, 3));
+    }
+};
+} // namespace
+
+namespace sha256d64_sse41
+{
+void Transform_4way(unsigned char* out, const unsigned char* in)
+{
+    sha256_multiway::DoubleSHA256<SSE41Lanes>::Transform(out, in);
+}
+} // namespace sha256d64_sse41
+
+#endif
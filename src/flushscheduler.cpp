@@ -0,0 +1,276 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "flushscheduler.h"
+
+#include "crypto/common.h"
+#include "main.h"
+#include "txdb.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+CFlushScheduler flushscheduler;
+
+CFlushScheduler::CFlushScheduler() : pblocktree(NULL), pcoinsdb(NULL), pzerocoindb(NULL), fWorker(false), fPending(false), nPendingEpoch(0), nCommitting(0), nLastEpoch(0), nDurableEpoch(0)
+{
+}
+
+void CFlushScheduler::SetDatabases(CBlockTreeDB* pblocktreeIn, CCoinsViewDB* pcoinsdbIn, CZerocoinDB* pzerocoindbIn, uint64_t nEpoch)
+{
+    boost::unique_lock<boost::mutex> lockCommit(mutexCommit);
+    boost::unique_lock<boost::mutex> lock(mutex);
+    pblocktree = pblocktreeIn;
+    pcoinsdb = pcoinsdbIn;
+    pzerocoindb = pzerocoindbIn;
+    fPending = false;
+    nLastEpoch = nEpoch;
+    nDurableEpoch = nEpoch;
+    strError.clear();
+}
+
+uint64_t CFlushScheduler::NewEpoch()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return ++nLastEpoch;
+}
+
+void CFlushScheduler::WriteJournal(uint64_t nEpoch, const CBlockIndexJournal& journal)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (pcoinsdb)
+        pcoinsdb->WriteJournal(nEpoch, journal, nDurableEpoch);
+}
+
+bool CommitBlockFiles(const std::set<int>& setFiles, std::string& strError)
+{
+    for (int nFile : setFiles) {
+        CDiskBlockPos pos(nFile, 0);
+        const char* prefixes[] = {"blk", "rev"};
+        for (const char* prefix : prefixes) {
+            if (!boost::filesystem::exists(GetBlockPosFilename(pos, prefix)))
+                continue;
+            FILE* file = OpenDiskFile(pos, prefix, true);
+            if (!file) {
+                strError = strprintf("Failed to open %s%05u.dat", prefix, nFile);
+                return false;
+            }
+            FileCommit(file);
+            fclose(file);
+        }
+    }
+    return true;
+}
+
+bool CFlushScheduler::Commit(uint64_t nEpoch)
+{
+    boost::unique_lock<boost::mutex> lockCommit(mutexCommit);
+    CBlockTreeDB* pblocktreeCommit;
+    CCoinsViewDB* pcoinsdbCommit;
+    CZerocoinDB* pzerocoindbCommit;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (!strError.empty())
+            return false;
+        pblocktreeCommit = pblocktree;
+        pcoinsdbCommit = pcoinsdb;
+        pzerocoindbCommit = pzerocoindb;
+    }
+
+    // the block and undo files were synced before the epoch was scheduled
+    int64_t nStart = GetTimeMicros();
+    std::string strFailed;
+    if (pzerocoindbCommit && !pzerocoindbCommit->Sync())
+        strFailed = "Failed to sync the zerocoin database";
+    if (strFailed.empty() && pcoinsdbCommit && !pcoinsdbCommit->Sync())
+        strFailed = "Failed to sync the coin database";
+    // also syncs the block index written before it
+    if (strFailed.empty() && pblocktreeCommit && !pblocktreeCommit->WriteFlushEpoch(nEpoch))
+        strFailed = "Failed to write to block index database";
+    int64_t nTime = GetTimeMicros() - nStart;
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (strFailed.empty()) {
+        nDurableEpoch = std::max(nDurableEpoch, nEpoch);
+        stats.nCommitted++;
+        stats.nCommitMicros += nTime;
+        LogPrint("flush", "%s : epoch %u durable, %.2fms\n", __func__, nEpoch, 0.001 * nTime);
+    } else {
+        strError = strFailed;
+        LogPrintf("%s : %s\n", __func__, strError);
+    }
+    return strFailed.empty();
+}
+
+void CFlushScheduler::CommitPending()
+{
+    uint64_t nEpoch;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (!fPending)
+            return;
+        nEpoch = nPendingEpoch;
+        fPending = false;
+        nCommitting++;
+    }
+    Commit(nEpoch);
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nCommitting--;
+    condDurable.notify_all();
+}
+
+void CFlushScheduler::Thread()
+{
+    RenameThread("simplicity-flush");
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fWorker = true;
+    }
+    try {
+        while (true) {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!fPending)
+                    condWorker.wait(lock);
+            }
+            CommitPending();
+        }
+    } catch (const boost::thread_interrupted&) {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fWorker = false;
+            condDurable.notify_all();
+        }
+        // later epochs are committed by the thread that schedules them
+        CommitPending();
+        throw;
+    }
+}
+
+bool CFlushScheduler::Schedule(uint64_t nEpoch)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (!strError.empty())
+            return false;
+        stats.nScheduled++;
+        if (fPending)
+            stats.nMerged++;
+        nPendingEpoch = fPending ? std::max(nPendingEpoch, nEpoch) : nEpoch;
+        fPending = true;
+        if (fWorker) {
+            condWorker.notify_one();
+            return true;
+        }
+    }
+    CommitPending();
+    return GetError().empty();
+}
+
+bool CFlushScheduler::WaitForEpoch(uint64_t nEpoch)
+{
+    boost::this_thread::disable_interruption di;
+    int64_t nStart = GetTimeMicros();
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (nDurableEpoch < nEpoch && strError.empty()) {
+        if (!fWorker && fPending) {
+            lock.unlock();
+            CommitPending();
+            lock.lock();
+            continue;
+        }
+        // a commit the stopped worker took may still be running
+        if (!fWorker && !nCommitting)
+            break;
+        condDurable.wait(lock);
+    }
+    stats.nWaitMicros += GetTimeMicros() - nStart;
+    return nDurableEpoch >= nEpoch;
+}
+
+uint64_t CFlushScheduler::GetDurableEpoch() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return nDurableEpoch;
+}
+
+std::string CFlushScheduler::GetError() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return strError;
+}
+
+CFlushSchedulerStats CFlushScheduler::GetStats() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return stats;
+}
+
+/** Whether the block file holds the start of a block where the index entry says its data is */
+static bool HaveBlockData(const CDiskBlockIndex& index)
+{
+    if (!(index.nStatus & BLOCK_HAVE_DATA))
+        return true;
+    if (index.nDataPos < 8)
+        return false;
+    // the message start and size are written in front of each block
+    FILE* file = OpenDiskFile(CDiskBlockPos(index.nFile, index.nDataPos - 8), "blk", true);
+    if (!file)
+        return false;
+    unsigned char header[8];
+    bool fHave = fread(header, 1, sizeof(header), file) == sizeof(header) &&
+                 memcmp(header, Params().MessageStart(), MESSAGE_START_SIZE) == 0 && ReadLE32(header + MESSAGE_START_SIZE) > 0;
+    fclose(file);
+    return fHave;
+}
+
+bool ReplayBlockIndexJournal(CCoinsViewDB& coinsdb, CBlockTreeDB& blocktree, uint64_t& nEpoch)
+{
+    uint64_t nDurable = 0;
+    blocktree.ReadFlushEpoch(nDurable);
+    nEpoch = nDurable;
+
+    std::map<uint64_t, CBlockIndexJournal> mapJournal;
+    if (!coinsdb.ReadJournal(mapJournal))
+        return error("%s : failed to read the block index journal", __func__);
+    if (mapJournal.empty())
+        return true;
+
+    int nReplayed = 0;
+    for (std::pair<const uint64_t, CBlockIndexJournal>& entry : mapJournal) {
+        nEpoch = std::max(nEpoch, entry.first);
+        if (entry.first <= nDurable)
+            continue;
+        CBlockIndexJournal& journal = entry.second;
+        // the block files are synced before the journal is written, so a block missing from
+        // them means the chainstate refers to data that is gone
+        for (const std::pair<uint256, CDiskBlockIndex>& block : journal.vBlocks) {
+            if (!HaveBlockData(block.second))
+                return error("%s : the data of block %s in epoch %u is missing from blk%05u.dat", __func__, block.first.GetHex(), entry.first, block.second.nFile);
+        }
+        // a later epoch may have reached the block tree and not the coins, keep the larger
+        // file sizes so blocks it wrote are not overwritten
+        for (std::pair<int, CBlockFileInfo>& file : journal.vFiles) {
+            CBlockFileInfo info;
+            if (blocktree.ReadBlockFileInfo(file.first, info) && info.nSize >= file.second.nSize && info.nUndoSize >= file.second.nUndoSize)
+                file.second = info;
+        }
+        int nLastFile = 0;
+        if (blocktree.ReadLastBlockFile(nLastFile))
+            journal.nLastFile = std::max(journal.nLastFile, nLastFile);
+        if (!blocktree.WriteJournal(journal))
+            return error("%s : failed to write the journal of epoch %u", __func__, entry.first);
+        nReplayed++;
+    }
+    if (nReplayed)
+        LogPrintf("%s : replayed the block index of %d flushes after epoch %u, the last one not known to be durable\n", __func__, nReplayed, nDurable);
+
+    if (!blocktree.WriteFlushEpoch(nEpoch))
+        return error("%s : failed to write to block index database", __func__);
+    return coinsdb.EraseJournal();
+}
@@ -0,0 +1,109 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SIMPLICITY_FLUSHSCHEDULER_H
+#define SIMPLICITY_FLUSHSCHEDULER_H
+
+#include <set>
+#include <stdint.h>
+#include <string>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class CBlockTreeDB;
+struct CBlockIndexJournal;
+class CCoinsViewDB;
+class CZerocoinDB;
+
+struct CFlushSchedulerStats {
+    uint64_t nScheduled;
+    //! epochs scheduled while an earlier one was still waiting, committed with it
+    uint64_t nMerged;
+    uint64_t nCommitted;
+    uint64_t nCommitMicros;
+    //! time the validating thread spent waiting for an epoch to become durable
+    uint64_t nWaitMicros;
+
+    CFlushSchedulerStats() : nScheduled(0), nMerged(0), nCommitted(0), nCommitMicros(0), nWaitMicros(0) {}
+};
+
+/**
+ * Makes the state flushed by FlushStateToDisk durable off the validating thread. Each flush
+ * syncs the block and undo files it wrote to, then writes the block index, coins and zerocoin
+ * changes without syncing and schedules an epoch; the worker then syncs the zerocoin and coin
+ * databases, and records the epoch in the block tree with a synced write. Epochs scheduled
+ * while another is waiting are merged. Without a running worker, epochs are committed by the
+ * caller.
+ */
+class CFlushScheduler
+{
+private:
+    mutable boost::mutex mutex;
+    boost::condition_variable condWorker;
+    boost::condition_variable condDurable;
+    //! taken while an epoch is committed, they are committed in order
+    boost::mutex mutexCommit;
+
+    CBlockTreeDB* pblocktree;
+    CCoinsViewDB* pcoinsdb;
+    CZerocoinDB* pzerocoindb;
+
+    bool fWorker;
+    bool fPending;
+    uint64_t nPendingEpoch;
+    //! commits taken from pending that have not finished
+    int nCommitting;
+    uint64_t nLastEpoch;
+    uint64_t nDurableEpoch;
+    std::string strError;
+
+    CFlushSchedulerStats stats;
+
+    bool Commit(uint64_t nEpoch);
+    void CommitPending();
+
+public:
+    CFlushScheduler();
+
+    /** Commit to these databases, starting after nEpoch, or stop with NULL */
+    void SetDatabases(CBlockTreeDB* pblocktreeIn, CCoinsViewDB* pcoinsdbIn, CZerocoinDB* pzerocoindbIn, uint64_t nEpoch);
+
+    /** Worker thread, commits the pending epoch when interrupted */
+    void Thread();
+
+    /** Number the next flush */
+    uint64_t NewEpoch();
+    /** Write the block index journal of an epoch with the next batch of the coin database */
+    void WriteJournal(uint64_t nEpoch, const CBlockIndexJournal& journal);
+
+    /** Make an epoch durable, once its block files are synced. False after a failed commit */
+    bool Schedule(uint64_t nEpoch);
+    /** Wait until an epoch is durable */
+    bool WaitForEpoch(uint64_t nEpoch);
+
+    uint64_t GetDurableEpoch() const;
+    /** The reason a commit failed, empty if none did */
+    std::string GetError() const;
+    CFlushSchedulerStats GetStats() const;
+};
+
+/**
+ * Sync the block and undo files a flush wrote to. This runs before the chainstate of the flush
+ * is written, so the coins and the block index journal never reach the disk ahead of the
+ * blocks they refer to.
+ */
+bool CommitBlockFiles(const std::set<int>& setFiles, std::string& strError);
+
+/**
+ * Write the block index journals of epochs that were not durable at a crash from the coin
+ * database back to the block tree, before the block index is loaded. nEpoch is set to the
+ * last epoch that was written. Fails if a replayed block is missing from its file, which
+ * needs a reindex.
+ */
+bool ReplayBlockIndexJournal(CCoinsViewDB& coinsdb, CBlockTreeDB& blocktree, uint64_t& nEpoch);
+
+extern CFlushScheduler flushscheduler;
+
+#endif // SIMPLICITY_FLUSHSCHEDULER_H
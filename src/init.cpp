@@ -14,10 +14,15 @@
 
 #include "zspl/accumulators.h"
 #include "activemasternode.h"
+#include "addressindex.h"
 #include "addrman.h"
 #include "amount.h"
+#include "blockstats.h"
 #include "checkpoints.h"
+#include "coinsprefetch.h"
 #include "compat/sanity.h"
+#include "crypto/sha256.h"
+#include "flushscheduler.h"
 #include "httpserver.h"
 #include "httprpc.h"
 #include "invalid.h"
@@ -26,16 +31,20 @@
 #include "masternode-budget.h"
 #include "masternode-payments.h"
 #include "masternodeconfig.h"
+#include "masternodedb.h"
 #include "masternodeman.h"
 #include "miner.h"
 #include "net.h"
+#include "obfuscation.h"
 #include "rpc/server.h"
 #include "script/standard.h"
 #include "scheduler.h"
+#include "snapshot.h"
 #include "spork.h"
 #include "sporkdb.h"
 #include "txdb.h"
 #include "torcontrol.h"
+#include "trace.h"
 #include "guiinterface.h"
 #include "util.h"
 #include "utilmoneystr.h"
@@ -211,6 +220,8 @@ void PrepareShutdown()
     DumpMasternodes();
     DumpBudgets();
     DumpMasternodePayments();
+    delete pmnStateDB;
+    pmnStateDB = NULL;
     UnregisterNodeSignals(GetNodeSignals());
 
     // After everything has been shut down, but before things get flushed, stop the
@@ -230,12 +241,14 @@ void PrepareShutdown()
 
     {
         LOCK(cs_main);
+        coinsprefetcher.SetView(NULL);
         if (pcoinsTip != NULL) {
             FlushStateToDisk();
 
             //record that client took the proper shutdown procedure
             pblocktree->WriteFlag("shutdown", true);
         }
+        flushscheduler.SetDatabases(NULL, NULL, NULL, 0);
         delete pcoinsTip;
         pcoinsTip = NULL;
         delete pcoinscatcher;
@@ -387,10 +400,15 @@ std::string HelpMessage(HelpMessageMode mode)
     std::string strUsage = HelpMessageGroup(_("Options:"));
     strUsage += HelpMessageOpt("-?", _("This help message"));
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
+    strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain a full address index, used by the getaddressbalance, getaddressutxos and getaddresstxids rpc calls (default: %u)"), DEFAULT_ADDRESSINDEX));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
     strUsage += HelpMessageOpt("-alerts", strprintf(_("Receive and display P2P network alerts (default: %u)"), DEFAULT_ALERTS));
+    strUsage += HelpMessageOpt("-blockcache=<n>", strprintf(_("Keep up to <n> megabytes of recently read blocks deserialized in memory (default: %u)"), DEFAULT_BLOCK_CACHE));
+    strUsage += HelpMessageOpt("-blockmmapfiles=<n>", strprintf(_("Memory-map up to <n> block files that are no longer written to, 0 to read them with file I/O (default: %u)"), DEFAULT_BLOCK_MMAP_FILES));
+    strUsage += HelpMessageOpt("-blockreadahead=<n>", strprintf(_("Prefetch <n> megabytes ahead of sequential block reads (default: %u)"), DEFAULT_BLOCK_READAHEAD));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     strUsage += HelpMessageOpt("-blocksizenotify=<cmd>", _("Execute command when the best block changes and its size is over (%s in cmd is replaced by block hash, %d with the block size)"));
+    strUsage += HelpMessageOpt("-blockstatsindex", strprintf(_("Maintain per-block fee and transaction statistics, used by the getblockindexstats and getfeeinfo rpc calls (default: %u)"), 1));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), 500));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), "simplicity.conf"));
     if (mode == HMM_BITCOIND) {
@@ -401,16 +419,22 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-loadtxoutset=<file>", _("Bootstrap a new data directory from a chainstate snapshot written by dumptxoutset, blocks up to its base are not downloaded or validated") + " " + _("on startup") + ". " + _("Only regtest accepts snapshots until snapshot hashes are listed for the other networks") + ". " + _("Such a node runs in -litemode"));
     strUsage += HelpMessageOpt("-maxreorg=<n>", strprintf(_("Set the Maximum reorg depth (default: %u)"), Params(CBaseChainParams::MAIN).MaxReorganizationDepth()));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), "simplicityd.pid"));
 #endif
+    strUsage += HelpMessageOpt("-prefetchthreads=<n>", strprintf(_("Set the number of threads reading the coins of blocks ahead of their validation (0 to %d, default: %d)"), MAX_PREFETCH_THREADS, DEFAULT_PREFETCH_THREADS));
+    strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by pruning (deleting) old blocks. This mode disables wallet rescans beyond the kept blocks, masternode and budget processing (-litemode) and is incompatible with -txindex and -masternode. "
+            "Warning: Reverting this setting requires re-downloading the entire blockchain. "
+            "(default: 0 = disable pruning blocks, >%u = target size in MiB to use for block files)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild block chain index from current blk000??.dat files") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-reindexaccumulators", _("Reindex the accumulator database") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-reindexmoneysupply", _("Reindex the SPL and zSPL money supply statistics") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-resync", _("Delete blockchain folders and resync from scratch") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain a full spent output index, used by the getspentinfo rpc call (default: %u)"), DEFAULT_SPENTINDEX));
 #if !defined(WIN32)
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
@@ -501,6 +525,11 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkpoints", strprintf(_("Only accept block chain matching built-in checkpoints (default: %u)"), 1));
+        strUsage += HelpMessageOpt("-dbcachesplit=<db>:<n>", _("Give <n> percent of -dbcache to the blockindex, chainstate or zerocoin database, the rest is used for coins in memory"));
+        strUsage += HelpMessageOpt("-dbmaxopenfiles=[<db>:]<n>", strprintf(_("Let LevelDB keep at most <n> files open, for all databases or the named one (default: %u)"), 64));
+        strUsage += HelpMessageOpt("-dbblocksize=[<db>:]<n>", strprintf(_("Set the LevelDB block size in kilobytes, for all databases or the named one (default: %u)"), 4));
+        strUsage += HelpMessageOpt("-dbwritebuffer=[<db>:]<n>", _("Set the LevelDB write buffer in megabytes, for all databases or the named one (default: a quarter of its cache)"));
+        strUsage += HelpMessageOpt("-dbcompression=[<db>:]<n>", strprintf(_("Compress LevelDB blocks with Snappy if LevelDB was built with it, for all databases or the named one (default: %u)"), 0));
         strUsage += HelpMessageOpt("-dblogsize=<n>", strprintf(_("Flush database activity from memory pool to disk log every <n> megabytes (default: %u)"), 100));
         strUsage += HelpMessageOpt("-disablesafemode", strprintf(_("Disable safemode, override a real safe mode event (default: %u)"), 0));
         strUsage += HelpMessageOpt("-testsafemode", strprintf(_("Force safe mode (default: %u)"), 0));
@@ -509,9 +538,11 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-flushwallet", strprintf(_("Run a thread to flush wallet periodically (default: %u)"), 1));
         strUsage += HelpMessageOpt("-maxreorg", strprintf(_("Use a custom max chain reorganization depth (default: %u)"), 100));
         strUsage += HelpMessageOpt("-stopafterblockimport", strprintf(_("Stop running after importing blocks from disk (default: %u)"), 0));
+        strUsage += HelpMessageOpt("-trace", strprintf(_("Start tracing validation and networking at startup, see the trace rpc call (default: %u)"), 0));
+        strUsage += HelpMessageOpt("-tracebuffer=<n>", strprintf(_("Keep the last <n> trace events of each thread (default: %u)"), DEFAULT_TRACE_BUFFER));
         strUsage += HelpMessageOpt("-sporkkey=<privkey>", _("Enable spork administration functionality with the appropriate private key."));
     }
-    std::string debugCategories = "addrman, alert, bench, coindb, db, lock, rand, rpc, selectcoins, tor, mempool, net, proxy, http, libevent, simplicity, (obfuscation, swiftx, masternode, mnpayments, mnbudget, zero, precompute, staking)"; // Don't translate these and qt below
+    std::string debugCategories = "addrman, alert, bench, blockstore, coindb, db, lock, rand, rpc, selectcoins, tor, mempool, net, proxy, http, libevent, simplicity, (obfuscation, swiftx, masternode, mnpayments, mnbudget, zero, precompute, staking)"; // Don't translate these and qt below
     if (mode == HMM_BITCOIN_QT)
         debugCategories += ", qt";
     strUsage += HelpMessageOpt("-debug=<category>", strprintf(_("Output debugging information (default: %u, supplying <category> is optional)"), 0) + ". " +
@@ -653,6 +684,46 @@ static void BlockSizeNotifyCallback(int size, const uint256& hashNewTip)
     boost::thread t(runCommand, strCmd); // thread runs free
 }
 
+// If we're using -prune with -reindex, then delete block files that will be ignored by the
+// reindex.  Since reindexing works by starting at block file 0 and looping until a blockfile
+// is missing, do the same here to delete any later block files after a gap.  Also delete all
+// rev files since they'll be rewritten by the reindex anyway.  This ensures that vinfoBlockFile
+// is in sync with what's actually on disk by the time we start downloading, so that pruning
+// works correctly.
+static void CleanupBlockRevFiles()
+{
+    std::map<std::string, boost::filesystem::path> mapBlockFiles;
+
+    // Glob all blk?????.dat and rev?????.dat files from the blocks directory.
+    // Remove the rev files immediately and insert the blk file paths into an
+    // ordered map keyed by block file index.
+    LogPrintf("Removing unusable blk?????.dat and rev?????.dat files for -reindex with -prune\n");
+    boost::filesystem::path blocksdir = GetDataDir() / "blocks";
+    for (boost::filesystem::directory_iterator it(blocksdir); it != boost::filesystem::directory_iterator(); it++) {
+        if (boost::filesystem::is_regular_file(*it) &&
+            it->path().filename().string().length() == 12 &&
+            it->path().filename().string().substr(8, 4) == ".dat") {
+            if (it->path().filename().string().substr(0, 3) == "blk")
+                mapBlockFiles[it->path().filename().string().substr(3, 5)] = it->path();
+            else if (it->path().filename().string().substr(0, 3) == "rev")
+                remove(it->path());
+        }
+    }
+
+    // Remove all block files that aren't part of a contiguous set starting at
+    // zero by walking the ordered map (keys are block file indices) by
+    // keeping a separate counter.  Once we hit a gap (or if 0 doesn't exist)
+    // start removing block files.
+    int nContigCounter = 0;
+    for (const std::pair<std::string, boost::filesystem::path>& item : mapBlockFiles) {
+        if (atoi(item.first) == nContigCounter) {
+            nContigCounter++;
+            continue;
+        }
+        remove(item.second);
+    }
+}
+
 struct CImportingNow {
     CImportingNow()
     {
@@ -726,6 +797,25 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
     }
 }
 
+void ThreadCoinsPrefetch()
+{
+    coinsprefetcher.Thread();
+}
+
+void ThreadFlushScheduler()
+{
+    flushscheduler.Thread();
+}
+
+/** Compute the UTXO set commitment of a chainstate written before it was maintained */
+void ThreadCoinsCommitment()
+{
+    RenameThread("simplicity-utxohash");
+
+    if (!pcoinsdbview->RebuildCommitment())
+        LogPrintf("%s : failed to compute the UTXO set commitment\n", __func__);
+}
+
 /** Sanity checks
  *  Ensure that Simplicity is running in a usable environment with all
  *  necessary library support.
@@ -900,6 +990,21 @@ bool AppInit2()
             LogPrintf("AppInit2 : parameter interaction: -zapwallettxes=<mode> -> setting -rescan=1\n");
     }
 
+    // if using block pruning, then disable txindex
+    if (GetArg("-prune", 0)) {
+        if (GetBoolArg("-txindex", false) && mapArgs.count("-txindex"))
+            return InitError(_("Prune mode is incompatible with -txindex."));
+        if (SoftSetBoolArg("-txindex", false))
+            LogPrintf("AppInit2 : parameter interaction: -prune set -> setting -txindex=0\n");
+        // budget collateral transactions are only in the block files, their outputs never reach the coins
+        if (GetBoolArg("-masternode", false))
+            return InitError(_("Prune mode is incompatible with -masternode."));
+        if (!GetBoolArg("-litemode", false) && mapArgs.count("-litemode"))
+            return InitError(_("Prune mode requires -litemode."));
+        if (SoftSetBoolArg("-litemode", true))
+            LogPrintf("AppInit2 : parameter interaction: -prune set -> setting -litemode=1\n");
+    }
+
     if (!GetBoolArg("-enableswifttx", fEnableSwiftTX)) {
         if (SoftSetArg("-swifttxdepth", "0"))
             LogPrintf("AppInit2 : parameter interaction: -enableswifttx=false -> setting -nSwiftTXDepth=0\n");
@@ -951,6 +1056,10 @@ bool AppInit2()
     fCheckBlockIndex = GetBoolArg("-checkblockindex", Params().DefaultConsistencyChecks());
     Checkpoints::fEnabled = GetBoolArg("-checkpoints", true);
 
+    SetTraceBufferSize(std::max<int64_t>(1, std::min<int64_t>(GetArg("-tracebuffer", DEFAULT_TRACE_BUFFER), 1 << 24)));
+    if (GetBoolArg("-trace", false))
+        StartTrace();
+
     // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
     nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
     if (nScriptCheckThreads <= 0)
@@ -1047,10 +1156,29 @@ bool AppInit2()
 
     }
 
+    // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
+    int64_t nSignedPruneTarget = GetArg("-prune", 0) * 1024 * 1024;
+    if (nSignedPruneTarget < 0) {
+        return InitError(_("Prune cannot be configured with a negative value."));
+    }
+    nPruneTarget = (uint64_t)nSignedPruneTarget;
+    if (nPruneTarget) {
+        if (nPruneTarget < MIN_DISK_SPACE_FOR_BLOCK_FILES) {
+            return InitError(strprintf(_("Prune configured below the minimum of %d MiB.  Please use a higher number."), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+        }
+        LogPrintf("Prune configured to target %uMiB on disk for block and undo files.\n", nPruneTarget / 1024 / 1024);
+        fPruneMode = true;
+        // Old blocks may be gone, so don't claim to serve the full chain
+        nLocalServices &= ~NODE_NETWORK;
+    }
+
     nMaxTipAge = GetArg("-maxtipage", DEFAULT_MAX_TIP_AGE);
 
     // ********************************************************* Step 4: application initialization: dir lock, daemonize, pidfile, debug log
 
+    // Pick the SHA-256 implementation before other threads start hashing
+    std::string sha256_algo = SHA256AutoDetect();
+
     // Initialize elliptic curve code
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1083,6 +1211,7 @@ bool AppInit2()
     LogPrintf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
     LogPrintf("Simplicity version %s (%s)\n", FormatFullVersion(), CLIENT_DATE);
     LogPrintf("Using OpenSSL version %s\n", SSLeay_version(SSLEAY_VERSION));
+    LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
 #ifdef ENABLE_WALLET
     LogPrintf("Using BerkeleyDB version %s\n", DbEnv::version(0, 0, 0));
 #endif
@@ -1098,6 +1227,8 @@ bool AppInit2()
     if (nScriptCheckThreads) {
         for (int i = 0; i < nScriptCheckThreads - 1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+            threadGroup.create_thread(&ThreadMessageSigCheck);
     }
 
     if (mapArgs.count("-sporkkey")) // spork priv key
@@ -1421,6 +1552,10 @@ bool AppInit2()
     // Create blocks directory if it doesn't already exist
     boost::filesystem::create_directories(GetDataDir() / "blocks");
 
+    // cleanup the block and rev files a pruned node can't reindex from
+    if (fReindex && fPruneMode)
+        CleanupBlockRevFiles();
+
     // cache size calculations
     size_t nTotalCache = (GetArg("-dbcache", nDefaultDbCache) << 20);
     if (nTotalCache < (nMinDbCache << 20))
@@ -1430,11 +1565,24 @@ bool AppInit2()
     size_t nBlockTreeDBCache = nTotalCache / 8;
     if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", true))
         nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
-    nTotalCache -= nBlockTreeDBCache;
-    size_t nCoinDBCache = nTotalCache / 2; // use half of the remaining cache for coindb cache
-    nTotalCache -= nCoinDBCache;
+    size_t nCoinDBCache = (nTotalCache - nBlockTreeDBCache) / 2; // use half of the remaining cache for coindb cache
+    size_t nZerocoinDBCache = 0;
+    int64_t nCachePercent;
+    if (GetDBArg("-dbcachesplit", "blockindex", nCachePercent))
+        nBlockTreeDBCache = nTotalCache / 100 * std::max<int64_t>(0, std::min<int64_t>(nCachePercent, 100));
+    if (GetDBArg("-dbcachesplit", "chainstate", nCachePercent))
+        nCoinDBCache = nTotalCache / 100 * std::max<int64_t>(0, std::min<int64_t>(nCachePercent, 100));
+    if (GetDBArg("-dbcachesplit", "zerocoin", nCachePercent))
+        nZerocoinDBCache = nTotalCache / 100 * std::max<int64_t>(0, std::min<int64_t>(nCachePercent, 100));
+    if (nBlockTreeDBCache + nCoinDBCache + nZerocoinDBCache >= nTotalCache)
+        return InitError(_("-dbcachesplit leaves no cache for the in-memory coins"));
+    nTotalCache -= nBlockTreeDBCache + nCoinDBCache + nZerocoinDBCache;
     nCoinCacheSize = nTotalCache / 300; // coins in memory require around 300 bytes
 
+    blockstore.SetLimits(std::max<int64_t>(0, GetArg("-blockcache", DEFAULT_BLOCK_CACHE)) << 20,
+        GetArg("-blockmmapfiles", DEFAULT_BLOCK_MMAP_FILES),
+        std::max<int64_t>(0, std::min<int64_t>(GetArg("-blockreadahead", DEFAULT_BLOCK_READAHEAD), 64)) << 20);
+
     bool fLoaded = false;
     while (!fLoaded && !ShutdownRequested()) {
         bool fReset = fReindex;
@@ -1447,6 +1595,7 @@ bool AppInit2()
 
             try {
                 UnloadBlockIndex();
+                flushscheduler.SetDatabases(NULL, NULL, NULL, 0);
                 delete pcoinsTip;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
@@ -1455,7 +1604,7 @@ bool AppInit2()
                 delete pSporkDB;
 
                 //Simplicity specific: zerocoin and spork DB's
-                zerocoinDB = new CZerocoinDB(0, false, fReindex);
+                zerocoinDB = new CZerocoinDB(nZerocoinDBCache, false, fReindex);
                 pSporkDB = new CSporkDB(0, false, false);
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
@@ -1469,10 +1618,46 @@ bool AppInit2()
                 // End loop if shutdown was requested
                 if (ShutdownRequested()) break;
 
+                // A snapshot is only loaded into empty databases, so the option can stay set
+                if (mapArgs.count("-loadtxoutset") && !fReindex) {
+                    if (pcoinsdbview->GetBestBlock() == uint256(0)) {
+                        uiInterface.InitMessage(_("Loading chainstate snapshot..."));
+                        CSnapshotInfo info;
+                        std::string strError;
+                        if (!LoadChainstateSnapshot(GetArg("-loadtxoutset", ""), *pcoinsdbview, *pblocktree, *zerocoinDB, info, strError)) {
+                            if (ShutdownRequested()) break;
+                            strLoadError = strprintf("%s : %s", _("Error loading chainstate snapshot"), strError);
+                            break;
+                        }
+                    } else {
+                        LogPrintf("Chainstate is not empty, ignoring -loadtxoutset\n");
+                    }
+                }
+
+                // A snapshot base without a best block is a snapshot load that did not finish
+                uint256 hashSnapshotBase;
+                if (pcoinsdbview->GetBestBlock() == uint256(0) && pblocktree->ReadSnapshotBase(hashSnapshotBase)) {
+                    strLoadError = _("Loading the chainstate snapshot did not finish, restart with -loadtxoutset to load it again or with -reindex");
+                    break;
+                }
+
                 // Simplicity: load previous sessions sporks if we have them.
                 uiInterface.InitMessage(_("Loading sporks..."));
                 LoadSporksFromDB();
 
+                // Blocks connected while the block stats index is disabled are backfilled once it is enabled again
+                fBlockStatsIndex = GetBoolArg("-blockstatsindex", true);
+                if (!fBlockStatsIndex)
+                    pblocktree->WriteFlag("blockstatsindex", false);
+
+                // Block index updates of flushes that were not durable at a crash
+                uint64_t nFlushEpoch = 0;
+                if (!ReplayBlockIndexJournal(*pcoinsdbview, *pblocktree, nFlushEpoch)) {
+                    strLoadError = _("Error replaying the block index journal");
+                    break;
+                }
+                flushscheduler.SetDatabases(pblocktree, pcoinsdbview, zerocoinDB, nFlushEpoch);
+
                 uiInterface.InitMessage(_("Loading block index..."));
                 std::string strBlockIndexError = "";
                 if (!LoadBlockIndex(strBlockIndexError)) {
@@ -1499,6 +1684,23 @@ bool AppInit2()
                     break;
                 }
 
+                // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
+                // in the past, but is now trying to run unpruned.
+                if (fHavePruned && !fPruneMode && !pblocktree->ReadSnapshotBase(hashSnapshotBase)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to go back to unpruned mode.  This will redownload the entire blockchain");
+                    break;
+                }
+
+                // Check for changed -addressindex and -spentindex state
+                if (fAddressIndex != GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to change -addressindex");
+                    break;
+                }
+                if (fSpentIndex != GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to change -spentindex");
+                    break;
+                }
+
                 // Populate list of invalid/fraudulent outpoints that are banned from the chain
                 invalid_out::LoadOutpoints();
                 invalid_out::LoadSerials();
@@ -1610,6 +1812,13 @@ bool AppInit2()
         return false;
     }
 
+    // Blocks below a loaded snapshot base were never downloaded, so don't claim to serve the full chain
+    uint256 hashSnapshotBase;
+    if (pblocktree->ReadSnapshotBase(hashSnapshotBase)) {
+        fSnapshotChain = true;
+        nLocalServices &= ~NODE_NETWORK;
+    }
+
     boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fopen(est_path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -1713,6 +1922,16 @@ bool AppInit2()
                 pindexRescan = chainActive.Genesis();
         }
         if (chainActive.Tip() && chainActive.Tip() != pindexRescan) {
+            // We can't rescan beyond pruned data, stop and throw an error
+            if (fHavePruned) {
+                CBlockIndex* block = chainActive.Tip();
+                while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA) && block->pprev->nTx > 0 && pindexRescan != block)
+                    block = block->pprev;
+
+                if (pindexRescan != block)
+                    return InitError(_("Prune: last wallet synchronisation goes beyond pruned data. You need to -reindex (download the whole blockchain again in case of pruned node)"));
+            }
+
             uiInterface.InitMessage(_("Rescanning..."));
             LogPrintf("Rescanning last %i blocks (from block %i)...\n", chainActive.Height() - pindexRescan->nHeight, pindexRescan->nHeight);
             const int64_t nWalletRescanTime = GetTimeMillis();
@@ -1761,6 +1980,15 @@ bool AppInit2()
 #else  // ENABLE_WALLET
     LogPrintf("No wallet compiled in!\n");
 #endif // !ENABLE_WALLET
+    // if pruning, perform the initial blockstore prune
+    // after any wallet rescanning has taken place.
+    if (fPruneMode) {
+        if (!fReindex) {
+            uiInterface.InitMessage(_("Pruning blockstore..."));
+            PruneAndFlush();
+        }
+    }
+
     // ********************************************************* Step 9: import blocks
 
     if (mapArgs.count("-blocknotify"))
@@ -1779,7 +2007,19 @@ bool AppInit2()
         for (std::string strFile : mapMultiArgs["-loadblock"])
             vImportFiles.push_back(strFile);
     }
+    int nPrefetchThreads = std::max(0, std::min((int)GetArg("-prefetchthreads", DEFAULT_PREFETCH_THREADS), MAX_PREFETCH_THREADS));
+    if (nPrefetchThreads) {
+        coinsprefetcher.SetView(pcoinsdbview);
+        for (int i = 0; i < nPrefetchThreads; i++)
+            threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "coinsprefetch", &ThreadCoinsPrefetch));
+    }
+    threadGroup.create_thread(&ThreadFlushScheduler);
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
+    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "blockstats", &ThreadBlockStatsBackfill));
+    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "spendindex", &ThreadZerocoinSpendIndex));
+    if (!pcoinsdbview->HaveCommitment())
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "utxohash", &ThreadCoinsCommitment));
+    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "snapshotcheck", &ThreadSnapshotValidation));
     if (chainActive.Tip() == NULL) {
         LogPrintf("Waiting for genesis block to be imported...\n");
         while (!fRequestShutdown && chainActive.Tip() == NULL)
@@ -1788,6 +2028,12 @@ bool AppInit2()
 
     // ********************************************************* Step 10: setup ObfuScation
 
+    try {
+        pmnStateDB = new CMasternodeStateDB(0, false, false);
+    } catch (std::exception& e) {
+        return InitError(strprintf(_("Error opening masternode state database: %s"), e.what()));
+    }
+
     uiInterface.InitMessage(_("Loading masternode cache..."));
 
     CMasternodeDB mndb;
@@ -1913,6 +2159,17 @@ bool AppInit2()
         return InitError("You can not start a masternode in litemode");
     }
 
+    // Below a snapshot base there are no blocks to read budget collaterals from
+    if (fSnapshotChain) {
+        if (fMasterNode)
+            return InitError(_("A node bootstrapped from a chainstate snapshot can not run a masternode."));
+        if (!fLiteMode && mapArgs.count("-litemode"))
+            return InitError(_("A node bootstrapped from a chainstate snapshot requires -litemode."));
+        if (!fLiteMode)
+            LogPrintf("AppInit2 : chainstate snapshot loaded -> setting -litemode=1\n");
+        fLiteMode = true;
+    }
+
     LogPrintf("fLiteMode %d\n", fLiteMode);
     LogPrintf("nSwiftTXDepth %d\n", nSwiftTXDepth);
     LogPrintf("Budget Mode %s\n", strBudgetMode.c_str());
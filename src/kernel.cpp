@@ -10,6 +10,7 @@
 #include "kernel.h"
 #include "script/interpreter.h"
 #include "timedata.h"
+#include "trace.h"
 #include "util.h"
 #include "stakeinput.h"
 #include "utilmoneystr.h"
@@ -333,10 +334,10 @@ bool GetHashProofOfStake(const CBlockIndex* pindexPrev, CStakeInput* stake, cons
         modifier_ss << pindexPrev->nStakeModifierV2;
     }
 
-    CDataStream ss(modifier_ss);
-    // Calculate hash
-    ss << nTimeBlockFrom << ssUniqueID << nTimeTx;
-    hashProofOfStakeRet = Hash(ss.begin(), ss.end());
+    // Calculate hash, streaming the kernel into the hasher rather than copying it into a buffer first
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << modifier_ss << nTimeBlockFrom << ssUniqueID << nTimeTx;
+    hashProofOfStakeRet = ss.GetHash();
 
     if (fVerify) {
         LogPrint("staking", "%s :{ nStakeModifier=%s\n"
@@ -349,6 +350,7 @@ bool GetHashProofOfStake(const CBlockIndex* pindexPrev, CStakeInput* stake, cons
 
 bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int nBits, unsigned int& nTimeTx, uint256& hashProofOfStake)
 {
+    TRACE_SCOPE("staking", "Stake");
     if (CBlockHeader::CURRENT_VERSION == Params().WALLET_UPGRADE_VERSION() && chainActive.Height() + 1 < Params().WALLET_UPGRADE_BLOCK() && Params().NetworkID() == CBaseChainParams::MAIN)
         return error("%s : INFO: staking on new wallet disabled until block %d", __func__, Params().WALLET_UPGRADE_BLOCK()); // Do not stake until the upgrade block
 
@@ -445,18 +447,25 @@ bool initStakeInput(const CBlock block, std::unique_ptr<CStakeInput>& stake, int
         // First try finding the previous transaction in database
         uint256 hashBlock;
         CTransaction txPrev;
-        if (!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true))
-            return error("%s : INFO: read txPrev failed, tx id prev: %s, block id %s",
-                         __func__, txin.prevout.hash.GetHex(), block.GetHash().GetHex());
+        std::unique_ptr<CSplStake> splInput(new CSplStake());
+        if (GetTransaction(txin.prevout.hash, txPrev, hashBlock, true)) {
+            if (txin.prevout.n >= txPrev.vout.size())
+                return error("%s : invalid kernel output %s", __func__, txin.prevout.ToString());
+            splInput->SetInput(txPrev, txin.prevout.n);
+        } else {
+            // The block of the previous transaction may be pruned, fall back to the unspent coins
+            CCoins coins;
+            if (!fPruneMode || !pcoinsTip->GetCoins(txin.prevout.hash, coins) || !splInput->SetInput(txin.prevout.hash, coins, txin.prevout.n))
+                return error("%s : INFO: read txPrev failed, tx id prev: %s, block id %s",
+                             __func__, txin.prevout.hash.GetHex(), block.GetHash().GetHex());
+        }
 
         //verify signature and script
         ScriptError serror = SCRIPT_ERR_OK;
-        if (!VerifyScript(txin.scriptSig, txPrev.vout[txin.prevout.n].scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0), &serror))
+        if (!VerifyScript(txin.scriptSig, splInput->GetScriptFrom(), STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 0), &serror))
             return error("%s : VerifySignature failed on coinstake %s, %s", __func__, tx.GetHash().ToString().c_str(), ScriptErrorString(serror));
 
-        CSplStake* splInput = new CSplStake();
-        splInput->SetInput(txPrev, txin.prevout.n);
-        stake = std::unique_ptr<CStakeInput>(splInput);
+        stake = std::unique_ptr<CStakeInput>(splInput.release());
     }
     return true;
 }
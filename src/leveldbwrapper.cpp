@@ -4,9 +4,15 @@
 
 #include "leveldbwrapper.h"
 
+#include "sync.h"
 #include "util.h"
 
+#include <stdio.h>
+#include <sstream>
+
 #include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
@@ -27,14 +33,65 @@ void HandleError(const leveldb::Status& status)
     throw leveldb_error("Unknown database error");
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+CLevelDBOptions::CLevelDBOptions(const std::string& strNameIn, size_t nCacheSize) : strName(strNameIn),
+                                                                                    nBlockCacheSize(nCacheSize / 2),
+                                                                                    nWriteBufferSize(nCacheSize / 4), // up to two write buffers may be held in memory simultaneously
+                                                                                    nMaxOpenFiles(64),
+                                                                                    nBlockSize(4096),
+                                                                                    fCompression(false)
+{
+}
+
+bool GetDBArg(const std::string& strArg, const std::string& strName, int64_t& nValue)
+{
+    std::map<std::string, std::vector<std::string> >::const_iterator it = mapMultiArgs.find(strArg);
+    if (it == mapMultiArgs.end())
+        return false;
+
+    bool fFound = false, fNamed = false;
+    for (const std::string& strEntry : it->second) {
+        size_t nSep = strEntry.find(':');
+        bool fEntryNamed = nSep != std::string::npos;
+        if (fEntryNamed && strEntry.substr(0, nSep) != strName)
+            continue;
+        if (fNamed && !fEntryNamed)
+            continue;
+        try {
+            nValue = boost::lexical_cast<int64_t>(fEntryNamed ? strEntry.substr(nSep + 1) : strEntry);
+        } catch (const boost::bad_lexical_cast&) {
+            LogPrintf("%s : ignoring invalid %s=%s\n", __func__, strArg, strEntry);
+            continue;
+        }
+        fFound = true;
+        fNamed = fEntryNamed;
+    }
+    return fFound;
+}
+
+CLevelDBOptions DBOptionsFromArgs(const std::string& strName, size_t nCacheSize)
+{
+    CLevelDBOptions dboptions(strName, nCacheSize);
+    int64_t nValue;
+    if (GetDBArg("-dbmaxopenfiles", strName, nValue) && nValue > 0)
+        dboptions.nMaxOpenFiles = std::max<int64_t>(nValue, 20); // LevelDB needs a few descriptors for logs and the manifest
+    if (GetDBArg("-dbblocksize", strName, nValue) && nValue > 0)
+        dboptions.nBlockSize = nValue << 10;
+    if (GetDBArg("-dbwritebuffer", strName, nValue) && nValue > 0)
+        dboptions.nWriteBufferSize = nValue << 20;
+    if (GetDBArg("-dbcompression", strName, nValue))
+        dboptions.fCompression = nValue != 0;
+    return dboptions;
+}
+
+static leveldb::Options GetOptions(const CLevelDBOptions& dboptions)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
+    options.block_cache = leveldb::NewLRUCache(dboptions.nBlockCacheSize);
+    options.write_buffer_size = dboptions.nWriteBufferSize;
     options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.compression = dboptions.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = dboptions.nMaxOpenFiles;
+    options.block_size = dboptions.nBlockSize;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -43,14 +100,21 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe)
+namespace
+{
+//! open on-disk databases by name, for reporting and maintenance
+CCriticalSection cs_openDBs;
+std::map<std::string, CLevelDBWrapper*> mapOpenDBs;
+} // namespace
+
+CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& pathIn, const CLevelDBOptions& dboptionsIn, bool fMemoryIn, bool fWipe) : dboptions(dboptionsIn), path(pathIn), fMemory(fMemoryIn), nManualCompactions(0)
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(dboptions);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -66,10 +130,23 @@ CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCa
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     HandleError(status);
     LogPrintf("Opened LevelDB successfully\n");
+    LogPrint("db", "%s options: block cache %u, write buffer %u, block size %u, max open files %d, compression %u\n",
+        dboptions.strName, dboptions.nBlockCacheSize, dboptions.nWriteBufferSize, dboptions.nBlockSize, dboptions.nMaxOpenFiles, dboptions.fCompression);
+
+    if (!fMemory) {
+        LOCK(cs_openDBs);
+        mapOpenDBs[dboptions.strName] = this;
+    }
 }
 
 CLevelDBWrapper::~CLevelDBWrapper()
 {
+    if (!fMemory) {
+        LOCK(cs_openDBs);
+        std::map<std::string, CLevelDBWrapper*>::iterator it = mapOpenDBs.find(dboptions.strName);
+        if (it != mapOpenDBs.end() && it->second == this)
+            mapOpenDBs.erase(it);
+    }
     delete pdb;
     pdb = NULL;
     delete options.filter_policy;
@@ -86,3 +163,82 @@ bool CLevelDBWrapper::WriteBatch(CLevelDBBatch& batch, bool fSync)
     HandleError(status);
     return true;
 }
+
+bool CLevelDBWrapper::EraseAll()
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    pcursor->SeekToFirst();
+    while (pcursor->Valid()) {
+        CLevelDBBatch batch;
+        for (int i = 0; i < 10000 && pcursor->Valid(); i++, pcursor->Next())
+            batch.EraseSerialized(pcursor->key().ToString());
+        WriteBatch(batch);
+    }
+    HandleError(pcursor->status());
+    return Sync();
+}
+
+bool CLevelDBWrapper::GetProperty(const std::string& strProperty, std::string& strValue) const
+{
+    return pdb->GetProperty(strProperty, &strValue);
+}
+
+uint64_t CLevelDBWrapper::GetApproximateSize() const
+{
+    // keys start with a type character, so this range covers all entries
+    leveldb::Range range(std::string(1, '\x00'), std::string(1, '\xff'));
+    uint64_t nSize = 0;
+    pdb->GetApproximateSizes(&range, 1, &nSize);
+    return nSize;
+}
+
+std::vector<CLevelDBLevelStats> CLevelDBWrapper::GetLevelStats() const
+{
+    std::vector<CLevelDBLevelStats> vStats;
+    std::string strStats;
+    if (!GetProperty("leveldb.stats", strStats))
+        return vStats;
+
+    // three header lines, then one line per level that holds files or has been compacted
+    std::istringstream ss(strStats);
+    std::string strLine;
+    for (int i = 0; i < 3 && std::getline(ss, strLine); i++) {
+    }
+    while (std::getline(ss, strLine)) {
+        CLevelDBLevelStats stats;
+        if (sscanf(strLine.c_str(), "%d %d %lf %lf %lf %lf", &stats.nLevel, &stats.nFiles, &stats.dSizeMB, &stats.dTimeSec, &stats.dReadMB, &stats.dWriteMB) == 6)
+            vStats.push_back(stats);
+    }
+    return vStats;
+}
+
+void CLevelDBWrapper::Compact()
+{
+    LogPrintf("Compacting LevelDB in %s\n", path.string());
+    int64_t nStart = GetTimeMillis();
+    pdb->CompactRange(NULL, NULL);
+    nManualCompactions++;
+    LogPrintf("Compacted LevelDB in %s in %dms\n", path.string(), GetTimeMillis() - nStart);
+}
+
+bool ForEachLevelDB(const std::string& strName, const boost::function<void(CLevelDBWrapper&)>& fn)
+{
+    LOCK(cs_openDBs);
+    bool fFound = false;
+    for (std::map<std::string, CLevelDBWrapper*>::iterator it = mapOpenDBs.begin(); it != mapOpenDBs.end(); ++it) {
+        if (!strName.empty() && it->first != strName)
+            continue;
+        fn(*it->second);
+        fFound = true;
+    }
+    return fFound;
+}
+
+CLevelDBSnapshot::CLevelDBSnapshot(const CLevelDBWrapper& db) : pdb(db.pdb), snapshot(db.pdb->GetSnapshot())
+{
+}
+
+CLevelDBSnapshot::~CLevelDBSnapshot()
+{
+    pdb->ReleaseSnapshot(snapshot);
+}
@@ -11,7 +11,10 @@
 #include "util.h"
 #include "version.h"
 
+#include <algorithm>
+
 #include <boost/filesystem/path.hpp>
+#include <boost/function.hpp>
 
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
@@ -24,6 +27,42 @@ public:
 
 void HandleError(const leveldb::Status& status);
 
+/**
+ * Tuning of one database. The defaults give half of its cache to the block cache and a
+ * quarter to each of the two write buffers LevelDB may hold, without compression.
+ */
+struct CLevelDBOptions {
+    //! name the database is configured and reported by
+    std::string strName;
+    size_t nBlockCacheSize;
+    size_t nWriteBufferSize;
+    int nMaxOpenFiles;
+    size_t nBlockSize;
+    //! Snappy, if LevelDB was built with it
+    bool fCompression;
+
+    CLevelDBOptions(const std::string& strNameIn, size_t nCacheSize);
+};
+
+/**
+ * Value of a -db* argument for the named database: the last "<db>:<n>" entry for it,
+ * else the last plain "<n>" entry.
+ */
+bool GetDBArg(const std::string& strArg, const std::string& strName, int64_t& nValue);
+
+/** Options of the named database with its cache size and the -db* arguments applied */
+CLevelDBOptions DBOptionsFromArgs(const std::string& strName, size_t nCacheSize);
+
+/** Per-level compaction statistics, as reported in leveldb.stats */
+struct CLevelDBLevelStats {
+    int nLevel;
+    int nFiles;
+    double dSizeMB;
+    double dTimeSec;
+    double dReadMB;
+    double dWriteMB;
+};
+
 /** Batch of changes queued to be written to a CLevelDBWrapper */
 class CLevelDBBatch
 {
@@ -59,6 +98,34 @@ public:
 
         batch.Delete(slKey);
     }
+
+    //! Write an entry whose key and value are already serialized
+    void WriteSerialized(const std::string& strKey, const std::string& strValue)
+    {
+        batch.Put(strKey, strValue);
+    }
+
+    //! Erase an entry by its already serialized key
+    void EraseSerialized(const std::string& strKey)
+    {
+        batch.Delete(strKey);
+    }
+};
+
+class CLevelDBWrapper;
+
+/** Consistent read-only state of a database, released when destroyed */
+class CLevelDBSnapshot
+{
+private:
+    leveldb::DB* pdb;
+    const leveldb::Snapshot* snapshot;
+
+public:
+    explicit CLevelDBSnapshot(const CLevelDBWrapper& db);
+    ~CLevelDBSnapshot();
+
+    friend class CLevelDBWrapper;
 };
 
 class CLevelDBWrapper
@@ -85,10 +152,34 @@ private:
     //! the database itself
     leveldb::DB* pdb;
 
+    //! tuning the database was opened with
+    CLevelDBOptions dboptions;
+    boost::filesystem::path path;
+    bool fMemory;
+
+    //! compactions requested through Compact
+    int nManualCompactions;
+
 public:
-    CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CLevelDBWrapper(const boost::filesystem::path& path, const CLevelDBOptions& dboptions, bool fMemory = false, bool fWipe = false);
     ~CLevelDBWrapper();
 
+    const CLevelDBOptions& GetDBOptions() const { return dboptions; }
+    const boost::filesystem::path& GetPath() const { return path; }
+    int GetManualCompactions() const { return nManualCompactions; }
+
+    //! Value of a LevelDB property such as leveldb.stats
+    bool GetProperty(const std::string& strProperty, std::string& strValue) const;
+
+    //! Approximate size on disk of all entries
+    uint64_t GetApproximateSize() const;
+
+    //! Compaction statistics of the levels that hold files
+    std::vector<CLevelDBLevelStats> GetLevelStats() const;
+
+    //! Compact the whole key range, blocks until done
+    void Compact();
+
     template <typename K, typename V>
     bool Read(const K& key, V& value) const
     {
@@ -114,6 +205,48 @@ public:
         return true;
     }
 
+    /**
+     * Read a batch of keys from one consistent state of the database. The keys are looked
+     * up in their on-disk order so that neighbouring keys share table blocks. Returns the
+     * number of keys found, vFound holds them in that order.
+     */
+    template <typename K, typename V>
+    size_t ReadMany(const std::vector<K>& vKeys, std::vector<std::pair<K, V> >& vFound) const
+    {
+        std::vector<std::pair<std::string, size_t> > vSerialized;
+        vSerialized.reserve(vKeys.size());
+        for (size_t i = 0; i < vKeys.size(); i++) {
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            ssKey.reserve(ssKey.GetSerializeSize(vKeys[i]));
+            ssKey << vKeys[i];
+            vSerialized.push_back(std::make_pair(ssKey.str(), i));
+        }
+        std::sort(vSerialized.begin(), vSerialized.end());
+
+        CLevelDBSnapshot snapshot(*this);
+        leveldb::ReadOptions options = readoptions;
+        options.snapshot = snapshot.snapshot;
+        vFound.clear();
+        std::string strValue;
+        for (const std::pair<std::string, size_t>& key : vSerialized) {
+            leveldb::Status status = pdb->Get(options, key.first, &strValue);
+            if (!status.ok()) {
+                if (status.IsNotFound())
+                    continue;
+                LogPrintf("LevelDB read failure: %s\n", status.ToString());
+                HandleError(status);
+            }
+            try {
+                CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
+                V value;
+                ssValue >> value;
+                vFound.push_back(std::make_pair(vKeys[key.second], value));
+            } catch (const std::exception&) {
+            }
+        }
+        return vFound.size();
+    }
+
     template <typename K, typename V>
     bool Write(const K& key, const V& value, bool fSync = false)
     {
@@ -151,6 +284,9 @@ public:
 
     bool WriteBatch(CLevelDBBatch& batch, bool fSync = false);
 
+    //! Erase every entry, for a database whose content is started over
+    bool EraseAll();
+
     // not available for LevelDB; provide for compatibility with BDB
     bool Flush()
     {
@@ -168,6 +304,22 @@ public:
     {
         return pdb->NewIterator(iteroptions);
     }
+
+    //! Iterate over the state of the database when the snapshot was taken
+    leveldb::Iterator* NewIterator(const CLevelDBSnapshot& snapshot)
+    {
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = snapshot.snapshot;
+        return pdb->NewIterator(options);
+    }
+
+    friend class CLevelDBSnapshot;
 };
 
+/**
+ * Call fn for the open on-disk database with the given name, or for all of them if the
+ * name is empty. Databases cannot close meanwhile. Returns false if none matched.
+ */
+bool ForEachLevelDB(const std::string& strName, const boost::function<void(CLevelDBWrapper&)>& fn);
+
 #endif // BITCOIN_LEVELDBWRAPPER_H
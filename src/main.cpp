@@ -11,12 +11,17 @@
 
 #include "zspl/accumulators.h"
 #include "zspl/accumulatormap.h"
+#include "addressindex.h"
 #include "addrman.h"
 #include "alert.h"
+#include "blockimport.h"
 #include "blocksignature.h"
+#include "blockstats.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "coinsprefetch.h"
+#include "flushscheduler.h"
 #include "init.h"
 #include "kernel.h"
 #include "masternode-budget.h"
@@ -29,6 +34,7 @@
 #include "spork.h"
 #include "sporkdb.h"
 #include "swifttx.h"
+#include "trace.h"
 #include "txdb.h"
 #include "txmempool.h"
 #include "guiinterface.h"
@@ -73,6 +79,10 @@ int nScriptCheckThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = true;
+bool fHavePruned = false;
+bool fPruneMode = false;
+bool fSnapshotChain = false;
+uint64_t nPruneTarget = 0;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
 bool fVerifyingBlocks = false;
@@ -212,6 +222,12 @@ namespace {
     /** Dirty block file entries. */
     std::set<int> setDirtyFileInfo;
 
+    /** Block and undo files written to since the last flush, synced before its chainstate is written. */
+    std::set<int> setFilesToCommit;
+
+    /** Global flag to indicate we should check to see if there are block/undo files that should be deleted. Set on startup or if we allocate more file space when we're in prune mode. */
+    bool fCheckForPruning = false;
+
     /** Number of peers from which we're downloading blocks. */
     int nPeersWithValidatedDownloads = 0;
 } // anon namespace
@@ -1009,9 +1025,9 @@ int GetIXConfirmations(uint256 nTXHash)
 {
     int sigs = 0;
 
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(nTXHash);
-    if (i != mapTxLocks.end()) {
-        sigs = (*i).second.CountSignatures();
+    CTransactionLock lock;
+    if (GetTransactionLock(nTXHash, lock)) {
+        sigs = lock.CountSignatures();
     }
     if (sigs >= SWIFTTX_SIGNATURES_REQUIRED) {
         return nSwiftTXDepth;
@@ -1482,6 +1498,8 @@ std::string FormatStateMessage(const CValidationState &state)
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees)
 {
     AssertLockHeld(cs_main);
+    CTraceScope trace("mempool", "AcceptToMemoryPool");
+    trace.SetArg("inputs", tx.vin.size());
     if (pfMissingInputs)
         *pfMissingInputs = false;
 
@@ -1527,8 +1545,9 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
     // ----------- swiftTX transaction scanning -----------
 
     for (const CTxIn& in : tx.vin) {
-        if (mapLockedInputs.count(in.prevout)) {
-            if (mapLockedInputs[in.prevout] != tx.GetHash()) {
+        uint256 hashLocked;
+        if (GetLockedInputTx(in.prevout, hashLocked)) {
+            if (hashLocked != tx.GetHash()) {
                 return state.DoS(0,
                     error("AcceptToMemoryPool : conflicts with existing transaction lock: %s", reason),
                     REJECT_INVALID, "tx-lock-conflict");
@@ -1761,6 +1780,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         pool.addUnchecked(hash, entry);
     }
 
+    mnodeman.NotifyCollateralSpends(tx);
     SyncWithWallets(tx, nullptr);
 
     //Track zerocoinspends and ensure that they are given priority to make it into the blockchain
@@ -1801,8 +1821,9 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
     // ----------- swiftTX transaction scanning -----------
 
     for (const CTxIn& in : tx.vin) {
-        if (mapLockedInputs.count(in.prevout)) {
-            if (mapLockedInputs[in.prevout] != tx.GetHash()) {
+        uint256 hashLocked;
+        if (GetLockedInputTx(in.prevout, hashLocked)) {
+            if (hashLocked != tx.GetHash()) {
                 return state.DoS(0,
                     error("AcceptableInputs : conflicts with existing transaction lock: %s", reason),
                     REJECT_INVALID, "tx-lock-conflict");
@@ -2074,21 +2095,11 @@ bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos)
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
+/** Deserialize a block from its file and check its header, without the block cache */
+static bool ReadBlockFromDiskUncached(CBlock& block, const CDiskBlockPos& pos, bool& fSequential)
 {
-    block.SetNull();
-
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk : OpenBlockFile failed");
-
-    // Read block
-    try {
-        filein >> block;
-    } catch (std::exception& e) {
-        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-    }
+    if (!blockstore.Read(pos, block, fSequential))
+        return error("ReadBlockFromDisk : unable to read block %d:%u", pos.nFile, pos.nPos);
 
     if (block.nVersion < Params().WALLET_UPGRADE_VERSION() && block.vtx.size() > 1 && block.vtx[1].IsCoinStake())
         block.fPreForkPoS = true;
@@ -2101,12 +2112,61 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
     return true;
 }
 
+bool ReadBlockFromDisk(CBlockRef& pblockOut, const CDiskBlockPos& pos)
+{
+    pblockOut = blockstore.Lookup(pos);
+    if (pblockOut)
+        return true;
+
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    bool fSequential;
+    if (!ReadBlockFromDiskUncached(*pblock, pos, fSequential))
+        return false;
+
+    // a scan through the files would only push the blocks read at random out of the cache
+    if (!fSequential)
+        blockstore.Insert(pos, pblock);
+    pblockOut = pblock;
+    return true;
+}
+
+bool ReadBlockFromDisk(CBlockRef& pblock, const CBlockIndex* pindex)
+{
+    if (!ReadBlockFromDisk(pblock, pindex->GetBlockPos()))
+        return false;
+    if (pblock->GetHash() != pindex->GetBlockHash()) {
+        LogPrintf("%s : block=%s index=%s\n", __func__, pblock->GetHash().GetHex(), pindex->GetBlockHash().GetHex());
+        pblock.reset();
+        return error("ReadBlockFromDisk(CBlock&, CBlockIndex*) : GetHash() doesn't match index");
+    }
+    return true;
+}
+
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
+{
+    // a cached block has to be copied, the caller owns its block; otherwise it is read straight
+    // into the caller's block and left out of the cache, which would need a copy of its own
+    CBlockRef pblock = blockstore.Lookup(pos);
+    if (pblock) {
+        block = *pblock;
+        return true;
+    }
+
+    bool fSequential;
+    if (!ReadBlockFromDiskUncached(block, pos, fSequential)) {
+        block.SetNull();
+        return false;
+    }
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
 {
     if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
         return false;
     if (block.GetHash() != pindex->GetBlockHash()) {
         LogPrintf("%s : block=%s index=%s\n", __func__, block.GetHash().GetHex(), pindex->GetBlockHash().GetHex());
+        block.SetNull();
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*) : GetHash() doesn't match index");
     }
     return true;
@@ -2390,24 +2450,58 @@ void static InvalidBlockFound(CBlockIndex *pindex, const CValidationState &state
 
 void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCache& inputs, CTxUndo& txundo, int nHeight)
 {
+    CCoinsCommitment& commitment = inputs.GetCommitmentDelta();
+
     // mark inputs spent
     if (!tx.IsCoinBase() && !tx.HasZerocoinSpendInputs()) {
         txundo.vprevout.reserve(tx.vin.size());
         for (const CTxIn& txin : tx.vin) {
             txundo.vprevout.push_back(CTxInUndo());
-            bool ret = inputs.ModifyCoins(txin.prevout.hash)->Spend(txin.prevout, txundo.vprevout.back());
+            CCoinsModifier coins = inputs.ModifyCoins(txin.prevout.hash);
+            int nPrevHeight = coins->nHeight;
+            bool fPrevCoinBase = coins->fCoinBase;
+            bool ret = coins->Spend(txin.prevout, txundo.vprevout.back());
             assert(ret);
+            commitment.RemoveOutput(txin.prevout, txundo.vprevout.back().txout, nPrevHeight, fPrevCoinBase);
+            if (coins->IsPruned())
+                commitment.nTransactions--;
         }
     }
 
-    // add outputs
-    inputs.ModifyCoins(tx.GetHash())->FromTx(tx, nHeight);
+    // add outputs, replacing a duplicate transaction
+    CCoinsModifier outs = inputs.ModifyCoins(tx.GetHash());
+    commitment.RemoveCoins(tx.GetHash(), *outs);
+    outs->FromTx(tx, nHeight);
+    commitment.AddCoins(tx.GetHash(), *outs);
 }
 
 bool CScriptCheck::operator()()
 {
     const CScript& scriptSig = ptxTo->vin[nIn].scriptSig;
-    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore), &error)) {
+    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, cacheStore, txdata), &error)) {
+        return ::error("CScriptCheck(): %s:%d VerifySignature failed: %s", ptxTo->GetHash().ToString(), nIn, ScriptErrorString(error));
+    }
+    return true;
+}
+
+/** Whether the script result is that of a single signature check at its end */
+static bool IsSingleSigScript(const CScript& scriptPubKey)
+{
+    if (scriptPubKey.IsNormalPaymentScript())
+        return true;
+    // pay-to-pubkey, with a compressed or uncompressed key
+    return (scriptPubKey.size() == 35 && scriptPubKey[0] == 33 && scriptPubKey[34] == OP_CHECKSIG) ||
+           (scriptPubKey.size() == 67 && scriptPubKey[0] == 65 && scriptPubKey[66] == OP_CHECKSIG);
+}
+
+bool CScriptCheck::operator()(CSignatureBatch& batch)
+{
+    // A push-only scriptSig cannot check signatures itself, so such a script fails exactly
+    // when its last signature check would and that check can be verified later
+    const CScript& scriptSig = ptxTo->vin[nIn].scriptSig;
+    if (!IsSingleSigScript(scriptPubKey) || !scriptSig.IsPushOnly())
+        return (*this)();
+    if (!VerifyScript(scriptSig, scriptPubKey, nFlags, BatchingTransactionSignatureChecker(ptxTo, nIn, batch, cacheStore, txdata), &error)) {
         return ::error("CScriptCheck(): %s:%d VerifySignature failed: %s", ptxTo->GetHash().ToString(), nIn, ScriptErrorString(error));
     }
     return true;
@@ -2497,7 +2591,7 @@ CAmount GetInvalidUTXOValue()
     return nValue;
 }
 
-bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks)
+bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks, const PrecomputedTransactionData* txdata)
 {
     if (!tx.IsCoinBase() && !tx.HasZerocoinSpendInputs()) {
         if (pvChecks)
@@ -2558,13 +2652,20 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
         // before the last block chain checkpoint. This is safe because block merkle hashes are
         // still computed and checked, and any change will be caught at the next checkpoint.
         if (fScriptChecks) {
+            // Checks done here can share signature hash data that lives as long as this call
+            std::unique_ptr<PrecomputedTransactionData> txdataLocal;
+            if (!txdata && !pvChecks && tx.vin.size() > 1) {
+                txdataLocal.reset(new PrecomputedTransactionData(tx));
+                txdata = txdataLocal.get();
+            }
+
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint& prevout = tx.vin[i].prevout;
                 const CCoins* coins = inputs.AccessCoins(prevout.hash);
                 assert(coins);
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore);
+                CScriptCheck check(*coins, tx, i, flags, cacheStore, txdata);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -2577,7 +2678,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
                         CScriptCheck check(*coins, tx, i,
-                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
+                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, txdata);
                         if (check())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                     }
@@ -2597,7 +2698,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
     return true;
 }
 
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean, bool fJustCheck)
 {
     if (pindex->GetBlockHash() != view.GetBestBlock())
         LogPrintf("%s : pindex=%s view=%s\n", __func__, pindex->GetBlockHash().GetHex(), view.GetBestBlock().GetHex());
@@ -2618,6 +2719,9 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
         return error("DisconnectBlock() : block and undo data inconsistent");
 
+    if (!fJustCheck && !zerocoinDB->EraseSpendIndex(pindex->nHeight))
+        return error("DisconnectBlock() : failed to erase the serial index of the block");
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction& tx = block.vtx[i];
@@ -2646,6 +2750,9 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                             serial = spend.getCoinSerialNumber();
                         }
 
+                        if (fJustCheck)
+                            continue;
+
                         if (!zerocoinDB->EraseCoinSpend(serial))
                             return error("failed to erase spent zerocoin in block");
 
@@ -2671,7 +2778,7 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                     if (!TxOutToPublicCoin(txout, pubCoin, state))
                         return error("DisconnectBlock(): TxOutToPublicCoin() failed");
 
-                    if (!zerocoinDB->EraseCoinMint(pubCoin.getValue()))
+                    if (!fJustCheck && !zerocoinDB->EraseCoinMint(pubCoin.getValue()))
                         return error("DisconnectBlock(): Failed to erase coin mint");
                 }
             }
@@ -2698,6 +2805,7 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                 fClean = fClean && error("DisconnectBlock() : added transaction mismatch? database corrupted");
 
             // remove outputs
+            view.GetCommitmentDelta().RemoveCoins(hash, *outs);
             outs->Clear();
         }
 
@@ -2710,6 +2818,8 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                 const COutPoint& out = tx.vin[j].prevout;
                 const CTxInUndo& undo = txundo.vprevout[j];
                 CCoinsModifier coins = view.ModifyCoins(out.hash);
+                if (coins->IsPruned())
+                    view.GetCommitmentDelta().nTransactions++;
                 if (undo.nHeight != 0) {
                     // undo data contains height: this is the last output of the prevout tx being spent
                     if (!coins->IsPruned())
@@ -2727,14 +2837,29 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                 if (coins->vout.size() < out.n + 1)
                     coins->vout.resize(out.n + 1);
                 coins->vout[out.n] = undo.txout;
+                view.GetCommitmentDelta().AddOutput(out, undo.txout, coins->nHeight, coins->fCoinBase);
             }
         }
     }
 
+    if (!fJustCheck && (fAddressIndex || fSpentIndex)) {
+        CAddressIndexChanges changes;
+        if (!GetAddressIndexChanges(block, blockUndo, pindex->nHeight, changes))
+            return error("DisconnectBlock() : failed to get the address index changes");
+        // the undo data only has the height of the last spent output of a tx, the restored coins have it
+        for (std::pair<CAddressUnspentKey, CAddressUnspentValue>& entry : changes.vUnspentSpent) {
+            const CCoins* coins = view.AccessCoins(entry.first.txhash);
+            if (entry.second.nBlockHeight == 0 && coins)
+                entry.second.nBlockHeight = coins->nHeight;
+        }
+        if (!pblocktree->DisconnectAddressIndex(changes))
+            return error("DisconnectBlock() : failed to erase the address index of the block");
+    }
+
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
-    if (!fVerifyingBlocks) {
+    if (!fJustCheck && !fVerifyingBlocks) {
         //if block is an accumulator checkpoint block, remove checkpoint and checksums from db
         uint256 nCheckpoint = pindex->nAccumulatorCheckpoint;
         if(nCheckpoint != pindex->pprev->nAccumulatorCheckpoint) {
@@ -2757,26 +2882,27 @@ void static FlushBlockFile(bool fFinalize = false)
 
     CDiskBlockPos posOld(nLastBlockFile, 0);
 
-    FILE* fileOld = OpenBlockFile(posOld);
-    if (fileOld) {
-        if (fFinalize)
+    if (fFinalize) {
+        FILE* fileOld = OpenBlockFile(posOld);
+        if (fileOld) {
             TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
-        FileCommit(fileOld);
-        fclose(fileOld);
-    }
+            fclose(fileOld);
+        }
 
-    fileOld = OpenUndoFile(posOld);
-    if (fileOld) {
-        if (fFinalize)
+        fileOld = OpenUndoFile(posOld);
+        if (fileOld) {
             TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nUndoSize);
-        FileCommit(fileOld);
-        fclose(fileOld);
+            fclose(fileOld);
+        }
     }
+
+    // synced by the next flush, before the chainstate that refers to it
+    setFilesToCommit.insert(nLastBlockFile);
 }
 
 bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+static CCheckQueue<CScriptCheck, CSignatureBatch> scriptcheckqueue(128);
 
 void ThreadScriptCheck()
 {
@@ -3049,10 +3175,15 @@ static int64_t nTimeConnect = 0;
 static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
+static int64_t nBlocksConnected = 0;
+static int64_t nTxConnected = 0;
+static int64_t nInputsConnected = 0;
 
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fAlreadyChecked)
 {
     AssertLockHeld(cs_main);
+    CTraceScope trace("validation", fJustCheck ? "TestBlockValidity" : "ConnectBlock");
+    trace.SetArg("txs", block.vtx.size());
     // Check it again in case a previous version let a bad block in
     if (!fAlreadyChecked && !CheckBlock(block, state, !fJustCheck, !fJustCheck))
         return error("%s: Consensus::CheckBlock: %s", __func__, FormatStateMessage(state));
@@ -3130,7 +3261,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
     }
 
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
+    // Signature hash data of the transactions, shared by their queued script checks. Declared
+    // before the queue control so it outlives the checks; reserved so it never reallocates.
+    std::vector<PrecomputedTransactionData> vTxData;
+    vTxData.reserve(block.vtx.size());
+    CCheckQueueControl<CScriptCheck, CSignatureBatch> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
     int64_t nTimeStart = GetTimeMicros();
     CAmount nFees = 0;
@@ -3140,6 +3275,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     std::vector<std::pair<libzerocoin::CoinSpend, uint256> > vSpends;
     std::vector<std::pair<libzerocoin::PublicCoin, uint256> > vMints;
+    ZerocoinSpendIndex vSpendIndex;
     vPos.reserve(block.vtx.size());
     CBlockUndo blockundo;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
@@ -3182,7 +3318,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
             //Check for double spending of serial #'s
             std::set<CBigNum> setSerials;
-            for (const CTxIn& txIn : tx.vin) {
+            for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++) {
+                const CTxIn& txIn = tx.vin[nIn];
                 bool isPublicSpend = txIn.IsZerocoinPublicSpend();
                 bool isPrivZerocoinSpend = txIn.IsZerocoinSpend();
                 if (!isPrivZerocoinSpend && !isPublicSpend)
@@ -3203,6 +3340,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                     nValueIn += publicSpend.getDenomination() * COIN;
                     //queue for db write after the 'justcheck' section has concluded
                     vSpends.emplace_back(std::make_pair(publicSpend, tx.GetHash()));
+                    vSpendIndex.emplace_back(std::make_pair(CZerocoinSpendPos(pindex->nHeight, txid, nIn),
+                                                            CZerocoinSpendInfo(publicSpend.getCoinSerialNumber(), publicSpend.getDenomination(), true, tx)));
                     if (!ContextualCheckZerocoinSpend(tx, &publicSpend, pindex, hashBlock))
                         return state.DoS(100, error("%s: failed to add block %s with invalid public zc spend", __func__, tx.GetHash().GetHex()), REJECT_INVALID);
                 } else {
@@ -3210,6 +3349,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                     nValueIn += spend.getDenomination() * COIN;
                     //queue for db write after the 'justcheck' section has concluded
                     vSpends.emplace_back(std::make_pair(spend, tx.GetHash()));
+                    vSpendIndex.emplace_back(std::make_pair(CZerocoinSpendPos(pindex->nHeight, txid, nIn),
+                                                            CZerocoinSpendInfo(spend.getCoinSerialNumber(), spend.getDenomination(), false, tx)));
                     if (!ContextualCheckZerocoinSpend(tx, &spend, pindex, hashBlock))
                         return state.DoS(100, error("%s: failed to add block %s with invalid zerocoinspend", __func__, tx.GetHash().GetHex()), REJECT_INVALID);
                 }
@@ -3275,7 +3416,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             nValueIn += view.GetValueIn(tx);
 
             std::vector<CScriptCheck> vChecks;
-            if (!CheckInputs(tx, state, view, fScriptChecks, MANDATORY_SCRIPT_VERIFY_FLAGS, false, nScriptCheckThreads ? &vChecks : NULL))
+            const PrecomputedTransactionData* txdata = NULL;
+            if (fScriptChecks && tx.vin.size() > 1) {
+                vTxData.emplace_back(tx);
+                txdata = &vTxData.back();
+            }
+            if (!CheckInputs(tx, state, view, fScriptChecks, MANDATORY_SCRIPT_VERIFY_FLAGS, false, nScriptCheckThreads ? &vChecks : NULL, txdata))
                 return false;
             control.Add(vChecks);
         }
@@ -3377,6 +3523,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (fJustCheck)
         return true;
 
+    nBlocksConnected++;
+    nTxConnected += block.vtx.size();
+    nInputsConnected += nInputs - 1;
+
+    // flag masternodes whose collateral is spent in this block
+    for (const CTransaction& tx : block.vtx)
+        mnodeman.NotifyCollateralSpends(tx);
+
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
         if (pindex->GetUndoPos().IsNull()) {
@@ -3427,6 +3581,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // Flush spend/mint info to disk
     if (!zerocoinDB->WriteCoinSpendBatch(vSpends)) return state.Abort(("Failed to record coin serials to database"));
     if (!zerocoinDB->WriteCoinMintBatch(vMints)) return state.Abort(("Failed to record new mints to database"));
+    if (!vSpendIndex.empty() && !zerocoinDB->WriteSpendIndexBatch(vSpendIndex)) return state.Abort(("Failed to record the serial index to database"));
 
     //Record accumulator checksums
     //DatabaseChecksums(mapAccumulators);
@@ -3435,6 +3590,18 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return state.Abort("Failed to write transaction index");
 
+    if (fAddressIndex || fSpentIndex) {
+        CAddressIndexChanges changes;
+        if (!GetAddressIndexChanges(block, blockundo, pindex->nHeight, changes) || !pblocktree->ConnectAddressIndex(changes))
+            return state.Abort("Failed to write address index");
+    }
+
+    if (fBlockStatsIndex) {
+        CBlockStats stats;
+        if (!ComputeBlockStats(block, blockundo, stats) || !blockStatsIndex.Put(pindex, stats))
+            return state.Abort("Failed to write block stats index");
+    }
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -3472,6 +3639,8 @@ enum FlushStateMode {
     FLUSH_STATE_ALWAYS
 };
 
+void static FindFilesToPrune(std::set<int>& setFilesToPrune);
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed if either they're too large, forceWrite is set, or
@@ -3480,9 +3649,24 @@ enum FlushStateMode {
 bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
 {
     LOCK(cs_main);
+    CTraceScope trace("validation", "FlushStateToDisk");
+    trace.SetArg("mode", mode);
     static int64_t nLastWrite = 0;
+    std::set<int> setFilesToPrune;
+    bool fFlushForPrune = false;
     try {
-        if ((mode == FLUSH_STATE_ALWAYS) ||
+        if (fPruneMode && fCheckForPruning && !fReindex) {
+            FindFilesToPrune(setFilesToPrune);
+            fCheckForPruning = false;
+            if (!setFilesToPrune.empty()) {
+                fFlushForPrune = true;
+                if (!fHavePruned) {
+                    pblocktree->WriteFlag("prunedblockfiles", true);
+                    fHavePruned = true;
+                }
+            }
+        }
+        if ((mode == FLUSH_STATE_ALWAYS) || fFlushForPrune ||
             ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
             (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
             // Typical CCoins structures on disk are around 100 bytes in size.
@@ -3492,29 +3676,55 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
             // overwrite one. Still, use a conservative safety factor of 2.
             if (!CheckDiskSpace(100 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
-            // First make sure all block and undo data is flushed to disk.
+            // First make sure all block and undo data is written out, and durable before
+            // anything that refers to it can reach the disk.
             FlushBlockFile();
+            std::set<int> setFilesEpoch;
+            {
+                LOCK(cs_LastBlockFile);
+                setFilesEpoch.swap(setFilesToCommit);
+            }
+            std::string strCommitError;
+            if (!CommitBlockFiles(setFilesEpoch, strCommitError))
+                return state.Abort(strCommitError);
             // Then update all block file information (which may refer to block and undo files).
+            // The databases are not synced here, the flush scheduler makes the epoch durable in
+            // the background and the journal in the coin database covers a crash before that.
+            uint64_t nEpoch = flushscheduler.NewEpoch();
             {
-                std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
-                vFiles.reserve(setDirtyFileInfo.size());
-                for (std::set<int>::iterator it = setDirtyFileInfo.begin(); it != setDirtyFileInfo.end(); ) {
-                    vFiles.push_back(std::make_pair(*it, &vinfoBlockFile[*it]));
-                    setDirtyFileInfo.erase(it++);
+                CBlockIndexJournal journal;
+                {
+                    LOCK(cs_LastBlockFile);
+                    journal.vFiles.reserve(setDirtyFileInfo.size());
+                    for (std::set<int>::iterator it = setDirtyFileInfo.begin(); it != setDirtyFileInfo.end(); ) {
+                        journal.vFiles.push_back(std::make_pair(*it, vinfoBlockFile[*it]));
+                        setDirtyFileInfo.erase(it++);
+                    }
+                    journal.nLastFile = nLastBlockFile;
                 }
-                std::vector<const CBlockIndex*> vBlocks;
-                vBlocks.reserve(setDirtyBlockIndex.size());
+                journal.vBlocks.reserve(setDirtyBlockIndex.size());
                 for (std::set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end(); ) {
-                    vBlocks.push_back(*it);
+                    journal.vBlocks.push_back(std::make_pair((*it)->GetBlockHash(), CDiskBlockIndex(*it)));
                     setDirtyBlockIndex.erase(it++);
                 }
-                if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
+                if (!pblocktree->WriteJournal(journal)) {
                     return state.Abort("Files to write to block index database");
                 }
+                flushscheduler.WriteJournal(nEpoch, journal);
             }
             // Finally flush the chainstate (which may refer to block index entries).
             if (!pcoinsTip->Flush())
                 return state.Abort("Failed to write to coin database");
+            if (!flushscheduler.Schedule(nEpoch))
+                return state.Abort(flushscheduler.GetError());
+            // Callers that need the state on disk, and pruning, wait for the epoch.
+            if (mode == FLUSH_STATE_ALWAYS || fFlushForPrune) {
+                if (!flushscheduler.WaitForEpoch(nEpoch))
+                    return state.Abort(flushscheduler.GetError());
+            }
+            // Only delete the files once the index no longer points into them.
+            if (fFlushForPrune)
+                UnlinkPrunedFiles(setFilesToPrune);
             // Update best block in wallet (so we can detect restored wallets).
             if (mode != FLUSH_STATE_IF_NEEDED) {
                 GetMainSignals().SetBestChain(chainActive.GetLocator());
@@ -3532,6 +3742,12 @@ void FlushStateToDisk() {
     FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
 }
 
+void PruneAndFlush() {
+    CValidationState state;
+    fCheckForPruning = true;
+    FlushStateToDisk(state, FLUSH_STATE_NONE);
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex* pindexNew)
 {
@@ -3628,6 +3844,8 @@ bool static DisconnectTip(CValidationState &state) {
     }
     mempool.removeCoinbaseSpends(pcoinsTip, pindexDelete->nHeight);
     mempool.check(pcoinsTip);
+    // collaterals spent by the block are unspent again unless the mempool took the spend back
+    mnodeman.RecheckCollateralSpends();
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev);
     // Let wallets know transactions went from 1-confirmed to
@@ -3644,6 +3862,26 @@ static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
 static int64_t nTimePostConnect = 0;
 
+CConnectBlockTimings GetConnectBlockTimings()
+{
+    AssertLockHeld(cs_main);
+    CConnectBlockTimings timings;
+    timings.nBlocks = nBlocksConnected;
+    timings.nTransactions = nTxConnected;
+    timings.nInputs = nInputsConnected;
+    timings.nTimeReadFromDisk = nTimeReadFromDisk;
+    timings.nTimeConnect = nTimeConnect;
+    timings.nTimeVerify = nTimeVerify;
+    timings.nTimeIndex = nTimeIndex;
+    timings.nTimeCallbacks = nTimeCallbacks;
+    timings.nTimeConnectTotal = nTimeConnectTotal;
+    timings.nTimeFlush = nTimeFlush;
+    timings.nTimeChainState = nTimeChainState;
+    timings.nTimePostConnect = nTimePostConnect;
+    timings.nTimeTotal = nTimeTotal;
+    return timings;
+}
+
 /**
  * Connect a new block to chainActive. pblock is either NULL or a pointer to a CBlock
  * corresponding to pindexNew, to bypass loading it again from disk.
@@ -3651,7 +3889,12 @@ static int64_t nTimePostConnect = 0;
 bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock* pblock, bool fAlreadyChecked)
 {
     assert(pindexNew->pprev == chainActive.Tip());
+    CTraceScope trace("validation", "ConnectTip");
+    trace.SetArg("height", pindexNew->nHeight);
     mempool.check(pcoinsTip);
+    unsigned int nPrefetched = coinsprefetcher.Apply(*pcoinsTip);
+    if (nPrefetched)
+        LogPrint("bench", "  - Prefetched coins: %u\n", nPrefetched);
     CCoinsViewCache view(pcoinsTip);
 
     if (pblock == NULL)
@@ -3703,6 +3946,8 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     std::list<CTransaction> txConflicted;
     mempool.removeForBlock(pblock->vtx, pindexNew->nHeight, txConflicted);
     mempool.check(pcoinsTip);
+    if (!txConflicted.empty())
+        mnodeman.RecheckCollateralSpends();
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
     // Tell wallet about transactions that went from mempool
@@ -3914,6 +4159,16 @@ static bool ActivateBestChainStep(CValidationState& state, CBlockIndex* pindexMo
         }
         nHeight = nTargetHeight;
 
+        // Read the coins of the blocks after the next one while it is connected.
+        unsigned int nPrefetch = 0;
+        BOOST_REVERSE_FOREACH (CBlockIndex* pindexConnect, vpindexToConnect) {
+            if (nPrefetch++ == 0 || (pindexConnect == pindexMostWork && pblock))
+                continue;
+            if (nPrefetch > PREFETCH_BLOCKS_AHEAD || !(pindexConnect->nStatus & BLOCK_HAVE_DATA))
+                break;
+            coinsprefetcher.Prefetch(pindexConnect->GetBlockHash(), pindexConnect->GetBlockPos());
+        }
+
         // Connect new blocks.
         BOOST_REVERSE_FOREACH (CBlockIndex* pindexConnect, vpindexToConnect) {
             if (!ConnectTip(state, pindexConnect, pindexConnect == pindexMostWork ? pblock : NULL, fAlreadyChecked)) {
@@ -4252,6 +4507,7 @@ bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned int nAdd
         }
         FlushBlockFile(!fKnown);
         nLastBlockFile = nFile;
+        blockstore.SetWriteFile(nLastBlockFile);
     }
 
     vinfoBlockFile[nFile].AddBlock(nHeight, nTime);
@@ -4264,6 +4520,8 @@ bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned int nAdd
         unsigned int nOldChunks = (pos.nPos + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
         unsigned int nNewChunks = (vinfoBlockFile[nFile].nSize + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
         if (nNewChunks > nOldChunks) {
+            if (fPruneMode)
+                fCheckForPruning = true;
             if (CheckDiskSpace(nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos)) {
                 FILE* file = OpenBlockFile(pos);
                 if (file) {
@@ -4277,6 +4535,7 @@ bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned int nAdd
     }
 
     setDirtyFileInfo.insert(nFile);
+    setFilesToCommit.insert(nFile);
     return true;
 }
 
@@ -4290,10 +4549,14 @@ bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigne
     pos.nPos = vinfoBlockFile[nFile].nUndoSize;
     nNewSize = vinfoBlockFile[nFile].nUndoSize += nAddSize;
     setDirtyFileInfo.insert(nFile);
+    // undo data can go to a file before the last one
+    setFilesToCommit.insert(nFile);
 
     unsigned int nOldChunks = (pos.nPos + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
     unsigned int nNewChunks = (nNewSize + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
     if (nNewChunks > nOldChunks) {
+        if (fPruneMode)
+            fCheckForPruning = true;
         if (CheckDiskSpace(nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos)) {
             FILE* file = OpenUndoFile(pos);
             if (file) {
@@ -4328,6 +4591,9 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool f
 
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig)
 {
+    CTraceScope trace("validation", "CheckBlock");
+    trace.SetArg("txs", block.vtx.size());
+
     // These are checks that are independent of context.
 
     //if (block.fChecked)
@@ -4410,11 +4676,12 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
             if (!tx.IsCoinBase()) {
                 //only reject blocks when it's based on complete consensus
                 for (const CTxIn& in : tx.vin) {
-                    if (mapLockedInputs.count(in.prevout)) {
-                        if (mapLockedInputs[in.prevout] != tx.GetHash()) {
+                    uint256 hashLocked;
+                    if (GetLockedInputTx(in.prevout, hashLocked)) {
+                        if (hashLocked != tx.GetHash()) {
                             mapRejectedBlocks.insert(std::make_pair(block.GetHash(), GetTime()));
                             LogPrintf("%s : found conflicting transaction with transaction lock %s %s\n", __func__,
-                                    mapLockedInputs[in.prevout].ToString(), tx.GetHash().GetHex());
+                                    hashLocked.ToString(), tx.GetHash().GetHex());
                             return state.DoS(0, error("%s : found conflicting transaction with transaction lock", __func__),
                                 REJECT_INVALID, "conflicting-tx-ix");
                         }
@@ -4854,6 +5121,8 @@ void CBlockIndex::BuildSkip()
 
 bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, bool fForceProcessing, CDiskBlockPos* dbp)
 {
+    TRACE_SCOPE("validation", "ProcessNewBlock");
+
     // Preliminary checks
     int64_t nStartTime = GetTimeMillis();
 
@@ -4980,6 +5249,118 @@ boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos& pos, const char
     return GetDataDir() / "blocks" / strprintf("%s%05u.dat", prefix, pos.nFile);
 }
 
+uint64_t CalculateCurrentUsage()
+{
+    uint64_t retval = 0;
+    for (const CBlockFileInfo& file : vinfoBlockFile) {
+        retval += file.nSize + file.nUndoSize;
+    }
+    return retval;
+}
+
+unsigned int GetPruneKeepDepth()
+{
+    return std::max<unsigned int>(MIN_BLOCKS_TO_KEEP, Params().MaxReorganizationDepth());
+}
+
+void PruneOneBlockFile(const int fileNumber)
+{
+    for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); ++it) {
+        CBlockIndex* pindex = it->second;
+        if (pindex->nFile == fileNumber) {
+            pindex->nStatus &= ~BLOCK_HAVE_DATA;
+            pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nFile = 0;
+            pindex->nDataPos = 0;
+            pindex->nUndoPos = 0;
+            setDirtyBlockIndex.insert(pindex);
+
+            // Prune from mapBlocksUnlinked -- any block we prune would have
+            // to be downloaded again in order to consider its chain, at which
+            // point it would be considered as a candidate for
+            // mapBlocksUnlinked or setBlockIndexCandidates.
+            std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex->pprev);
+            while (range.first != range.second) {
+                std::multimap<CBlockIndex*, CBlockIndex*>::iterator itUnlinked = range.first;
+                range.first++;
+                if (itUnlinked->second == pindex) {
+                    mapBlocksUnlinked.erase(itUnlinked);
+                }
+            }
+        }
+    }
+
+    vinfoBlockFile[fileNumber].SetNull();
+    setDirtyFileInfo.insert(fileNumber);
+    blockstore.ForgetFile(fileNumber);
+}
+
+void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
+{
+    for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
+        CDiskBlockPos pos(*it, 0);
+        boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
+        boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
+        LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
+    }
+}
+
+/**
+ * Find the files to delete to get below nTarget, oldest first. Files holding blocks
+ * within GetPruneKeepDepth() of the tip, or from the zerocoin start height on (their mints
+ * are read back when witnesses are built), are kept, as is the file being written.
+ */
+unsigned int SelectFilesToPrune(const std::vector<CBlockFileInfo>& vinfo, int nLastFile, int nTipHeight, uint64_t nTarget, std::set<int>& setFilesToPrune)
+{
+    if (nTarget == 0 || nTipHeight <= (int)GetPruneKeepDepth())
+        return 0;
+
+    unsigned int nLastBlockWeCanPrune = std::min<unsigned int>(nTipHeight - GetPruneKeepDepth(), Params().Zerocoin_StartHeight());
+    uint64_t nCurrentUsage = 0;
+    for (const CBlockFileInfo& file : vinfo)
+        nCurrentUsage += file.nSize + file.nUndoSize;
+    // We don't check to prune until after we've allocated new space for files,
+    // so we should leave a nice buffer under the target to account for another allocation
+    // before the next pruning.
+    uint64_t nBuffer = BLOCKFILE_CHUNK_SIZE + UNDOFILE_CHUNK_SIZE;
+
+    if (nCurrentUsage + nBuffer >= nTarget) {
+        for (int fileNumber = 0; fileNumber < nLastFile && fileNumber < (int)vinfo.size(); fileNumber++) {
+            if (vinfo[fileNumber].nSize == 0)
+                continue;
+
+            if (nCurrentUsage + nBuffer < nTarget) // are we below our target?
+                break;
+
+            // don't prune files that could have a block within the keep depth or zerocoin range
+            if (vinfo[fileNumber].nHeightLast >= nLastBlockWeCanPrune)
+                continue;
+
+            // Queue up the files for removal
+            setFilesToPrune.insert(fileNumber);
+            nCurrentUsage -= vinfo[fileNumber].nSize + vinfo[fileNumber].nUndoSize;
+        }
+    }
+    return nLastBlockWeCanPrune;
+}
+
+void static FindFilesToPrune(std::set<int>& setFilesToPrune)
+{
+    LOCK2(cs_main, cs_LastBlockFile);
+    if (chainActive.Tip() == NULL)
+        return;
+
+    unsigned int nLastBlockWeCanPrune = SelectFilesToPrune(vinfoBlockFile, nLastBlockFile, chainActive.Tip()->nHeight, nPruneTarget, setFilesToPrune);
+    for (int fileNumber : setFilesToPrune)
+        PruneOneBlockFile(fileNumber);
+
+    uint64_t nCurrentUsage = CalculateCurrentUsage();
+    LogPrint("prune", "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d removed %d blk/rev pairs\n",
+        nPruneTarget / 1024 / 1024, nCurrentUsage / 1024 / 1024,
+        ((int64_t)nPruneTarget - (int64_t)nCurrentUsage) / 1024 / 1024,
+        nLastBlockWeCanPrune, setFilesToPrune.size());
+}
+
 CBlockIndex* InsertBlockIndex(uint256 hash)
 {
     if (hash.IsNull())
@@ -5022,7 +5403,8 @@ bool static LoadBlockIndexDB(std::string& strError)
 
         CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
-        if (pindex->nStatus & BLOCK_HAVE_DATA) {
+        // blocks that were processed once keep their transaction count after their data is gone
+        if (pindex->nTx > 0) {
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
@@ -5046,6 +5428,7 @@ bool static LoadBlockIndexDB(std::string& strError)
 
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
+    blockstore.SetWriteFile(nLastBlockFile);
     vinfoBlockFile.resize(nLastBlockFile + 1);
     LogPrintf("%s: last block file = %i\n", __func__, nLastBlockFile);
     for (int nFile = 0; nFile <= nLastBlockFile; nFile++) {
@@ -5087,10 +5470,21 @@ bool static LoadBlockIndexDB(std::string& strError)
     pblocktree->ReadReindexing(fReindexing);
     fReindex |= fReindexing;
 
+    // Check whether blocks in the index may be missing their data
+    pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
+    if (fHavePruned)
+        LogPrintf("LoadBlockIndexDB(): block files are incomplete\n");
+
     // Check whether we have a transaction index
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
 
+    // Check whether we have the address and spent indexes
+    pblocktree->ReadFlag("addressindex", fAddressIndex);
+    LogPrintf("LoadBlockIndexDB(): address index %s\n", fAddressIndex ? "enabled" : "disabled");
+    pblocktree->ReadFlag("spentindex", fSpentIndex);
+    LogPrintf("LoadBlockIndexDB(): spent index %s\n", fSpentIndex ? "enabled" : "disabled");
+
     // If this is written true before the next client init, then we know the shutdown process failed
     pblocktree->WriteFlag("shutdown", false);
 
@@ -5143,6 +5537,11 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
         uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
         if (pindex->nHeight < chainActive.Height() - nCheckDepth)
             break;
+        // blocks below a loaded chainstate snapshot have no data
+        if (fHavePruned && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            LogPrintf("VerifyDB(): block data ends at height %d\n", pindex->nHeight);
+            break;
+        }
         CBlock block;
         // check level 0: read from disk
         if (!ReadBlockFromDisk(block, pindex))
@@ -5163,7 +5562,8 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
         if (nCheckLevel >= 3 && pindex == pindexState && (coins.GetCacheSize() + pcoinsTip->GetCacheSize()) <= nCoinCacheSize) {
             bool fClean = true;
-            if (!DisconnectBlock(block, state, pindex, coins, &fClean))
+            // the indexes stay, a shutdown before the blocks are reconnected would not restore them
+            if (!DisconnectBlock(block, state, pindex, coins, &fClean, true))
                 return error("VerifyDB() : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
             pindexState = pindex->pprev;
             if (!fClean) {
@@ -5212,12 +5612,17 @@ void UnloadBlockIndex()
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
     nLastBlockFile = 0;
+    blockstore.SetWriteFile(nLastBlockFile);
+    blockstore.Clear();
     nBlockSequenceId = 1;
+    fHavePruned = false;
+    fCheckForPruning = false;
     mapBlockSource.clear();
     mapBlocksInFlight.clear();
     nPreferredDownload = 0;
     setDirtyBlockIndex.clear();
     setDirtyFileInfo.clear();
+    setFilesToCommit.clear();
     mapNodeState.clear();
     recentRejects.reset(NULL);
 
@@ -5249,6 +5654,10 @@ bool InitBlockIndex() {
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", true);
     pblocktree->WriteFlag("txindex", fTxIndex);
+    fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    pblocktree->WriteFlag("addressindex", fAddressIndex);
+    fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    pblocktree->WriteFlag("spentindex", fSpentIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -5285,47 +5694,28 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
     static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
+    // blocks are read and deserialized on other threads while the previous ones are validated,
+    // and the coins they spend are prefetched
+    unsigned int nWorkers = std::max(1, std::min((int)boost::thread::hardware_concurrency() - 1, 4));
+    CBlockImportReader reader(fileIn, dbp ? dbp->nFile : -1, nWorkers, DEFAULT_IMPORT_WINDOW,
+        [](const CBlock& block) { coinsprefetcher.Prefetch(block); });
+
     int nLoaded = 0;
     try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        std::shared_ptr<CImportedBlock> pimported;
+        while (reader.Next(pimported)) {
             boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[MESSAGE_START_SIZE];
-                blkdat.FindByte(Params().MessageStart()[0]);
-                nRewind = blkdat.GetPos() + 1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
-            }
+            if (!pimported->fValid)
+                continue;
+
             try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
+                CBlock& block = pimported->block;
+                const uint256& hash = pimported->hash;
                 if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
+                    dbp->nPos = pimported->pos.nPos;
 
                 // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
                 if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
                     LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
                             block.hashPrevBlock.ToString());
@@ -5354,14 +5744,15 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
                     std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
                     while (range.first != range.second) {
                         std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second)) { // only call to ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
+                        CBlock blockChild;
+                        if (ReadBlockFromDisk(blockChild, it->second)) { // only call to ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
+                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, blockChild.GetHash().ToString(),
                                 head.ToString());
                             CValidationState dummy;
-                            if (ProcessNewBlock(dummy, NULL, &block, true, &it->second))
+                            if (ProcessNewBlock(dummy, NULL, &blockChild, true, &it->second))
                             {
                                 nLoaded++;
-                                queue.push_back(block.GetHash());
+                                queue.push_back(blockChild.GetHash());
                             }
                         }
                         range.first++;
@@ -5416,6 +5807,7 @@ void static CheckBlockIndex()
     int nHeight = 0;
     CBlockIndex* pindexFirstInvalid = NULL;         // Oldest ancestor of pindex which is invalid.
     CBlockIndex* pindexFirstMissing = NULL;         // Oldest ancestor of pindex which does not have BLOCK_HAVE_DATA.
+    CBlockIndex* pindexFirstNeverProcessed = NULL;  // Oldest ancestor of pindex for which nTx == 0.
     CBlockIndex* pindexFirstNotTreeValid = NULL;    // Oldest ancestor of pindex which does not have BLOCK_VALID_TREE (regardless of being valid or not).
     CBlockIndex* pindexFirstNotChainValid = NULL;   // Oldest ancestor of pindex which does not have BLOCK_VALID_CHAIN (regardless of being valid or not).
     CBlockIndex* pindexFirstNotScriptsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_SCRIPTS (regardless of being valid or not).
@@ -5423,6 +5815,7 @@ void static CheckBlockIndex()
         nNodes++;
         if (pindexFirstInvalid == NULL && pindex->nStatus & BLOCK_FAILED_VALID) pindexFirstInvalid = pindex;
         if (pindexFirstMissing == NULL && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
+        if (pindexFirstNeverProcessed == NULL && pindex->nTx == 0) pindexFirstNeverProcessed = pindex;
         if (pindex->pprev != NULL && pindexFirstNotTreeValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TREE) pindexFirstNotTreeValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotChainValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN) pindexFirstNotChainValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotScriptsValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) pindexFirstNotScriptsValid = pindex;
@@ -5433,12 +5826,19 @@ void static CheckBlockIndex()
             assert(pindex->GetBlockHash() == Params().HashGenesisBlock()); // Genesis block's hash must match.
             assert(pindex == chainActive.Genesis());                       // The current active chain's genesis block must be this block.
         }
-        // HAVE_DATA is equivalent to VALID_TRANSACTIONS and equivalent to nTx > 0 (we stored the number of transactions in the block)
-        assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+        if (!fHavePruned) {
+            // HAVE_DATA is equivalent to VALID_TRANSACTIONS and equivalent to nTx > 0 (we stored the number of transactions in the block)
+            assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+            assert(pindexFirstMissing == pindexFirstNeverProcessed);
+        } else {
+            // Blocks may have lost their data since, so HAVE_DATA only implies nTx > 0
+            if (pindex->nStatus & BLOCK_HAVE_DATA) assert(pindex->nTx > 0);
+        }
+        if (pindex->nStatus & BLOCK_HAVE_UNDO) assert(pindex->nStatus & BLOCK_HAVE_DATA);
         assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0));
         if (pindex->nChainTx == 0) assert(pindex->nSequenceId == 0); // nSequenceId can't be set for blocks that aren't linked
-        // All parents having data is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
-        assert((pindexFirstMissing != NULL) == (pindex->nChainTx == 0));                                             // nChainTx == 0 is used to signal that all parent block's transaction data is available.
+        // All parents having had data is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
+        assert((pindexFirstNeverProcessed != NULL) == (pindex->nChainTx == 0));                                      // nChainTx == 0 is used to signal that all parent blocks were processed, their data may be gone since.
         assert(pindex->nHeight == nHeight);                                                                          // nHeight must be consistent.
         assert(pindex->pprev == NULL || pindex->nChainWork >= pindex->pprev->nChainWork);                            // For every block except the genesis block, the chainwork must be larger than the parent's.
         assert(nHeight < 2 || (pindex->pskip && (pindex->pskip->nHeight < nHeight)));                                // The pskip pointer must point back for all but the first 2 blocks.
@@ -5450,8 +5850,10 @@ void static CheckBlockIndex()
             // Checks for not-invalid blocks.
             assert((pindex->nStatus & BLOCK_FAILED_MASK) == 0); // The failed mask cannot be set for blocks without invalid parents.
         }
-        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstMissing == NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block sorts at least as good as the current tip and is valid, it must be in setBlockIndexCandidates.
+        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstNeverProcessed == NULL) {
+            // If this block sorts at least as good as the current tip, is valid and all its parents have data, it must be in
+            // setBlockIndexCandidates. The tip must be there too, even if some parents lost their data.
+            if (pindexFirstInvalid == NULL && (pindexFirstMissing == NULL || pindex == chainActive.Tip())) {
                 assert(setBlockIndexCandidates.count(pindex));
             }
         } else { // If this block sorts worse than the current tip, it cannot be in setBlockIndexCandidates.
@@ -5468,13 +5870,12 @@ void static CheckBlockIndex()
             }
             rangeUnlinked.first++;
         }
-        if (pindex->pprev && pindex->nStatus & BLOCK_HAVE_DATA && pindexFirstMissing != NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block has block data available, some parent doesn't, and has no invalid parents, it must be in mapBlocksUnlinked.
-                assert(foundInUnlinked);
-            }
-        } else { // If this block does not have block data available, or all parents do, it cannot be in mapBlocksUnlinked.
-            assert(!foundInUnlinked);
+        if (pindex->pprev && pindex->nStatus & BLOCK_HAVE_DATA && pindexFirstNeverProcessed != NULL && pindexFirstInvalid == NULL) {
+            // If this block has block data available, some parent was never received, and has no invalid parents, it must be in mapBlocksUnlinked.
+            assert(foundInUnlinked);
         }
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) assert(!foundInUnlinked); // If this block does not have block data available, it cannot be in mapBlocksUnlinked.
+        if (pindexFirstMissing == NULL) assert(!foundInUnlinked);            // Neither if all parents have their data.
         // assert(pindex->GetBlockHash() == pindex->GetBlockHeader().GetHash()); // Perhaps too slow
         // End: actual consistency checks.
 
@@ -5493,6 +5894,7 @@ void static CheckBlockIndex()
             // If pindex was the first with a certain property, unset the corresponding variable.
             if (pindex == pindexFirstInvalid) pindexFirstInvalid = NULL;
             if (pindex == pindexFirstMissing) pindexFirstMissing = NULL;
+            if (pindex == pindexFirstNeverProcessed) pindexFirstNeverProcessed = NULL;
             if (pindex == pindexFirstNotTreeValid) pindexFirstNotTreeValid = NULL;
             if (pindex == pindexFirstNotChainValid) pindexFirstNotChainValid = NULL;
             if (pindex == pindexFirstNotScriptsValid) pindexFirstNotScriptsValid = NULL;
@@ -5609,14 +6011,13 @@ bool static AlreadyHave(const CInv& inv)
     case MSG_BLOCK:
         return mapBlockIndex.count(inv.hash);
     case MSG_TXLOCK_REQUEST:
-        return mapTxLockReq.count(inv.hash) ||
-               mapTxLockReqRejected.count(inv.hash);
+        return HaveTxLockRequest(inv.hash);
     case MSG_TXLOCK_VOTE:
-        return mapTxLockVote.count(inv.hash);
+        return HaveTxLockVote(inv.hash);
     case MSG_SPORK:
         return mapSporks.count(inv.hash);
     case MSG_MASTERNODE_WINNER:
-        if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
+        if (masternodePayments.HasVote(inv.hash)) {
             masternodeSync.AddedMasternodeWinner(inv.hash);
             return true;
         }
@@ -5692,13 +6093,21 @@ void static ProcessGetData(CNode* pfrom)
                             LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
                         }
                     }
+                    // A pruning node does not advertise NODE_NETWORK, so only serve the blocks it
+                    // is sure to keep, which also hides which older files are still around.
+                    if (send && fPruneMode && !pfrom->fWhitelisted &&
+                        chainActive.Height() - mi->second->nHeight >= (int)GetPruneKeepDepth()) {
+                        LogPrint("net", "%s: ignoring request from peer=%i for block below the prune depth\n", __func__, pfrom->GetId());
+                        send = false;
+                    }
                 }
                 // Don't send not-validated blocks
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
                     // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
+                    CBlockRef pblock;
+                    if (!ReadBlockFromDisk(pblock, (*mi).second))
                         assert(!"cannot load block from disk");
+                    const CBlock& block = *pblock;
                     if (inv.type == MSG_BLOCK)
                         pfrom->PushMessage("block", block);
                     else // MSG_FILTERED_BLOCK)
@@ -5798,19 +6207,21 @@ void static ProcessGetData(CNode* pfrom)
                 }
 
                 if (!pushed && inv.type == MSG_TXLOCK_VOTE) {
-                    if (mapTxLockVote.count(inv.hash)) {
+                    CConsensusVote vote;
+                    if (GetTxLockVote(inv.hash, vote)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << mapTxLockVote[inv.hash];
+                        ss << vote;
                         pfrom->PushMessage("txlvote", ss);
                         pushed = true;
                     }
                 }
                 if (!pushed && inv.type == MSG_TXLOCK_REQUEST) {
-                    if (mapTxLockReq.count(inv.hash)) {
+                    CTransaction tx;
+                    if (GetTxLockRequest(inv.hash, tx)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << mapTxLockReq[inv.hash];
+                        ss << tx;
                         pfrom->PushMessage("ix", ss);
                         pushed = true;
                     }
@@ -5825,10 +6236,11 @@ void static ProcessGetData(CNode* pfrom)
                     }
                 }
                 if (!pushed && inv.type == MSG_MASTERNODE_WINNER) {
-                    if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
+                    CMasternodePaymentWinner winner;
+                    if (masternodePayments.GetVote(inv.hash, winner)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << masternodePayments.mapMasternodePayeeVotes[inv.hash];
+                        ss << winner;
                         pfrom->PushMessage("mnw", ss);
                         pushed = true;
                     }
@@ -6285,6 +6697,15 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                 LogPrint("net", "  getblocks stopping at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
                 break;
             }
+            // If pruning, don't inv blocks unless we have them and they are recent enough
+            // to stay on disk until the peer asks for them. A node bootstrapped from a snapshot
+            // has no blocks below its base and no NODE_NETWORK either, so it is held to the same limit.
+            const int nPrunedBlocksLikelyToHave = (int)GetPruneKeepDepth() - (int)(3600 / Params().TargetSpacing());
+            if ((fPruneMode || fSnapshotChain) && (!(pindex->nStatus & BLOCK_HAVE_DATA) || pindex->nHeight <= chainActive.Tip()->nHeight - nPrunedBlocksLikelyToHave))
+            {
+                LogPrint("net", "  getblocks stopping, pruned or too old block at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+                break;
+            }
             pfrom->PushInventory(CInv(MSG_BLOCK, pindex->GetBlockHash()));
             if (--nLimit <= 0)
             {
@@ -6701,6 +7122,8 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 
     else if (strCommand == "block" && !fImporting && !fReindex) // Ignore blocks received while importing
     {
+        CTraceScope trace("net", "ReceiveBlock");
+        trace.SetArg("bytes", vRecv.size());
         CBlock block;
         vRecv >> block;
         uint256 hashBlock = block.GetHash();
@@ -7017,6 +7440,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     } else {
         //probably one the extensions
         //obfuScationPool.ProcessMessageObfuscation(pfrom, strCommand, vRecv);
+        TRACE_SCOPE("masternode", "ProcessMessage");
         mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
         budget.ProcessMessage(pfrom, strCommand, vRecv);
         masternodePayments.ProcessMessageMasternodePayments(pfrom, strCommand, vRecv);
@@ -7046,6 +7470,22 @@ int ActiveProtocol()
     return MIN_PEER_PROTO_VERSION_BEFORE_ENFORCEMENT;
 }
 
+/** Trace name of a message command, the command of a peer is not interned as it could be anything */
+static const char* TraceCommandName(const std::string& strCommand)
+{
+    static const char* const ppszCommands[] = {
+        "accvalue", "addr", "alert", "block", "dsee", "dseep", "dseg", "dstx", "fbs", "fbvote",
+        "filteradd", "filterclear", "filterload", "genwit", "getaddr", "getblocks", "getdata",
+        "getheaders", "getsporks", "headers", "inv", "ix", "mempool", "mnb", "mnget", "mnp", "mnvs",
+        "mnw", "mprop", "mvote", "ping", "pong", "reject", "sendheaders", "spork", "ssc", "tx",
+        "txlvote", "verack", "version"};
+    for (const char* pszCommand : ppszCommands) {
+        if (strCommand == pszCommand)
+            return pszCommand;
+    }
+    return "unknown";
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool ProcessMessages(CNode* pfrom)
 {
@@ -7068,6 +7508,9 @@ bool ProcessMessages(CNode* pfrom)
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
 
+    // recover masternode message signers on the check threads, before any lock is taken
+    PreVerifyMessages(pfrom);
+
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
         // Don't bother if send buffer is too full to respond anyway
@@ -7120,6 +7563,11 @@ bool ProcessMessages(CNode* pfrom)
 
         // Process message
         bool fRet = false;
+        CTraceScope trace("net", "ProcessMessage");
+        if (trace.IsActive()) {
+            trace.SetName(TraceCommandName(strCommand));
+            trace.SetArg("bytes", nMessageSize);
+        }
         try {
             fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
             boost::this_thread::interruption_point();
@@ -14,6 +14,7 @@
 #endif
 
 #include "amount.h"
+#include "blockstore.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "coins.h"
@@ -46,6 +47,7 @@
 
 #include <boost/unordered_map.hpp>
 
+class CBlockFileInfo;
 class CBlockIndex;
 class CBlockTreeDB;
 class CZerocoinDB;
@@ -167,6 +169,14 @@ extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+/** Blocks in the index may be missing their data, for instance below a loaded chainstate snapshot */
+extern bool fHavePruned;
+/** Whether old block and undo files are deleted, see -prune */
+extern bool fPruneMode;
+/** Whether the chainstate was bootstrapped from a snapshot, see -loadtxoutset */
+extern bool fSnapshotChain;
+/** Bytes of block and undo files to stay below when pruning */
+extern uint64_t nPruneTarget;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
 extern unsigned int nCoinCacheSize;
@@ -200,6 +210,8 @@ static const uint64_t nMinDiskSpace = 52428800;
 
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
 static const unsigned int MIN_BLOCKS_TO_KEEP = 2160; // number of blocks in 2 days
+/** Smallest -prune target, so the blocks that are kept and the files being written fit */
+static const uint64_t MIN_DISK_SPACE_FOR_BLOCK_FILES = 550 * 1024 * 1024;
 
 /** Register with a network node to receive its signals */
 void RegisterNodeSignals(CNodeSignals& nodeSignals);
@@ -221,12 +233,26 @@ void UnregisterNodeSignals(CNodeSignals& nodeSignals);
 bool ProcessNewBlock(CValidationState &state, CNode* pfrom, CBlock* pblock, bool fForceProcessing, CDiskBlockPos *dbp);
 /** Check whether enough disk space is available for an incoming block */
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
+/** Open a block or undo file, by its prefix */
+FILE* OpenDiskFile(const CDiskBlockPos& pos, const char* prefix, bool fReadOnly);
 /** Open a block file (blk?????.dat) */
 FILE* OpenBlockFile(const CDiskBlockPos& pos, bool fReadOnly = false);
 /** Open an undo file (rev?????.dat) */
 FILE* OpenUndoFile(const CDiskBlockPos& pos, bool fReadOnly = false);
 /** Translation to a filesystem path */
 boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos& pos, const char* prefix);
+/** Bytes used by the block and undo files */
+uint64_t CalculateCurrentUsage();
+/** Mark the blocks of a file as no longer having data, before the file is deleted */
+void PruneOneBlockFile(const int fileNumber);
+/** Delete the block and undo files of the given numbers */
+void UnlinkPrunedFiles(std::set<int>& setFilesToPrune);
+/** Blocks below the tip whose files are never pruned */
+unsigned int GetPruneKeepDepth();
+/** Add the files to delete to get below nTarget to setFilesToPrune, returns the height they must be below */
+unsigned int SelectFilesToPrune(const std::vector<CBlockFileInfo>& vinfo, int nLastFile, int nTipHeight, uint64_t nTarget, std::set<int>& setFilesToPrune);
+/** Prune and flush to disk, at startup */
+void PruneAndFlush();
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp = NULL);
 /** Initialize a new block tree database + block data on disk */
@@ -367,9 +393,9 @@ unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& ma
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
- * instead of being performed inline.
+ * instead of being performed inline. Deferred checks share txdata, which must outlive them.
  */
-bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks = NULL);
+bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck>* pvChecks = NULL, const PrecomputedTransactionData* txdata = NULL);
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCache& inputs, CTxUndo& txundo, int nHeight);
@@ -440,14 +466,17 @@ private:
     unsigned int nFlags;
     bool cacheStore;
     ScriptError error;
+    const PrecomputedTransactionData* txdata;
 
 public:
-    CScriptCheck(): ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
-    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn) :
+    CScriptCheck(): ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(NULL) {}
+    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, const PrecomputedTransactionData* txdataIn = NULL) :
         scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey),
-        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR) { }
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
 
     bool operator()();
+    /** On a check queue worker, defer the signature of pay-to-pubkey(-hash) scripts to its batch */
+    bool operator()(CSignatureBatch& batch);
 
     void swap(CScriptCheck& check) {
         scriptPubKey.swap(check.scriptPubKey);
@@ -456,6 +485,7 @@ public:
         std::swap(nFlags, check.nFlags);
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
+        std::swap(txdata, check.txdata);
     }
 
     ScriptError GetScriptError() const { return error; }
@@ -466,6 +496,9 @@ public:
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** Shared with the block cache, avoids copying a cached block */
+bool ReadBlockFromDisk(CBlockRef& pblock, const CDiskBlockPos& pos);
+bool ReadBlockFromDisk(CBlockRef& pblock, const CBlockIndex* pindex);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -473,8 +506,9 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  In case pfClean is provided, operation will try to be tolerant about errors, and *pfClean
  *  will be true if no problems were found. Otherwise, the return value will be false in case
- *  of problems. Note that in any case, coins may be modified. */
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL);
+ *  of problems. Note that in any case, coins may be modified. With fJustCheck, coins is a
+ *  scratch view and the zerocoin databases and address indexes are left alone. */
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL, bool fJustCheck = false);
 
 /** Reprocess a number of blocks to try and get on the correct chain again **/
 bool DisconnectBlocksAndReprocess(int blocks);
@@ -482,6 +516,30 @@ bool DisconnectBlocksAndReprocess(int blocks);
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins */
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool fJustCheck, bool fAlreadyChecked = false);
 
+/** Time spent in each stage of connecting blocks, the totals logged by -debug=bench */
+struct CConnectBlockTimings {
+    int64_t nBlocks;
+    int64_t nTransactions;
+    //! inputs spent, not counting the coinbase
+    int64_t nInputs;
+    int64_t nTimeReadFromDisk;
+    int64_t nTimeConnect;
+    int64_t nTimeVerify;
+    int64_t nTimeIndex;
+    int64_t nTimeCallbacks;
+    int64_t nTimeConnectTotal;
+    int64_t nTimeFlush;
+    int64_t nTimeChainState;
+    int64_t nTimePostConnect;
+    int64_t nTimeTotal;
+
+    CConnectBlockTimings() : nBlocks(0), nTransactions(0), nInputs(0), nTimeReadFromDisk(0), nTimeConnect(0), nTimeVerify(0), nTimeIndex(0),
+                             nTimeCallbacks(0), nTimeConnectTotal(0), nTimeFlush(0), nTimeChainState(0), nTimePostConnect(0), nTimeTotal(0) {}
+};
+
+/** Microseconds spent connecting blocks since startup, requires cs_main */
+CConnectBlockTimings GetConnectBlockTimings();
+
 /** Context-independent validity checks */
 bool CheckWork(const CBlockHeader& block, CBlockIndex* const pindexPrev);
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW = true);
@@ -12,8 +12,10 @@
 #include "masternode-budget.h"
 #include "masternode-sync.h"
 #include "masternode.h"
+#include "masternodedb.h"
 #include "masternodeman.h"
 #include "obfuscation.h"
+#include "trace.h"
 #include "util.h"
 #include "utilmoneystr.h"
 #include <boost/filesystem.hpp>
@@ -270,6 +272,15 @@ void CBudgetManager::SubmitFinalBudget()
 // CBudgetDB
 //
 
+static const char DB_BUDGET_PROPOSAL = 'r';
+static const char DB_BUDGET_FINALIZED = 'z';
+static const char DB_BUDGET_SEEN_PROPOSAL = 'R';
+static const char DB_BUDGET_SEEN_VOTE = 'V';
+static const char DB_BUDGET_SEEN_FINALIZED = 'Z';
+static const char DB_BUDGET_SEEN_FINALIZED_VOTE = 'F';
+static const char DB_BUDGET_ORPHAN_VOTE = 'o';
+static const char DB_BUDGET_ORPHAN_FINALIZED_VOTE = 'f';
+
 CBudgetDB::CBudgetDB()
 {
     pathDB = GetDataDir() / "budget.dat";
@@ -278,33 +289,35 @@ CBudgetDB::CBudgetDB()
 
 bool CBudgetDB::Write(const CBudgetManager& objToSave)
 {
-    LOCK(objToSave.cs);
+    if (pmnStateDB == NULL)
+        return error("%s : Masternode state store is not open", __func__);
 
     int64_t nStart = GetTimeMillis();
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << strMagicMessage;                   // masternode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
+    {
+        LOCK(objToSave.cs);
+
+        pmnStateDB->DumpHeader(strMagicMessage);
+        pmnStateDB->DumpMap(DB_BUDGET_SEEN_PROPOSAL, objToSave.mapSeenMasternodeBudgetProposals);
+        pmnStateDB->DumpMap(DB_BUDGET_SEEN_VOTE, objToSave.mapSeenMasternodeBudgetVotes);
+        pmnStateDB->DumpMap(DB_BUDGET_SEEN_FINALIZED, objToSave.mapSeenFinalizedBudgets);
+        pmnStateDB->DumpMap(DB_BUDGET_SEEN_FINALIZED_VOTE, objToSave.mapSeenFinalizedBudgetVotes);
+        pmnStateDB->DumpMap(DB_BUDGET_ORPHAN_VOTE, objToSave.mapOrphanMasternodeBudgetVotes);
+        pmnStateDB->DumpMap(DB_BUDGET_ORPHAN_FINALIZED_VOTE, objToSave.mapOrphanFinalizedBudgetVotes);
+        pmnStateDB->DumpMap(DB_BUDGET_PROPOSAL, objToSave.mapProposals);
+        pmnStateDB->DumpMap(DB_BUDGET_FINALIZED, objToSave.mapFinalizedBudgets);
     }
-    fileout.fclose();
 
-    LogPrint("mnbudget","Written info to budget.dat  %dms\n", GetTimeMillis() - nStart);
+    const char pchBudgetTypes[] = {DB_BUDGET_PROPOSAL, DB_BUDGET_FINALIZED, DB_BUDGET_SEEN_PROPOSAL, DB_BUDGET_SEEN_VOTE,
+        DB_BUDGET_SEEN_FINALIZED, DB_BUDGET_SEEN_FINALIZED_VOTE, DB_BUDGET_ORPHAN_VOTE, DB_BUDGET_ORPHAN_FINALIZED_VOTE};
+    if (!pmnStateDB->CommitDump(std::string(pchBudgetTypes, sizeof(pchBudgetTypes))))
+        return error("%s : Failed to write budget state", __func__);
+
+    // the store supersedes the flat file once it has been written
+    if (boost::filesystem::exists(pathDB))
+        boost::filesystem::remove(pathDB);
+
+    LogPrint("mnbudget","Written info to masternode state store  %dms\n", GetTimeMillis() - nStart);
 
     return true;
 }
@@ -314,6 +327,55 @@ CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad, bool fDryRun)
     LOCK(objToLoad.cs);
 
     int64_t nStart = GetTimeMillis();
+
+    bool fFound = false;
+    ReadResult result = ReadStore(objToLoad, fFound);
+    // nothing in the store yet, migrate from the flat file
+    if (result == Ok && !fFound)
+        result = ReadFile(objToLoad);
+    if (result != Ok)
+        return result;
+
+    LogPrint("mnbudget","Loaded info from %s  %dms\n", fFound ? "masternode state store" : "budget.dat", GetTimeMillis() - nStart);
+    LogPrint("mnbudget","  %s\n", objToLoad.ToString());
+    if (!fDryRun) {
+        LogPrint("mnbudget","Budget manager - cleaning....\n");
+        objToLoad.CheckAndRemove();
+        LogPrint("mnbudget","Budget manager - result:\n");
+        LogPrint("mnbudget","  %s\n", objToLoad.ToString());
+    }
+
+    return Ok;
+}
+
+CBudgetDB::ReadResult CBudgetDB::ReadStore(CBudgetManager& objToLoad, bool& fFound)
+{
+    fFound = false;
+    if (pmnStateDB == NULL)
+        return Ok;
+
+    if (!pmnStateDB->LoadHeader(strMagicMessage, fFound))
+        return IncorrectMagicNumber;
+    if (!fFound)
+        return Ok;
+
+    if (!pmnStateDB->LoadMap(DB_BUDGET_SEEN_PROPOSAL, objToLoad.mapSeenMasternodeBudgetProposals) ||
+        !pmnStateDB->LoadMap(DB_BUDGET_SEEN_VOTE, objToLoad.mapSeenMasternodeBudgetVotes) ||
+        !pmnStateDB->LoadMap(DB_BUDGET_SEEN_FINALIZED, objToLoad.mapSeenFinalizedBudgets) ||
+        !pmnStateDB->LoadMap(DB_BUDGET_SEEN_FINALIZED_VOTE, objToLoad.mapSeenFinalizedBudgetVotes) ||
+        !pmnStateDB->LoadMap(DB_BUDGET_ORPHAN_VOTE, objToLoad.mapOrphanMasternodeBudgetVotes) ||
+        !pmnStateDB->LoadMap(DB_BUDGET_ORPHAN_FINALIZED_VOTE, objToLoad.mapOrphanFinalizedBudgetVotes) ||
+        !pmnStateDB->LoadMap(DB_BUDGET_PROPOSAL, objToLoad.mapProposals) ||
+        !pmnStateDB->LoadMap(DB_BUDGET_FINALIZED, objToLoad.mapFinalizedBudgets)) {
+        objToLoad.Clear();
+        return IncorrectFormat;
+    }
+
+    return Ok;
+}
+
+CBudgetDB::ReadResult CBudgetDB::ReadFile(CBudgetManager& objToLoad)
+{
     // open input file, and associate with CAutoFile
     FILE* file = fopen(pathDB.string().c_str(), "rb");
     CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
@@ -382,15 +444,6 @@ CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad, bool fDryRun)
         return IncorrectFormat;
     }
 
-    LogPrint("mnbudget","Loaded info from budget.dat  %dms\n", GetTimeMillis() - nStart);
-    LogPrint("mnbudget","  %s\n", objToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint("mnbudget","Budget manager - cleaning....\n");
-        objToLoad.CheckAndRemove();
-        LogPrint("mnbudget","Budget manager - result:\n");
-        LogPrint("mnbudget","  %s\n", objToLoad.ToString());
-    }
-
     return Ok;
 }
 
@@ -399,23 +452,8 @@ void DumpBudgets()
     int64_t nStart = GetTimeMillis();
 
     CBudgetDB budgetdb;
-    CBudgetManager tempBudget;
-
-    LogPrint("mnbudget","Verifying budget.dat format...\n");
-    CBudgetDB::ReadResult readResult = budgetdb.Read(tempBudget, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CBudgetDB::FileError)
-        LogPrint("mnbudget","Missing budgets file - budget.dat, will try to recreate\n");
-    else if (readResult != CBudgetDB::Ok) {
-        LogPrint("mnbudget","Error reading budget.dat: ");
-        if (readResult == CBudgetDB::IncorrectFormat)
-            LogPrint("mnbudget","magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint("mnbudget","file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
-    LogPrint("mnbudget","Writting info to budget.dat...\n");
+
+    LogPrint("mnbudget","Writting info to masternode state store...\n");
     budgetdb.Write(budget);
 
     LogPrint("mnbudget","Budget dump finished  %dms\n", GetTimeMillis() - nStart);
@@ -448,6 +486,7 @@ bool CBudgetManager::AddProposal(CBudgetProposal& budgetProposal)
     }
 
     mapProposals.insert(std::make_pair(budgetProposal.GetHash(), budgetProposal));
+    hashBudgetTip = 0;
     LogPrint("mnbudget","CBudgetManager::AddProposal - proposal %s added\n", budgetProposal.GetName ().c_str ());
     return true;
 }
@@ -518,6 +557,7 @@ void CBudgetManager::CheckAndRemove()
     // Remove invalid entries by overwriting complete map
     mapFinalizedBudgets.swap(tmpMapFinalizedBudgets);
     mapProposals.swap(tmpMapProposals);
+    hashBudgetTip = 0;
 
     // clang doesn't accept copy assignemnts :-/
     // mapFinalizedBudgets = tmpMapFinalizedBudgets;
@@ -772,7 +812,8 @@ std::vector<CBudgetProposal*> CBudgetManager::GetAllProposals()
 
     std::map<uint256, CBudgetProposal>::iterator it = mapProposals.begin();
     while (it != mapProposals.end()) {
-        (*it).second.CleanAndRemove(false);
+        if ((*it).second.CleanAndRemove(false))
+            hashBudgetTip = 0;
 
         CBudgetProposal* pbudgetProposal = &((*it).second);
         vBudgetProposalRet.push_back(pbudgetProposal);
@@ -800,6 +841,22 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
 {
     LOCK(cs);
 
+    std::vector<CBudgetProposal*> vBudgetProposalsRet;
+
+    CBlockIndex* pindexPrev;
+    {
+        LOCK(cs_main);
+        pindexPrev = chainActive.Tip();
+    }
+    if (pindexPrev == NULL) return vBudgetProposalsRet;
+
+    // IsPassing depends on the enabled count and vote validity on the list members,
+    // so the ranking is only reused while the tip and the masternode list are unchanged
+    int mnCount = mnodeman.CountEnabled(ActiveProtocol());
+    int mnListSize = mnodeman.size();
+    if (pindexPrev->GetBlockHash() == hashBudgetTip && mnCount == nBudgetMnCount && mnListSize == nBudgetMnListSize)
+        return vBudgetRanked;
+
     // ------- Sort budgets by Yes Count
 
     std::vector<std::pair<CBudgetProposal*, int> > vBudgetPorposalsSort;
@@ -815,20 +872,10 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
 
     // ------- Grab The Budgets In Order
 
-    std::vector<CBudgetProposal*> vBudgetProposalsRet;
-
     CAmount nBudgetAllocated = 0;
 
-    CBlockIndex* pindexPrev;
-    {
-        LOCK(cs_main);
-        pindexPrev = chainActive.Tip();
-    }
-    if (pindexPrev == NULL) return vBudgetProposalsRet;
-
     int nBlockStart = pindexPrev->nHeight - pindexPrev->nHeight % Params().GetBudgetCycleBlocks() + Params().GetBudgetCycleBlocks();
     int nBlockEnd = nBlockStart + Params().GetBudgetCycleBlocks() - 1;
-    int mnCount = mnodeman.CountEnabled(ActiveProtocol());
     CAmount nTotalBudget = GetTotalBudget(nBlockStart);
 
     std::vector<std::pair<CBudgetProposal*, int> >::iterator it2 = vBudgetPorposalsSort.begin();
@@ -856,13 +903,18 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
         else {
             LogPrint("mnbudget","CBudgetManager::GetBudget() -   Check 1 failed: valid=%d | %ld <= %ld | %ld >= %ld | Yeas=%d Nays=%d Count=%d | established=%d\n",
                       pbudgetProposal->fValid, pbudgetProposal->nBlockStart, nBlockStart, pbudgetProposal->nBlockEnd,
-                      nBlockEnd, pbudgetProposal->GetYeas(), pbudgetProposal->GetNays(), mnodeman.CountEnabled(ActiveProtocol()) / 10,
+                      nBlockEnd, pbudgetProposal->GetYeas(), pbudgetProposal->GetNays(), mnCount / 10,
                       pbudgetProposal->IsEstablished());
         }
 
         ++it2;
     }
 
+    hashBudgetTip = pindexPrev->GetBlockHash();
+    nBudgetMnCount = mnCount;
+    nBudgetMnListSize = mnListSize;
+    vBudgetRanked = vBudgetProposalsRet;
+
     return vBudgetProposalsRet;
 }
 
@@ -947,6 +999,7 @@ CAmount CBudgetManager::GetTotalBudget(int nHeight)
 
 void CBudgetManager::NewBlock()
 {
+    TRACE_SCOPE("masternode", "BudgetNewBlock");
     TRY_LOCK(cs, fBudgetNewBlock);
     if (!fBudgetNewBlock) return;
 
@@ -993,7 +1046,8 @@ void CBudgetManager::NewBlock()
     LogPrint("mnbudget","CBudgetManager::NewBlock - mapProposals cleanup - size: %d\n", mapProposals.size());
     std::map<uint256, CBudgetProposal>::iterator it2 = mapProposals.begin();
     while (it2 != mapProposals.end()) {
-        (*it2).second.CleanAndRemove(false);
+        if ((*it2).second.CleanAndRemove(false))
+            hashBudgetTip = 0;
         ++it2;
     }
 
@@ -1410,7 +1464,11 @@ bool CBudgetManager::UpdateProposal(CBudgetVote& vote, CNode* pfrom, std::string
     }
 
 
-    return mapProposals[vote.nProposalHash].AddOrUpdateVote(vote, strError);
+    if (!mapProposals[vote.nProposalHash].AddOrUpdateVote(vote, strError))
+        return false;
+
+    hashBudgetTip = 0;
+    return true;
 }
 
 bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pfrom, std::string& strError)
@@ -1446,6 +1504,9 @@ CBudgetProposal::CBudgetProposal()
     nBlockEnd = 0;
     nAmount = 0;
     nTime = 0;
+    nYeas = 0;
+    nNays = 0;
+    nAbstains = 0;
     fValid = true;
 }
 
@@ -1458,6 +1519,9 @@ CBudgetProposal::CBudgetProposal(std::string strProposalNameIn, std::string strU
     address = addressIn;
     nAmount = nAmountIn;
     nFeeTXHash = nFeeTXHashIn;
+    nYeas = 0;
+    nNays = 0;
+    nAbstains = 0;
     fValid = true;
 }
 
@@ -1472,6 +1536,9 @@ CBudgetProposal::CBudgetProposal(const CBudgetProposal& other)
     nTime = other.nTime;
     nFeeTXHash = other.nFeeTXHash;
     mapVotes = other.mapVotes;
+    nYeas = other.nYeas;
+    nNays = other.nNays;
+    nAbstains = other.nAbstains;
     fValid = true;
 }
 
@@ -1607,19 +1674,53 @@ bool CBudgetProposal::AddOrUpdateVote(CBudgetVote& vote, std::string& strError)
         return false;
     }
 
+    if (mapVotes.count(hash))
+        CountVote(mapVotes[hash], -1);
     mapVotes[hash] = vote;
+    CountVote(vote, 1);
     LogPrint("mnbudget", "CBudgetProposal::AddOrUpdateVote - %s %s\n", strAction.c_str(), vote.GetHash().ToString().c_str());
 
     return true;
 }
 
 // If masternode voted for a proposal, but is now invalid -- remove the vote
-void CBudgetProposal::CleanAndRemove(bool fSignatureCheck)
+bool CBudgetProposal::CleanAndRemove(bool fSignatureCheck)
 {
+    bool fChanged = false;
     std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
 
     while (it != mapVotes.end()) {
-        (*it).second.fValid = (*it).second.SignatureValid(fSignatureCheck);
+        bool fVoteValid = (*it).second.SignatureValid(fSignatureCheck);
+        if ((*it).second.fValid != fVoteValid) {
+            CountVote((*it).second, -1);
+            (*it).second.fValid = fVoteValid;
+            CountVote((*it).second, 1);
+            fChanged = true;
+        }
+        ++it;
+    }
+
+    return fChanged;
+}
+
+void CBudgetProposal::CountVote(const CBudgetVote& vote, int nDelta)
+{
+    if (!vote.fValid) return;
+
+    if (vote.nVote == VOTE_YES) nYeas += nDelta;
+    if (vote.nVote == VOTE_NO) nNays += nDelta;
+    if (vote.nVote == VOTE_ABSTAIN) nAbstains += nDelta;
+}
+
+void CBudgetProposal::RecountVotes()
+{
+    nYeas = 0;
+    nNays = 0;
+    nAbstains = 0;
+
+    std::map<uint256, CBudgetVote>::const_iterator it = mapVotes.begin();
+    while (it != mapVotes.end()) {
+        CountVote((*it).second, 1);
         ++it;
     }
 }
@@ -1644,41 +1745,17 @@ double CBudgetProposal::GetRatio()
 
 int CBudgetProposal::GetYeas() const
 {
-    int ret = 0;
-
-    std::map<uint256, CBudgetVote>::const_iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_YES && (*it).second.fValid) ret++;
-        ++it;
-    }
-
-    return ret;
+    return nYeas;
 }
 
 int CBudgetProposal::GetNays() const
 {
-    int ret = 0;
-
-    std::map<uint256, CBudgetVote>::const_iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_NO && (*it).second.fValid) ret++;
-        ++it;
-    }
-
-    return ret;
+    return nNays;
 }
 
 int CBudgetProposal::GetAbstains() const
 {
-    int ret = 0;
-
-    std::map<uint256, CBudgetVote>::const_iterator it = mapVotes.begin();
-    while (it != mapVotes.end()) {
-        if ((*it).second.nVote == VOTE_ABSTAIN && (*it).second.fValid) ret++;
-        ++it;
-    }
-
-    return ret;
+    return nAbstains;
 }
 
 int CBudgetProposal::GetBlockStartCycle()
@@ -1785,7 +1862,7 @@ bool CBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + std::to_string(nVote) + std::to_string(nTime);
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrint("mnbudget","CBudgetVote::Sign - Error upon calling SignMessage");
@@ -1803,7 +1880,7 @@ bool CBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 bool CBudgetVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + std::to_string(nVote) + std::to_string(nTime);
+    std::string strMessage = GetStrMessage();
 
     CMasternode* pmn = mnodeman.Find(vin);
 
@@ -1824,6 +1901,11 @@ bool CBudgetVote::SignatureValid(bool fSignatureCheck)
     return true;
 }
 
+std::string CBudgetVote::GetStrMessage() const
+{
+    return vin.prevout.ToStringShort() + nProposalHash.ToString() + std::to_string(nVote) + std::to_string(nTime);
+}
+
 CFinalizedBudget::CFinalizedBudget()
 {
     strBudgetName = "";
@@ -2315,7 +2397,7 @@ bool CFinalizedBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + std::to_string(nTime);
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrint("mnbudget","CFinalizedBudgetVote::Sign - Error upon calling SignMessage");
@@ -2334,7 +2416,7 @@ bool CFinalizedBudgetVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
 
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + std::to_string(nTime);
+    std::string strMessage = GetStrMessage();
 
     CMasternode* pmn = mnodeman.Find(vin);
 
@@ -2353,6 +2435,11 @@ bool CFinalizedBudgetVote::SignatureValid(bool fSignatureCheck)
     return true;
 }
 
+std::string CFinalizedBudgetVote::GetStrMessage() const
+{
+    return vin.prevout.ToStringShort() + nBudgetHash.ToString() + std::to_string(nTime);
+}
+
 std::string CBudgetManager::ToString() const
 {
     std::ostringstream info;
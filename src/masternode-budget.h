@@ -73,6 +73,7 @@ public:
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool SignatureValid(bool fSignatureCheck);
     void Relay();
+    std::string GetStrMessage() const;
 
     std::string GetVoteString()
     {
@@ -125,6 +126,7 @@ public:
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool SignatureValid(bool fSignatureCheck);
     void Relay();
+    std::string GetStrMessage() const;
 
     uint256 GetHash()
     {
@@ -169,6 +171,10 @@ public:
     CBudgetDB();
     bool Write(const CBudgetManager& objToSave);
     ReadResult Read(CBudgetManager& objToLoad, bool fDryRun = false);
+
+private:
+    ReadResult ReadStore(CBudgetManager& objToLoad, bool& fFound);
+    ReadResult ReadFile(CBudgetManager& objToLoad);
 };
 
 
@@ -182,6 +188,13 @@ private:
     // XX42    std::map<uint256, CTransaction> mapCollateral;
     std::map<uint256, uint256> mapCollateralTxids;
 
+    // ranked budget returned by GetBudget for the tip hashBudgetTip and the masternode counts it was
+    // ranked with, reset when proposals or votes change
+    uint256 hashBudgetTip;
+    int nBudgetMnCount;
+    int nBudgetMnListSize;
+    std::vector<CBudgetProposal*> vBudgetRanked;
+
 public:
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
@@ -197,7 +210,7 @@ public:
     std::map<uint256, CFinalizedBudgetVote> mapSeenFinalizedBudgetVotes;
     std::map<uint256, CFinalizedBudgetVote> mapOrphanFinalizedBudgetVotes;
 
-    CBudgetManager()
+    CBudgetManager() : nBudgetMnCount(0), nBudgetMnListSize(0)
     {
         mapProposals.clear();
         mapFinalizedBudgets.clear();
@@ -249,6 +262,7 @@ public:
         LOCK(cs);
 
         LogPrintf("Budget object cleared\n");
+        hashBudgetTip = 0;
         mapProposals.clear();
         mapFinalizedBudgets.clear();
         mapSeenMasternodeBudgetProposals.clear();
@@ -463,6 +477,13 @@ private:
     mutable CCriticalSection cs;
     CAmount nAlloted;
 
+    // tallies of the valid votes in mapVotes, kept up to date by AddOrUpdateVote and CleanAndRemove
+    int nYeas;
+    int nNays;
+    int nAbstains;
+
+    void CountVote(const CBudgetVote& vote, int nDelta);
+
 public:
     bool fValid;
     std::string strProposalName;
@@ -479,6 +500,7 @@ public:
     int64_t nTime;
     uint256 nFeeTXHash;
 
+    // only change through AddOrUpdateVote and CleanAndRemove, or call RecountVotes afterwards
     std::map<uint256, CBudgetVote> mapVotes;
     //cache object
 
@@ -514,7 +536,9 @@ public:
     void SetAllotted(CAmount nAllotedIn) { nAlloted = nAllotedIn; }
     CAmount GetAllotted() { return nAlloted; }
 
-    void CleanAndRemove(bool fSignatureCheck);
+    // returns true if any vote changed validity
+    bool CleanAndRemove(bool fSignatureCheck);
+    void RecountVotes();
 
     uint256 GetHash() const
     {
@@ -548,6 +572,8 @@ public:
 
         //for saving to the serialized db
         READWRITE(mapVotes);
+        if (ser_action.ForRead())
+            RecountVotes();
     }
 };
 
@@ -576,6 +602,8 @@ public:
         swap(first.nTime, second.nTime);
         swap(first.nFeeTXHash, second.nFeeTXHash);
         first.mapVotes.swap(second.mapVotes);
+        first.RecountVotes();
+        second.RecountVotes();
     }
 
     CBudgetProposalBroadcast& operator=(CBudgetProposalBroadcast from)
@@ -9,6 +9,7 @@
 #include "chainparams.h"
 #include "masternode-budget.h"
 #include "masternode-sync.h"
+#include "masternodedb.h"
 #include "masternodeman.h"
 #include "obfuscation.h"
 #include "spork.h"
@@ -28,6 +29,9 @@ CCriticalSection cs_mapMasternodePayeeVotes;
 // CMasternodePaymentDB
 //
 
+static const char DB_PAYMENT_VOTE = 'w';
+static const char DB_PAYMENT_BLOCK = 'k';
+
 CMasternodePaymentDB::CMasternodePaymentDB()
 {
     pathDB = GetDataDir() / "mnpayments.dat";
@@ -36,31 +40,26 @@ CMasternodePaymentDB::CMasternodePaymentDB()
 
 bool CMasternodePaymentDB::Write(const CMasternodePayments& objToSave)
 {
+    if (pmnStateDB == NULL)
+        return error("%s : Masternode state store is not open", __func__);
+
     int64_t nStart = GetTimeMillis();
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << strMagicMessage;                   // masternode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
+    {
+        LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
+
+        pmnStateDB->DumpHeader(strMagicMessage);
+        pmnStateDB->DumpMap(DB_PAYMENT_VOTE, objToSave.mapMasternodePayeeVotes);
     }
-    fileout.fclose();
 
-    LogPrint("masternode","Written info to mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
+    if (!pmnStateDB->CommitDump(std::string(1, DB_PAYMENT_VOTE) + DB_PAYMENT_BLOCK))
+        return error("%s : Failed to write masternode payment state", __func__);
+
+    // the store supersedes the flat file once it has been written
+    if (boost::filesystem::exists(pathDB))
+        boost::filesystem::remove(pathDB);
+
+    LogPrint("masternode","Written info to masternode state store  %dms\n", GetTimeMillis() - nStart);
 
     return true;
 }
@@ -68,6 +67,54 @@ bool CMasternodePaymentDB::Write(const CMasternodePayments& objToSave)
 CMasternodePaymentDB::ReadResult CMasternodePaymentDB::Read(CMasternodePayments& objToLoad, bool fDryRun)
 {
     int64_t nStart = GetTimeMillis();
+
+    bool fFound = false;
+    ReadResult result = ReadStore(objToLoad, fFound);
+    // nothing in the store yet, migrate from the flat file
+    if (result == Ok && !fFound)
+        result = ReadFile(objToLoad);
+    if (result != Ok)
+        return result;
+
+    LogPrint("masternode","Loaded info from %s  %dms\n", fFound ? "masternode state store" : "mnpayments.dat", GetTimeMillis() - nStart);
+    LogPrint("masternode","  %s\n", objToLoad.ToString());
+    if (!fDryRun) {
+        LogPrint("masternode","Masternode payments manager - cleaning....\n");
+        objToLoad.CleanPaymentList();
+        LogPrint("masternode","Masternode payments manager - result:\n");
+        LogPrint("masternode","  %s\n", objToLoad.ToString());
+    }
+
+    return Ok;
+}
+
+CMasternodePaymentDB::ReadResult CMasternodePaymentDB::ReadStore(CMasternodePayments& objToLoad, bool& fFound)
+{
+    fFound = false;
+    if (pmnStateDB == NULL)
+        return Ok;
+
+    if (!pmnStateDB->LoadHeader(strMagicMessage, fFound))
+        return IncorrectMagicNumber;
+    if (!fFound)
+        return Ok;
+
+    LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
+
+    // block records of older versions are only read so the next dump erases them
+    std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
+    if (!pmnStateDB->LoadMap(DB_PAYMENT_VOTE, objToLoad.mapMasternodePayeeVotes) ||
+        !pmnStateDB->LoadMap(DB_PAYMENT_BLOCK, mapMasternodeBlocks)) {
+        objToLoad.Clear();
+        return IncorrectFormat;
+    }
+    objToLoad.RebuildBlockVotes();
+
+    return Ok;
+}
+
+CMasternodePaymentDB::ReadResult CMasternodePaymentDB::ReadFile(CMasternodePayments& objToLoad)
+{
     // open input file, and associate with CAutoFile
     FILE* file = fopen(pathDB.string().c_str(), "rb");
     CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
@@ -135,15 +182,6 @@ CMasternodePaymentDB::ReadResult CMasternodePaymentDB::Read(CMasternodePayments&
         return IncorrectFormat;
     }
 
-    LogPrint("masternode","Loaded info from mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
-    LogPrint("masternode","  %s\n", objToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint("masternode","Masternode payments manager - cleaning....\n");
-        objToLoad.CleanPaymentList();
-        LogPrint("masternode","Masternode payments manager - result:\n");
-        LogPrint("masternode","  %s\n", objToLoad.ToString());
-    }
-
     return Ok;
 }
 
@@ -152,26 +190,11 @@ void DumpMasternodePayments()
     int64_t nStart = GetTimeMillis();
 
     CMasternodePaymentDB paymentdb;
-    CMasternodePayments tempPayments;
-
-    LogPrint("masternode","Verifying mnpayments.dat format...\n");
-    CMasternodePaymentDB::ReadResult readResult = paymentdb.Read(tempPayments, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CMasternodePaymentDB::FileError)
-        LogPrint("masternode","Missing budgets file - mnpayments.dat, will try to recreate\n");
-    else if (readResult != CMasternodePaymentDB::Ok) {
-        LogPrint("masternode","Error reading mnpayments.dat: ");
-        if (readResult == CMasternodePaymentDB::IncorrectFormat)
-            LogPrint("masternode","magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint("masternode","file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
-    LogPrint("masternode","Writting info to mnpayments.dat...\n");
+
+    LogPrint("masternode","Writting info to masternode state store...\n");
     paymentdb.Write(masternodePayments);
 
-    LogPrint("masternode","Budget dump finished  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("masternode","Masternode payments dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
 bool IsBlockValueValid(const CBlock& block, CAmount nExpectedValue, CAmount nMinted)
@@ -487,14 +510,14 @@ void CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom, std::st
             winner.nBlockHeight,
             winner.vinMasternode.prevout.ToStringShort() );
 
-        if (masternodePayments.mapMasternodePayeeVotes.count(winner.GetHash())) {
+        if (masternodePayments.HasVote(winner.GetHash())) {
             LogPrint("mnpayments", "%s - already seen\n", logString.c_str());
             masternodeSync.AddedMasternodeWinner(winner.GetHash());
             return;
         }
 
         int nFirstBlock = nHeight - (mnodeman.CountEnabled(winner.payeeLevel) * 1.25);
-        if (winner.nBlockHeight < nFirstBlock || winner.nBlockHeight > nHeight + 20) {
+        if (winner.nBlockHeight < nFirstBlock || winner.nBlockHeight > nHeight + MNPAYMENTS_FUTURE_BLOCKS) {
             LogPrint("mnpayments", "%s - out of range\n", logString.c_str());
 
             // Ban after 100 times
@@ -545,7 +568,7 @@ bool CMasternodePaymentWinner::Sign(CKey& keyMasternode, CPubKey& pubKeyMasterno
     std::string errorMessage;
     std::string strMasterNodeSignMessage;
 
-    std::string strMessage = vinMasternode.prevout.ToStringShort() + std::to_string(nBlockHeight) + payee.ToString();
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrint("masternode","CMasternodePing::Sign() - Error: %s\n", errorMessage.c_str());
@@ -562,11 +585,37 @@ bool CMasternodePaymentWinner::Sign(CKey& keyMasternode, CPubKey& pubKeyMasterno
 
 bool CMasternodePayments::GetBlockPayee(int nBlockHeight, unsigned mnlevel, CScript& payee)
 {
-    if (mapMasternodeBlocks.count(nBlockHeight)) {
-        return mapMasternodeBlocks[nBlockHeight].GetPayee(mnlevel, payee);
-    }
+    LOCK(cs_mapMasternodeBlocks);
 
-    return false;
+    const CBlockVotes* pblock = FindBlockVotes(nBlockHeight);
+    return pblock && pblock->payees.GetPayee(mnlevel, payee);
+}
+
+bool CMasternodePayments::HasPayeeWithVotes(int nBlockHeight, const CScript& payee, const CTxIn& vin, int nVotesReq)
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    CBlockVotes* pblock = FindBlockVotes(nBlockHeight);
+    return pblock && pblock->payees.HasPayeeWithVotes(payee, vin, nVotesReq);
+}
+
+bool CMasternodePayments::HasVote(const uint256& hash) const
+{
+    LOCK(cs_mapMasternodePayeeVotes);
+
+    return mapMasternodePayeeVotes.count(hash);
+}
+
+bool CMasternodePayments::GetVote(const uint256& hash, CMasternodePaymentWinner& winner) const
+{
+    LOCK(cs_mapMasternodePayeeVotes);
+
+    VoteMap::const_iterator it = mapMasternodePayeeVotes.find(hash);
+    if (it == mapMasternodePayeeVotes.end())
+        return false;
+
+    winner = it->second;
+    return true;
 }
 
 // Is this masternode scheduled to get paid soon?
@@ -587,11 +636,10 @@ bool CMasternodePayments::IsScheduled(CMasternode& mn, int nNotBlockHeight) cons
     CScript payee;
     for (int64_t h = nHeight; h <= nHeight + 8; h++) {
         if (h == nNotBlockHeight) continue;
-        if (mapMasternodeBlocks.count(h)) {
-            if (mapMasternodeBlocks.at(h).GetPayee(mn.Level(), payee)) {
-                if (mnpayee == payee) {
-                    return true;
-                }
+        const CBlockVotes* pblock = FindBlockVotes(h);
+        if (pblock && pblock->payees.GetPayee(mn.Level(), payee)) {
+            if (mnpayee == payee) {
+                return true;
             }
         }
     }
@@ -599,6 +647,18 @@ bool CMasternodePayments::IsScheduled(CMasternode& mn, int nNotBlockHeight) cons
     return false;
 }
 
+bool CMasternodePayments::CanVote(const COutPoint& outMasternode, int nBlockHeight, unsigned mnlevel)
+{
+    LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
+
+    CBlockVotes* pblock = InsertBlockVotes(nBlockHeight);
+    if (pblock == NULL)
+        return false;
+
+    //record this masternode voted
+    return pblock->setVoters.insert(std::make_pair(outMasternode, mnlevel)).second;
+}
+
 bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerIn)
 {
     uint256 blockHash = 0;
@@ -606,24 +666,9 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
         return false;
     }
 
-    {
-        LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
-
-        if (mapMasternodePayeeVotes.count(winnerIn.GetHash())) {
-            return false;
-        }
-
-        mapMasternodePayeeVotes[winnerIn.GetHash()] = winnerIn;
-
-        if (!mapMasternodeBlocks.count(winnerIn.nBlockHeight)) {
-            CMasternodeBlockPayees blockPayees(winnerIn.nBlockHeight);
-            mapMasternodeBlocks[winnerIn.nBlockHeight] = blockPayees;
-        }
-    }
-
-    mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payeeLevel, winnerIn.payee, winnerIn.payeeVin, 1);
+    LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
 
-    return true;
+    return AddVote(winnerIn);
 }
 
 bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew, CAmount& nBlockValue, bool fProofOfStake)
@@ -739,8 +784,9 @@ std::string CMasternodePayments::GetRequiredPaymentsString(int nBlockHeight)
 {
     LOCK(cs_mapMasternodeBlocks);
 
-    if (mapMasternodeBlocks.count(nBlockHeight)) {
-        return mapMasternodeBlocks[nBlockHeight].GetRequiredPaymentsString();
+    CBlockVotes* pblock = FindBlockVotes(nBlockHeight);
+    if (pblock) {
+        return pblock->payees.GetRequiredPaymentsString();
     }
 
     return "Unknown";
@@ -750,8 +796,9 @@ bool CMasternodePayments::IsTransactionValid(const CTransaction& txNew, int nBlo
 {
     LOCK(cs_mapMasternodeBlocks);
 
-    if (mapMasternodeBlocks.count(nBlockHeight)) {
-        return mapMasternodeBlocks[nBlockHeight].IsTransactionValid(txNew, nBlockValue, fProofOfStake);
+    CBlockVotes* pblock = FindBlockVotes(nBlockHeight);
+    if (pblock) {
+        return pblock->payees.IsTransactionValid(txNew, nBlockValue, fProofOfStake);
     }
 
     return true;
@@ -771,18 +818,12 @@ void CMasternodePayments::CleanPaymentList()
     //keep up to five cycles for historical sake
     int nLimit = std::max(int(mnodeman.size() * 1.25), 1000);
 
-    std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
-    while (it != mapMasternodePayeeVotes.end()) {
-        CMasternodePaymentWinner winner = (*it).second;
+    ResizeBlockRing(nLimit + MNPAYMENTS_FUTURE_BLOCKS + 1);
 
-        if (nHeight - winner.nBlockHeight > nLimit) {
-            LogPrint("mnpayments", "CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", winner.nBlockHeight);
-            masternodeSync.mapSeenSyncMNW.erase((*it).first);
-            mapMasternodePayeeVotes.erase(it++);
-            mapMasternodeBlocks.erase(winner.nBlockHeight);
-        } else {
-            ++it;
-        }
+    // old votes go with the slot of their height, so only the window is walked
+    for (CBlockVotes& block : vBlockRing) {
+        if (block.payees.nBlockHeight != 0 && nHeight - block.payees.nBlockHeight > nLimit)
+            EraseBlockVotes(block);
     }
 }
 
@@ -928,7 +969,7 @@ bool CMasternodePaymentWinner::SignatureValid()
     CMasternode* pmn = mnodeman.Find(vinMasternode);
 
     if (pmn != NULL) {
-        std::string strMessage = vinMasternode.prevout.ToStringShort() + std::to_string(nBlockHeight) + payee.ToString();
+        std::string strMessage = GetStrMessage();
 
         std::string errorMessage = "";
         if (!obfuScationSigner.VerifyMessage(pmn->pubKeyMasternode, vchSig, strMessage, errorMessage)) {
@@ -941,9 +982,14 @@ bool CMasternodePaymentWinner::SignatureValid()
     return false;
 }
 
+std::string CMasternodePaymentWinner::GetStrMessage() const
+{
+    return vinMasternode.prevout.ToStringShort() + std::to_string(nBlockHeight) + payee.ToString();
+}
+
 void CMasternodePayments::Sync(CNode* node, int nCountNeeded)
 {
-    LOCK(cs_mapMasternodePayeeVotes);
+    LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
 
     int nHeight;
     {
@@ -954,22 +1000,28 @@ void CMasternodePayments::Sync(CNode* node, int nCountNeeded)
 
     std::map<unsigned, int> mn_counts = mnodeman.CountEnabledByLevels();
 
-    for(auto& count : mn_counts)
+    int nMaxCount = 0;
+    for(auto& count : mn_counts) {
         count.second = std::min(nCountNeeded, (int)(count.second * 1.25));
+        nMaxCount = std::max(nMaxCount, count.second);
+    }
 
     int nInvCount = 0;
 
-    for(const auto& vote : mapMasternodePayeeVotes) {
-        const CMasternodePaymentWinner& winner = vote.second;
+    for(int h = nHeight - nMaxCount; h <= nHeight + MNPAYMENTS_FUTURE_BLOCKS; ++h) {
+        const CBlockVotes* pblock = FindBlockVotes(h);
+        if(!pblock)
+            continue;
 
-        bool push = winner.nBlockHeight >= nHeight - mn_counts[winner.payeeLevel]
-                  && winner.nBlockHeight <= nHeight + 20;
+        for(const VoteMap::iterator& it : pblock->vecVotes) {
+            const CMasternodePaymentWinner& winner = it->second;
 
-        if(!push)
-            continue;
+            if(winner.nBlockHeight < nHeight - mn_counts[winner.payeeLevel])
+                continue;
 
-        node->PushInventory(CInv(MSG_MASTERNODE_WINNER, winner.GetHash()));
-        ++nInvCount;
+            node->PushInventory(CInv(MSG_MASTERNODE_WINNER, it->first));
+            ++nInvCount;
+        }
     }
     node->PushMessage("ssc", MASTERNODE_SYNC_MNW, nInvCount);
 }
@@ -978,7 +1030,7 @@ std::string CMasternodePayments::ToString() const
 {
     std::ostringstream info;
 
-    info << "Votes: " << (int)mapMasternodePayeeVotes.size() << ", Blocks: " << (int)mapMasternodeBlocks.size();
+    info << "Votes: " << (int)mapMasternodePayeeVotes.size() << ", Blocks: " << nBlocks;
 
     return info.str();
 }
@@ -990,12 +1042,10 @@ int CMasternodePayments::GetOldestBlock()
 
     int nOldestBlock = std::numeric_limits<int>::max();
 
-    std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.begin();
-    while (it != mapMasternodeBlocks.end()) {
-        if ((*it).first < nOldestBlock) {
-            nOldestBlock = (*it).first;
+    for (const CBlockVotes& block : vBlockRing) {
+        if (block.payees.nBlockHeight != 0 && block.payees.nBlockHeight < nOldestBlock) {
+            nOldestBlock = block.payees.nBlockHeight;
         }
-        it++;
     }
 
     return nOldestBlock;
@@ -1008,13 +1058,116 @@ int CMasternodePayments::GetNewestBlock()
 
     int nNewestBlock = 0;
 
-    std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.begin();
-    while (it != mapMasternodeBlocks.end()) {
-        if ((*it).first > nNewestBlock) {
-            nNewestBlock = (*it).first;
+    for (const CBlockVotes& block : vBlockRing) {
+        if (block.payees.nBlockHeight > nNewestBlock) {
+            nNewestBlock = block.payees.nBlockHeight;
         }
-        it++;
     }
 
     return nNewestBlock;
 }
+
+CMasternodePayments::CMasternodePayments()
+{
+    nSyncedFromPeer = 0;
+    nLastBlockHeight = 0;
+    vBlockRing.resize(MNPAYMENTS_MIN_RING_SIZE);
+    nBlocks = 0;
+}
+
+CMasternodePayments::CBlockVotes* CMasternodePayments::FindBlockVotes(int nBlockHeight)
+{
+    if (nBlockHeight <= 0)
+        return NULL;
+
+    CBlockVotes& block = vBlockRing[nBlockHeight & (vBlockRing.size() - 1)];
+    return block.payees.nBlockHeight == nBlockHeight ? &block : NULL;
+}
+
+const CMasternodePayments::CBlockVotes* CMasternodePayments::FindBlockVotes(int nBlockHeight) const
+{
+    return const_cast<CMasternodePayments*>(this)->FindBlockVotes(nBlockHeight);
+}
+
+// Take the slot of a height, evicting the older height it held. Heights older than the one in
+// their slot have fallen out of the window and get no slot.
+CMasternodePayments::CBlockVotes* CMasternodePayments::InsertBlockVotes(int nBlockHeight)
+{
+    if (nBlockHeight <= 0)
+        return NULL;
+
+    CBlockVotes& block = vBlockRing[nBlockHeight & (vBlockRing.size() - 1)];
+    if (block.payees.nBlockHeight == nBlockHeight)
+        return &block;
+    if (block.payees.nBlockHeight > nBlockHeight)
+        return NULL;
+
+    if (block.payees.nBlockHeight != 0)
+        EraseBlockVotes(block);
+
+    block.payees.nBlockHeight = nBlockHeight;
+    nBlocks++;
+    return &block;
+}
+
+void CMasternodePayments::EraseBlockVotes(CBlockVotes& block)
+{
+    LogPrint("mnpayments", "CMasternodePayments::EraseBlockVotes - Removing %d old Masternode payments - block %d\n", block.vecVotes.size(), block.payees.nBlockHeight);
+
+    for (const VoteMap::iterator& it : block.vecVotes) {
+        masternodeSync.mapSeenSyncMNW.erase(it->first);
+        mapMasternodePayeeVotes.erase(it);
+    }
+
+    block = CBlockVotes();
+    nBlocks--;
+}
+
+// Grow the ring to the next power of two holding the window. Heights in distinct slots stay in
+// distinct slots, so the entries move over without evictions.
+void CMasternodePayments::ResizeBlockRing(size_t nWindow)
+{
+    size_t nSize = vBlockRing.size();
+    while (nSize < nWindow)
+        nSize <<= 1;
+    if (nSize == vBlockRing.size())
+        return;
+
+    std::vector<CBlockVotes> vOldRing(nSize);
+    vOldRing.swap(vBlockRing);
+    for (CBlockVotes& block : vOldRing) {
+        if (block.payees.nBlockHeight != 0)
+            std::swap(vBlockRing[block.payees.nBlockHeight & (nSize - 1)], block);
+    }
+}
+
+bool CMasternodePayments::AddVote(const CMasternodePaymentWinner& winner)
+{
+    uint256 hash = winner.GetHash();
+    if (mapMasternodePayeeVotes.count(hash))
+        return false;
+
+    CBlockVotes* pblock = InsertBlockVotes(winner.nBlockHeight);
+    if (pblock == NULL)
+        return false;
+
+    pblock->vecVotes.push_back(mapMasternodePayeeVotes.insert(std::make_pair(hash, winner)).first);
+    pblock->setVoters.insert(std::make_pair(winner.vinMasternode.prevout, winner.payeeLevel));
+    pblock->payees.AddPayee(winner.payeeLevel, winner.payee, winner.payeeVin, 1);
+
+    return true;
+}
+
+// Index freshly loaded votes into the ring and tally them
+void CMasternodePayments::RebuildBlockVotes()
+{
+    LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
+
+    VoteMap mapVotes;
+    mapVotes.swap(mapMasternodePayeeVotes);
+    vBlockRing.assign(vBlockRing.size(), CBlockVotes());
+    nBlocks = 0;
+
+    for (const std::pair<const uint256, CMasternodePaymentWinner>& vote : mapVotes)
+        AddVote(vote.second);
+}
@@ -11,6 +11,8 @@
 #include "main.h"
 #include "masternode.h"
 
+#include <boost/unordered_set.hpp>
+
 extern CCriticalSection cs_vecPayments;
 extern CCriticalSection cs_mapMasternodeBlocks;
 extern CCriticalSection cs_mapMasternodePayeeVotes;
@@ -23,6 +25,10 @@ extern CMasternodePayments masternodePayments;
 
 #define MNPAYMENTS_SIGNATURES_REQUIRED 6
 #define MNPAYMENTS_SIGNATURES_TOTAL 10
+//! how far past the tip payment votes are accepted
+#define MNPAYMENTS_FUTURE_BLOCKS 20
+//! initial number of heights in the payment vote ring, a power of two
+#define MNPAYMENTS_MIN_RING_SIZE 2048
 
 void ProcessMessageMasternodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 bool IsBlockPayeeValid(const CBlock& block, int nBlockHeight);
@@ -54,6 +60,10 @@ public:
     CMasternodePaymentDB();
     bool Write(const CMasternodePayments& objToSave);
     ReadResult Read(CMasternodePayments& objToLoad, bool fDryRun = false);
+
+private:
+    ReadResult ReadStore(CMasternodePayments& objToLoad, bool& fFound);
+    ReadResult ReadFile(CMasternodePayments& objToLoad);
 };
 
 class CMasternodePayee
@@ -218,6 +228,7 @@ public:
     bool IsValid(CNode* pnode, std::string& strError);
     bool SignatureValid();
     void Relay();
+    std::string GetStrMessage() const;
 
     void AddPayee(CScript payeeIn, unsigned payeeLevelIn, CTxIn payeeVinIn)
     {
@@ -262,26 +273,54 @@ public:
 class CMasternodePayments
 {
 private:
+    typedef std::map<uint256, CMasternodePaymentWinner> VoteMap;
+
+    /** Hashes a (masternode collateral, payee level) pair for the per-height voter sets */
+    struct CVoterHasher {
+        size_t operator()(const std::pair<COutPoint, unsigned>& voter) const
+        {
+            return voter.first.hash.GetLow64() ^ ((uint64_t)voter.first.n << 8) ^ voter.second;
+        }
+    };
+
+    /** Payee tallies and votes of a single block height in the voting window */
+    struct CBlockVotes {
+        CMasternodeBlockPayees payees;
+        //! votes for this height, owned by mapMasternodePayeeVotes
+        std::vector<VoteMap::iterator> vecVotes;
+        //! masternodes that voted for this height, by payee level
+        boost::unordered_set<std::pair<COutPoint, unsigned>, CVoterHasher> setVoters;
+    };
+
     int nSyncedFromPeer;
     int nLastBlockHeight;
 
-public:
-    std::map<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
-    std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
-    std::map<uint256, int> mapMasternodesLastVote; // ((outMasternode.hash + outMasternode.n) << 4) + mnlevel, nBlockHeight
+    //! every vote we know of, served to peers by hash
+    VoteMap mapMasternodePayeeVotes;
+    //! ring of the heights in the voting window, slot is nBlockHeight modulo its power of two size
+    std::vector<CBlockVotes> vBlockRing;
+    //! number of ring slots holding a height
+    int nBlocks;
 
-    CMasternodePayments()
-    {
-        nSyncedFromPeer = 0;
-        nLastBlockHeight = 0;
-    }
+    CBlockVotes* FindBlockVotes(int nBlockHeight);
+    const CBlockVotes* FindBlockVotes(int nBlockHeight) const;
+    CBlockVotes* InsertBlockVotes(int nBlockHeight);
+    void EraseBlockVotes(CBlockVotes& block);
+    void ResizeBlockRing(size_t nWindow);
+    bool AddVote(const CMasternodePaymentWinner& winner);
+    void RebuildBlockVotes();
+
+    friend class CMasternodePaymentDB;
+
+public:
+    CMasternodePayments();
 
     void Clear()
     {
-        LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
-        mapMasternodeBlocks.clear();
+        LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
         mapMasternodePayeeVotes.clear();
-        mapMasternodesLastVote.clear();
+        vBlockRing.assign(vBlockRing.size(), CBlockVotes());
+        nBlocks = 0;
     }
 
     bool AddWinningMasternode(CMasternodePaymentWinner& winner);
@@ -291,25 +330,13 @@ public:
     void CleanPaymentList();
     int LastPayment(CMasternode& mn);
 
+    bool HasVote(const uint256& hash) const;
+    bool GetVote(const uint256& hash, CMasternodePaymentWinner& winner) const;
+    bool HasPayeeWithVotes(int nBlockHeight, const CScript& payee, const CTxIn& vin, int nVotesReq);
     bool GetBlockPayee(int nBlockHeight, unsigned mnlevel, CScript& payee);
     bool IsTransactionValid(const CTransaction& txNew, int nBlockHeight, CAmount& nBlockValue, bool fProofOfStake);
     bool IsScheduled(CMasternode& mn, int nNotBlockHeight) const;
-    bool CanVote(const COutPoint& outMasternode, int nBlockHeight, unsigned mnlevel)
-    {
-        LOCK(cs_mapMasternodePayeeVotes);
-
-        uint256 key = ((outMasternode.hash + outMasternode.n) << 4) + mnlevel;
-
-        if (mapMasternodesLastVote.count(key)) {
-            if (mapMasternodesLastVote[key] == nBlockHeight) {
-                return false;
-            }
-        }
-
-        //record this masternode voted
-        mapMasternodesLastVote[key] = nBlockHeight;
-        return true;
-    }
+    bool CanVote(const COutPoint& outMasternode, int nBlockHeight, unsigned mnlevel);
     int GetMinMasternodePaymentsProto();
     void ProcessMessageMasternodePayments(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
     std::string GetRequiredPaymentsString(int nBlockHeight);
@@ -324,7 +351,11 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
     {
         READWRITE(mapMasternodePayeeVotes);
+        // the tallies are rebuilt from the votes, the serialized ones are only kept for the format
+        std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
         READWRITE(mapMasternodeBlocks);
+        if (ser_action.ForRead())
+            RebuildBlockVotes();
     }
 };
 
@@ -118,7 +118,7 @@ void CMasternodeSync::AddedMasternodeList(uint256 hash)
 
 void CMasternodeSync::AddedMasternodeWinner(uint256 hash)
 {
-    if (masternodePayments.mapMasternodePayeeVotes.count(hash)) {
+    if (masternodePayments.HasVote(hash)) {
         if (mapSeenSyncMNW[hash] < MASTERNODE_SYNC_THRESHOLD) {
             lastMasternodeWinner = GetTime();
             mapSeenSyncMNW[hash]++;
@@ -215,6 +215,8 @@ void CMasternodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
             if (nItemID != RequestedMasternodeAssets) return;
             sumMasternodeList += nCount;
             countMasternodeList++;
+            // a peer whose list digests matched ours sends no inventory, but our list is complete
+            if (nCount > 0 && lastMasternodeList == 0) lastMasternodeList = GetTime();
             break;
         case (MASTERNODE_SYNC_MNW):
             if (nItemID != RequestedMasternodeAssets) return;
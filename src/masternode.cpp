@@ -223,23 +223,25 @@ void CMasternode::Check(bool forceCheck)
     }
 
     if (!unitTest) {
+        bool fSpent = false;
 
-/*
-        CMutableTransaction tx = CMutableTransaction();
-        CTxOut vout = CTxOut((GetMNCollateral(chainActive.Height())-0.01) * COIN, obfuScationPool.collateralPubKey);
-        tx.vin.push_back(vin);
-        tx.vout.push_back(vout);
-*/
-        CMutableTransaction tx;
+        // spends of a watched collateral are reported from ConnectBlock and AcceptToMemoryPool,
+        // so only the first check of a masternode has to look at the coins view and the mempool
+        if (mnodeman.GetCollateralState(vin.prevout, fSpent)) {
+            if (fSpent) {
+                activeState = MASTERNODE_VIN_SPENT;
+                return;
+            }
+        } else {
+            CMutableTransaction tx;
 
-        CValidationState state = CMasternodeMan::GetInputCheckingTx(vin, tx);
+            CValidationState state = CMasternodeMan::GetInputCheckingTx(vin, tx);
 
-        if (!state.IsValid()) {
-            activeState = MASTERNODE_VIN_SPENT;
-            return;
-        }
+            if (!state.IsValid()) {
+                activeState = MASTERNODE_VIN_SPENT;
+                return;
+            }
 
-        {
             TRY_LOCK(cs_main, lockMain);
             if (!lockMain) return;
 
@@ -247,6 +249,9 @@ void CMasternode::Check(bool forceCheck)
                 activeState = MASTERNODE_VIN_SPENT;
                 return;
             }
+
+            // cs_main is still held, so no spend can slip in between the check and the watch
+            mnodeman.WatchCollateral(vin.prevout);
         }
     }
 
@@ -293,14 +298,12 @@ int64_t CMasternode::GetLastPaid()
         }
         n++;
 
-        if (masternodePayments.mapMasternodeBlocks.count(BlockReading->nHeight)) {
-            /*
-                Search for this payee, with at least 2 votes. This will aid in consensus allowing the network
-                to converge on the same payees quickly, then keep the same schedule.
-            */
-            if (masternodePayments.mapMasternodeBlocks[BlockReading->nHeight].HasPayeeWithVotes(mnpayee, vin, 2)) {
-                return BlockReading->nTime + nOffset;
-            }
+        /*
+            Search for this payee, with at least 2 votes. This will aid in consensus allowing the network
+            to converge on the same payees quickly, then keep the same schedule.
+        */
+        if (masternodePayments.HasPayeeWithVotes(BlockReading->nHeight, mnpayee, vin, 2)) {
+            return BlockReading->nTime + nOffset;
         }
 
         if (BlockReading->pprev == NULL) {
@@ -379,18 +382,36 @@ bool CMasternode::IsDepositCoins(CAmount vin_val)
     return Level(vin_val, chainActive.Height());
 }
 
-bool CMasternode::IsDepositCoins(const CTxIn& vin, CAmount& vin_val)
+bool CMasternode::GetCollateral(const COutPoint& outpoint, CAmount& nValue, int& nHeight)
 {
-    CTransaction prevout_tx;
-    uint256      hashBlock = 0;
+    LOCK(cs_main);
 
-    bool vin_valid =  GetTransaction(vin.prevout.hash, prevout_tx, hashBlock, true)
-                   && (vin.prevout.n < prevout_tx.vout.size());
+    // the chainstate still has it when its block is pruned or below a snapshot
+    const CCoins* coins = pcoinsTip->AccessCoins(outpoint.hash);
+    if (coins && coins->IsAvailable(outpoint.n)) {
+        nValue = coins->vout[outpoint.n].nValue;
+        nHeight = coins->nHeight;
+        return true;
+    }
 
-    if (!vin_valid)
+    // spent, or only in the mempool
+    CTransaction tx;
+    uint256 hashBlock = 0;
+    if (!GetTransaction(outpoint.hash, tx, hashBlock, true) || outpoint.n >= tx.vout.size())
         return false;
+    nValue = tx.vout[outpoint.n].nValue;
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+    nHeight = (mi != mapBlockIndex.end() && mi->second) ? mi->second->nHeight : -1;
+    return true;
+}
 
-    CAmount vin_amount = prevout_tx.vout[vin.prevout.n].nValue;
+bool CMasternode::IsDepositCoins(const CTxIn& vin, CAmount& vin_val)
+{
+    CAmount vin_amount;
+    int nHeight;
+
+    if (!GetCollateral(vin.prevout, vin_amount, nHeight))
+        return false;
 
     if (!IsDepositCoins(vin_amount))
         return false;
@@ -710,14 +731,12 @@ bool CMasternodeBroadcast::CheckInputsAndAdd(int& nDoS)
 
     // verify that sig time is legit in past
     // should be at least not earlier than block when 1000 SPL tx got MASTERNODE_MIN_CONFIRMATIONS
-    uint256 hashBlock = 0;
-    CTransaction tx2;
-    GetTransaction(vin.prevout.hash, tx2, hashBlock, true);
-    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-    if (mi != mapBlockIndex.end() && (*mi).second) {
-        CBlockIndex* pMNIndex = (*mi).second;                                                        // block for 1000 SPL tx -> 1 confirmation
-        CBlockIndex* pConfIndex = chainActive[pMNIndex->nHeight + MASTERNODE_MIN_CONFIRMATIONS - 1]; // block where tx got MASTERNODE_MIN_CONFIRMATIONS
-        if (pConfIndex->GetBlockTime() > sigTime) {
+    CAmount nCollateral;
+    int nCollateralHeight;
+    if (GetCollateral(vin.prevout, nCollateral, nCollateralHeight) && nCollateralHeight >= 0) {
+        // block for 1000 SPL tx -> 1 confirmation
+        CBlockIndex* pConfIndex = chainActive[nCollateralHeight + MASTERNODE_MIN_CONFIRMATIONS - 1]; // block where tx got MASTERNODE_MIN_CONFIRMATIONS
+        if (pConfIndex && pConfIndex->GetBlockTime() > sigTime) {
             LogPrint("masternode","mnb - Bad sigTime %d for Masternode %s (%i conf block is at %d)\n",
                 sigTime, vin.prevout.hash.ToString(), MASTERNODE_MIN_CONFIRMATIONS, pConfIndex->GetBlockTime());
             return false;
@@ -832,7 +851,7 @@ bool CMasternodePing::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
     std::string strMasterNodeSignMessage;
 
     sigTime = GetAdjustedTime();
-    std::string strMessage = vin.ToString() + blockHash.ToString() + std::to_string(sigTime);
+    std::string strMessage = GetStrMessage();
 
     if (!obfuScationSigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrint("masternode","CMasternodePing::Sign() - Error: %s\n", errorMessage);
@@ -849,7 +868,7 @@ bool CMasternodePing::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
 
 bool CMasternodePing::VerifySignature(CPubKey& pubKeyMasternode, int &nDos)
 {
-    std::string strMessage = vin.ToString() + blockHash.ToString() + std::to_string(sigTime);
+    std::string strMessage = GetStrMessage();
     std::string errorMessage = "";
 
     if (!obfuScationSigner.VerifyMessage(pubKeyMasternode, vchSig, strMessage, errorMessage)) {
@@ -859,6 +878,11 @@ bool CMasternodePing::VerifySignature(CPubKey& pubKeyMasternode, int &nDos)
     return true;
 }
 
+std::string CMasternodePing::GetStrMessage() const
+{
+    return vin.ToString() + blockHash.ToString() + std::to_string(sigTime);
+}
+
 bool CMasternodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled, bool fCheckSigTimeOnly, bool fSkipCheckPingTimeAndRelay)
 {
     if (sigTime > GetAdjustedTime() + 60 * 60) {
@@ -63,6 +63,7 @@ public:
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool VerifySignature(CPubKey& pubKeyMasternode, int &nDos);
     void Relay();
+    std::string GetStrMessage() const;
 
     uint256 GetHash()
     {
@@ -158,6 +159,8 @@ public:
 
     static bool IsDepositCoins(CAmount);
     static bool IsDepositCoins(const CTxIn& vin, CAmount& vin_val);
+    /** Value and height (-1 if not in a block) of a collateral, the unspent coins are tried before its transaction */
+    static bool GetCollateral(const COutPoint& outpoint, CAmount& nValue, int& nHeight);
 
     CMasternode();
     CMasternode(const CMasternode& other);
@@ -205,6 +208,15 @@ public:
 
     uint256 CalculateScore(int mod = 1, int64_t nBlockHeight = 0);
 
+    /// Hash of the broadcast announcing this masternode, see CMasternodeBroadcast::GetHash
+    uint256 GetBroadcastHash() const
+    {
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << sigTime;
+        ss << pubKeyCollateralAddress;
+        return ss.GetHash();
+    }
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -349,10 +361,7 @@ public:
 
     uint256 GetHash()
     {
-        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-        ss << sigTime;
-        ss << pubKeyCollateralAddress;
-        return ss.GetHash();
+        return GetBroadcastHash();
     }
 
     /// Create Masternode broadcast, needs to be relayed manually after that
@@ -0,0 +1,58 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternodedb.h"
+#include "chainparams.h"
+
+static const char DB_HEADER = 'v';
+
+CMasternodeStateDB* pmnStateDB = NULL;
+
+CMasternodeStateDB::CMasternodeStateDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "mnstate", DBOptionsFromArgs("mnstate", nCacheSize), fMemory, fWipe)
+{
+    nDumpWritten = 0;
+}
+
+bool CMasternodeStateDB::CommitDump(const std::string& strTypes)
+{
+    int nErased = 0;
+    std::map<std::string, uint256>::iterator it = mapWritten.begin();
+    while (it != mapWritten.end()) {
+        const std::string& strKey = it->first;
+        if (strTypes.find(strKey[0]) != std::string::npos && !setDumped.count(strKey)) {
+            batchDump.EraseSerialized(strKey);
+            mapWritten.erase(it++);
+            nErased++;
+        } else {
+            ++it;
+        }
+    }
+
+    LogPrint("masternode", "CMasternodeStateDB::CommitDump - %d of %d records written, %d erased\n", nDumpWritten, setDumped.size(), nErased);
+
+    bool fResult = WriteBatch(batchDump, true);
+    batchDump = CLevelDBBatch();
+    setDumped.clear();
+    nDumpWritten = 0;
+    return fResult;
+}
+
+void CMasternodeStateDB::DumpHeader(const std::string& strMagicMessage)
+{
+    std::vector<unsigned char> vchMessageStart(Params().MessageStart(), Params().MessageStart() + MESSAGE_START_SIZE);
+    DumpEntry(std::make_pair(DB_HEADER, strMagicMessage), vchMessageStart);
+}
+
+bool CMasternodeStateDB::LoadHeader(const std::string& strMagicMessage, bool& fFound)
+{
+    std::vector<unsigned char> vchMessageStart;
+    fFound = LoadEntry(std::make_pair(DB_HEADER, strMagicMessage), vchMessageStart);
+    if (!fFound)
+        return true;
+
+    if (vchMessageStart.size() != MESSAGE_START_SIZE || memcmp(&vchMessageStart[0], Params().MessageStart(), MESSAGE_START_SIZE))
+        return error("%s : Invalid network magic number", __func__);
+
+    return true;
+}
@@ -0,0 +1,132 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SIMPLICITY_MASTERNODEDB_H
+#define SIMPLICITY_MASTERNODEDB_H
+
+#include "hash.h"
+#include "leveldbwrapper.h"
+#include "uint256.h"
+
+#include <map>
+#include <set>
+#include <string>
+
+#include <boost/scoped_ptr.hpp>
+
+class CMasternodeStateDB;
+
+extern CMasternodeStateDB* pmnStateDB;
+
+/** LevelDB store backing the masternode, payment and budget caches.
+ *
+ * Every cached object is its own record keyed by a type char and the object's key, so a dump
+ * only writes the records that changed since they were last loaded or written and erases the
+ * ones that were dropped. Compaction of the log is left to LevelDB.
+ * Not thread safe: the caches are loaded during init and dumped on shutdown.
+ */
+class CMasternodeStateDB : public CLevelDBWrapper
+{
+public:
+    CMasternodeStateDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+private:
+    CMasternodeStateDB(const CMasternodeStateDB&);
+    void operator=(const CMasternodeStateDB&);
+
+    //! hash of every stored value as last loaded or written, by serialized key
+    std::map<std::string, uint256> mapWritten;
+    //! serialized keys passed to the dump in progress
+    std::set<std::string> setDumped;
+    //! changes queued by the dump in progress
+    CLevelDBBatch batchDump;
+    int nDumpWritten;
+
+public:
+    /** Queue a record for the dump in progress if its value changed */
+    template <typename K, typename V>
+    void DumpEntry(const K& key, const V& value)
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey << key;
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        ssValue << value;
+
+        std::string strKey = ssKey.str();
+        setDumped.insert(strKey);
+
+        uint256 hash = Hash(ssValue.begin(), ssValue.end());
+        std::map<std::string, uint256>::iterator it = mapWritten.find(strKey);
+        if (it != mapWritten.end() && it->second == hash)
+            return;
+
+        mapWritten[strKey] = hash;
+        batchDump.WriteSerialized(strKey, ssValue.str());
+        nDumpWritten++;
+    }
+
+    /** Queue every entry of a map as a record of the given type */
+    template <typename K, typename V>
+    void DumpMap(char chType, const std::map<K, V>& mapEntries)
+    {
+        for (typename std::map<K, V>::const_iterator it = mapEntries.begin(); it != mapEntries.end(); ++it)
+            DumpEntry(std::make_pair(chType, it->first), it->second);
+    }
+
+    /** Write the queued records, erasing the records of the given types that were not dumped again */
+    bool CommitDump(const std::string& strTypes);
+
+    /** Read a single record */
+    template <typename K, typename V>
+    bool LoadEntry(const K& key, V& value)
+    {
+        if (!Read(key, value))
+            return false;
+
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey << key;
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        ssValue << value;
+        mapWritten[ssKey.str()] = Hash(ssValue.begin(), ssValue.end());
+        return true;
+    }
+
+    /** Read every record of the given type into a map */
+    template <typename K, typename V>
+    bool LoadMap(char chType, std::map<K, V>& mapEntries)
+    {
+        boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+        pcursor->Seek(std::string(1, chType));
+
+        for (; pcursor->Valid(); pcursor->Next()) {
+            leveldb::Slice slKey = pcursor->key();
+            if (slKey.empty() || slKey[0] != chType)
+                break;
+
+            try {
+                CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+                char chTypeIn;
+                K key;
+                ssKey >> chTypeIn >> key;
+
+                leveldb::Slice slValue = pcursor->value();
+                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+                mapWritten[slKey.ToString()] = Hash(ssValue.begin(), ssValue.end());
+                ssValue >> mapEntries[key];
+            } catch (std::exception& e) {
+                return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+            }
+        }
+
+        return true;
+    }
+
+    /** Queue the header of a cache: its magic message and our network magic number */
+    void DumpHeader(const std::string& strMagicMessage);
+
+    /** Check the header of a cache, fFound is false if the cache was never written to the store */
+    bool LoadHeader(const std::string& strMagicMessage, bool& fFound);
+};
+
+#endif //SIMPLICITY_MASTERNODEDB_H
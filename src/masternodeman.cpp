@@ -9,8 +9,10 @@
 #include "activemasternode.h"
 #include "addrman.h"
 #include "masternode.h"
+#include "masternodedb.h"
 #include "obfuscation.h"
 #include "spork.h"
+#include "trace.h"
 #include "util.h"
 #include <boost/filesystem.hpp>
 
@@ -45,6 +47,11 @@ struct CompareScoreMN {
 // CMasternodeDB
 //
 
+static const char DB_MASTERNODE = 'n';
+static const char DB_MASTERNODE_BROADCAST = 'b';
+static const char DB_MASTERNODE_PING = 'p';
+static const char DB_MASTERNODE_ASKED = 'a';
+
 CMasternodeDB::CMasternodeDB()
 {
     pathMN = GetDataDir() / "mncache.dat";
@@ -53,32 +60,40 @@ CMasternodeDB::CMasternodeDB()
 
 bool CMasternodeDB::Write(const CMasternodeMan& mnodemanToSave)
 {
+    if (pmnStateDB == NULL)
+        return error("%s : Masternode state store is not open", __func__);
+
     int64_t nStart = GetTimeMillis();
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssMasternodes(SER_DISK, CLIENT_VERSION);
-    ssMasternodes << strMagicMessage;                   // masternode cache file specific magic message
-    ssMasternodes << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssMasternodes << mnodemanToSave;
-    uint256 hash = Hash(ssMasternodes.begin(), ssMasternodes.end());
-    ssMasternodes << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathMN.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathMN.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssMasternodes;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
+    {
+        LOCK(mnodemanToSave.cs);
+
+        pmnStateDB->DumpHeader(strMagicMessage);
+        for (const CMasternode& mn : mnodemanToSave.vMasternodes)
+            pmnStateDB->DumpEntry(std::make_pair(DB_MASTERNODE, mn.vin.prevout), mn);
+        pmnStateDB->DumpMap(DB_MASTERNODE_BROADCAST, mnodemanToSave.mapSeenMasternodeBroadcast);
+        pmnStateDB->DumpMap(DB_MASTERNODE_PING, mnodemanToSave.mapSeenMasternodePing);
+
+        pmnStateDB->DumpEntry(std::make_pair(DB_MASTERNODE_ASKED, 0), mnodemanToSave.mAskedUsForMasternodeList);
+        pmnStateDB->DumpEntry(std::make_pair(DB_MASTERNODE_ASKED, 1), mnodemanToSave.mWeAskedForMasternodeList);
+        pmnStateDB->DumpEntry(std::make_pair(DB_MASTERNODE_ASKED, 2), mnodemanToSave.mWeAskedForMasternodeListEntry);
+        pmnStateDB->DumpEntry(std::make_pair(DB_MASTERNODE_ASKED, 3), mnodemanToSave.mAskedUsForWinnerMasternodeList);
+        pmnStateDB->DumpEntry(std::make_pair(DB_MASTERNODE_ASKED, 4), mnodemanToSave.mWeAskedForWinnerMasternodeList);
+        pmnStateDB->DumpEntry(std::make_pair(DB_MASTERNODE_ASKED, 5), mnodemanToSave.nDsqCount);
     }
-    //    FileCommit(fileout);
-    fileout.fclose();
 
-    LogPrint("masternode","Written info to mncache.dat  %dms\n", GetTimeMillis() - nStart);
+    std::string strTypes;
+    strTypes += DB_MASTERNODE;
+    strTypes += DB_MASTERNODE_BROADCAST;
+    strTypes += DB_MASTERNODE_PING;
+    if (!pmnStateDB->CommitDump(strTypes))
+        return error("%s : Failed to write masternode state", __func__);
+
+    // the store supersedes the flat file once it has been written
+    if (boost::filesystem::exists(pathMN))
+        boost::filesystem::remove(pathMN);
+
+    LogPrint("masternode","Written info to masternode state store  %dms\n", GetTimeMillis() - nStart);
     LogPrint("masternode","  %s\n", mnodemanToSave.ToString());
 
     return true;
@@ -87,6 +102,67 @@ bool CMasternodeDB::Write(const CMasternodeMan& mnodemanToSave)
 CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad, bool fDryRun)
 {
     int64_t nStart = GetTimeMillis();
+
+    bool fFound = false;
+    ReadResult result = ReadStore(mnodemanToLoad, fFound);
+    // nothing in the store yet, migrate from the flat file
+    if (result == Ok && !fFound)
+        result = ReadFile(mnodemanToLoad);
+    if (result != Ok)
+        return result;
+
+    LogPrint("masternode","Loaded info from %s  %dms\n", fFound ? "masternode state store" : "mncache.dat", GetTimeMillis() - nStart);
+    LogPrint("masternode","  %s\n", mnodemanToLoad.ToString());
+    if (!fDryRun) {
+        LogPrint("masternode","Masternode manager - cleaning....\n");
+        mnodemanToLoad.WatchLoadedCollaterals();
+        mnodemanToLoad.CheckAndRemove(true);
+        LogPrint("masternode","Masternode manager - result:\n");
+        LogPrint("masternode","  %s\n", mnodemanToLoad.ToString());
+    }
+
+    return Ok;
+}
+
+CMasternodeDB::ReadResult CMasternodeDB::ReadStore(CMasternodeMan& mnodemanToLoad, bool& fFound)
+{
+    fFound = false;
+    if (pmnStateDB == NULL)
+        return Ok;
+
+    if (!pmnStateDB->LoadHeader(strMagicMessage, fFound))
+        return IncorrectMagicNumber;
+    if (!fFound)
+        return Ok;
+
+    LOCK(mnodemanToLoad.cs);
+
+    std::map<COutPoint, CMasternode> mapMasternodes;
+    bool fLoaded = pmnStateDB->LoadMap(DB_MASTERNODE, mapMasternodes) &&
+                   pmnStateDB->LoadMap(DB_MASTERNODE_BROADCAST, mnodemanToLoad.mapSeenMasternodeBroadcast) &&
+                   pmnStateDB->LoadMap(DB_MASTERNODE_PING, mnodemanToLoad.mapSeenMasternodePing);
+    if (!fLoaded) {
+        mnodemanToLoad.Clear();
+        return IncorrectFormat;
+    }
+
+    mnodemanToLoad.vMasternodes.reserve(mapMasternodes.size());
+    for (std::map<COutPoint, CMasternode>::iterator it = mapMasternodes.begin(); it != mapMasternodes.end(); ++it)
+        mnodemanToLoad.vMasternodes.push_back(it->second);
+
+    // request bookkeeping is best effort, missing entries just start empty
+    pmnStateDB->LoadEntry(std::make_pair(DB_MASTERNODE_ASKED, 0), mnodemanToLoad.mAskedUsForMasternodeList);
+    pmnStateDB->LoadEntry(std::make_pair(DB_MASTERNODE_ASKED, 1), mnodemanToLoad.mWeAskedForMasternodeList);
+    pmnStateDB->LoadEntry(std::make_pair(DB_MASTERNODE_ASKED, 2), mnodemanToLoad.mWeAskedForMasternodeListEntry);
+    pmnStateDB->LoadEntry(std::make_pair(DB_MASTERNODE_ASKED, 3), mnodemanToLoad.mAskedUsForWinnerMasternodeList);
+    pmnStateDB->LoadEntry(std::make_pair(DB_MASTERNODE_ASKED, 4), mnodemanToLoad.mWeAskedForWinnerMasternodeList);
+    pmnStateDB->LoadEntry(std::make_pair(DB_MASTERNODE_ASKED, 5), mnodemanToLoad.nDsqCount);
+
+    return Ok;
+}
+
+CMasternodeDB::ReadResult CMasternodeDB::ReadFile(CMasternodeMan& mnodemanToLoad)
+{
     // open input file, and associate with CAutoFile
     FILE* file = fopen(pathMN.string().c_str(), "rb");
     CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
@@ -153,15 +229,6 @@ CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad, bo
         return IncorrectFormat;
     }
 
-    LogPrint("masternode","Loaded info from mncache.dat  %dms\n", GetTimeMillis() - nStart);
-    LogPrint("masternode","  %s\n", mnodemanToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint("masternode","Masternode manager - cleaning....\n");
-        mnodemanToLoad.CheckAndRemove(true);
-        LogPrint("masternode","Masternode manager - result:\n");
-        LogPrint("masternode","  %s\n", mnodemanToLoad.ToString());
-    }
-
     return Ok;
 }
 
@@ -170,23 +237,8 @@ void DumpMasternodes()
     int64_t nStart = GetTimeMillis();
 
     CMasternodeDB mndb;
-    CMasternodeMan tempMnodeman;
-
-    LogPrint("masternode","Verifying mncache.dat format...\n");
-    CMasternodeDB::ReadResult readResult = mndb.Read(tempMnodeman, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CMasternodeDB::FileError)
-        LogPrint("masternode","Missing masternode cache file - mncache.dat, will try to recreate\n");
-    else if (readResult != CMasternodeDB::Ok) {
-        LogPrint("masternode","Error reading mncache.dat: ");
-        if (readResult == CMasternodeDB::IncorrectFormat)
-            LogPrint("masternode","magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint("masternode","file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
-    LogPrint("masternode","Writting info to mncache.dat...\n");
+
+    LogPrint("masternode","Writting info to masternode state store...\n");
     mndb.Write(mnodeman);
 
     LogPrint("masternode","Masternode dump finished  %dms\n", GetTimeMillis() - nStart);
@@ -262,6 +314,7 @@ void CMasternodeMan::Check()
 
 void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
 {
+    TRACE_SCOPE("masternode", "CheckAndRemove");
     Check();
 
     LOCK(cs);
@@ -288,6 +341,8 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
                 }
             }
 
+            UnwatchCollateral((*it).vin.prevout);
+
             // allow us to ask for this masternode again if we see another ping
             std::map<COutPoint, int64_t>::iterator it2 = mWeAskedForMasternodeListEntry.begin();
             while (it2 != mWeAskedForMasternodeListEntry.end()) {
@@ -388,6 +443,89 @@ void CMasternodeMan::Clear()
     mapSeenMasternodeBroadcast.clear();
     mapSeenMasternodePing.clear();
     nDsqCount = 0;
+
+    LOCK(cs_collaterals);
+    mapCollaterals.clear();
+}
+
+void CMasternodeMan::WatchCollateral(const COutPoint& outpoint)
+{
+    LOCK(cs_collaterals);
+    mapCollaterals.insert(std::make_pair(outpoint, false));
+}
+
+void CMasternodeMan::UnwatchCollateral(const COutPoint& outpoint)
+{
+    LOCK(cs_collaterals);
+    mapCollaterals.erase(outpoint);
+}
+
+bool CMasternodeMan::GetCollateralState(const COutPoint& outpoint, bool& fSpent) const
+{
+    LOCK(cs_collaterals);
+
+    std::map<COutPoint, bool>::const_iterator it = mapCollaterals.find(outpoint);
+    if (it == mapCollaterals.end())
+        return false;
+
+    fSpent = it->second;
+    return true;
+}
+
+void CMasternodeMan::NotifyCollateralSpends(const CTransaction& tx)
+{
+    if (tx.IsCoinBase())
+        return;
+
+    LOCK(cs_collaterals);
+
+    if (mapCollaterals.empty())
+        return;
+
+    for (const CTxIn& txin : tx.vin) {
+        std::map<COutPoint, bool>::iterator it = mapCollaterals.find(txin.prevout);
+        if (it != mapCollaterals.end() && !it->second) {
+            LogPrint("masternode", "CMasternodeMan: Masternode collateral %s spent by %s\n", txin.prevout.ToString(), tx.GetHash().ToString());
+            it->second = true;
+        }
+    }
+}
+
+void CMasternodeMan::RecheckCollateralSpends()
+{
+    AssertLockHeld(cs_main);
+
+    std::vector<COutPoint> vSpent;
+    {
+        LOCK(cs_collaterals);
+        for (const std::pair<const COutPoint, bool>& collateral : mapCollaterals) {
+            if (collateral.second)
+                vSpent.push_back(collateral.first);
+        }
+    }
+    if (vSpent.empty())
+        return;
+
+    // look the outpoints up before taking cs_collaterals again, it is always the last lock taken;
+    // spends are only flagged under cs_main, so none can be missed in between
+    std::vector<COutPoint> vUnspent;
+    {
+        LOCK(mempool.cs);
+        for (const COutPoint& outpoint : vSpent) {
+            const CCoins* coins = pcoinsTip->AccessCoins(outpoint.hash);
+            if (coins && coins->IsAvailable(outpoint.n) && !mempool.mapNextTx.count(outpoint))
+                vUnspent.push_back(outpoint);
+        }
+    }
+
+    LOCK(cs_collaterals);
+    for (const COutPoint& outpoint : vUnspent) {
+        std::map<COutPoint, bool>::iterator it = mapCollaterals.find(outpoint);
+        if (it != mapCollaterals.end() && it->second) {
+            LogPrint("masternode", "CMasternodeMan: Masternode collateral %s is unspent again\n", outpoint.ToString());
+            it->second = false;
+        }
+    }
 }
 
 int CMasternodeMan::size(unsigned mnlevel)
@@ -519,12 +657,64 @@ bool CMasternodeMan::DsegUpdate(CNode* pnode)
         }
     }
 
-    pnode->PushMessage("dseg", CTxIn());
+    // the digests let the peer skip the levels we already have, older peers ignore them
+    pnode->PushMessage("dseg", CTxIn(), GetListDigests());
     int64_t askAgain = GetTime() + MASTERNODES_DSEG_SECONDS;
     mWeAskedForMasternodeList[pnode->addr] = askAgain;
     return true;
 }
 
+std::vector<uint256> CMasternodeMan::GetListDigests()
+{
+    LOCK(cs);
+
+    std::vector<std::vector<uint256> > vHashes(CMasternode::LevelValue::MAX);
+
+    for (CMasternode& mn : vMasternodes) {
+        if (mn.addr.IsRFC1918() || !mn.IsEnabled(true))
+            continue;
+
+        unsigned level = mn.Level();
+        if (level == CMasternode::LevelValue::UNSPECIFIED || level > CMasternode::LevelValue::MAX)
+            continue;
+
+        vHashes[level - 1].push_back(mn.GetBroadcastHash());
+    }
+
+    std::vector<uint256> vDigests;
+    vDigests.reserve(vHashes.size());
+
+    for (std::vector<uint256>& vLevelHashes : vHashes) {
+        std::sort(vLevelHashes.begin(), vLevelHashes.end());
+        vDigests.push_back(Hash(vLevelHashes.begin(), vLevelHashes.end()));
+    }
+
+    return vDigests;
+}
+
+void CMasternodeMan::WatchLoadedCollaterals()
+{
+    LOCK2(cs_main, cs);
+
+    // the cached list is the baseline, so only the UTXO set is consulted
+    // instead of checking every entry like a new broadcast
+    int nSpent = 0;
+
+    for (CMasternode& mn : vMasternodes) {
+        const CCoins* coins = pcoinsTip->AccessCoins(mn.vin.prevout.hash);
+
+        if (!coins || !coins->IsAvailable(mn.vin.prevout.n) || !CMasternode::IsDepositCoins(coins->vout[mn.vin.prevout.n].nValue)) {
+            mn.activeState = CMasternode::MASTERNODE_VIN_SPENT;
+            nSpent++;
+            continue;
+        }
+
+        WatchCollateral(mn.vin.prevout);
+    }
+
+    LogPrint("masternode", "CMasternodeMan: Watching %d loaded Masternode collaterals, %d spent\n", vMasternodes.size() - nSpent, nSpent);
+}
+
 bool CMasternodeMan::WinnersUpdate(CNode* node)
 {
     TRY_LOCK(cs, locked);
@@ -729,15 +919,14 @@ CMasternode* CMasternodeMan::GetCurrentMasterNode(unsigned mnlevel, int mod, int
     return winner;
 }
 
-int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+bool CMasternodeMan::GetMasternodeScores(int64_t nBlockHeight, int minProtocol, bool fOnlyActive, std::vector<std::pair<int64_t, CTxIn> >& vecMasternodeScores)
 {
-    std::vector<std::pair<int64_t, CTxIn> > vecMasternodeScores;
     int64_t nMasternode_Min_Age = GetSporkValue(SPORK_20_MN_WINNER_MINIMUM_AGE);
     int64_t nMasternode_Age = 0;
 
     //make sure we know about this block
     uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return -1;
+    if (!GetBlockHash(hash, nBlockHeight)) return false;
 
     // scan for winner
     for (CMasternode& mn : vMasternodes) {
@@ -765,6 +954,14 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
 
     sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
 
+    return true;
+}
+
+int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+{
+    std::vector<std::pair<int64_t, CTxIn> > vecMasternodeScores;
+    if (!GetMasternodeScores(nBlockHeight, minProtocol, fOnlyActive, vecMasternodeScores)) return -1;
+
     int rank = 0;
     for (PAIRTYPE(int64_t, CTxIn) & s : vecMasternodeScores) {
         rank++;
@@ -776,6 +973,22 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
     return -1;
 }
 
+std::vector<CTxIn> CMasternodeMan::GetTopMasternodes(int nCount, int64_t nBlockHeight, int minProtocol)
+{
+    LOCK(cs);
+
+    std::vector<CTxIn> vecTop;
+    std::vector<std::pair<int64_t, CTxIn> > vecMasternodeScores;
+    if (!GetMasternodeScores(nBlockHeight, minProtocol, true, vecMasternodeScores)) return vecTop;
+
+    for (PAIRTYPE(int64_t, CTxIn) & s : vecMasternodeScores) {
+        if ((int)vecTop.size() >= nCount) break;
+        vecTop.push_back(s.second);
+    }
+
+    return vecTop;
+}
+
 std::vector<std::pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t nBlockHeight, int minProtocol)
 {
     std::vector<std::pair<int64_t, CMasternode> > vecMasternodeScores;
@@ -953,6 +1166,14 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         CTxIn vin;
         vRecv >> vin;
 
+        // newer peers append the digests of their list, levels matching ours are not announced again
+        std::vector<uint256> vPeerDigests;
+        std::vector<uint256> vDigests;
+        if (vin == CTxIn() && !vRecv.empty()) {
+            vRecv >> vPeerDigests;
+            vDigests = GetListDigests();
+        }
+
         if (vin == CTxIn()) { //only should ask for this once
             //local network
             bool isLocal = (pfrom->addr.IsRFC1918() || pfrom->addr.IsLocal());
@@ -975,11 +1196,21 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
 
 
         int nInvCount = 0;
+        int nInSyncCount = 0;
 
         for (CMasternode& mn : vMasternodes) {
             if (mn.addr.IsRFC1918()) continue; //local network
 
             if (mn.IsEnabled(true)) {
+                if (!vPeerDigests.empty()) {
+                    unsigned level = mn.Level();
+                    if (level != CMasternode::LevelValue::UNSPECIFIED && level <= vPeerDigests.size() && level <= vDigests.size() &&
+                        vPeerDigests[level - 1] == vDigests[level - 1]) {
+                        nInSyncCount++;
+                        continue;
+                    }
+                }
+
                 if (vin == CTxIn() || vin == mn.vin) {
                     LogPrint("masternode", "dseg - Sending Masternode entry to peer=%i ip=%s - %s \n", pfrom->GetId(), pfrom->addr.ToString().c_str(), mn.vin.prevout.hash.ToString());
 
@@ -999,8 +1230,9 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         }
 
         if (vin == CTxIn()) {
-            pfrom->PushMessage("ssc", MASTERNODE_SYNC_LIST, nInvCount);
-            LogPrint("masternode", "dseg - Sent %d Masternode entries to peer=%i ip=%s\n", nInvCount, pfrom->GetId(), pfrom->addr.ToString().c_str());
+            // entries of matching levels count as delivered, the peer has them already
+            pfrom->PushMessage("ssc", MASTERNODE_SYNC_LIST, nInvCount + nInSyncCount);
+            LogPrint("masternode", "dseg - Sent %d Masternode entries to peer=%i ip=%s, %d already in sync\n", nInvCount, pfrom->GetId(), pfrom->addr.ToString().c_str(), nInSyncCount);
         }
     }
     /*
@@ -1176,14 +1408,12 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
 
             // verify that sig time is legit in past
             // should be at least not earlier than block when 200000 SPL tx got MASTERNODE_MIN_CONFIRMATIONS
-            uint256 hashBlock = 0;
-            CTransaction tx2;
-            GetTransaction(vin.prevout.hash, tx2, hashBlock, true);
-            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-            if (mi != mapBlockIndex.end() && (*mi).second) {
-                CBlockIndex* pMNIndex = (*mi).second;                                                        // block for 10000 SPL tx -> 1 confirmation
-                CBlockIndex* pConfIndex = chainActive[pMNIndex->nHeight + MASTERNODE_MIN_CONFIRMATIONS - 1]; // block where tx got MASTERNODE_MIN_CONFIRMATIONS
-                if (pConfIndex->GetBlockTime() > sigTime) {
+            CAmount nCollateral;
+            int nCollateralHeight;
+            if (CMasternode::GetCollateral(vin.prevout, nCollateral, nCollateralHeight) && nCollateralHeight >= 0) {
+                // block for 10000 SPL tx -> 1 confirmation
+                CBlockIndex* pConfIndex = chainActive[nCollateralHeight + MASTERNODE_MIN_CONFIRMATIONS - 1]; // block where tx got MASTERNODE_MIN_CONFIRMATIONS
+                if (pConfIndex && pConfIndex->GetBlockTime() > sigTime) {
                     LogPrint("masternode","mnb - Bad sigTime %d for Masternode %s (%i conf block is at %d)\n",
                         sigTime, vin.prevout.hash.ToString(), MASTERNODE_MIN_CONFIRMATIONS, pConfIndex->GetBlockTime());
                     return;
@@ -1340,6 +1570,7 @@ void CMasternodeMan::Remove(CTxIn vin)
     while (it != vMasternodes.end()) {
         if ((*it).vin == vin) {
             LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
+            UnwatchCollateral((*it).vin.prevout);
             vMasternodes.erase(it);
             break;
         }
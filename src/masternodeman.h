@@ -23,7 +23,7 @@ class CMasternodeMan;
 extern CMasternodeMan mnodeman;
 void DumpMasternodes();
 
-/** Access to the MN database (mncache.dat)
+/** Access to the MN database (the masternode state store, migrating mncache.dat)
  */
 class CMasternodeDB
 {
@@ -45,10 +45,16 @@ public:
     CMasternodeDB();
     bool Write(const CMasternodeMan& mnodemanToSave);
     ReadResult Read(CMasternodeMan& mnodemanToLoad, bool fDryRun = false);
+
+private:
+    ReadResult ReadStore(CMasternodeMan& mnodemanToLoad, bool& fFound);
+    ReadResult ReadFile(CMasternodeMan& mnodemanToLoad);
 };
 
 class CMasternodeMan
 {
+    friend class CMasternodeDB;
+
 private:
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
@@ -69,6 +75,14 @@ private:
     // who we asked for the winning Masternode list and the last time
     std::map<CNetAddr, int64_t> mWeAskedForWinnerMasternodeList;
 
+    // critical section to protect the collateral watch set, always the last one taken
+    mutable CCriticalSection cs_collaterals;
+    // collateral outpoints of verified Masternodes, flagged once a spending tx is seen
+    std::map<COutPoint, bool> mapCollaterals;
+
+    // score the Masternodes eligible for a block, highest first; false if the block is unknown
+    bool GetMasternodeScores(int64_t nBlockHeight, int minProtocol, bool fOnlyActive, std::vector<std::pair<int64_t, CTxIn> >& vecMasternodeScores);
+
 public:
     // Keep track of all broadcasts I've seen
     std::map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
@@ -116,12 +130,33 @@ public:
     /// Clear Masternode vector
     void Clear();
 
+    /// Start watching the collateral of a Masternode whose inputs were verified
+    void WatchCollateral(const COutPoint& outpoint);
+
+    /// Stop watching the collateral of a removed Masternode
+    void UnwatchCollateral(const COutPoint& outpoint);
+
+    /// Get the spent flag of a watched collateral, false if it is not watched
+    bool GetCollateralState(const COutPoint& outpoint, bool& fSpent) const;
+
+    /// Flag the watched collaterals spent by a block or mempool transaction
+    void NotifyCollateralSpends(const CTransaction& tx);
+
+    /// Clear the spent flags of collaterals whose spend was disconnected or left the mempool unconfirmed
+    void RecheckCollateralSpends();
+
     unsigned CountEnabled(unsigned mnlevel = CMasternode::LevelValue::UNSPECIFIED, int protocolVersion = -1);
     std::map<unsigned, int> CountEnabledByLevels(int protocolVersion = -1);
 
     void CountNetworks(int protocolVersion, int& ipv4, int& ipv6, int& onion);
 
     bool DsegUpdate(CNode* pnode);
+
+    /// Digests of the sorted broadcast hashes of the Masternodes announced on dseg, one per level
+    std::vector<uint256> GetListDigests();
+
+    /// Check the collaterals of a Masternode list loaded from disk against the UTXO set and watch them
+    void WatchLoadedCollaterals();
     bool WinnersUpdate(CNode* node);
 
     /// Find an entry
@@ -147,6 +182,8 @@ public:
 
     std::vector<std::pair<int, CMasternode> > GetMasternodeRanks(int64_t nBlockHeight, int minProtocol = 0);
     int GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
+    /// Get the Masternodes ranked 1 to nCount for a block, in rank order
+    std::vector<CTxIn> GetTopMasternodes(int nCount, int64_t nBlockHeight, int minProtocol = 0);
     CMasternode* GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true);
 
     void ProcessMasternodeConnections();
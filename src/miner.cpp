@@ -12,6 +12,7 @@
 #include "hash.h"
 #include "main.h"
 #include "masternode-sync.h"
+#include "masternodeman.h"
 #include "net.h"
 #include "pow.h"
 #include "primitives/block.h"
@@ -546,6 +547,7 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
         if (!TestBlockValidity(state, *pblock, pindexPrev, false, false)) {
             LogPrintf("CreateNewBlock() : TestBlockValidity failed\n");
             mempool.clear();
+            mnodeman.RecheckCollateralSpends();
             return NULL;
         }
 
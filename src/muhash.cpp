@@ -0,0 +1,84 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "muhash.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+
+namespace
+{
+const CBigNum& Modulus()
+{
+    static const CBigNum bnModulus = (CBigNum(1) << 3072) - CBigNum(1103717);
+    return bnModulus;
+}
+
+/** Expand an element to a number modulo the prime, with SHA256 in counter mode over its digest */
+CBigNum ToNum3072(const std::vector<unsigned char>& vch)
+{
+    unsigned char seed[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(vch.data(), vch.size()).Finalize(seed);
+
+    // little-endian, with a trailing zero so the number is positive
+    std::vector<unsigned char> vchNum(CMuHash3072::BYTE_SIZE + 1, 0);
+    for (uint32_t i = 0; i < CMuHash3072::BYTE_SIZE / CSHA256::OUTPUT_SIZE; i++) {
+        unsigned char counter[4];
+        WriteLE32(counter, i);
+        CSHA256().Write(seed, sizeof(seed)).Write(counter, sizeof(counter)).Finalize(&vchNum[i * CSHA256::OUTPUT_SIZE]);
+    }
+    return CBigNum(vchNum) % Modulus();
+}
+} // namespace
+
+CMuHash3072::CMuHash3072() : numerator(1), denominator(1)
+{
+}
+
+CMuHash3072& CMuHash3072::Insert(const std::vector<unsigned char>& vch)
+{
+    numerator = numerator.mul_mod(ToNum3072(vch), Modulus());
+    return *this;
+}
+
+CMuHash3072& CMuHash3072::Remove(const std::vector<unsigned char>& vch)
+{
+    denominator = denominator.mul_mod(ToNum3072(vch), Modulus());
+    return *this;
+}
+
+CMuHash3072& CMuHash3072::operator*=(const CMuHash3072& b)
+{
+    numerator = numerator.mul_mod(b.numerator, Modulus());
+    denominator = denominator.mul_mod(b.denominator, Modulus());
+    return *this;
+}
+
+CMuHash3072& CMuHash3072::operator/=(const CMuHash3072& b)
+{
+    numerator = numerator.mul_mod(b.denominator, Modulus());
+    denominator = denominator.mul_mod(b.numerator, Modulus());
+    return *this;
+}
+
+void CMuHash3072::Normalize()
+{
+    if (denominator.isOne())
+        return;
+    numerator = numerator.mul_mod(denominator.inverse(Modulus()), Modulus());
+    denominator = CBigNum(1);
+}
+
+uint256 CMuHash3072::Finalize() const
+{
+    CMuHash3072 normalized(*this);
+    normalized.Normalize();
+
+    std::vector<unsigned char> vch = normalized.numerator.getvch();
+    vch.resize(BYTE_SIZE, 0);
+
+    uint256 hash;
+    CSHA256().Write(vch.data(), vch.size()).Finalize((unsigned char*)&hash);
+    return hash;
+}
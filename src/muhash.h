@@ -0,0 +1,59 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SIMPLICITY_MUHASH_H
+#define SIMPLICITY_MUHASH_H
+
+#include "libzerocoin/bignum.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <vector>
+
+/**
+ * Order-independent hash of a set of byte strings: each element is expanded to a number
+ * modulo the prime 2^3072 - 1103717 and the set hashes to the product of its elements.
+ * Removing an element divides by it, so the hash of a set can be updated as elements are
+ * added and removed, in any order, and hashes of disjoint changes can be combined.
+ *
+ * Removals are accumulated in a separate denominator, the only modular inverse is taken
+ * when the hash is finalized or normalized.
+ */
+class CMuHash3072
+{
+private:
+    CBigNum numerator;
+    CBigNum denominator;
+
+public:
+    static const size_t BYTE_SIZE = 384;
+
+    /** The hash of the empty set */
+    CMuHash3072();
+
+    /** Add or remove an element */
+    CMuHash3072& Insert(const std::vector<unsigned char>& vch);
+    CMuHash3072& Remove(const std::vector<unsigned char>& vch);
+
+    /** Union and difference of the sets of two hashes */
+    CMuHash3072& operator*=(const CMuHash3072& b);
+    CMuHash3072& operator/=(const CMuHash3072& b);
+
+    /** Fold the denominator into the numerator, to keep the serialized form canonical */
+    void Normalize();
+
+    /** 256-bit digest of the set */
+    uint256 Finalize() const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(numerator);
+        READWRITE(denominator);
+    }
+};
+
+#endif // SIMPLICITY_MUHASH_H
@@ -223,6 +223,7 @@ public:
     unsigned int nDataPos;
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
+    bool fPreVerified;              // signatures already handed to the message check threads
 
     CNetMessage(int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), vRecv(nTypeIn, nVersionIn) {
         hdrbuf.resize(24);
@@ -230,6 +231,7 @@ public:
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
+        fPreVerified = false;
     }
 
     bool complete() const
@@ -4,9 +4,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "obfuscation.h"
+#include "checkqueue.h"
 #include "coincontrol.h"
 #include "init.h"
 #include "main.h"
+#include "masternode-budget.h"
 #include "masternodeman.h"
 #include "script/sign.h"
 #include "swifttx.h"
@@ -587,22 +589,110 @@ bool CObfuScationSigner::SignMessage(std::string strMessage, std::string& errorM
     return true;
 }
 
-bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, std::vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage)
+namespace {
+
+/**
+ * Cache of the key IDs recovered from masternode message signatures. The same
+ * broadcasts, pings and votes arrive from many peers during sync, and the
+ * recovery result only depends on the message hash and the signature.
+ */
+class CMessageSigCache
+{
+private:
+    //! sigdata_type is (message hash, compact signature)
+    typedef std::pair<uint256, std::vector<unsigned char> > sigdata_type;
+    std::map<sigdata_type, CKeyID> mapRecovered;
+    boost::shared_mutex cs_msgsigcache;
+
+public:
+    bool Get(const uint256& hash, const std::vector<unsigned char>& vchSig, CKeyID& keyID)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_msgsigcache);
+
+        std::map<sigdata_type, CKeyID>::const_iterator mi = mapRecovered.find(sigdata_type(hash, vchSig));
+        if (mi == mapRecovered.end())
+            return false;
+
+        keyID = mi->second;
+        return true;
+    }
+
+    void Set(const uint256& hash, const std::vector<unsigned char>& vchSig, const CKeyID& keyID)
+    {
+        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
+        if (nMaxCacheSize <= 0) return;
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_msgsigcache);
+
+        while (static_cast<int64_t>(mapRecovered.size()) > nMaxCacheSize) {
+            // Evict a random entry, same as the script signature cache
+            std::map<sigdata_type, CKeyID>::iterator it = mapRecovered.lower_bound(sigdata_type(GetRandHash(), std::vector<unsigned char>()));
+            if (it == mapRecovered.end())
+                it = mapRecovered.begin();
+            mapRecovered.erase(it);
+        }
+
+        mapRecovered.insert(std::make_pair(sigdata_type(hash, vchSig), keyID));
+    }
+};
+
+CMessageSigCache messageSigCache;
+
+/** Queue of message signature recoveries, served by the message check threads */
+CCheckQueue<CMessageSigCheck> messagesigcheckqueue(16);
+
+uint256 GetMessageHash(const std::string& strMessage)
 {
     CHashWriter ss(SER_GETHASH, 0);
     ss << strMessageMagic;
     ss << strMessage;
+    return ss.GetHash();
+}
 
-    CPubKey pubkey2;
-    if (!pubkey2.RecoverCompact(ss.GetHash(), vchSig)) {
+bool RecoverMessageKey(const uint256& hash, const std::vector<unsigned char>& vchSig, CKeyID& keyID)
+{
+    if (messageSigCache.Get(hash, vchSig, keyID))
+        return true;
+
+    // Recovery also pins the recovery id and the compression flag of the
+    // signature, which a plain verify against the known key wouldn't, and
+    // older peers reject signatures that differ in either.
+    CPubKey pubkey;
+    if (!pubkey.RecoverCompact(hash, vchSig))
+        return false;
+
+    keyID = pubkey.GetID();
+    messageSigCache.Set(hash, vchSig, keyID);
+    return true;
+}
+
+}
+
+bool CObfuScationSigner::VerifyMessage(CPubKey pubkey, std::vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage)
+{
+    CKeyID keyID;
+    if (!RecoverMessageKey(GetMessageHash(strMessage), vchSig, keyID)) {
         errorMessage = _("Error recovering public key.");
         return false;
     }
 
-    if (fDebug && pubkey2.GetID() != pubkey.GetID())
-        LogPrintf("CObfuScationSigner::VerifyMessage -- keys don't match: %s %s\n", pubkey2.GetID().ToString(), pubkey.GetID().ToString());
+    if (fDebug && keyID != pubkey.GetID())
+        LogPrintf("CObfuScationSigner::VerifyMessage -- keys don't match: %s %s\n", keyID.ToString(), pubkey.GetID().ToString());
+
+    return (keyID == pubkey.GetID());
+}
 
-    return (pubkey2.GetID() == pubkey.GetID());
+bool CObfuScationSigner::PreVerifyMessage(const std::string& strMessage, const std::vector<unsigned char>& vchSig)
+{
+    CKeyID keyID;
+    return RecoverMessageKey(GetMessageHash(strMessage), vchSig, keyID);
+}
+
+bool CMessageSigCheck::operator()()
+{
+    // a bad signature is reported when the message itself is processed
+    obfuScationSigner.PreVerifyMessage(strMessage, vchSig);
+    return true;
 }
 
 bool CObfuscationQueue::Sign()
@@ -704,3 +794,72 @@ void ThreadCheckObfuScationPool()
         }
     }
 }
+
+void ThreadMessageSigCheck()
+{
+    RenameThread("simplicity-msgsigch");
+    messagesigcheckqueue.Thread();
+}
+
+void PreVerifyMessages(CNode* pfrom)
+{
+    if (fLiteMode || !nScriptCheckThreads) return;
+
+    std::vector<CMessageSigCheck> vChecks;
+
+    for (CNetMessage& msg : pfrom->vRecvMsg) {
+        if (!msg.complete())
+            break;
+
+        if (msg.fPreVerified)
+            continue;
+        msg.fPreVerified = true;
+
+        std::string strCommand = msg.hdr.GetCommand();
+        if (strCommand != "mnb" && strCommand != "mnp" && strCommand != "mnw" && strCommand != "mvote" && strCommand != "fbvote" &&
+            strCommand != "txlvote")
+            continue;
+
+        // work on a copy, the message itself is read when it gets processed
+        CDataStream vRecv(msg.vRecv.begin(), msg.vRecv.end(), msg.vRecv.GetType(), msg.vRecv.GetVersion());
+
+        try {
+            if (strCommand == "mnb") {
+                CMasternodeBroadcast mnb;
+                vRecv >> mnb;
+                vChecks.push_back(CMessageSigCheck(mnb.GetOldStrMessage(), mnb.sig));
+                if (mnb.lastPing != CMasternodePing())
+                    vChecks.push_back(CMessageSigCheck(mnb.lastPing.GetStrMessage(), mnb.lastPing.vchSig));
+            } else if (strCommand == "mnp") {
+                CMasternodePing mnp;
+                vRecv >> mnp;
+                vChecks.push_back(CMessageSigCheck(mnp.GetStrMessage(), mnp.vchSig));
+            } else if (strCommand == "mnw") {
+                CMasternodePaymentWinner winner;
+                vRecv >> winner;
+                vChecks.push_back(CMessageSigCheck(winner.GetStrMessage(), winner.vchSig));
+            } else if (strCommand == "txlvote") {
+                CConsensusVote vote;
+                vRecv >> vote;
+                vChecks.push_back(CMessageSigCheck(vote.GetStrMessage(), vote.vchMasterNodeSignature));
+            } else if (strCommand == "mvote") {
+                CBudgetVote vote;
+                vRecv >> vote;
+                vChecks.push_back(CMessageSigCheck(vote.GetStrMessage(), vote.vchSig));
+            } else {
+                CFinalizedBudgetVote vote;
+                vRecv >> vote;
+                vChecks.push_back(CMessageSigCheck(vote.GetStrMessage(), vote.vchSig));
+            }
+        } catch (const std::exception&) {
+            // malformed messages are rejected when they get processed
+        }
+    }
+
+    if (vChecks.empty())
+        return;
+
+    CCheckQueueControl<CMessageSigCheck> control(&messagesigcheckqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
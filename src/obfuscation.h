@@ -213,6 +213,29 @@ public:
     bool SignMessage(std::string strMessage, std::string& errorMessage, std::vector<unsigned char>& vchSig, CKey key);
     /// Verify the message, returns true if succcessful
     bool VerifyMessage(CPubKey pubkey, std::vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage);
+    /// Recover and cache the signer of the message, so a later VerifyMessage doesn't repeat the recovery
+    bool PreVerifyMessage(const std::string& strMessage, const std::vector<unsigned char>& vchSig);
+};
+
+/** Closure recovering the signer of one masternode network message on a message check thread
+ */
+class CMessageSigCheck
+{
+private:
+    std::string strMessage;
+    std::vector<unsigned char> vchSig;
+
+public:
+    CMessageSigCheck() {}
+    CMessageSigCheck(const std::string& strMessageIn, const std::vector<unsigned char>& vchSigIn) : strMessage(strMessageIn), vchSig(vchSigIn) {}
+
+    bool operator()();
+
+    void swap(CMessageSigCheck& check)
+    {
+        strMessage.swap(check.strMessage);
+        vchSig.swap(check.vchSig);
+    }
 };
 
 /** Used to keep track of current status of Obfuscation pool
@@ -373,4 +396,10 @@ public:
 
 void ThreadCheckObfuScationPool();
 
+/** Run the message check threads */
+void ThreadMessageSigCheck();
+
+/** Recover the signers of the masternode messages queued for a peer in parallel, before they are processed */
+void PreVerifyMessages(CNode* pfrom);
+
 #endif
@@ -26,6 +26,12 @@ public:
 
 typedef uint256 ChainCode;
 
+/** A public key parsed for verification, opaque outside pubkey.cpp */
+struct CParsedPubKey
+{
+    unsigned char data[64];
+};
+
 /** An encapsulated public key. */
 class CPubKey
 {
@@ -185,6 +191,12 @@ public:
      */
     bool Verify(const uint256& hash, const std::vector<unsigned char>& vchSig) const;
 
+    //! Parse once for several verifications, false if not fully valid
+    bool Parse(CParsedPubKey& parsed) const;
+
+    //! Verify a DER signature with a key from Parse
+    static bool Verify(const CParsedPubKey& parsed, const uint256& hash, const std::vector<unsigned char>& vchSig);
+
     /**
      * Check whether a signature is normalized (lower-S).
      */
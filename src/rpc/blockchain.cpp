@@ -5,13 +5,18 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "addressindex.h"
 #include "base58.h"
+#include "blockstats.h"
+#include "blockstore.h"
 #include "checkpoints.h"
 #include "clientversion.h"
 #include "kernel.h"
+#include "leveldbwrapper.h"
 #include "main.h"
 #include "miner.h"
 #include "rpc/server.h"
+#include "snapshot.h"
 #include "sync.h"
 #include "txdb.h"
 #include "util.h"
@@ -30,6 +35,8 @@
 #include <numeric>
 #include <condition_variable>
 
+#include <boost/bind.hpp>
+
 
 struct CUpdatedBlock
 {
@@ -684,11 +691,15 @@ UniValue getblock(const UniValue& params, bool fHelp)
     if (mapBlockIndex.count(hash) == 0)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    CBlock block;
+    CBlockRef pblock;
     CBlockIndex* pblockindex = mapBlockIndex[hash];
 
-    if (!ReadBlockFromDisk(block, pblockindex))
+    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+
+    if (!ReadBlockFromDisk(pblock, pblockindex))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    const CBlock& block = *pblock;
 
     if (!fVerbose) {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
@@ -754,11 +765,16 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
 
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 1)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( audit )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "The totals and the MuHash of the set are maintained as blocks are connected, so this call is instant.\n"
+            "With audit, the set is also scanned in full from a database snapshot and checked against them,\n"
+            "which takes some time but does not block the node.\n"
+
+            "\nArguments:\n"
+            "1. audit     (boolean, optional, default=false) Scan the set and check the maintained commitment\n"
 
             "\nResult:\n"
             "{\n"
@@ -766,29 +782,263 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
-            "  \"total_amount\": x.xxx          (numeric) The total amount\n"
+            "  \"hash_muhash\": \"hash\",   (string) The MuHash of the unspent outputs\n"
+            "  \"total_amount\": x.xxx,       (numeric) The total amount\n"
+            "  \"bytes_serialized\": n,  (numeric) The serialized size, with audit only\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash, with audit only\n"
+            "  \"audit_ok\": true|false,      (boolean) Whether the scan matches the maintained commitment, with audit only\n"
             "}\n"
 
             "\nExamples:\n" +
-            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleRpc("gettxoutsetinfo", ""));
+            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleCli("gettxoutsetinfo", "true") + HelpExampleRpc("gettxoutsetinfo", ""));
 
-    LOCK(cs_main);
+    bool fAudit = params.size() > 0 && params[0].get_bool();
 
     UniValue ret(UniValue::VOBJ);
 
+    if (!fAudit) {
+        LOCK(cs_main);
+        CCoinsCommitment commitment;
+        if (!pcoinsTip->GetCommitment(commitment))
+            throw JSONRPCError(RPC_IN_WARMUP, "The UTXO set commitment is still being computed, use audit to scan the set");
+        ret.push_back(Pair("height", (int64_t)chainActive.Height()));
+        ret.push_back(Pair("bestblock", pcoinsTip->GetBestBlock().GetHex()));
+        ret.push_back(Pair("transactions", commitment.nTransactions));
+        ret.push_back(Pair("txouts", commitment.nTransactionOutputs));
+        ret.push_back(Pair("hash_muhash", commitment.muhash.Finalize().GetHex()));
+        ret.push_back(Pair("total_amount", ValueFromAmount(commitment.nTotalAmount)));
+        return ret;
+    }
+
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+    }
+
+    // the scan reads a snapshot of the database, blocks keep connecting meanwhile
     CCoinsStats stats;
-    FlushStateToDisk();
-    if (pcoinsTip->GetStats(stats)) {
-        ret.push_back(Pair("height", (int64_t)stats.nHeight));
-        ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
-        ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
-        ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
-        ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
-        ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
-        ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+    if (!pcoinsTip->GetStats(stats))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator mi = mapBlockIndex.find(stats.hashBlock);
+        if (mi != mapBlockIndex.end())
+            stats.nHeight = mi->second->nHeight;
     }
+
+    ret.push_back(Pair("height", (int64_t)stats.nHeight));
+    ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+    ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
+    ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+    ret.push_back(Pair("hash_muhash", stats.hashMuHash.GetHex()));
+    ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+    ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
+    ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+    if (stats.fCommitment) {
+        bool fOk = stats.commitment.muhash.Finalize() == stats.hashMuHash &&
+                   stats.commitment.nTransactions == (int64_t)stats.nTransactions &&
+                   stats.commitment.nTransactionOutputs == (int64_t)stats.nTransactionOutputs &&
+                   stats.commitment.nTotalAmount == stats.nTotalAmount;
+        if (!fOk)
+            LogPrintf("%s : UTXO set commitment does not match the scan at block %s\n", __func__, stats.hashBlock.GetHex());
+        ret.push_back(Pair("audit_ok", fOk));
+    }
+    return ret;
+}
+
+UniValue dumptxoutset(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrites the chainstate at the current tip to a file that -loadtxoutset bootstraps a new node from.\n"
+            "The file holds the block index of the active chain, the UTXO set with its commitment and the zerocoin\n"
+            "database. The block index is written with the chain locked, the rest from database snapshots.\n"
+            "\nOnly regtest loads these files for now: main and testnet list no snapshot hashes yet. A node loaded from\n"
+            "a snapshot never downloads or validates the blocks below its base. Its background check only re-checks\n"
+            "their headers and audits the UTXO set against its commitment; validating the history needs -reindex.\n"
+
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) Path of the new file, relative to the data directory unless absolute\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"base_hash\": \"hash\",      (string) The block the snapshot was taken at\n"
+            "  \"base_height\": n,          (numeric) Its height\n"
+            "  \"blocks\": n,               (numeric) The number of block index entries written\n"
+            "  \"transactions\": n,         (numeric) The number of transactions with unspent outputs written\n"
+            "  \"zerocoin_entries\": n,     (numeric) The number of zerocoin database entries written\n"
+            "  \"snapshot_hash\": \"hash\",  (string) The hash of the file, as listed in the chain parameters\n"
+            "  \"hash_muhash\": \"hash\",    (string) The MuHash of the unspent outputs\n"
+            "  \"path\": \"path\"            (string) The absolute path of the file\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("dumptxoutset", "\"utxo.dat\"") + HelpExampleRpc("dumptxoutset", "\"utxo.dat\""));
+
+    boost::filesystem::path path = boost::filesystem::absolute(params[0].get_str(), GetDataDir());
+    CSnapshotInfo info;
+    std::string strError;
+    if (!DumpChainstateSnapshot(path, info, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("base_hash", info.hashBase.GetHex()));
+    ret.push_back(Pair("base_height", info.nHeight));
+    ret.push_back(Pair("blocks", info.nBlocks));
+    ret.push_back(Pair("transactions", info.nCoins));
+    ret.push_back(Pair("zerocoin_entries", info.nZerocoinEntries));
+    ret.push_back(Pair("snapshot_hash", info.hashSnapshot.GetHex()));
+    ret.push_back(Pair("hash_muhash", info.hashMuHash.GetHex()));
+    ret.push_back(Pair("path", path.string()));
+    return ret;
+}
+
+static void DBInfoToJSON(UniValue& result, CLevelDBWrapper& db)
+{
+    const CLevelDBOptions& dboptions = db.GetDBOptions();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("path", db.GetPath().string()));
+
+    UniValue options(UniValue::VOBJ);
+    options.push_back(Pair("block_cache", (uint64_t)dboptions.nBlockCacheSize));
+    options.push_back(Pair("write_buffer", (uint64_t)dboptions.nWriteBufferSize));
+    options.push_back(Pair("block_size", (uint64_t)dboptions.nBlockSize));
+    options.push_back(Pair("max_open_files", dboptions.nMaxOpenFiles));
+    options.push_back(Pair("compression", dboptions.fCompression));
+    obj.push_back(Pair("options", options));
+
+    obj.push_back(Pair("approximate_size", db.GetApproximateSize()));
+    std::string strMemory;
+    if (db.GetProperty("leveldb.approximate-memory-usage", strMemory))
+        obj.push_back(Pair("approximate_memory", atoi64(strMemory)));
+
+    UniValue levels(UniValue::VARR);
+    for (const CLevelDBLevelStats& stats : db.GetLevelStats()) {
+        UniValue level(UniValue::VOBJ);
+        level.push_back(Pair("level", stats.nLevel));
+        level.push_back(Pair("files", stats.nFiles));
+        level.push_back(Pair("size_mb", stats.dSizeMB));
+        level.push_back(Pair("compaction_time", stats.dTimeSec));
+        level.push_back(Pair("compaction_read_mb", stats.dReadMB));
+        level.push_back(Pair("compaction_write_mb", stats.dWriteMB));
+        levels.push_back(level);
+    }
+    obj.push_back(Pair("levels", levels));
+    obj.push_back(Pair("manual_compactions", db.GetManualCompactions()));
+
+    std::string strStats;
+    if (db.GetProperty("leveldb.stats", strStats))
+        obj.push_back(Pair("stats", strStats));
+
+    result.push_back(Pair(dboptions.strName, obj));
+}
+
+UniValue getdbinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw std::runtime_error(
+            "getdbinfo ( \"name\" )\n"
+            "\nReturns the tuning and LevelDB statistics of the open databases.\n"
+
+            "\nArguments:\n"
+            "1. \"name\"     (string, optional) Only this database: blockindex, chainstate, zerocoin, sporks or mnstate\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {\n"
+            "    \"path\": \"dir\",               (string) Directory of the database\n"
+            "    \"options\": {\n"
+            "      \"block_cache\": n,          (numeric) Block cache size in bytes\n"
+            "      \"write_buffer\": n,         (numeric) Write buffer size in bytes\n"
+            "      \"block_size\": n,           (numeric) Block size in bytes\n"
+            "      \"max_open_files\": n,       (numeric) Maximum number of open files\n"
+            "      \"compression\": true|false  (boolean) Whether blocks are compressed\n"
+            "    },\n"
+            "    \"approximate_size\": n,       (numeric) Approximate size on disk in bytes\n"
+            "    \"approximate_memory\": n,     (numeric) Approximate memory used by caches and write buffers\n"
+            "    \"levels\": [                  (array) Levels that hold files or have been compacted\n"
+            "      {\n"
+            "        \"level\": n,              (numeric) The level\n"
+            "        \"files\": n,              (numeric) Number of table files\n"
+            "        \"size_mb\": x.x,          (numeric) Size of the files\n"
+            "        \"compaction_time\": x.x,  (numeric) Seconds spent compacting into this level\n"
+            "        \"compaction_read_mb\": x.x,   (numeric) Data read by compactions\n"
+            "        \"compaction_write_mb\": x.x   (numeric) Data written by compactions\n"
+            "      }, ...\n"
+            "    ],\n"
+            "    \"manual_compactions\": n,     (numeric) Compactions requested with compactdb\n"
+            "    \"stats\": \"text\"              (string) The leveldb.stats property\n"
+            "  }, ...\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getdbinfo", "") + HelpExampleCli("getdbinfo", "\"chainstate\"") + HelpExampleRpc("getdbinfo", "\"chainstate\""));
+
+    std::string strName = params.size() > 0 ? params[0].get_str() : "";
+
+    UniValue ret(UniValue::VOBJ);
+    if (!ForEachLevelDB(strName, boost::bind(&DBInfoToJSON, boost::ref(ret), _1)) && !strName.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown database: " + strName);
+    return ret;
+}
+
+UniValue compactdb(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw std::runtime_error(
+            "compactdb \"name\"\n"
+            "\nCompacts the whole key range of a database. Returns when done, which may take some time.\n"
+
+            "\nArguments:\n"
+            "1. \"name\"     (string, required) The database: blockindex, chainstate, zerocoin, sporks or mnstate\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("compactdb", "\"chainstate\"") + HelpExampleRpc("compactdb", "\"chainstate\""));
+
+    std::string strName = params[0].get_str();
+    if (strName.empty() || !ForEachLevelDB(strName, boost::bind(&CLevelDBWrapper::Compact, _1)))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown database: " + strName);
+    return NullUniValue;
+}
+
+UniValue getblockstoreinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error(
+            "getblockstoreinfo\n"
+            "\nReturns statistics of block reads, the block cache and the mapped block files.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"cache_hits\": n,          (numeric) Reads served from the block cache\n"
+            "  \"cache_misses\": n,        (numeric) Reads that went to the block files\n"
+            "  \"hit_rate\": x.xxx,        (numeric) Fraction of reads served from the cache\n"
+            "  \"mapped_reads\": n,        (numeric) File reads served from a memory-mapped file\n"
+            "  \"sequential_reads\": n,    (numeric) File reads that continued a scan, these bypass the cache\n"
+            "  \"bytes_read\": n,          (numeric) Serialized block bytes read from the files\n"
+            "  \"cache_blocks\": n,        (numeric) Blocks in the cache\n"
+            "  \"cache_bytes\": n,         (numeric) Serialized size of the cached blocks\n"
+            "  \"mapped_files\": n         (numeric) Block files currently mapped\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getblockstoreinfo", "") + HelpExampleRpc("getblockstoreinfo", ""));
+
+    CBlockStoreStats stats = blockstore.GetStats();
+    uint64_t nReads = stats.nCacheHits + stats.nCacheMisses;
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("cache_hits", stats.nCacheHits));
+    ret.push_back(Pair("cache_misses", stats.nCacheMisses));
+    ret.push_back(Pair("hit_rate", nReads ? (double)stats.nCacheHits / nReads : 0.0));
+    ret.push_back(Pair("mapped_reads", stats.nMappedReads));
+    ret.push_back(Pair("sequential_reads", stats.nSequentialReads));
+    ret.push_back(Pair("bytes_read", stats.nBytesRead));
+    ret.push_back(Pair("cache_blocks", (uint64_t)stats.nCacheBlocks));
+    ret.push_back(Pair("cache_bytes", (uint64_t)stats.nCacheBytes));
+    ret.push_back(Pair("mapped_files", (uint64_t)stats.nMappedFiles));
     return ret;
 }
 
@@ -947,6 +1197,14 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"difficulty\": xxxxxx,     (numeric) the current difficulty\n"
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
             "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"pruned\": xx,             (boolean) if the blocks are subject to pruning\n"
+            "  \"pruneheight\": xxxxxx,    (numeric) lowest block with its data on disk, only present if pruning is enabled\n"
+            "  \"snapshot\": {             (object) only if the node was bootstrapped with -loadtxoutset\n"
+            "     \"base\": \"hash\",        (string) the block the chainstate snapshot was taken at\n"
+            "     \"height\": xxxxxx,      (numeric) its height, blocks up to it have no data\n"
+            "     \"validated\": xx        (boolean) whether the background check of the headers and UTXO set has completed,\n"
+            "                              the blocks below the base are not validated\n"
+            "  }\n"
             "  \"softforks\": [            (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",        (string) name of softfork\n"
@@ -975,6 +1233,25 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("difficulty", (double)GetDifficulty()));
     obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(chainActive.Tip())));
     obj.push_back(Pair("chainwork", chainActive.Tip()->nChainWork.GetHex()));
+    obj.push_back(Pair("pruned", fPruneMode));
+    if (fPruneMode) {
+        CBlockIndex* block = chainActive.Tip();
+        while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA))
+            block = block->pprev;
+
+        obj.push_back(Pair("pruneheight", block->nHeight));
+    }
+    uint256 hashSnapshotBase;
+    if (pblocktree->ReadSnapshotBase(hashSnapshotBase)) {
+        UniValue snapshot(UniValue::VOBJ);
+        bool fValidated = false;
+        pblocktree->ReadFlag("snapshotvalidated", fValidated);
+        BlockMap::const_iterator mi = mapBlockIndex.find(hashSnapshotBase);
+        snapshot.push_back(Pair("base", hashSnapshotBase.GetHex()));
+        snapshot.push_back(Pair("height", mi != mapBlockIndex.end() ? mi->second->nHeight : -1));
+        snapshot.push_back(Pair("validated", fValidated));
+        obj.push_back(Pair("snapshot", snapshot));
+    }
     //CBlockIndex* tip = chainActive.Tip();
     //UniValue softforks(UniValue::VARR);
     //softforks.push_back(SoftForkDesc("bip65", 5, tip));
@@ -1261,6 +1538,50 @@ UniValue findserial(const UniValue& params, bool fHelp)
     return ret;
 }
 
+UniValue findserials(const UniValue& params, bool fHelp)
+{
+    if(fHelp || params.size() != 1)
+        throw std::runtime_error(
+            "findserials [\"serial\",...]\n"
+            "\nSearches the zerocoin database for the zerocoin spend transactions that contain the specified serials\n"
+
+            "\nArguments:\n"
+            "1. serials   (array, required) the serials of the zerocoin spends to search for.\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"serial\": \"xxx\"           (string) The serial\n"
+            "    \"success\": true|false      (boolean) Whether the serial was found\n"
+            "    \"txid\": \"xxx\"             (string) The transaction that contains the spent serial\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("findserials", "\"[\\\"serial\\\"]\"") + HelpExampleRpc("findserials", "[\"serial\"]"));
+
+    UniValue serials = params[0].get_array();
+    UniValue ret(UniValue::VARR);
+    for (unsigned int i = 0; i < serials.size(); i++) {
+        std::string strSerial = serials[i].get_str();
+        CBigNum bnSerial = 0;
+        bnSerial.SetHex(strSerial);
+        if (!bnSerial)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, strprintf("Invalid serial %s", strSerial));
+
+        uint256 txid = 0;
+        bool fSuccess = zerocoinDB->ReadCoinSpend(bnSerial, txid);
+
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("serial", strSerial));
+        obj.push_back(Pair("success", fSuccess));
+        obj.push_back(Pair("txid", txid.GetHex()));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
 UniValue getaccumulatorvalues(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -1441,7 +1762,8 @@ UniValue getserials(const UniValue& params, bool fHelp) {
     if (fHelp || params.size() < 2 || params.size() > 3)
         throw std::runtime_error(
             "getserials height range ( fVerbose )\n"
-            "\nLook the inputs of any tx in a range of blocks and returns the serial numbers for any coinspend.\n"
+            "\nReturns the serial numbers of the coinspends in a range of blocks,\n"
+            "ordered by block height, then by transaction id and input index.\n"
 
             "\nArguments:\n"
             "1. starting_height   (numeric, required) the height of the first block to check\n"
@@ -1460,94 +1782,87 @@ UniValue getserials(const UniValue& params, bool fHelp) {
         fVerbose = params[2].get_bool();
     }
 
-    CBlockIndex* pblockindex = nullptr;
-    {
-        LOCK(cs_main);
-        pblockindex = chainActive[heightStart];
+    ZerocoinSpendIndex vEntries;
+    if (zerocoinDB->ReadSpendIndexComplete()) {
+        if (!zerocoinDB->ReadSpendIndex(heightStart, heightEnd, vEntries))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "failed to read the serial index");
+    } else {
+        // the serial index is still being built, decode the blocks
+        CBlockIndex* pblockindex = nullptr;
+        {
+            LOCK(cs_main);
+            pblockindex = chainActive[heightStart];
+        }
+
+        if (!pblockindex)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "invalid block height");
+
+        while (true) {
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pblockindex))
+                throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+            if (!BlockToZerocoinSpendIndex(block, pblockindex->nHeight, vEntries))
+                throw JSONRPCError(RPC_INTERNAL_ERROR, "public zerocoin spend parse failed");
+
+            if (pblockindex->nHeight < heightEnd) {
+                LOCK(cs_main);
+                pblockindex = chainActive.Next(pblockindex);
+            } else {
+                break;
+            }
+        }
     }
 
-    if (!pblockindex)
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "invalid block height");
+    // the index keys sort the txid bytewise and the blocks list their transactions in block order,
+    // so give both sources the same order
+    std::sort(vEntries.begin(), vEntries.end(), [](const std::pair<CZerocoinSpendPos, CZerocoinSpendInfo>& a, const std::pair<CZerocoinSpendPos, CZerocoinSpendInfo>& b) {
+        return a.first < b.first;
+    });
 
-    UniValue serialsObj(UniValue::VOBJ);    // for fVerbose
     UniValue serialsArr(UniValue::VARR);
+    for (const std::pair<CZerocoinSpendPos, CZerocoinSpendInfo>& entry : vEntries) {
+        const CZerocoinSpendPos& pos = entry.first;
+        const CZerocoinSpendInfo& info = entry.second;
+        std::string serial_str = info.bnSerial.ToString(16);
+        if (!fVerbose) {
+            serialsArr.push_back(serial_str);
+            continue;
+        }
 
-    while (true) {
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pblockindex))
-                throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
-
-        // loop through each tx in the block
-        for (const CTransaction& tx : block.vtx) {
-            std::string txid = tx.GetHash().GetHex();
-            // collect the destination (first output) if fVerbose
-            std::string spentTo = "";
-            if (fVerbose) {
-                if (tx.vout[0].IsZerocoinMint()) {
-                    spentTo = "Zerocoin Mint";
-                } else if (tx.vout[0].IsEmpty()) {
-                    spentTo = "Zerocoin Stake";
-                } else {
-                    txnouttype type;
-                    std::vector<CTxDestination> addresses;
-                    int nRequired;
-                    if (!ExtractDestinations(tx.vout[0].scriptPubKey, type, addresses, nRequired)) {
-                        spentTo = strprintf("type: %d", GetTxnOutputType(type));
-                    } else {
-                        spentTo = CBitcoinAddress(addresses[0]).ToString();
-                    }
-                }
+        // the destination (first output) of the spending tx
+        std::string spentTo = "";
+        if (info.txoutSpentTo.IsZerocoinMint()) {
+            spentTo = "Zerocoin Mint";
+        } else if (info.txoutSpentTo.IsEmpty()) {
+            spentTo = "Zerocoin Stake";
+        } else {
+            txnouttype type;
+            std::vector<CTxDestination> addresses;
+            int nRequired;
+            if (!ExtractDestinations(info.txoutSpentTo.scriptPubKey, type, addresses, nRequired)) {
+                spentTo = strprintf("type: %d", GetTxnOutputType(type));
+            } else {
+                spentTo = CBitcoinAddress(addresses[0]).ToString();
             }
-            // loop through each input
-            for (const CTxIn& txin : tx.vin) {
-                bool isPublicSpend =  txin.IsZerocoinPublicSpend();
-                if (txin.IsZerocoinSpend() || isPublicSpend) {
-                    std::string serial_str;
-                    int denom;
-                    if (isPublicSpend) {
-                        CTxOut prevOut;
-                        CValidationState state;
-                        if(!GetOutput(txin.prevout.hash, txin.prevout.n, state, prevOut)){
-                            throw JSONRPCError(RPC_INTERNAL_ERROR, "public zerocoin spend prev output not found");
-                        }
-                        libzerocoin::ZerocoinParams *params = Params().Zerocoin_Params(false);
-                        PublicCoinSpend publicSpend(params);
-                        if (!ZSPLModule::parseCoinSpend(txin, tx, prevOut, publicSpend)) {
-                            throw JSONRPCError(RPC_INTERNAL_ERROR, "public zerocoin spend parse failed");
-                        }
-                        serial_str = publicSpend.getCoinSerialNumber().ToString(16);
-                        denom = libzerocoin::ZerocoinDenominationToInt(publicSpend.getDenomination());
-                    } else {
-                        libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txin);
-                        serial_str = spend.getCoinSerialNumber().ToString(16);
-                        denom = libzerocoin::ZerocoinDenominationToInt(spend.getDenomination());
-                    }
-                    if (!fVerbose) {
-                        serialsArr.push_back(serial_str);
-                    } else {
-                        UniValue s(UniValue::VOBJ);
-                        s.push_back(Pair("serial", serial_str));
-                        s.push_back(Pair("denom", denom));
-                        s.push_back(Pair("bitsize", (int)serial_str.size()*4));
-                        s.push_back(Pair("spentTo", spentTo));
-                        s.push_back(Pair("txid", txid));
-                        s.push_back(Pair("blocknum", pblockindex->nHeight));
-                        s.push_back(Pair("blocktime", block.GetBlockTime()));
-                        serialsArr.push_back(s);
-                    }
-                }
-
-            } // end for vin in tx
-        } // end for tx in block
-
-        if (pblockindex->nHeight < heightEnd) {
+        }
+
+        int64_t nBlockTime = 0;
+        {
             LOCK(cs_main);
-            pblockindex = chainActive.Next(pblockindex);
-        } else {
-            break;
+            if (chainActive[pos.nHeight])
+                nBlockTime = chainActive[pos.nHeight]->GetBlockTime();
         }
 
-    } // end for blocks
+        UniValue s(UniValue::VOBJ);
+        s.push_back(Pair("serial", serial_str));
+        s.push_back(Pair("denom", info.nDenomination));
+        s.push_back(Pair("bitsize", (int)serial_str.size()*4));
+        s.push_back(Pair("spentTo", spentTo));
+        s.push_back(Pair("txid", pos.txid.GetHex()));
+        s.push_back(Pair("blocknum", pos.nHeight));
+        s.push_back(Pair("blocktime", nBlockTime));
+        serialsArr.push_back(s);
+    }
 
     return serialsArr;
 
@@ -1590,6 +1905,11 @@ UniValue getblockindexstats(const UniValue& params, bool fHelp) {
                 "  \"ttlfee\": xxxxx                 (numeric) Sum of the fee amount of all txes (zSPL mints excluded) over block range\n"
                 "  \"ttlfee_all\": xxxxx             (numeric) Sum of the fee amount of all txes (zSPL mints included) over block range\n"
                 "  \"feeperkb\": xxxxx               (numeric) Average fee per kb (excluding zc txes)\n"
+                "  \"feerate_percentiles\": {         (json object) Approximate fee per kb at the 10th, 25th, 50th, 75th and 90th\n"
+                "                                     percentiles of the tx bytes, from the percentiles of each block\n"
+                "        \"p10\": xxxxx                (numeric) fee per kb paid by the cheapest 10% of the tx bytes\n"
+                "         ...                    ... p25, p50, p75, p90\n"
+                "  }\n"
                 "}\n"
 
                 "\nExamples:\n" +
@@ -1614,14 +1934,11 @@ UniValue getblockindexstats(const UniValue& params, bool fHelp) {
     int64_t nTxCount = 0;
     int64_t nTxCount_all = 0;
 
-    std::map<libzerocoin::CoinDenomination, int64_t> mapMintCount;
-    std::map<libzerocoin::CoinDenomination, int64_t> mapSpendCount;
-    std::map<libzerocoin::CoinDenomination, int64_t> mapPublicSpendCount;
-    for (auto& denom : libzerocoin::zerocoinDenomList) {
-        mapMintCount.insert(std::make_pair(denom, 0));
-        mapSpendCount.insert(std::make_pair(denom, 0));
-        mapPublicSpendCount.insert(std::make_pair(denom, 0));
-    }
+    std::vector<int64_t> vMintCount(libzerocoin::zerocoinDenomList.size(), 0);
+    std::vector<int64_t> vSpendCount(libzerocoin::zerocoinDenomList.size(), 0);
+    std::vector<int64_t> vPublicSpendCount(libzerocoin::zerocoinDenomList.size(), 0);
+    // every block contributes its percentiles, each weighted by an equal share of its bytes
+    std::vector<std::pair<CAmount, int64_t> > vFeeRates;
 
     CBlockIndex* pindex = nullptr;
     {
@@ -1633,65 +1950,27 @@ UniValue getblockindexstats(const UniValue& params, bool fHelp) {
         throw JSONRPCError(RPC_INVALID_PARAMETER, "invalid block height");
 
     while (true) {
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pindex)) {
-            throw JSONRPCError(RPC_DATABASE_ERROR, "failed to read block from disk");
+        CBlockStats stats;
+        if (!blockStatsIndex.Get(pindex, stats)) {
+            int nStatsHeight = 0;
+            if (pblocktree->ReadInt("blockstatsheight", nStatsHeight) && pindex->nHeight < nStatsHeight)
+                throw JSONRPCError(RPC_MISC_ERROR, strprintf("block stats are only available from height %d, the data of older blocks is missing", nStatsHeight));
+            throw JSONRPCError(RPC_DATABASE_ERROR, "failed to read block stats");
         }
 
-        CAmount nValueIn = 0;
-        CAmount nValueOut = 0;
-        const int ntx = block.vtx.size();
-        nTxCount_all += ntx;
-        nTxCount = block.IsProofOfStake() ? nTxCount + ntx - 2 : nTxCount + ntx - 1;
-
-        // loop through each tx in block and save size and fee
-        for (const CTransaction& tx : block.vtx) {
-            if (tx.IsCoinBase() || (tx.IsCoinStake() && !tx.HasZerocoinSpendInputs()))
-                continue;
-
-            // fetch input value from prevouts and count spends
-            for (unsigned int j = 0; j < tx.vin.size(); j++) {
-                if (tx.vin[j].IsZerocoinSpend()) {
-                    if (!fFeeOnly)
-                        mapSpendCount[libzerocoin::IntToZerocoinDenomination(tx.vin[j].nSequence)]++;
-                    continue;
-                }
-                if (tx.vin[j].IsZerocoinPublicSpend()) {
-                    if (!fFeeOnly)
-                        mapPublicSpendCount[libzerocoin::IntToZerocoinDenomination(tx.vin[j].nSequence)]++;
-                    continue;
-                }
-
-                COutPoint prevout = tx.vin[j].prevout;
-                CTransaction txPrev;
-                uint256 hashBlock;
-                if(!GetTransaction(prevout.hash, txPrev, hashBlock, true))
-                    throw JSONRPCError(RPC_DATABASE_ERROR, "failed to read tx from disk");
-                nValueIn += txPrev.vout[prevout.n].nValue;
-            }
-
-            // zc spends have no fee
-            if (tx.HasZerocoinSpendInputs())
-                continue;
-
-            // sum output values in nValueOut
-            for (unsigned int j = 0; j < tx.vout.size(); j++) {
-                nValueOut += tx.vout[j].nValue;
-            }
-
-            // update sums
-            nFees_all += nValueIn - nValueOut;
-            if (!tx.HasZerocoinMintOutputs()) {
-                nFees += nValueIn - nValueOut;
-                nBytes += tx.GetSerializeSize(SER_NETWORK, CLIENT_VERSION);
-            }
+        nTxCount += stats.nTxCount;
+        nTxCount_all += stats.nTxCountAll;
+        nBytes += stats.nTxBytes;
+        nFees += stats.nFee;
+        nFees_all += stats.nFeeAll;
+        for (unsigned int i = 0; i < libzerocoin::zerocoinDenomList.size(); i++) {
+            vMintCount[i] += stats.vMints[i];
+            vSpendCount[i] += stats.vSpends[i];
+            vPublicSpendCount[i] += stats.vPublicSpends[i];
         }
-
-        // add mints to map
-        if (!fFeeOnly) {
-            for (auto& denom : libzerocoin::zerocoinDenomList) {
-                mapMintCount[denom] += count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
-            }
+        if (stats.nTxBytes > 0) {
+            for (const CAmount& nFeeRate : stats.vFeeRatePercentiles)
+                vFeeRates.push_back(std::make_pair(nFeeRate, stats.nTxBytes));
         }
 
         if (pindex->nHeight < heightEnd) {
@@ -1712,10 +1991,11 @@ UniValue getblockindexstats(const UniValue& params, bool fHelp) {
         UniValue mint_obj(UniValue::VOBJ);
         UniValue spend_obj(UniValue::VOBJ);
         UniValue pubspend_obj(UniValue::VOBJ);
-        for (auto& denom : libzerocoin::zerocoinDenomList) {
-            mint_obj.push_back(Pair(strprintf("denom_%d", ZerocoinDenominationToInt(denom)), mapMintCount[denom]));
-            spend_obj.push_back(Pair(strprintf("denom_%d", ZerocoinDenominationToInt(denom)), mapSpendCount[denom]));
-            pubspend_obj.push_back(Pair(strprintf("denom_%d", ZerocoinDenominationToInt(denom)), mapPublicSpendCount[denom]));
+        for (unsigned int i = 0; i < libzerocoin::zerocoinDenomList.size(); i++) {
+            std::string strDenom = strprintf("denom_%d", ZerocoinDenominationToInt(libzerocoin::zerocoinDenomList[i]));
+            mint_obj.push_back(Pair(strDenom, vMintCount[i]));
+            spend_obj.push_back(Pair(strDenom, vSpendCount[i]));
+            pubspend_obj.push_back(Pair(strDenom, vPublicSpendCount[i]));
         }
         ret.push_back(Pair("mintcount", mint_obj));
         ret.push_back(Pair("spendcount", spend_obj));
@@ -1726,8 +2006,57 @@ UniValue getblockindexstats(const UniValue& params, bool fHelp) {
     ret.push_back(Pair("ttlfee", FormatMoney(nFees)));
     ret.push_back(Pair("ttlfee_all", FormatMoney(nFees_all)));
     ret.push_back(Pair("feeperkb", FormatMoney(nFeeRate.GetFeePerK())));
+    UniValue percentiles_obj(UniValue::VOBJ);
+    std::vector<CAmount> vPercentiles = GetFeeRatePercentiles(vFeeRates);
+    for (unsigned int i = 0; i < BLOCKSTATS_NUM_PERCENTILES; i++)
+        percentiles_obj.push_back(Pair(strprintf("p%d", BLOCKSTATS_PERCENTILES[i]), FormatMoney(vPercentiles[i])));
+    ret.push_back(Pair("feerate_percentiles", percentiles_obj));
 
     return ret;
 
 }
 
+
+UniValue getspentinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1 || !params[0].isObject())
+        throw std::runtime_error(
+            "getspentinfo {\"txid\": \"hash\", \"index\": n}\n"
+            "\nReturns the txid and input index spending an output (requires -spentindex).\n"
+
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"txid\" : \"hash\"   (string, required) The hex string of the txid\n"
+            "  \"index\" : n       (numeric, required) The output index\n"
+            "}\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\" : \"hash\",  (string) The txid of the spending transaction\n"
+            "  \"index\" : n,      (numeric) The spending input index\n"
+            "  \"height\" : n      (numeric) The height of the block of the spending transaction\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'") +
+            HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}"));
+
+    if (!fSpentIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Spent index not enabled, restart with -spentindex -reindex");
+
+    const UniValue& txidValue = find_value(params[0].get_obj(), "txid");
+    const UniValue& indexValue = find_value(params[0].get_obj(), "index");
+    if (!txidValue.isStr() || !indexValue.isNum())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid txid or index");
+
+    CSpentIndexKey key(ParseHashV(txidValue, "txid"), indexValue.get_int());
+    CSpentIndexValue value;
+    if (!pblocktree->ReadSpentIndex(key, value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("txid", value.txid.GetHex()));
+    obj.push_back(Pair("index", (int)value.nInputIndex));
+    obj.push_back(Pair("height", value.nBlockHeight));
+    return obj;
+}
@@ -158,10 +158,16 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"getmintsinblocks", 0},
         {"getmintsinblocks", 1},
         {"getmintsinblocks", 2},
+        {"findserials", 0},
         {"getserials", 0},
         {"getserials", 1},
         {"getserials", 2},
         {"getfeeinfo", 0},
+        {"getaddressbalance", 0},
+        {"getaddressutxos", 0},
+        {"getaddresstxids", 0},
+        {"getspentinfo", 0},
+        {"gettxoutsetinfo", 0},
         {"getchecksumblock", 1},
         {"getchecksumblock", 2},
     };
@@ -5,6 +5,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "addressindex.h"
 #include "base58.h"
 #include "clientversion.h"
 #include "init.h"
@@ -15,15 +16,19 @@
 #include "rpc/server.h"
 #include "spork.h"
 #include "timedata.h"
+#include "trace.h"
+#include "txdb.h"
 #include "util.h"
 #ifdef ENABLE_WALLET
 #include "wallet/wallet.h"
 #include "wallet/walletdb.h"
 #endif
 
+#include <algorithm>
 #include <stdint.h>
 
 #include <boost/assign/list_of.hpp>
+#include <boost/filesystem.hpp>
 
 #include <univalue.h>
 
@@ -584,6 +589,315 @@ UniValue setmocktime(const UniValue& params, bool fHelp)
     return NullUniValue;
 }
 
+UniValue trace(const UniValue& params, bool fHelp)
+{
+    std::string strMode;
+    if (params.size() >= 1)
+        strMode = params[0].get_str();
+
+    if (fHelp || params.size() < 1 || params.size() > 2 || (strMode != "start" && strMode != "stop" && strMode != "status" && strMode != "dump") ||
+        (params.size() == 2 && strMode != "dump")) {
+        throw std::runtime_error(
+            "trace \"start|stop|status|dump\" ( \"path\" )\n"
+            "\nRecords the time spent in validation, mempool, networking, staking, zerocoin and masternode code.\n"
+            "'start' begins a new trace session, 'stop' ends it and 'dump' exports the events of the session,\n"
+            "while or after it runs, in the Chrome trace event format that chrome://tracing and Perfetto load.\n"
+            "Each thread keeps its last -tracebuffer events.\n"
+
+            "\nArguments:\n"
+            "1. \"mode\"    (string, required) 'start', 'stop', 'status' or 'dump'\n"
+            "2. \"path\"    (string, optional) 'dump' mode: write the trace to this file, relative to the data directory unless absolute\n"
+
+            "\nResult ('status' mode):\n"
+            "{\n"
+            "  \"enabled\": true|false,   (boolean) Whether events are recorded\n"
+            "  \"buffersize\": n,         (numeric) Events kept per thread\n"
+            "  \"threads\": n,            (numeric) Threads that recorded events\n"
+            "  \"recorded\": n,           (numeric) Events recorded since startup\n"
+            "}\n"
+
+            "\nResult ('dump' mode without a path):\n"
+            "{\n"
+            "  \"traceEvents\": [ ... ],  (array) The events, as complete (\"X\") events with microsecond timestamps\n"
+            "  \"displayTimeUnit\": \"ms\"\n"
+            "}\n"
+
+            "\nResult ('dump' mode with a path):\n"
+            "{\n"
+            "  \"path\": \"path\",        (string) The absolute path of the file\n"
+            "  \"events\": n             (numeric) Events written\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("trace", "\"start\"") + HelpExampleCli("trace", "\"dump\" \"trace.json\"") + HelpExampleRpc("trace", "\"status\""));
+    }
+
+    if (strMode == "start")
+        StartTrace();
+    else if (strMode == "stop")
+        StopTrace();
+    if (strMode != "dump")
+        return TraceStatus();
+
+    UniValue result = TraceToJSON();
+    if (params.size() < 2)
+        return result;
+
+    boost::filesystem::path path = boost::filesystem::absolute(params[1].get_str(), GetDataDir());
+    FILE* file = fopen(path.string().c_str(), "w");
+    if (!file)
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("Unable to open %s for writing", path.string()));
+    std::string strTrace = result.write();
+    bool fWritten = fwrite(strTrace.data(), 1, strTrace.size(), file) == strTrace.size();
+    fWritten = fclose(file) == 0 && fWritten;
+    if (!fWritten)
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("Failed to write %s", path.string()));
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("path", path.string()));
+    obj.push_back(Pair("events", (int)result["traceEvents"].size()));
+    return obj;
+}
+
+namespace
+{
+bool GetAddressIndexKey(const std::string& strAddress, unsigned char& nType, uint160& hashBytes)
+{
+    CBitcoinAddress address(strAddress);
+    if (!address.IsValid())
+        return false;
+
+    CTxDestination dest = address.Get();
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest)) {
+        nType = ADDRESS_PUBKEYHASH;
+        hashBytes = *keyID;
+        return true;
+    }
+    if (const CScriptID* scriptID = boost::get<CScriptID>(&dest)) {
+        nType = ADDRESS_SCRIPTHASH;
+        hashBytes = *scriptID;
+        return true;
+    }
+    return false;
+}
+
+std::string GetAddressFromIndexKey(unsigned char nType, const uint160& hashBytes)
+{
+    if (nType == ADDRESS_SCRIPTHASH)
+        return CBitcoinAddress(CScriptID(hashBytes)).ToString();
+    return CBitcoinAddress(CKeyID(hashBytes)).ToString();
+}
+
+/** Addresses of an {"addresses": [...]} object or of a single address string */
+std::vector<std::pair<unsigned char, uint160> > ParseAddressIndexParams(const UniValue& param)
+{
+    std::vector<UniValue> vValues;
+    if (param.isStr()) {
+        vValues.push_back(param);
+    } else if (param.isObject()) {
+        const UniValue& addresses = find_value(param.get_obj(), "addresses");
+        if (!addresses.isArray())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Addresses is expected to be an array");
+        vValues = addresses.getValues();
+    } else {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Expected an address or an object with addresses");
+    }
+
+    std::vector<std::pair<unsigned char, uint160> > vAddresses;
+    for (const UniValue& value : vValues) {
+        unsigned char nType;
+        uint160 hashBytes;
+        if (!value.isStr() || !GetAddressIndexKey(value.get_str(), nType, hashBytes))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+        vAddresses.push_back(std::make_pair(nType, hashBytes));
+    }
+    return vAddresses;
+}
+} // namespace
+
+UniValue getaddressbalance(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw std::runtime_error(
+            "getaddressbalance {\"addresses\": [\"address\",...]}\n"
+            "\nReturns the balance of the addresses (requires -addressindex).\n"
+
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"addresses\"     (array, required) The simplicity addresses\n"
+            "    [\n"
+            "      \"address\"   (string) A simplicity address\n"
+            "      ,...\n"
+            "    ]\n"
+            "}\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\" : n,    (numeric) The current balance in satoshis\n"
+            "  \"received\" : n    (numeric) The total amount received in satoshis, change included\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"8TmzKKhAXkacz9fKckPjp5TUSVtsz1B79R\"]}'") +
+            HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"8TmzKKhAXkacz9fKckPjp5TUSVtsz1B79R\"]}"));
+
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled, restart with -addressindex -reindex");
+
+    std::vector<std::pair<unsigned char, uint160> > vAddresses = ParseAddressIndexParams(params[0]);
+
+    CAmount nBalance = 0;
+    CAmount nReceived = 0;
+    for (const std::pair<unsigned char, uint160>& address : vAddresses) {
+        AddressIndex vEntries;
+        if (!pblocktree->ReadAddressIndex(address.first, address.second, vEntries))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the address index");
+
+        for (const std::pair<CAddressIndexKey, CAmount>& entry : vEntries) {
+            if (entry.second > 0)
+                nReceived += entry.second;
+            nBalance += entry.second;
+        }
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("balance", nBalance));
+    result.push_back(Pair("received", nReceived));
+    return result;
+}
+
+UniValue getaddressutxos(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw std::runtime_error(
+            "getaddressutxos {\"addresses\": [\"address\",...]}\n"
+            "\nReturns the unspent outputs of the addresses (requires -addressindex).\n"
+
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"addresses\"     (array, required) The simplicity addresses\n"
+            "    [\n"
+            "      \"address\"   (string) A simplicity address\n"
+            "      ,...\n"
+            "    ]\n"
+            "}\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\" : \"address\",  (string) The address\n"
+            "    \"txid\" : \"hash\",        (string) The output txid\n"
+            "    \"outputIndex\" : n,      (numeric) The output index\n"
+            "    \"script\" : \"hex\",       (string) The script hex\n"
+            "    \"satoshis\" : n,         (numeric) The output value in satoshis\n"
+            "    \"height\" : n            (numeric) The height of the block of the output\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"8TmzKKhAXkacz9fKckPjp5TUSVtsz1B79R\"]}'") +
+            HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"8TmzKKhAXkacz9fKckPjp5TUSVtsz1B79R\"]}"));
+
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled, restart with -addressindex -reindex");
+
+    std::vector<std::pair<unsigned char, uint160> > vAddresses = ParseAddressIndexParams(params[0]);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    for (const std::pair<unsigned char, uint160>& address : vAddresses) {
+        AddressUnspentIndex vEntries;
+        if (!pblocktree->ReadAddressUnspentIndex(address.first, address.second, vEntries))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the address index");
+        vUnspent.insert(vUnspent.end(), vEntries.begin(), vEntries.end());
+    }
+
+    std::sort(vUnspent.begin(), vUnspent.end(), [](const std::pair<CAddressUnspentKey, CAddressUnspentValue>& a, const std::pair<CAddressUnspentKey, CAddressUnspentValue>& b) {
+        return a.second.nBlockHeight < b.second.nBlockHeight;
+    });
+
+    UniValue result(UniValue::VARR);
+    for (const std::pair<CAddressUnspentKey, CAddressUnspentValue>& entry : vUnspent) {
+        UniValue output(UniValue::VOBJ);
+        output.push_back(Pair("address", GetAddressFromIndexKey(entry.first.type, entry.first.hashBytes)));
+        output.push_back(Pair("txid", entry.first.txhash.GetHex()));
+        output.push_back(Pair("outputIndex", (int)entry.first.nIndex));
+        output.push_back(Pair("script", HexStr(entry.second.script.begin(), entry.second.script.end())));
+        output.push_back(Pair("satoshis", entry.second.nSatoshis));
+        output.push_back(Pair("height", entry.second.nBlockHeight));
+        result.push_back(output);
+    }
+    return result;
+}
+
+UniValue getaddresstxids(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw std::runtime_error(
+            "getaddresstxids {\"addresses\": [\"address\",...], \"start\": n, \"end\": n}\n"
+            "\nReturns the txids of the transactions paying to or spending from the addresses (requires -addressindex).\n"
+
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"addresses\"     (array, required) The simplicity addresses\n"
+            "    [\n"
+            "      \"address\"   (string) A simplicity address\n"
+            "      ,...\n"
+            "    ]\n"
+            "  \"start\" : n     (numeric, optional) The start block height\n"
+            "  \"end\" : n       (numeric, optional) The end block height\n"
+            "}\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  \"transactionid\"  (string) The transaction id, in chain order\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"8TmzKKhAXkacz9fKckPjp5TUSVtsz1B79R\"]}'") +
+            HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"8TmzKKhAXkacz9fKckPjp5TUSVtsz1B79R\"]}"));
+
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled, restart with -addressindex -reindex");
+
+    std::vector<std::pair<unsigned char, uint160> > vAddresses = ParseAddressIndexParams(params[0]);
+
+    int nStart = 0;
+    int nEnd = 0;
+    if (params[0].isObject()) {
+        const UniValue& start = find_value(params[0].get_obj(), "start");
+        const UniValue& end = find_value(params[0].get_obj(), "end");
+        if (!start.isNull() || !end.isNull()) {
+            if (!start.isNum() || !end.isNum())
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Start and end are expected to be set together");
+            nStart = start.get_int();
+            nEnd = end.get_int();
+            if (nStart < 0 || nEnd < nStart)
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "End value is expected to be greater than start");
+        }
+    }
+
+    // (height, position in the block) of each txid, to return them in chain order
+    std::vector<std::pair<std::pair<int, unsigned int>, uint256> > vTxids;
+    for (const std::pair<unsigned char, uint160>& address : vAddresses) {
+        AddressIndex vEntries;
+        if (!pblocktree->ReadAddressIndex(address.first, address.second, vEntries, nStart, nEnd))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the address index");
+
+        for (const std::pair<CAddressIndexKey, CAmount>& entry : vEntries)
+            vTxids.push_back(std::make_pair(std::make_pair(entry.first.nBlockHeight, entry.first.nTxIndex), entry.first.txhash));
+    }
+
+    std::sort(vTxids.begin(), vTxids.end());
+    vTxids.erase(std::unique(vTxids.begin(), vTxids.end()), vTxids.end());
+
+    UniValue result(UniValue::VARR);
+    for (const std::pair<std::pair<int, unsigned int>, uint256>& txid : vTxids)
+        result.push_back(txid.second.GetHex());
+    return result;
+}
+
 #ifdef ENABLE_WALLET
 UniValue getstakingstatus(const UniValue& params, bool fHelp)
 {
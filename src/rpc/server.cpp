@@ -284,6 +284,7 @@ static const CRPCCommand vRPCCommands[] =
         {"control", "getinfo", &getinfo, true, false, false}, /* uses wallet if enabled */
         {"control", "help", &help, true, true, false},
         {"control", "stop", &stop, true, true, false},
+        {"control", "trace", &trace, true, true, false},
 
         /* P2P networking */
         {"network", "getnetworkinfo", &getnetworkinfo, true, false, false},
@@ -300,6 +301,7 @@ static const CRPCCommand vRPCCommands[] =
 
         /* Block chain and UTXO */
         {"blockchain", "findserial", &findserial, true, false, false},
+        {"blockchain", "findserials", &findserials, true, false, false},
         {"blockchain", "getaccumulatorvalues", &getaccumulatorvalues, true, false, false},
         {"blockchain", "getaccumulatorwitness", &getaccumulatorwitness, true, false, false},
         {"blockchain", "getblockindexstats", &getblockindexstats, true, false, false},
@@ -313,10 +315,15 @@ static const CRPCCommand vRPCCommands[] =
         {"blockchain", "getblockheader", &getblockheader, false, false, false},
         {"blockchain", "getchaintips", &getchaintips, true, false, false},
         {"blockchain", "getchecksumblock", &getchecksumblock, false, false, false},
+        {"blockchain", "getdbinfo", &getdbinfo, true, false, false},
+        {"blockchain", "getblockstoreinfo", &getblockstoreinfo, true, false, false},
+        {"blockchain", "compactdb", &compactdb, true, true, false},
+        {"blockchain", "dumptxoutset", &dumptxoutset, true, true, false},
         {"blockchain", "getdifficulty", &getdifficulty, true, false, false},
         {"blockchain", "getfeeinfo", &getfeeinfo, true, false, false},
         {"blockchain", "getmempoolinfo", &getmempoolinfo, true, true, false},
         {"blockchain", "getrawmempool", &getrawmempool, true, false, false},
+        {"blockchain", "getspentinfo", &getspentinfo, true, false, false},
         {"blockchain", "gettxout", &gettxout, true, false, false},
         {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true, false, false},
         {"blockchain", "invalidateblock", &invalidateblock, true, true, false},
@@ -348,6 +355,11 @@ static const CRPCCommand vRPCCommands[] =
         {"rawtransactions", "sendrawtransaction", &sendrawtransaction, false, false, false},
         {"rawtransactions", "signrawtransaction", &signrawtransaction, false, false, false}, /* uses wallet if enabled */
 
+        /* Address index */
+        {"addressindex", "getaddressbalance", &getaddressbalance, true, false, false},
+        {"addressindex", "getaddresstxids", &getaddresstxids, true, false, false},
+        {"addressindex", "getaddressutxos", &getaddressutxos, true, false, false},
+
         /* Utility functions */
         {"util", "createmultisig", &createmultisig, true, true, false},
         {"util", "validateaddress", &validateaddress, true, false, false}, /* uses wallet if enabled */
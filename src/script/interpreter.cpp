@@ -1107,9 +1107,99 @@ public:
     }
 };
 
+/** Serializes into a byte vector, for the parts of the signature hash kept across inputs */
+class CByteVectorWriter
+{
+private:
+    std::vector<unsigned char>& vch;
+
+public:
+    int nType;
+    int nVersion;
+
+    CByteVectorWriter(std::vector<unsigned char>& vchIn, int nTypeIn, int nVersionIn) : vch(vchIn), nType(nTypeIn), nVersion(nVersionIn) {}
+
+    CByteVectorWriter& write(const char* pch, size_t size)
+    {
+        vch.insert(vch.end(), (const unsigned char*)pch, (const unsigned char*)pch + size);
+        return (*this);
+    }
+
+    template <typename T>
+    CByteVectorWriter& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
+/** Like CHashWriter, but continues from a SHA-256 midstate */
+class CMidstateHashWriter
+{
+private:
+    CSHA256 sha;
+
+public:
+    int nType;
+    int nVersion;
+
+    CMidstateHashWriter(const CSHA256& shaIn, int nTypeIn, int nVersionIn) : sha(shaIn), nType(nTypeIn), nVersion(nVersionIn) {}
+
+    CMidstateHashWriter& write(const char* pch, size_t size)
+    {
+        sha.Write((const unsigned char*)pch, size);
+        return (*this);
+    }
+
+    template <typename T>
+    CMidstateHashWriter& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+
+    // invalidates the object
+    uint256 GetHash()
+    {
+        unsigned char buf[CSHA256::OUTPUT_SIZE];
+        sha.Finalize(buf);
+        uint256 result;
+        CSHA256().Write(buf, CSHA256::OUTPUT_SIZE).Finalize((unsigned char*)&result);
+        return result;
+    }
+};
+
 } // anon namespace
 
-uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo)
+{
+    // the serializer layout of SIGHASH_ALL, with every input script blanked
+    std::vector<unsigned char> vchHeader;
+    CByteVectorWriter header(vchHeader, SER_GETHASH, 0);
+    header << txTo.nVersion;
+    ::WriteCompactSize(header, txTo.vin.size());
+    CSHA256 sha;
+    sha.Write(&vchHeader[0], vchHeader.size());
+
+    CByteVectorWriter inputs(vchInputs, SER_GETHASH, 0);
+    vInputPos.reserve(txTo.vin.size() + 1);
+    vMidstates.reserve(txTo.vin.size());
+    for (const CTxIn& txin : txTo.vin) {
+        vInputPos.push_back(vchInputs.size());
+        vMidstates.push_back(sha);
+        inputs << txin.prevout << CScript() << txin.nSequence;
+        sha.Write(&vchInputs[vInputPos.back()], vchInputs.size() - vInputPos.back());
+    }
+    vInputPos.push_back(vchInputs.size());
+
+    CByteVectorWriter outputs(vchOutputs, SER_GETHASH, 0);
+    ::WriteCompactSize(outputs, txTo.vout.size());
+    for (const CTxOut& txout : txTo.vout)
+        outputs << txout;
+    outputs << txTo.nLockTime;
+}
+
+uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* txdata)
 {
     static const uint256 one(uint256S("0000000000000000000000000000000000000000000000000000000000000001"));
     if (nIn >= txTo.vin.size()) {
@@ -1128,6 +1218,18 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
+    // Every input and output is committed to, only the input being signed differs
+    bool fAll = !(nHashType & SIGHASH_ANYONECANPAY) && (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE;
+    if (txdata && fAll && txdata->vMidstates.size() == txTo.vin.size()) {
+        CMidstateHashWriter ss(txdata->vMidstates[nIn], SER_GETHASH, 0);
+        txTmp.SerializeInput(ss, nIn, SER_GETHASH, 0);
+        unsigned int nPos = txdata->vInputPos[nIn + 1];
+        ss.write((const char*)txdata->vchInputs.data() + nPos, txdata->vchInputs.size() - nPos);
+        ss.write((const char*)txdata->vchOutputs.data(), txdata->vchOutputs.size());
+        ss << nHashType;
+        return ss.GetHash();
+    }
+
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
     ss << txTmp << nHashType;
@@ -1152,7 +1254,7 @@ bool TransactionSignatureChecker::CheckSig(const std::vector<unsigned char>& vch
     int nHashType = vchSig.back();
     vchSig.pop_back();
 
-    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType);
+    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType, txdata);
 
     // pubkeys of ver 1 coinstake txes are considered invalid for some reason; there's probably a better way to handle this
     if (!(static_cast<uint32_t>(txTo->nVersion) == 1 /*&& txTo->IsCoinStake()*/) && !VerifySignature(vchSig, pubkey, sighash)) {
@@ -7,6 +7,7 @@
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
 #include "script_error.h"
+#include "crypto/sha256.h"
 #include "primitives/transaction.h"
 
 #include <vector>
@@ -91,7 +92,27 @@ enum
     SCRIPT_VERIFY_NULLFAIL = (1U << 14)
 };
 
-uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+/**
+ * Parts of the signature hash serialization that do not depend on the input being signed,
+ * computed once per transaction. For SIGHASH_ALL without SIGHASH_ANYONECANPAY the hash of
+ * an input continues from the SHA-256 midstate over the inputs before it, so only the
+ * input itself and the cached serialization after it are hashed again.
+ */
+struct PrecomputedTransactionData
+{
+    //! inputs with blanked scripts, after the version and the input count
+    std::vector<unsigned char> vchInputs;
+    //! offset of each input in vchInputs, followed by its size
+    std::vector<unsigned int> vInputPos;
+    //! output count, outputs and nLockTime
+    std::vector<unsigned char> vchOutputs;
+    //! SHA-256 state before each input
+    std::vector<CSHA256> vMidstates;
+
+    explicit PrecomputedTransactionData(const CTransaction& tx);
+};
+
+uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* txdata = NULL);
 
 class BaseSignatureChecker
 {
@@ -114,12 +135,13 @@ class TransactionSignatureChecker : public BaseSignatureChecker
 private:
     const CTransaction* txTo;
     unsigned int nIn;
+    const PrecomputedTransactionData* txdata;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
-    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn) : txTo(txToIn), nIn(nInIn) {}
+    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const PrecomputedTransactionData* txdataIn = NULL) : txTo(txToIn), nIn(nInIn), txdata(txdataIn) {}
     bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
     bool CheckLockTime(const CScriptNum& nLockTime) const;
 };
@@ -15,6 +15,12 @@
 
 namespace {
 
+//! sigdata_type is (signature hash, signature, public key):
+typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
+
+/** Parsed public keys kept by a check queue worker, cleared when full */
+static const size_t MAX_PARSED_PUBKEYS = 4096;
+
 /**
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
  * twice for every transaction (once when accepted into memory pool, and
@@ -23,11 +29,27 @@ namespace {
 class CSignatureCache
 {
 private:
-     //! sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
     std::set< sigdata_type> setValid;
     boost::shared_mutex cs_sigcache;
 
+    void Insert(const sigdata_type& k, int64_t nMaxCacheSize)
+    {
+        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
+        {
+            // Evict a random entry. Random because that helps
+            // foil would-be DoS attackers who might try to pre-generate
+            // and re-use a set of valid signatures just-slightly-greater
+            // than our cache size.
+            uint256 randomHash = GetRandHash();
+            std::set<sigdata_type>::iterator it = setValid.lower_bound(sigdata_type(randomHash));
+            if (it == setValid.end())
+                it = setValid.begin();
+            setValid.erase(*it);
+        }
+
+        setValid.insert(k);
+    }
+
 public:
     bool
     Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
@@ -51,30 +73,41 @@ public:
         if (nMaxCacheSize <= 0) return;
 
         boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        Insert(sigdata_type(hash, vchSig, pubKey), nMaxCacheSize);
+    }
 
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
-        {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::set<sigdata_type>::iterator it = setValid.lower_bound(sigdata_type(randomHash));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
-        }
+    /** Look up several signatures under one lock */
+    void GetBatch(const std::vector<sigdata_type>& vData, std::vector<bool>& vFound)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        vFound.resize(vData.size());
+        for (unsigned int i = 0; i < vData.size(); i++)
+            vFound[i] = setValid.count(vData[i]) > 0;
+    }
 
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
+    /** Add several valid signatures under one lock */
+    void SetBatch(const std::vector<sigdata_type>& vData)
+    {
+        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
+        if (nMaxCacheSize <= 0) return;
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        for (const sigdata_type& k : vData)
+            Insert(k, nMaxCacheSize);
     }
 };
 
+CSignatureCache& GetSignatureCache()
+{
+    static CSignatureCache signatureCache;
+    return signatureCache;
+}
+
 }
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
+    CSignatureCache& signatureCache = GetSignatureCache();
 
     if (signatureCache.Get(sighash, vchSig, pubkey))
         return true;
@@ -86,3 +119,62 @@ bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsig
         signatureCache.Set(sighash, vchSig, pubkey);
     return true;
 }
+
+bool BatchingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+{
+    batch.Add(sighash, vchSig, pubkey, store, txid, nIn);
+    return true;
+}
+
+void CSignatureBatch::Add(const uint256& sighash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, bool store, const uint256& txid, unsigned int nIn)
+{
+    CDeferredSig sig;
+    sig.sighash = sighash;
+    sig.vchSig = vchSig;
+    sig.pubkey = pubkey;
+    sig.store = store;
+    sig.txid = txid;
+    sig.nIn = nIn;
+    vDeferred.push_back(sig);
+}
+
+bool CSignatureBatch::Verify()
+{
+    if (vDeferred.empty())
+        return true;
+
+    CSignatureCache& signatureCache = GetSignatureCache();
+    std::vector<sigdata_type> vData;
+    vData.reserve(vDeferred.size());
+    for (const CDeferredSig& sig : vDeferred)
+        vData.push_back(sigdata_type(sig.sighash, sig.vchSig, sig.pubkey));
+    std::vector<bool> vFound;
+    signatureCache.GetBatch(vData, vFound);
+
+    bool fOk = true;
+    std::vector<sigdata_type> vStore;
+    for (unsigned int i = 0; i < vDeferred.size() && fOk; i++) {
+        if (vFound[i])
+            continue;
+        const CDeferredSig& sig = vDeferred[i];
+        std::map<CPubKey, CParsedPubKey>::iterator it = mapParsed.find(sig.pubkey);
+        if (it == mapParsed.end()) {
+            CParsedPubKey parsed;
+            if (!sig.pubkey.Parse(parsed)) {
+                fOk = error("CSignatureBatch::Verify() : %s:%d invalid public key", sig.txid.ToString(), sig.nIn);
+                break;
+            }
+            if (mapParsed.size() >= MAX_PARSED_PUBKEYS)
+                mapParsed.clear();
+            it = mapParsed.insert(std::make_pair(sig.pubkey, parsed)).first;
+        }
+        if (!CPubKey::Verify(it->second, sig.sighash, sig.vchSig))
+            fOk = error("CSignatureBatch::Verify() : %s:%d signature verification failed", sig.txid.ToString(), sig.nIn);
+        else if (sig.store)
+            vStore.push_back(vData[i]);
+    }
+    if (fOk && !vStore.empty())
+        signatureCache.SetBatch(vStore);
+    vDeferred.clear();
+    return fOk;
+}
@@ -6,19 +6,65 @@
 #ifndef BITCOIN_SCRIPT_SIGCACHE_H
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
+#include "pubkey.h"
 #include "script/interpreter.h"
 
+#include <map>
 #include <vector>
 
-class CPubKey;
-
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
     bool store;
 
 public:
-    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, bool storeIn=true) : TransactionSignatureChecker(txToIn, nInIn), store(storeIn) {}
+    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, bool storeIn=true, const PrecomputedTransactionData* txdataIn=NULL) : TransactionSignatureChecker(txToIn, nInIn, txdataIn), store(storeIn) {}
+
+    bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
+};
+
+/**
+ * Signatures whose verification a script check deferred, verified together by the check
+ * queue worker that ran them: one signature cache lookup and update for all of them, and
+ * public keys parsed once per worker.
+ */
+class CSignatureBatch
+{
+private:
+    struct CDeferredSig {
+        uint256 sighash;
+        std::vector<unsigned char> vchSig;
+        CPubKey pubkey;
+        bool store;
+        uint256 txid;
+        unsigned int nIn;
+    };
+
+    std::vector<CDeferredSig> vDeferred;
+    std::map<CPubKey, CParsedPubKey> mapParsed;
+
+public:
+    void Add(const uint256& sighash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, bool store, const uint256& txid, unsigned int nIn);
+    /** Verify and clear the deferred signatures */
+    bool Verify();
+    void Clear() { vDeferred.clear(); }
+    size_t size() const { return vDeferred.size(); }
+};
+
+/**
+ * Accepts every signature and defers its verification to a batch. Only sound for scripts
+ * that fail whenever their one signature check would, see CScriptCheck.
+ */
+class BatchingTransactionSignatureChecker : public TransactionSignatureChecker
+{
+private:
+    CSignatureBatch& batch;
+    bool store;
+    uint256 txid;
+    unsigned int nIn;
+
+public:
+    BatchingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, CSignatureBatch& batchIn, bool storeIn, const PrecomputedTransactionData* txdataIn=NULL) : TransactionSignatureChecker(txToIn, nInIn, txdataIn), batch(batchIn), store(storeIn), txid(txToIn->GetHash()), nIn(nInIn) {}
 
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
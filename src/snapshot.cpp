@@ -0,0 +1,572 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "snapshot.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "coins.h"
+#include "guiinterface.h"
+#include "hash.h"
+#include "main.h"
+#include "pow.h"
+#include "streams.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+/**
+ * Snapshot file layout:
+ *   header       CSnapshotHeader
+ *   block index  [uint64 n][CDiskBlockIndex x n], heights 0 to the base, without positions
+ *   coins        [uint64 n][(uint256 txid, CCoins) x n], in database order
+ *   zerocoin     [uint64 n][(string key, string value) x n], raw entries of the zerocoin database
+ *   trailer      uint256, double-SHA256 of everything before it
+ */
+
+static const unsigned char SNAPSHOT_MAGIC[4] = {'u', 't', 'x', 'o'};
+
+/** Entries loaded per database batch */
+static const unsigned int SNAPSHOT_BATCH_BLOCKS = 10000;
+static const unsigned int SNAPSHOT_BATCH_COINS = 100000;
+static const unsigned int SNAPSHOT_BATCH_ZEROCOIN = 10000;
+
+class CSnapshotHeader
+{
+public:
+    unsigned char pchMagic[4];
+    MessageStartChars pchMessageStart;
+    int nVersion;
+    uint256 hashBase;
+    int nHeight;
+    CCoinsCommitment commitment;
+
+    CSnapshotHeader() : nVersion(0), hashBase(0), nHeight(0)
+    {
+        memset(pchMagic, 0, sizeof(pchMagic));
+        memset(pchMessageStart, 0, sizeof(pchMessageStart));
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersionIn)
+    {
+        READWRITE(FLATDATA(pchMagic));
+        READWRITE(FLATDATA(pchMessageStart));
+        READWRITE(nVersion);
+        READWRITE(hashBase);
+        READWRITE(nHeight);
+        READWRITE(commitment);
+    }
+};
+
+/** Writes to a file and hashes what was written, closes the file when destroyed */
+class CHashedFileWriter
+{
+private:
+    FILE* file;
+    CHashWriter hasher;
+
+    CHashedFileWriter(const CHashedFileWriter&);
+    CHashedFileWriter& operator=(const CHashedFileWriter&);
+
+public:
+    int nType;
+    int nVersion;
+
+    CHashedFileWriter(FILE* fileIn, int nTypeIn, int nVersionIn) : file(fileIn), hasher(nTypeIn, nVersionIn), nType(nTypeIn), nVersion(nVersionIn) {}
+    ~CHashedFileWriter() { fclose(); }
+
+    bool fclose()
+    {
+        bool fOk = true;
+        if (file) {
+            fOk = fflush(file) == 0;
+            if (fOk)
+                FileCommit(file);
+            fOk = (::fclose(file) == 0) && fOk;
+            file = NULL;
+        }
+        return fOk;
+    }
+
+    CHashedFileWriter& write(const char* pch, size_t nSize)
+    {
+        if (fwrite(pch, 1, nSize, file) != nSize)
+            throw std::ios_base::failure("CHashedFileWriter::write : write failed");
+        hasher.write(pch, nSize);
+        return *this;
+    }
+
+    template <typename T>
+    CHashedFileWriter& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj, nType, nVersion);
+        return *this;
+    }
+
+    //! Hash of what was written so far, call once
+    uint256 GetHash() { return hasher.GetHash(); }
+};
+
+static bool SameCommitment(const CCoinsCommitment& a, const CCoinsCommitment& b)
+{
+    return a.muhash.Finalize() == b.muhash.Finalize() &&
+           a.nTransactions == b.nTransactions &&
+           a.nTransactionOutputs == b.nTransactionOutputs &&
+           a.nTotalAmount == b.nTotalAmount;
+}
+
+static bool WriteSnapshot(CHashedFileWriter& fileout, CSnapshotInfo& info, std::string& strError)
+{
+    boost::scoped_ptr<CCoinsViewCursor> pcursor;
+    boost::scoped_ptr<CLevelDBSnapshot> zerocoinSnapshot;
+    CSnapshotHeader header;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        CBlockIndex* pindexBase = chainActive.Tip();
+        if (!pindexBase) {
+            strError = "No active chain";
+            return false;
+        }
+        pcursor.reset(pcoinsTip->Cursor());
+        if (!pcursor || pcursor->GetBestBlock() != pindexBase->GetBlockHash()) {
+            strError = "The UTXO set on disk is not at the active tip";
+            return false;
+        }
+        if (!pcursor->GetCommitment(header.commitment)) {
+            strError = "The UTXO set commitment is still being computed";
+            return false;
+        }
+        zerocoinSnapshot.reset(new CLevelDBSnapshot(*zerocoinDB));
+
+        memcpy(header.pchMagic, SNAPSHOT_MAGIC, sizeof(header.pchMagic));
+        memcpy(header.pchMessageStart, Params().MessageStart(), sizeof(header.pchMessageStart));
+        header.nVersion = SNAPSHOT_VERSION;
+        header.hashBase = pindexBase->GetBlockHash();
+        header.nHeight = pindexBase->nHeight;
+        fileout << header;
+
+        // the index is copied without positions, blocks up to the base have no data where it is loaded
+        info.nBlocks = pindexBase->nHeight + 1;
+        fileout << info.nBlocks;
+        for (int nHeight = 0; nHeight <= pindexBase->nHeight; nHeight++) {
+            CDiskBlockIndex index(chainActive[nHeight]);
+            index.nStatus &= BLOCK_VALID_MASK;
+            index.nFile = 0;
+            index.nDataPos = 0;
+            index.nUndoPos = 0;
+            fileout << index;
+        }
+    }
+    info.hashBase = header.hashBase;
+    info.nHeight = header.nHeight;
+    info.hashMuHash = header.commitment.muhash.Finalize();
+
+    info.nCoins = header.commitment.nTransactions;
+    fileout << info.nCoins;
+    uint64_t nCoins = 0;
+    for (; pcursor->Valid(); pcursor->Next()) {
+        uint256 txid;
+        CCoins coins;
+        if (!pcursor->GetKey(txid) || !pcursor->GetValue(coins)) {
+            strError = "Unable to read UTXO set";
+            return false;
+        }
+        fileout << txid << coins;
+        nCoins++;
+    }
+    if (nCoins != info.nCoins) {
+        strError = strprintf("UTXO set has %u transactions, its commitment %u", nCoins, info.nCoins);
+        return false;
+    }
+
+    // counted first, the entries are written in the order the loader reads them
+    info.nZerocoinEntries = 0;
+    boost::scoped_ptr<leveldb::Iterator> pcursorZerocoin(zerocoinDB->NewIterator(*zerocoinSnapshot));
+    for (pcursorZerocoin->SeekToFirst(); pcursorZerocoin->Valid(); pcursorZerocoin->Next())
+        info.nZerocoinEntries++;
+    fileout << info.nZerocoinEntries;
+    for (pcursorZerocoin->SeekToFirst(); pcursorZerocoin->Valid(); pcursorZerocoin->Next()) {
+        fileout << pcursorZerocoin->key().ToString();
+        fileout << pcursorZerocoin->value().ToString();
+    }
+    if (!pcursorZerocoin->status().ok()) {
+        strError = "Unable to read zerocoin database";
+        return false;
+    }
+
+    info.hashSnapshot = fileout.GetHash();
+    fileout << info.hashSnapshot;
+    return true;
+}
+
+bool DumpChainstateSnapshot(const boost::filesystem::path& path, CSnapshotInfo& info, std::string& strError)
+{
+    if (boost::filesystem::exists(path)) {
+        strError = strprintf("%s already exists", path.string());
+        return false;
+    }
+    boost::filesystem::path pathTmp = path.string() + ".incomplete";
+    FILE* file = fopen(pathTmp.string().c_str(), "wb");
+    if (!file) {
+        strError = strprintf("Unable to open %s for writing", pathTmp.string());
+        return false;
+    }
+
+    bool fOk;
+    {
+        CHashedFileWriter fileout(file, SER_DISK, CLIENT_VERSION);
+        try {
+            fOk = WriteSnapshot(fileout, info, strError);
+        } catch (const std::exception& e) {
+            strError = strprintf("Unable to write snapshot: %s", e.what());
+            fOk = false;
+        }
+        if (!fileout.fclose() && fOk) {
+            strError = strprintf("Unable to write %s", pathTmp.string());
+            fOk = false;
+        }
+    }
+    if (fOk && !RenameOver(pathTmp, path)) {
+        strError = strprintf("Unable to rename %s", pathTmp.string());
+        fOk = false;
+    }
+    if (!fOk) {
+        boost::filesystem::remove(pathTmp);
+        return false;
+    }
+
+    LogPrintf("%s : wrote snapshot %s of block %s (height %d, %u transactions) to %s\n", __func__,
+        info.hashSnapshot.GetHex(), info.hashBase.GetHex(), info.nHeight, info.nCoins, path.string());
+    return true;
+}
+
+/** Hash of a snapshot file without its trailer, and the trailer */
+static bool HashSnapshotFile(const boost::filesystem::path& path, uint256& hashContent, uint256& hashTrailer, std::string& strError)
+{
+    CAutoFile filein(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        strError = strprintf("Unable to open %s", path.string());
+        return false;
+    }
+    uint64_t nSize = boost::filesystem::file_size(path);
+    if (nSize < sizeof(uint256)) {
+        strError = "Snapshot file is truncated";
+        return false;
+    }
+
+    CHash256 hasher;
+    std::vector<unsigned char> vBuf(1 << 20);
+    for (uint64_t nLeft = nSize - sizeof(uint256); nLeft > 0;) {
+        boost::this_thread::interruption_point();
+        size_t nRead = std::min<uint64_t>(nLeft, vBuf.size());
+        if (fread(&vBuf[0], 1, nRead, filein.Get()) != nRead) {
+            strError = "Unable to read snapshot file";
+            return false;
+        }
+        hasher.Write(&vBuf[0], nRead);
+        nLeft -= nRead;
+    }
+    hasher.Finalize((unsigned char*)&hashContent);
+    filein >> hashTrailer;
+    return true;
+}
+
+static bool ReadSnapshot(CAutoFile& filein, const CSnapshotInfo& info, CCoinsViewDB& coinsdb, CBlockTreeDB& blocktree, CZerocoinDB& zerocoindb, std::string& strError)
+{
+    CSnapshotHeader header;
+    filein >> header;
+    if (memcmp(header.pchMagic, SNAPSHOT_MAGIC, sizeof(header.pchMagic)) || header.nVersion != SNAPSHOT_VERSION) {
+        strError = "Not a chainstate snapshot, or written by an incompatible version";
+        return false;
+    }
+    if (memcmp(header.pchMessageStart, Params().MessageStart(), sizeof(header.pchMessageStart))) {
+        strError = "Chainstate snapshot is for a different network";
+        return false;
+    }
+
+    // the hash pins the whole file, what is known about its content is checked anyway
+    const MapSnapshotHashes& mapSnapshotHashes = Params().SnapshotHashes();
+    MapSnapshotHashes::const_iterator it = mapSnapshotHashes.find(header.nHeight);
+    if (it == mapSnapshotHashes.end() && !Params().MineBlocksOnDemand()) {
+        strError = strprintf("No chainstate snapshot at height %d is known on this network", header.nHeight);
+        return false;
+    }
+    if (it != mapSnapshotHashes.end() && it->second != info.hashSnapshot) {
+        strError = strprintf("Chainstate snapshot %s does not match the known one at height %d", info.hashSnapshot.GetHex(), header.nHeight);
+        return false;
+    }
+
+    // the base goes first and on its own, a base without a best block is a load that did not finish
+    if (!blocktree.WriteSnapshotBase(header.hashBase) || !blocktree.Sync()) {
+        strError = "Unable to write block index";
+        return false;
+    }
+
+    // block index
+    uint64_t nBlocks;
+    filein >> nBlocks;
+    if (header.nHeight < 0 || nBlocks != (uint64_t)header.nHeight + 1) {
+        strError = "Block index of the snapshot does not end at its base";
+        return false;
+    }
+    const Checkpoints::MapCheckpoints& mapCheckpoints = *Params().Checkpoints().mapCheckpoints;
+    uint256 hashPrev = 0;
+    for (uint64_t i = 0; i < nBlocks;) {
+        boost::this_thread::interruption_point();
+        std::vector<CDiskBlockIndex> vIndex;
+        for (uint64_t nEnd = std::min<uint64_t>(nBlocks, i + SNAPSHOT_BATCH_BLOCKS); i < nEnd; i++) {
+            vIndex.push_back(CDiskBlockIndex());
+            CDiskBlockIndex& index = vIndex.back();
+            filein >> index;
+            uint256 hash = index.GetBlockHash();
+            if ((uint64_t)index.nHeight != i || index.hashPrev != hashPrev) {
+                strError = strprintf("Block index of the snapshot is not a chain at height %u", i);
+                return false;
+            }
+            if (i == 0 && hash != Params().HashGenesisBlock()) {
+                strError = "Block index of the snapshot does not start at the genesis block";
+                return false;
+            }
+            if ((index.nStatus & ~BLOCK_VALID_MASK) || !index.IsValid(BLOCK_VALID_TRANSACTIONS) || index.nTx == 0) {
+                strError = strprintf("Block %s of the snapshot was not connected", hash.GetHex());
+                return false;
+            }
+            Checkpoints::MapCheckpoints::const_iterator itCheckpoint = mapCheckpoints.find(index.nHeight);
+            if (itCheckpoint != mapCheckpoints.end() && itCheckpoint->second != hash) {
+                strError = strprintf("Block index of the snapshot conflicts with the checkpoint at height %d", index.nHeight);
+                return false;
+            }
+            hashPrev = hash;
+        }
+        if (!blocktree.WriteBlockIndex(vIndex)) {
+            strError = "Unable to write block index";
+            return false;
+        }
+    }
+    if (hashPrev != header.hashBase) {
+        strError = "Block index of the snapshot does not end at its base";
+        return false;
+    }
+
+    // coins, written without a best block until they are complete
+    uint64_t nCoins;
+    filein >> nCoins;
+    if (nCoins != (uint64_t)header.commitment.nTransactions) {
+        strError = "Snapshot holds a different number of transactions than its commitment";
+        return false;
+    }
+    for (uint64_t i = 0; i < nCoins;) {
+        boost::this_thread::interruption_point();
+        CCoinsMap mapCoins;
+        CCoinsCommitment delta;
+        for (uint64_t nEnd = std::min<uint64_t>(nCoins, i + SNAPSHOT_BATCH_COINS); i < nEnd; i++) {
+            uint256 txid;
+            CCoins coins;
+            filein >> txid >> coins;
+            CCoinsCacheEntry& entry = mapCoins[txid];
+            if (coins.IsPruned() || entry.flags) {
+                strError = strprintf("Snapshot holds a spent or repeated transaction %s", txid.GetHex());
+                return false;
+            }
+            delta.AddCoins(txid, coins);
+            entry.coins.swap(coins);
+            entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+        }
+        if (!coinsdb.BatchWrite(mapCoins, uint256(0), delta)) {
+            strError = "Unable to write UTXO set";
+            return false;
+        }
+    }
+    CCoinsCommitment commitment;
+    if (!coinsdb.GetCommitment(commitment) || !SameCommitment(commitment, header.commitment)) {
+        strError = "UTXO set of the snapshot does not match its commitment";
+        return false;
+    }
+
+    uint64_t nZerocoinEntries;
+    filein >> nZerocoinEntries;
+    for (uint64_t i = 0; i < nZerocoinEntries;) {
+        boost::this_thread::interruption_point();
+        CLevelDBBatch batch;
+        for (uint64_t nEnd = std::min<uint64_t>(nZerocoinEntries, i + SNAPSHOT_BATCH_ZEROCOIN); i < nEnd; i++) {
+            std::string strKey, strValue;
+            filein >> strKey >> strValue;
+            batch.WriteSerialized(strKey, strValue);
+        }
+        if (!zerocoindb.WriteBatch(batch)) {
+            strError = "Unable to write zerocoin database";
+            return false;
+        }
+    }
+
+    uint256 hashTrailer;
+    filein >> hashTrailer;
+    if (hashTrailer != info.hashSnapshot || fgetc(filein.Get()) != EOF) {
+        strError = "Snapshot file has trailing data";
+        return false;
+    }
+
+    // the optional indexes start at the base, as they would for a new chain
+    if (!blocktree.WriteFlag("prunedblockfiles", true) ||
+        !blocktree.WriteFlag("txindex", GetBoolArg("-txindex", true)) ||
+        !blocktree.WriteFlag("addressindex", GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) ||
+        !blocktree.WriteFlag("spentindex", GetBoolArg("-spentindex", DEFAULT_SPENTINDEX))) {
+        strError = "Unable to write block index flags";
+        return false;
+    }
+    // everything the best block refers to is durable before it
+    if (!blocktree.Sync() || !zerocoindb.Sync() || !coinsdb.Sync()) {
+        strError = "Unable to sync the databases";
+        return false;
+    }
+
+    // setting the best block completes the load, an interrupted one is discarded and started over
+    CCoinsMap mapEmpty;
+    if (!coinsdb.BatchWrite(mapEmpty, header.hashBase, CCoinsCommitment())) {
+        strError = "Unable to write UTXO set";
+        return false;
+    }
+    return true;
+}
+
+bool LoadChainstateSnapshot(const boost::filesystem::path& path, CCoinsViewDB& coinsdb, CBlockTreeDB& blocktree, CZerocoinDB& zerocoindb, CSnapshotInfo& info, std::string& strError)
+{
+    if (coinsdb.GetBestBlock() != uint256(0)) {
+        strError = "A chainstate snapshot can only be loaded into a new data directory";
+        return false;
+    }
+    // the databases were empty when the interrupted load started
+    uint256 hashBase;
+    if (blocktree.ReadSnapshotBase(hashBase)) {
+        LogPrintf("%s : discarding the interrupted load of the snapshot of block %s\n", __func__, hashBase.GetHex());
+        if (!coinsdb.Wipe() || !blocktree.EraseAll() || !zerocoindb.EraseAll()) {
+            strError = "Unable to discard an interrupted snapshot load";
+            return false;
+        }
+    }
+
+    uint256 hashTrailer;
+    LogPrintf("%s : hashing %s\n", __func__, path.string());
+    if (!HashSnapshotFile(path, info.hashSnapshot, hashTrailer, strError))
+        return false;
+    if (info.hashSnapshot != hashTrailer) {
+        strError = "Snapshot file is corrupted";
+        return false;
+    }
+
+    CAutoFile filein(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        strError = strprintf("Unable to open %s", path.string());
+        return false;
+    }
+    try {
+        if (!ReadSnapshot(filein, info, coinsdb, blocktree, zerocoindb, strError))
+            return false;
+    } catch (const std::exception& e) {
+        strError = strprintf("Unable to read snapshot: %s", e.what());
+        return false;
+    }
+
+    CCoinsCommitment commitment;
+    coinsdb.GetCommitment(commitment);
+    info.hashBase = coinsdb.GetBestBlock();
+    info.nCoins = commitment.nTransactions;
+    info.hashMuHash = commitment.muhash.Finalize();
+    LogPrintf("%s : loaded snapshot %s of block %s, %u transactions\n", __func__,
+        info.hashSnapshot.GetHex(), info.hashBase.GetHex(), info.nCoins);
+    return true;
+}
+
+/** The chain below the base links up by hash and work, and passes the checkpoints */
+static bool CheckSnapshotHeaders(const CBlockIndex* pindexBase, std::string& strError)
+{
+    const Checkpoints::MapCheckpoints& mapCheckpoints = *Params().Checkpoints().mapCheckpoints;
+    for (const CBlockIndex* pindex = pindexBase; pindex; pindex = pindex->pprev) {
+        if (pindex->nHeight % 10000 == 0)
+            boost::this_thread::interruption_point();
+
+        uint256 hash = pindex->GetBlockHash();
+        CBlockHeader header = pindex->GetBlockHeader();
+        if (header.GetHash() != hash) {
+            strError = strprintf("header of block %s does not hash to it", hash.GetHex());
+            return false;
+        }
+        if (pindex->pprev) {
+            if (pindex->pprev->nHeight + 1 != pindex->nHeight || header.hashPrevBlock != pindex->pprev->GetBlockHash()) {
+                strError = strprintf("block %s does not link to its parent", hash.GetHex());
+                return false;
+            }
+            if (pindex->nChainWork != pindex->pprev->nChainWork + GetBlockProof(*pindex)) {
+                strError = strprintf("chain work of block %s is wrong", hash.GetHex());
+                return false;
+            }
+        } else if (pindex->nHeight != 0 || hash != Params().HashGenesisBlock()) {
+            strError = "chain does not start at the genesis block";
+            return false;
+        }
+        Checkpoints::MapCheckpoints::const_iterator it = mapCheckpoints.find(pindex->nHeight);
+        if (it != mapCheckpoints.end() && it->second != hash) {
+            strError = strprintf("block %s conflicts with the checkpoint at height %d", hash.GetHex(), pindex->nHeight);
+            return false;
+        }
+    }
+    return true;
+}
+
+void ThreadSnapshotValidation()
+{
+    RenameThread("simplicity-snapshotcheck");
+
+    uint256 hashBase;
+    bool fValidated = false;
+    if (!pblocktree->ReadSnapshotBase(hashBase) || (pblocktree->ReadFlag("snapshotvalidated", fValidated) && fValidated))
+        return;
+
+    const CBlockIndex* pindexBase;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator mi = mapBlockIndex.find(hashBase);
+        if (mi == mapBlockIndex.end()) {
+            AbortNode("Chainstate snapshot base is not in the block index", _("Error: The loaded chainstate snapshot is invalid, restart with -reindex"));
+            return;
+        }
+        pindexBase = mi->second;
+    }
+
+    // the entries below the base never change once loaded, so they are read without cs_main
+    LogPrintf("%s : checking the headers below the snapshot base at height %d\n", __func__, pindexBase->nHeight);
+    std::string strError;
+    if (!CheckSnapshotHeaders(pindexBase, strError)) {
+        AbortNode("Chainstate snapshot failed validation: " + strError, _("Error: The loaded chainstate snapshot is invalid, restart with -reindex"));
+        return;
+    }
+
+    // the commitment was checked against the snapshot when loading, now the stored set is checked against it
+    CCoinsStats stats;
+    if (!pcoinsTip->GetStats(stats)) {
+        LogPrintf("%s : unable to read the UTXO set, will retry at the next start\n", __func__);
+        return;
+    }
+    if (!stats.fCommitment ||
+        stats.commitment.muhash.Finalize() != stats.hashMuHash ||
+        stats.commitment.nTransactions != (int64_t)stats.nTransactions ||
+        stats.commitment.nTransactionOutputs != (int64_t)stats.nTransactionOutputs ||
+        stats.commitment.nTotalAmount != stats.nTotalAmount) {
+        AbortNode("Chainstate snapshot failed validation: UTXO set does not match its commitment", _("Error: The loaded chainstate snapshot is invalid, restart with -reindex"));
+        return;
+    }
+
+    pblocktree->WriteFlag("snapshotvalidated", true);
+    LogPrintf("%s : snapshot of block %s validated, UTXO set checked at block %s\n", __func__, hashBase.GetHex(), stats.hashBlock.GetHex());
+}
@@ -0,0 +1,53 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SIMPLICITY_SNAPSHOT_H
+#define SIMPLICITY_SNAPSHOT_H
+
+#include "uint256.h"
+
+#include <stdint.h>
+#include <string>
+
+#include <boost/filesystem/path.hpp>
+
+class CBlockTreeDB;
+class CCoinsViewDB;
+class CZerocoinDB;
+
+/** Version of the chainstate snapshot format written by dumptxoutset */
+static const int SNAPSHOT_VERSION = 1;
+
+/** What a chainstate snapshot holds */
+struct CSnapshotInfo {
+    uint256 hashBase;
+    int nHeight;
+    uint64_t nBlocks;
+    uint64_t nCoins;
+    uint64_t nZerocoinEntries;
+    //! double-SHA256 of the file, the value listed in the chain parameters
+    uint256 hashSnapshot;
+    uint256 hashMuHash;
+
+    CSnapshotInfo() : hashBase(0), nHeight(0), nBlocks(0), nCoins(0), nZerocoinEntries(0), hashSnapshot(0), hashMuHash(0) {}
+};
+
+/**
+ * Write the chainstate at the active tip to a new file: the block index of the active
+ * chain, the UTXO set with its commitment and the zerocoin database. Only the block index
+ * is written with cs_main held, the rest is read from database snapshots.
+ */
+bool DumpChainstateSnapshot(const boost::filesystem::path& path, CSnapshotInfo& info, std::string& strError);
+
+/**
+ * Bootstrap empty databases from a snapshot file, before the block index is loaded. The
+ * file must hash to the value the chain parameters list for its height, and the coins
+ * must add up to the commitment it was written with. Blocks up to the base have no data.
+ */
+bool LoadChainstateSnapshot(const boost::filesystem::path& path, CCoinsViewDB& coinsdb, CBlockTreeDB& blocktree, CZerocoinDB& zerocoindb, CSnapshotInfo& info, std::string& strError);
+
+/** Check the headers below the snapshot base and audit the UTXO set, once after a load */
+void ThreadSnapshotValidation();
+
+#endif // SIMPLICITY_SNAPSHOT_H
@@ -173,32 +173,47 @@ bool CZSplStake::MarkSpent(CWallet *pwallet, const uint256& txid)
 bool CSplStake::SetInput(CTransaction txPrev, unsigned int n)
 {
     this->txFrom = txPrev;
+    this->hashFrom = txPrev.GetHash();
+    this->outFrom = txPrev.vout[n];
     this->nPosition = n;
     return true;
 }
 
+bool CSplStake::SetInput(const uint256& hashPrev, const CCoins& coins, unsigned int n)
+{
+    if (!coins.IsAvailable(n))
+        return false;
+    this->hashFrom = hashPrev;
+    this->outFrom = coins.vout[n];
+    this->nPosition = n;
+    this->nHeightFrom = coins.nHeight;
+    return true;
+}
+
 bool CSplStake::GetTxFrom(CTransaction& tx)
 {
+    if (txFrom.IsNull())
+        return false;
     tx = txFrom;
     return true;
 }
 
 bool CSplStake::CreateTxIn(CWallet* pwallet, CTxIn& txIn, uint256 hashTxOut)
 {
-    txIn = CTxIn(txFrom.GetHash(), nPosition);
+    txIn = CTxIn(hashFrom, nPosition);
     return true;
 }
 
 CAmount CSplStake::GetValue()
 {
-    return txFrom.vout[nPosition].nValue;
+    return outFrom.nValue;
 }
 
 bool CSplStake::CreateTxOuts(CWallet* pwallet, std::vector<CTxOut>& vout, CAmount nTotal)
 {
     std::vector<valtype> vSolutions;
     txnouttype whichType;
-    CScript scriptPubKeyKernel = txFrom.vout[nPosition].scriptPubKey;
+    CScript scriptPubKeyKernel = outFrom.scriptPubKey;
     if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
         LogPrintf("CreateCoinStake : failed to parse kernel\n");
         return false;
@@ -275,7 +290,7 @@ CDataStream CSplStake::GetUniqueness()
 {
     //The unique identifier for a SPL stake is the outpoint
     CDataStream ss(SER_NETWORK, 0);
-    ss << nPosition << txFrom.GetHash();
+    ss << nPosition << hashFrom;
     return ss;
 }
 
@@ -284,9 +299,14 @@ CBlockIndex* CSplStake::GetIndexFrom()
 {
     if (pindexFrom)
         return pindexFrom;
+    if (nHeightFrom >= 0) {
+        // only the coins were known, take the block of their height on the active chain
+        pindexFrom = chainActive[nHeightFrom];
+        return pindexFrom;
+    }
     uint256 hashBlock = 0;
     CTransaction tx;
-    if (GetTransaction(txFrom.GetHash(), tx, hashBlock, true)) {
+    if (GetTransaction(hashFrom, tx, hashBlock, true)) {
         // If the index is in the chain, then set it as the "index from"
         if (mapBlockIndex.count(hashBlock)) {
             CBlockIndex* pindex = mapBlockIndex.at(hashBlock);
@@ -294,7 +314,7 @@ CBlockIndex* CSplStake::GetIndexFrom()
                 pindexFrom = pindex;
         }
     } else {
-        LogPrintf("%s : failed to find tx %s\n", __func__, txFrom.GetHash().GetHex());
+        LogPrintf("%s : failed to find tx %s\n", __func__, hashFrom.GetHex());
     }
 
     return pindexFrom;
@@ -9,6 +9,7 @@
 #include "streams.h"
 #include "uint256.h"
 
+class CCoins;
 class CKeyStore;
 class CWallet;
 class CWalletTx;
@@ -76,7 +77,11 @@ class CSplStake : public CStakeInput
 {
 private:
     CTransaction txFrom;
+    uint256 hashFrom;
+    CTxOut outFrom;
     unsigned int nPosition;
+    //! height of the coins when only they are known, the block may be pruned
+    int nHeightFrom = -1;
 
     // cached data
     uint64_t nStakeModifier = 0;
@@ -86,6 +91,8 @@ public:
     CSplStake(){}
 
     bool SetInput(CTransaction txPrev, unsigned int n);
+    bool SetInput(const uint256& hashPrev, const CCoins& coins, unsigned int n);
+    const CScript& GetScriptFrom() const { return outFrom.scriptPubKey; }
 
     CBlockIndex* GetIndexFrom() override;
     bool GetTxFrom(CTransaction& tx) override;
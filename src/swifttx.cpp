@@ -18,15 +18,242 @@
 #include "validationinterface.h"
 #include <boost/foreach.hpp>
 
+#include <queue>
+
 
-std::map<uint256, CTransaction> mapTxLockReq;
-std::map<uint256, CTransaction> mapTxLockReqRejected;
-std::map<uint256, CConsensusVote> mapTxLockVote;
-std::map<uint256, CTransactionLock> mapTxLocks;
-std::map<COutPoint, uint256> mapLockedInputs;
-std::map<uint256, int64_t> mapUnknownVotes; //track votes with no tx for DOS
 int nCompleteTXLocks;
 
+namespace
+{
+/** Number of shards the SwiftX state is split into */
+const int SWIFTTX_SHARDS = 16;
+/** Seconds a cached quorum is reused before the Masternode ranks are computed again */
+const int64_t SWIFTTX_QUORUM_CACHE_SECONDS = 60;
+/** Number of block heights a quorum is cached for */
+const unsigned int SWIFTTX_QUORUM_CACHE_SIZE = 100;
+
+/**
+ * Per transaction state of the transactions whose hash falls in one shard.
+ * Lock order: a transaction shard, then an input shard. Vote shards, cs_lockexpiry,
+ * cs_quorum and cs_unknownvotes are leaves, never held while taking another lock.
+ */
+struct CTxLockShard {
+    CCriticalSection cs;
+    std::map<uint256, CTransaction> mapTxLockReq;
+    std::map<uint256, CTransaction> mapTxLockReqRejected;
+    std::map<uint256, CTransactionLock> mapTxLocks;
+};
+
+struct CTxLockVoteShard {
+    CCriticalSection cs;
+    std::map<uint256, CConsensusVote> mapTxLockVote;
+};
+
+struct CLockedInputShard {
+    CCriticalSection cs;
+    std::map<COutPoint, uint256> mapLockedInputs;
+};
+
+CTxLockShard txLockShards[SWIFTTX_SHARDS];
+CTxLockVoteShard txLockVoteShards[SWIFTTX_SHARDS];
+CLockedInputShard lockedInputShards[SWIFTTX_SHARDS];
+
+// transaction locks by expiration time, earliest first; entries may be stale and are checked against the lock
+CCriticalSection cs_lockexpiry;
+std::priority_queue<std::pair<int64_t, uint256>, std::vector<std::pair<int64_t, uint256> >, std::greater<std::pair<int64_t, uint256> > > queueLockExpiry;
+
+// top SWIFTTX_SIGNATURES_TOTAL Masternodes by block height, with the time they were computed
+CCriticalSection cs_quorum;
+std::map<int64_t, std::pair<int64_t, std::vector<CTxIn> > > mapQuorums;
+
+CCriticalSection cs_unknownvotes;
+std::map<uint256, int64_t> mapUnknownVotes; //track votes with no tx for DOS
+
+CTxLockShard& TxShard(const uint256& txHash)
+{
+    return txLockShards[txHash.GetLow64() % SWIFTTX_SHARDS];
+}
+
+CTxLockVoteShard& VoteShard(const uint256& voteHash)
+{
+    return txLockVoteShards[voteHash.GetLow64() % SWIFTTX_SHARDS];
+}
+
+CLockedInputShard& InputShard(const COutPoint& outpoint)
+{
+    return lockedInputShards[(outpoint.hash.GetLow64() + outpoint.n) % SWIFTTX_SHARDS];
+}
+
+void ScheduleLockExpiry(int64_t nExpiration, const uint256& txHash)
+{
+    LOCK(cs_lockexpiry);
+    queueLockExpiry.push(std::make_pair(nExpiration, txHash));
+}
+
+// create the lock of a transaction if there is none, the shard lock must be held
+CTransactionLock& InsertTransactionLock(CTxLockShard& shard, const uint256& txHash, int nBlockHeight)
+{
+    std::map<uint256, CTransactionLock>::iterator it = shard.mapTxLocks.find(txHash);
+    if (it != shard.mapTxLocks.end())
+        return it->second;
+
+    CTransactionLock newLock;
+    newLock.nBlockHeight = nBlockHeight;
+    newLock.nExpiration = GetTime() + (60 * 60); //locks expire after 60 minutes (24 confirmations)
+    newLock.nTimeout = GetTime() + (60 * 5);
+    newLock.txHash = txHash;
+    ScheduleLockExpiry(newLock.nExpiration, txHash);
+    return shard.mapTxLocks.insert(std::make_pair(txHash, newLock)).first->second;
+}
+
+void ExpireTransactionLock(const uint256& txHash)
+{
+    CTxLockShard& shard = TxShard(txHash);
+    LOCK(shard.cs);
+    std::map<uint256, CTransactionLock>::iterator it = shard.mapTxLocks.find(txHash);
+    if (it != shard.mapTxLocks.end()) {
+        it->second.nExpiration = GetTime();
+        ScheduleLockExpiry(it->second.nExpiration, txHash);
+    }
+}
+
+bool AddTxLockVote(const CConsensusVote& vote)
+{
+    uint256 voteHash = vote.GetHash();
+    CTxLockVoteShard& shard = VoteShard(voteHash);
+    LOCK(shard.cs);
+    return shard.mapTxLockVote.insert(std::make_pair(voteHash, vote)).second;
+}
+
+void LockInput(const COutPoint& outpoint, const uint256& txHash)
+{
+    CLockedInputShard& shard = InputShard(outpoint);
+    LOCK(shard.cs);
+    if (!shard.mapLockedInputs.count(outpoint))
+        shard.mapLockedInputs.insert(std::make_pair(outpoint, txHash));
+}
+
+void UnlockInput(const COutPoint& outpoint, const uint256& txHash)
+{
+    CLockedInputShard& shard = InputShard(outpoint);
+    LOCK(shard.cs);
+    std::map<COutPoint, uint256>::iterator it = shard.mapLockedInputs.find(outpoint);
+    if (it != shard.mapLockedInputs.end() && it->second == txHash)
+        shard.mapLockedInputs.erase(it);
+}
+
+/**
+ * Rank of a Masternode in the SwiftX quorum of a block height: 1 to SWIFTTX_SIGNATURES_TOTAL in the quorum,
+ * SWIFTTX_SIGNATURES_TOTAL + 1 outside of it and -1 if the Masternode or the block is unknown.
+ */
+int GetQuorumRank(const CTxIn& vin, int64_t nBlockHeight)
+{
+    std::vector<CTxIn> vecQuorum;
+    {
+        LOCK(cs_quorum);
+        std::map<int64_t, std::pair<int64_t, std::vector<CTxIn> > >::iterator it = mapQuorums.find(nBlockHeight);
+        if (it != mapQuorums.end() && it->second.first + SWIFTTX_QUORUM_CACHE_SECONDS > GetTime())
+            vecQuorum = it->second.second;
+    }
+
+    if (vecQuorum.empty()) {
+        vecQuorum = mnodeman.GetTopMasternodes(SWIFTTX_SIGNATURES_TOTAL, nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+        if (vecQuorum.empty()) return -1;
+
+        LOCK(cs_quorum);
+        mapQuorums[nBlockHeight] = std::make_pair(GetTime(), vecQuorum);
+        // votes refer to recent heights, forget the oldest ones
+        while (mapQuorums.size() > SWIFTTX_QUORUM_CACHE_SIZE)
+            mapQuorums.erase(mapQuorums.begin());
+    }
+
+    for (unsigned int i = 0; i < vecQuorum.size(); i++) {
+        if (vecQuorum[i].prevout == vin.prevout)
+            return i + 1;
+    }
+
+    if (mnodeman.Find(vin) == NULL) return -1;
+
+    return SWIFTTX_SIGNATURES_TOTAL + 1;
+}
+
+// signatures of the lock of a transaction, -1 without a lock
+int CountTransactionLockSignatures(const uint256& txHash)
+{
+    CTxLockShard& shard = TxShard(txHash);
+    LOCK(shard.cs);
+    std::map<uint256, CTransactionLock>::iterator it = shard.mapTxLocks.find(txHash);
+    if (it != shard.mapTxLocks.end()) return it->second.CountSignatures();
+
+    return -1;
+}
+} // anonymous namespace
+
+bool HaveTxLockRequest(const uint256& txHash)
+{
+    CTxLockShard& shard = TxShard(txHash);
+    LOCK(shard.cs);
+    return shard.mapTxLockReq.count(txHash) || shard.mapTxLockReqRejected.count(txHash);
+}
+
+bool GetTxLockRequest(const uint256& txHash, CTransaction& tx)
+{
+    CTxLockShard& shard = TxShard(txHash);
+    LOCK(shard.cs);
+    std::map<uint256, CTransaction>::iterator it = shard.mapTxLockReq.find(txHash);
+    if (it == shard.mapTxLockReq.end()) return false;
+
+    tx = it->second;
+    return true;
+}
+
+void AddTxLockRequest(const CTransaction& tx)
+{
+    CTxLockShard& shard = TxShard(tx.GetHash());
+    LOCK(shard.cs);
+    shard.mapTxLockReq.insert(std::make_pair(tx.GetHash(), tx));
+}
+
+bool HaveTxLockVote(const uint256& voteHash)
+{
+    CTxLockVoteShard& shard = VoteShard(voteHash);
+    LOCK(shard.cs);
+    return shard.mapTxLockVote.count(voteHash);
+}
+
+bool GetTxLockVote(const uint256& voteHash, CConsensusVote& vote)
+{
+    CTxLockVoteShard& shard = VoteShard(voteHash);
+    LOCK(shard.cs);
+    std::map<uint256, CConsensusVote>::iterator it = shard.mapTxLockVote.find(voteHash);
+    if (it == shard.mapTxLockVote.end()) return false;
+
+    vote = it->second;
+    return true;
+}
+
+bool GetTransactionLock(const uint256& txHash, CTransactionLock& lock)
+{
+    CTxLockShard& shard = TxShard(txHash);
+    LOCK(shard.cs);
+    std::map<uint256, CTransactionLock>::iterator it = shard.mapTxLocks.find(txHash);
+    if (it == shard.mapTxLocks.end()) return false;
+
+    lock = it->second;
+    return true;
+}
+
+bool GetLockedInputTx(const COutPoint& outpoint, uint256& txHash)
+{
+    CLockedInputShard& shard = InputShard(outpoint);
+    LOCK(shard.cs);
+    std::map<COutPoint, uint256>::iterator it = shard.mapLockedInputs.find(outpoint);
+    if (it == shard.mapLockedInputs.end()) return false;
+
+    txHash = it->second;
+    return true;
+}
+
 //txlock - Locks transaction
 //
 //step 1.) Broadcast intention to lock transaction inputs, "txlreg", CTransaction
@@ -50,7 +277,7 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
         pfrom->AddInventoryKnown(inv);
         GetMainSignals().Inventory(inv.hash);
 
-        if (mapTxLockReq.count(tx.GetHash()) || mapTxLockReqRejected.count(tx.GetHash())) {
+        if (HaveTxLockRequest(tx.GetHash())) {
             return;
         }
 
@@ -82,7 +309,7 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
 
             DoConsensusVote(tx, nBlockHeight);
 
-            mapTxLockReq.insert(std::make_pair(tx.GetHash(), tx));
+            AddTxLockRequest(tx);
 
             LogPrintf("ProcessMessageSwiftTX::ix - Transaction Lock Request: %s %s : accepted %s\n",
                 pfrom->addr.ToString().c_str(), pfrom->cleanSubVer.c_str(),
@@ -95,7 +322,11 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
             return;
 
         } else {
-            mapTxLockReqRejected.insert(std::make_pair(tx.GetHash(), tx));
+            {
+                CTxLockShard& shard = TxShard(tx.GetHash());
+                LOCK(shard.cs);
+                shard.mapTxLockReqRejected.insert(std::make_pair(tx.GetHash(), tx));
+            }
 
             // can we get the conflicting transaction as proof?
 
@@ -103,24 +334,18 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
                 pfrom->addr.ToString().c_str(), pfrom->cleanSubVer.c_str(),
                 tx.GetHash().ToString().c_str());
 
-            for (const CTxIn& in : tx.vin) {
-                if (!mapLockedInputs.count(in.prevout)) {
-                    mapLockedInputs.insert(std::make_pair(in.prevout, tx.GetHash()));
-                }
-            }
+            for (const CTxIn& in : tx.vin)
+                LockInput(in.prevout, tx.GetHash());
 
             // resolve conflicts
-            std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(tx.GetHash());
-            if (i != mapTxLocks.end()) {
-                //we only care if we have a complete tx lock
-                if ((*i).second.CountSignatures() >= SWIFTTX_SIGNATURES_REQUIRED) {
-                    if (!CheckForConflictingLocks(tx)) {
-                        LogPrintf("ProcessMessageSwiftTX::ix - Found Existing Complete IX Lock\n");
-
-                        //reprocess the last 15 blocks
-                        ReprocessBlocks(15);
-                        mapTxLockReq.insert(std::make_pair(tx.GetHash(), tx));
-                    }
+            //we only care if we have a complete tx lock
+            if (CountTransactionLockSignatures(tx.GetHash()) >= SWIFTTX_SIGNATURES_REQUIRED) {
+                if (!CheckForConflictingLocks(tx)) {
+                    LogPrintf("ProcessMessageSwiftTX::ix - Found Existing Complete IX Lock\n");
+
+                    //reprocess the last 15 blocks
+                    ReprocessBlocks(15);
+                    AddTxLockRequest(tx);
                 }
             }
 
@@ -134,12 +359,10 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
         CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        if (mapTxLockVote.count(ctx.GetHash())) {
+        if (!AddTxLockVote(ctx)) {
             return;
         }
 
-        mapTxLockVote.insert(std::make_pair(ctx.GetHash(), ctx));
-
         if (ProcessConsensusVote(pfrom, ctx)) {
             //Spam/Dos protection
             /*
@@ -147,7 +370,8 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
                 This tracks those messages and allows it at the same rate of the rest of the network, if
                 a peer violates it, it will simply be ignored
             */
-            if (!mapTxLockReq.count(ctx.txHash) && !mapTxLockReqRejected.count(ctx.txHash)) {
+            if (!HaveTxLockRequest(ctx.txHash)) {
+                LOCK(cs_unknownvotes);
                 if (!mapUnknownVotes.count(ctx.vinMasternode.prevout.hash)) {
                     mapUnknownVotes[ctx.vinMasternode.prevout.hash] = GetTime() + (60 * 10);
                 }
@@ -165,8 +389,9 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
             RelayInv(inv);
         }
 
-        if (mapTxLockReq.count(ctx.txHash) && GetTransactionLockSignatures(ctx.txHash) == SWIFTTX_SIGNATURES_REQUIRED) {
-            GetMainSignals().NotifyTransactionLock(mapTxLockReq[ctx.txHash]);
+        CTransaction tx;
+        if (GetTxLockRequest(ctx.txHash, tx) && GetTransactionLockSignatures(ctx.txHash) == SWIFTTX_SIGNATURES_REQUIRED) {
+            GetMainSignals().NotifyTransactionLock(tx);
         }
 
         return;
@@ -239,17 +464,13 @@ int64_t CreateNewLock(CTransaction tx)
     */
     int nBlockHeight = (chainActive.Tip()->nHeight - nTxAge) + 4;
 
-    if (!mapTxLocks.count(tx.GetHash())) {
+    CTxLockShard& shard = TxShard(tx.GetHash());
+    LOCK(shard.cs);
+    if (!shard.mapTxLocks.count(tx.GetHash())) {
         LogPrintf("CreateNewLock - New Transaction Lock %s !\n", tx.GetHash().ToString().c_str());
-
-        CTransactionLock newLock;
-        newLock.nBlockHeight = nBlockHeight;
-        newLock.nExpiration = GetTime() + (60 * 60); //locks expire after 60 minutes (24 confirmations)
-        newLock.nTimeout = GetTime() + (60 * 5);
-        newLock.txHash = tx.GetHash();
-        mapTxLocks.insert(std::make_pair(tx.GetHash(), newLock));
+        InsertTransactionLock(shard, tx.GetHash(), nBlockHeight);
     } else {
-        mapTxLocks[tx.GetHash()].nBlockHeight = nBlockHeight;
+        shard.mapTxLocks[tx.GetHash()].nBlockHeight = nBlockHeight;
         LogPrint("swiftx", "CreateNewLock - Transaction Lock Exists %s !\n", tx.GetHash().ToString().c_str());
     }
 
@@ -262,7 +483,7 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
 {
     if (!fMasterNode) return;
 
-    int n = mnodeman.GetMasternodeRank(activeMasternode.vin, nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+    int n = GetQuorumRank(activeMasternode.vin, nBlockHeight);
 
     if (n == -1) {
         LogPrint("swiftx", "SwiftX::DoConsensusVote - Unknown Masternode\n");
@@ -292,7 +513,7 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
         return;
     }
 
-    mapTxLockVote[ctx.GetHash()] = ctx;
+    AddTxLockVote(ctx);
 
     CInv inv(MSG_TXLOCK_VOTE, ctx.GetHash());
     RelayInv(inv);
@@ -301,7 +522,7 @@ void DoConsensusVote(CTransaction& tx, int64_t nBlockHeight)
 //received a consensus vote
 bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
 {
-    int n = mnodeman.GetMasternodeRank(ctx.vinMasternode, ctx.nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+    int n = GetQuorumRank(ctx.vinMasternode, ctx.nBlockHeight);
 
     CMasternode* pmn = mnodeman.Find(ctx.vinMasternode);
     if (pmn != NULL)
@@ -326,68 +547,68 @@ bool ProcessConsensusVote(CNode* pnode, CConsensusVote& ctx)
         return false;
     }
 
-    if (!mapTxLocks.count(ctx.txHash)) {
-        LogPrintf("SwiftX::ProcessConsensusVote - New Transaction Lock %s !\n", ctx.txHash.ToString().c_str());
-
-        CTransactionLock newLock;
-        newLock.nBlockHeight = 0;
-        newLock.nExpiration = GetTime() + (60 * 60);
-        newLock.nTimeout = GetTime() + (60 * 5);
-        newLock.txHash = ctx.txHash;
-        mapTxLocks.insert(std::make_pair(ctx.txHash, newLock));
-    } else
-        LogPrint("swiftx", "SwiftX::ProcessConsensusVote - Transaction Lock Exists %s !\n", ctx.txHash.ToString().c_str());
-
     //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(ctx.txHash);
-    if (i != mapTxLocks.end()) {
-        (*i).second.AddSignature(ctx);
+    int nSignatures;
+    bool fHaveRequest;
+    bool fRejected;
+    CTransaction tx;
+    {
+        CTxLockShard& shard = TxShard(ctx.txHash);
+        LOCK(shard.cs);
+        if (!shard.mapTxLocks.count(ctx.txHash))
+            LogPrintf("SwiftX::ProcessConsensusVote - New Transaction Lock %s !\n", ctx.txHash.ToString().c_str());
+        else
+            LogPrint("swiftx", "SwiftX::ProcessConsensusVote - Transaction Lock Exists %s !\n", ctx.txHash.ToString().c_str());
+
+        CTransactionLock& lock = InsertTransactionLock(shard, ctx.txHash, 0);
+        lock.AddSignature(ctx);
+        nSignatures = lock.CountSignatures();
+
+        std::map<uint256, CTransaction>::iterator it = shard.mapTxLockReq.find(ctx.txHash);
+        fHaveRequest = it != shard.mapTxLockReq.end();
+        if (fHaveRequest)
+            tx = it->second;
+        fRejected = shard.mapTxLockReqRejected.count(ctx.txHash);
+    }
 
 #ifdef ENABLE_WALLET
-        if (pwalletMain) {
-            //when we get back signatures, we'll count them as requests. Otherwise the client will think it didn't propagate.
-            if (pwalletMain->mapRequestCount.count(ctx.txHash))
-                pwalletMain->mapRequestCount[ctx.txHash]++;
-        }
+    if (pwalletMain) {
+        //when we get back signatures, we'll count them as requests. Otherwise the client will think it didn't propagate.
+        if (pwalletMain->mapRequestCount.count(ctx.txHash))
+            pwalletMain->mapRequestCount[ctx.txHash]++;
+    }
 #endif
 
-        LogPrint("swiftx", "SwiftX::ProcessConsensusVote - Transaction Lock Votes %d - %s !\n", (*i).second.CountSignatures(), ctx.GetHash().ToString().c_str());
+    LogPrint("swiftx", "SwiftX::ProcessConsensusVote - Transaction Lock Votes %d - %s !\n", nSignatures, ctx.GetHash().ToString().c_str());
 
-        if ((*i).second.CountSignatures() >= SWIFTTX_SIGNATURES_REQUIRED) {
-            LogPrint("swiftx", "SwiftX::ProcessConsensusVote - Transaction Lock Is Complete %s !\n", (*i).second.GetHash().ToString().c_str());
+    if (nSignatures >= SWIFTTX_SIGNATURES_REQUIRED) {
+        LogPrint("swiftx", "SwiftX::ProcessConsensusVote - Transaction Lock Is Complete %s !\n", ctx.txHash.ToString().c_str());
 
-            CTransaction& tx = mapTxLockReq[ctx.txHash];
-            if (!CheckForConflictingLocks(tx)) {
+        if (!CheckForConflictingLocks(tx)) {
 #ifdef ENABLE_WALLET
-                if (pwalletMain) {
-                    if (pwalletMain->UpdatedTransaction((*i).second.txHash)) {
-                        nCompleteTXLocks++;
-                    }
+            if (pwalletMain) {
+                if (pwalletMain->UpdatedTransaction(ctx.txHash)) {
+                    nCompleteTXLocks++;
                 }
+            }
 #endif
 
-                if (mapTxLockReq.count(ctx.txHash)) {
-                    for (const CTxIn& in : tx.vin) {
-                        if (!mapLockedInputs.count(in.prevout)) {
-                            mapLockedInputs.insert(std::make_pair(in.prevout, ctx.txHash));
-                        }
-                    }
-                }
+            if (fHaveRequest) {
+                for (const CTxIn& in : tx.vin)
+                    LockInput(in.prevout, ctx.txHash);
+            }
 
-                // resolve conflicts
+            // resolve conflicts
 
-                //if this tx lock was rejected, we need to remove the conflicting blocks
-                if (mapTxLockReqRejected.count((*i).second.txHash)) {
-                    //reprocess the last 15 blocks
-                    ReprocessBlocks(15);
-                }
+            //if this tx lock was rejected, we need to remove the conflicting blocks
+            if (fRejected) {
+                //reprocess the last 15 blocks
+                ReprocessBlocks(15);
             }
         }
-        return true;
     }
 
-
-    return false;
+    return true;
 }
 
 bool CheckForConflictingLocks(CTransaction& tx)
@@ -400,11 +621,12 @@ bool CheckForConflictingLocks(CTransaction& tx)
         rescan the blocks and find they're acceptable and then take the chain with the most work.
     */
     for (const CTxIn& in : tx.vin) {
-        if (mapLockedInputs.count(in.prevout)) {
-            if (mapLockedInputs[in.prevout] != tx.GetHash()) {
-                LogPrintf("SwiftX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", tx.GetHash().ToString().c_str(), mapLockedInputs[in.prevout].ToString().c_str());
-                if (mapTxLocks.count(tx.GetHash())) mapTxLocks[tx.GetHash()].nExpiration = GetTime();
-                if (mapTxLocks.count(mapLockedInputs[in.prevout])) mapTxLocks[mapLockedInputs[in.prevout]].nExpiration = GetTime();
+        uint256 hashLocked;
+        if (GetLockedInputTx(in.prevout, hashLocked)) {
+            if (hashLocked != tx.GetHash()) {
+                LogPrintf("SwiftX::CheckForConflictingLocks - found two complete conflicting locks - removing both. %s %s", tx.GetHash().ToString().c_str(), hashLocked.ToString().c_str());
+                ExpireTransactionLock(tx.GetHash());
+                ExpireTransactionLock(hashLocked);
                 return true;
             }
         }
@@ -415,6 +637,8 @@ bool CheckForConflictingLocks(CTransaction& tx)
 
 int64_t GetAverageVoteTime()
 {
+    LOCK(cs_unknownvotes);
+
     std::map<uint256, int64_t>::iterator it = mapUnknownVotes.begin();
     int64_t total = 0;
     int64_t count = 0;
@@ -432,28 +656,57 @@ void CleanTransactionLocksList()
 {
     if (chainActive.Tip() == NULL) return;
 
-    std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.begin();
+    int64_t nNow = GetTime();
+
+    std::vector<uint256> vExpired;
+    {
+        LOCK(cs_lockexpiry);
+        while (!queueLockExpiry.empty() && nNow > queueLockExpiry.top().first) { //keep them for an hour
+            vExpired.push_back(queueLockExpiry.top().second);
+            queueLockExpiry.pop();
+        }
+    }
 
-    while (it != mapTxLocks.end()) {
-        if (GetTime() > it->second.nExpiration) { //keep them for an hour
-            LogPrintf("Removing old transaction lock %s\n", it->second.txHash.ToString().c_str());
+    for (const uint256& txHash : vExpired) {
+        std::vector<COutPoint> vInputs;
+        std::vector<uint256> vVotes;
+        {
+            CTxLockShard& shard = TxShard(txHash);
+            LOCK(shard.cs);
+            std::map<uint256, CTransactionLock>::iterator it = shard.mapTxLocks.find(txHash);
+            // already removed, or a newer expiration is queued
+            if (it == shard.mapTxLocks.end() || nNow <= it->second.nExpiration)
+                continue;
+
+            LogPrintf("Removing old transaction lock %s\n", txHash.ToString().c_str());
+
+            std::map<uint256, CTransaction>::iterator itReq = shard.mapTxLockReq.find(txHash);
+            if (itReq != shard.mapTxLockReq.end()) {
+                for (const CTxIn& in : itReq->second.vin)
+                    vInputs.push_back(in.prevout);
+                shard.mapTxLockReq.erase(itReq);
+            }
 
-            if (mapTxLockReq.count(it->second.txHash)) {
-                CTransaction& tx = mapTxLockReq[it->second.txHash];
+            std::map<uint256, CTransaction>::iterator itRejected = shard.mapTxLockReqRejected.find(txHash);
+            if (itRejected != shard.mapTxLockReqRejected.end()) {
+                for (const CTxIn& in : itRejected->second.vin)
+                    vInputs.push_back(in.prevout);
+                shard.mapTxLockReqRejected.erase(itRejected);
+            }
 
-                for (const CTxIn& in : tx.vin)
-                    mapLockedInputs.erase(in.prevout);
+            for (CConsensusVote& v : it->second.vecConsensusVotes)
+                vVotes.push_back(v.GetHash());
 
-                mapTxLockReq.erase(it->second.txHash);
-                mapTxLockReqRejected.erase(it->second.txHash);
+            shard.mapTxLocks.erase(it);
+        }
 
-                for (CConsensusVote& v : it->second.vecConsensusVotes)
-                    mapTxLockVote.erase(v.GetHash());
-            }
+        for (const COutPoint& outpoint : vInputs)
+            UnlockInput(outpoint, txHash);
 
-            mapTxLocks.erase(it++);
-        } else {
-            it++;
+        for (const uint256& voteHash : vVotes) {
+            CTxLockVoteShard& shard = VoteShard(voteHash);
+            LOCK(shard.cs);
+            shard.mapTxLockVote.erase(voteHash);
         }
     }
 }
@@ -463,10 +716,7 @@ int GetTransactionLockSignatures(uint256 txHash)
     if(fLargeWorkForkFound || fLargeWorkInvalidChainFound) return -2;
     if (!IsSporkActive(SPORK_2_SWIFTTX)) return -1;
 
-    std::map<uint256, CTransactionLock>::iterator it = mapTxLocks.find(txHash);
-    if(it != mapTxLocks.end()) return it->second.CountSignatures();
-
-    return -1;
+    return CountTransactionLockSignatures(txHash);
 }
 
 uint256 CConsensusVote::GetHash() const
@@ -475,10 +725,15 @@ uint256 CConsensusVote::GetHash() const
 }
 
 
+std::string CConsensusVote::GetStrMessage() const
+{
+    return txHash.ToString() + std::to_string(nBlockHeight);
+}
+
 bool CConsensusVote::SignatureValid()
 {
     std::string errorMessage;
-    std::string strMessage = txHash.ToString().c_str() + std::to_string(nBlockHeight);
+    std::string strMessage = GetStrMessage();
     //LogPrintf("verify strMessage %s \n", strMessage.c_str());
 
     CMasternode* pmn = mnodeman.Find(vinMasternode);
@@ -502,7 +757,7 @@ bool CConsensusVote::Sign()
 
     CKey key2;
     CPubKey pubkey2;
-    std::string strMessage = txHash.ToString().c_str() + std::to_string(nBlockHeight);
+    std::string strMessage = GetStrMessage();
     //LogPrintf("signing strMessage %s \n", strMessage.c_str());
     //LogPrintf("signing privkey %s \n", strMasterNodePrivKey.c_str());
 
@@ -528,7 +783,7 @@ bool CConsensusVote::Sign()
 bool CTransactionLock::SignaturesValid()
 {
     for (CConsensusVote vote : vecConsensusVotes) {
-        int n = mnodeman.GetMasternodeRank(vote.vinMasternode, vote.nBlockHeight, MIN_SWIFTTX_PROTO_VERSION);
+        int n = GetQuorumRank(vote.vinMasternode, vote.nBlockHeight);
 
         if (n == -1) {
             LogPrintf("CTransactionLock::SignaturesValid() - Unknown Masternode\n");
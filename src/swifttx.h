@@ -33,13 +33,19 @@ class CTransactionLock;
 
 static const int MIN_SWIFTTX_PROTO_VERSION = 70103;
 
-extern std::map<uint256, CTransaction> mapTxLockReq;
-extern std::map<uint256, CTransaction> mapTxLockReqRejected;
-extern std::map<uint256, CConsensusVote> mapTxLockVote;
-extern std::map<uint256, CTransactionLock> mapTxLocks;
-extern std::map<COutPoint, uint256> mapLockedInputs;
 extern int nCompleteTXLocks;
 
+// SwiftX state is sharded by transaction hash, each shard behind its own lock, and only reachable through these
+bool HaveTxLockRequest(const uint256& txHash); // accepted or rejected
+bool GetTxLockRequest(const uint256& txHash, CTransaction& tx);
+void AddTxLockRequest(const CTransaction& tx);
+bool HaveTxLockVote(const uint256& voteHash);
+bool GetTxLockVote(const uint256& voteHash, CConsensusVote& vote);
+bool GetTransactionLock(const uint256& txHash, CTransactionLock& lock);
+
+// get the transaction holding the lock on an input
+bool GetLockedInputTx(const COutPoint& outpoint, uint256& txHash);
+
 
 int64_t CreateNewLock(CTransaction tx);
 
@@ -73,6 +79,7 @@ public:
     std::vector<unsigned char> vchMasterNodeSignature;
 
     uint256 GetHash() const;
+    std::string GetStrMessage() const;
 
     bool SignatureValid();
     bool Sign();
@@ -0,0 +1,139 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+#include "key.h"
+#include "primitives/block.h"
+#include "script/standard.h"
+#include "txdb.h"
+#include "undo.h"
+#include "test_simplicity.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(addressindex_keys)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    unsigned char nType;
+    uint160 hashBytes;
+
+    BOOST_CHECK(GetAddressKey(GetScriptForDestination(pubkey.GetID()), nType, hashBytes));
+    BOOST_CHECK_EQUAL(nType, ADDRESS_PUBKEYHASH);
+    BOOST_CHECK(hashBytes == pubkey.GetID());
+
+    // pay to pubkey is indexed under the address of the key
+    BOOST_CHECK(GetAddressKey(CScript() << ToByteVector(pubkey) << OP_CHECKSIG, nType, hashBytes));
+    BOOST_CHECK_EQUAL(nType, ADDRESS_PUBKEYHASH);
+    BOOST_CHECK(hashBytes == pubkey.GetID());
+
+    CScript redeemScript = CScript() << OP_TRUE;
+    BOOST_CHECK(GetAddressKey(GetScriptForDestination(CScriptID(redeemScript)), nType, hashBytes));
+    BOOST_CHECK_EQUAL(nType, ADDRESS_SCRIPTHASH);
+    BOOST_CHECK(hashBytes == CScriptID(redeemScript));
+
+    BOOST_CHECK(!GetAddressKey(redeemScript, nType, hashBytes));
+    BOOST_CHECK(!GetAddressKey(CScript() << OP_RETURN, nType, hashBytes));
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_changes)
+{
+    CScript scriptA = GetScriptForDestination(CKeyID(uint160(1)));
+    CScript scriptB = GetScriptForDestination(CScriptID(uint160(2)));
+
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.push_back(CTxOut(50 * COIN, scriptA));
+    block.vtx.push_back(coinbase);
+
+    CMutableTransaction spend;
+    spend.vin.push_back(CTxIn(COutPoint(uint256(7), 1)));
+    spend.vout.push_back(CTxOut(9 * COIN, scriptB));
+    spend.vout.push_back(CTxOut(0, CScript() << OP_RETURN));
+    block.vtx.push_back(spend);
+
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(1);
+    blockundo.vtxundo[0].vprevout.push_back(CTxInUndo(CTxOut(10 * COIN, scriptA), false, false, 90));
+
+    fAddressIndex = true;
+    fSpentIndex = true;
+    CAddressIndexChanges changes;
+    BOOST_CHECK(GetAddressIndexChanges(block, blockundo, 100, changes));
+    fAddressIndex = false;
+    fSpentIndex = false;
+
+    // coinbase output, the spent input and the P2SH output, the OP_RETURN has no address
+    BOOST_CHECK_EQUAL(changes.vAddressIndex.size(), 3U);
+    BOOST_CHECK_EQUAL(changes.vUnspentCreated.size(), 2U);
+    BOOST_CHECK_EQUAL(changes.vUnspentSpent.size(), 1U);
+    BOOST_CHECK_EQUAL(changes.vUnspentSpent[0].second.nBlockHeight, 90);
+    BOOST_CHECK_EQUAL(changes.vSpentIndex.size(), 1U);
+    BOOST_CHECK(changes.vSpentIndex[0].second.txid == block.vtx[1].GetHash());
+    BOOST_CHECK_EQUAL(changes.vSpentIndex[0].second.nSatoshis, 10 * COIN);
+
+    CBlockTreeDB db(1 << 20, true);
+    BOOST_CHECK(db.ConnectAddressIndex(changes));
+
+    AddressIndex vEntries;
+    BOOST_CHECK(db.ReadAddressIndex(ADDRESS_PUBKEYHASH, uint160(1), vEntries));
+    BOOST_CHECK_EQUAL(vEntries.size(), 2U);
+    CAmount nBalance = 0;
+    for (const std::pair<CAddressIndexKey, CAmount>& entry : vEntries)
+        nBalance += entry.second;
+    BOOST_CHECK_EQUAL(nBalance, 40 * COIN);
+
+    AddressUnspentIndex vUnspent;
+    BOOST_CHECK(db.ReadAddressUnspentIndex(ADDRESS_SCRIPTHASH, uint160(2), vUnspent));
+    BOOST_CHECK_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK_EQUAL(vUnspent[0].second.nSatoshis, 9 * COIN);
+
+    CSpentIndexValue spent;
+    BOOST_CHECK(db.ReadSpentIndex(CSpentIndexKey(uint256(7), 1), spent));
+    BOOST_CHECK_EQUAL(spent.nBlockHeight, 100);
+
+    // disconnecting restores the spent output and drops everything else
+    BOOST_CHECK(db.DisconnectAddressIndex(changes));
+    vEntries.clear();
+    BOOST_CHECK(db.ReadAddressIndex(ADDRESS_PUBKEYHASH, uint160(1), vEntries));
+    BOOST_CHECK(vEntries.empty());
+    vUnspent.clear();
+    BOOST_CHECK(db.ReadAddressUnspentIndex(ADDRESS_PUBKEYHASH, uint160(1), vUnspent));
+    BOOST_CHECK_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(vUnspent[0].first.txhash == uint256(7));
+    BOOST_CHECK(!db.ReadSpentIndex(CSpentIndexKey(uint256(7), 1), spent));
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_order)
+{
+    CBlockTreeDB db(1 << 20, true);
+    CAddressIndexChanges changes;
+    // heights past one byte check the big-endian key order
+    const int nHeights[] = {70000, 2, 300, 256};
+    for (int nHeight : nHeights)
+        changes.vAddressIndex.push_back(std::make_pair(CAddressIndexKey(ADDRESS_PUBKEYHASH, uint160(5), nHeight, 0, uint256(nHeight), 0, false), nHeight));
+    changes.vAddressIndex.push_back(std::make_pair(CAddressIndexKey(ADDRESS_PUBKEYHASH, uint160(6), 1, 0, uint256(1), 0, false), 1));
+    BOOST_CHECK(db.ConnectAddressIndex(changes));
+
+    AddressIndex vEntries;
+    BOOST_CHECK(db.ReadAddressIndex(ADDRESS_PUBKEYHASH, uint160(5), vEntries));
+    BOOST_CHECK_EQUAL(vEntries.size(), 4U);
+    BOOST_CHECK_EQUAL(vEntries[0].first.nBlockHeight, 2);
+    BOOST_CHECK_EQUAL(vEntries[1].first.nBlockHeight, 256);
+    BOOST_CHECK_EQUAL(vEntries[2].first.nBlockHeight, 300);
+    BOOST_CHECK_EQUAL(vEntries[3].first.nBlockHeight, 70000);
+
+    vEntries.clear();
+    BOOST_CHECK(db.ReadAddressIndex(ADDRESS_PUBKEYHASH, uint160(5), vEntries, 3, 300));
+    BOOST_CHECK_EQUAL(vEntries.size(), 2U);
+    BOOST_CHECK_EQUAL(vEntries[0].first.nBlockHeight, 256);
+    BOOST_CHECK_EQUAL(vEntries[1].first.nBlockHeight, 300);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
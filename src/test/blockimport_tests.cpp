@@ -0,0 +1,122 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "random.h"
+#include "streams.h"
+#include "util.h"
+#include "test_simplicity.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockimport_tests, BasicTestingSetup)
+
+static CBlock MakeBlock(int nNonce)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << nNonce << OP_0;
+    tx.vout.push_back(CTxOut(50 * COIN, CScript() << OP_TRUE));
+    CBlock block;
+    block.nVersion = 4;
+    block.nNonce = nNonce;
+    block.vtx.push_back(tx);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+/** A block file with garbage between the blocks, and a truncated block at the end. The size
+ *  field of block nCorrupt is off by nSizeDelta */
+static FILE* WriteImportFile(const boost::filesystem::path& path, const std::vector<CBlock>& vBlocks, int nCorrupt = -1, int nSizeDelta = 0)
+{
+    CAutoFile fileout(fopen(path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!fileout.IsNull());
+    for (size_t i = 0; i < vBlocks.size(); i++) {
+        unsigned char garbage[13];
+        GetRandBytes(garbage, sizeof(garbage));
+        fileout << FLATDATA(garbage);
+        unsigned int nSize = fileout.GetSerializeSize(vBlocks[i]);
+        if ((int)i == nCorrupt)
+            nSize += nSizeDelta;
+        fileout << FLATDATA(Params().MessageStart()) << nSize << vBlocks[i];
+    }
+    fileout << FLATDATA(Params().MessageStart()) << (unsigned int)1000;
+    fileout.fclose();
+    return fopen(path.string().c_str(), "rb");
+}
+
+BOOST_AUTO_TEST_CASE(blockimport_order)
+{
+    boost::filesystem::path path = GetTempPath() / strprintf("test_blockimport_%lu.dat", (unsigned long)GetRand(1000000));
+    std::vector<CBlock> vBlocks;
+    for (int i = 0; i < 20; i++)
+        vBlocks.push_back(MakeBlock(i));
+
+    // a small window makes the reader wait for the caller
+    {
+        CBlockImportReader reader(WriteImportFile(path, vBlocks), 7, 3, 2);
+        std::shared_ptr<CImportedBlock> pblock;
+        for (const CBlock& block : vBlocks) {
+            BOOST_REQUIRE(reader.Next(pblock));
+            BOOST_CHECK(pblock->fValid);
+            BOOST_CHECK_EQUAL(pblock->pos.nFile, 7);
+            BOOST_CHECK(pblock->hash == block.GetHash());
+            BOOST_CHECK(pblock->block.hashMerkleRoot == block.hashMerkleRoot);
+        }
+        BOOST_CHECK(!reader.Next(pblock));
+    }
+
+    // stopping early joins the threads with blocks still in flight
+    {
+        CBlockImportReader reader(WriteImportFile(path, vBlocks), -1, 2, 4);
+        std::shared_ptr<CImportedBlock> pblock;
+        BOOST_REQUIRE(reader.Next(pblock));
+        BOOST_CHECK(pblock->hash == vBlocks[0].GetHash());
+        reader.Stop();
+        BOOST_CHECK(!reader.Next(pblock));
+    }
+
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(blockimport_corrupt_size)
+{
+    boost::filesystem::path path = GetTempPath() / strprintf("test_blockimport_%lu.dat", (unsigned long)GetRand(1000000));
+    std::vector<CBlock> vBlocks;
+    for (int i = 0; i < 20; i++)
+        vBlocks.push_back(MakeBlock(i));
+
+    // a size field covering the following blocks still finds them after the block
+    {
+        CBlockImportReader reader(WriteImportFile(path, vBlocks, 5, 500), -1, 3, 8);
+        std::shared_ptr<CImportedBlock> pblock;
+        for (const CBlock& block : vBlocks) {
+            BOOST_REQUIRE(reader.Next(pblock));
+            BOOST_CHECK(pblock->fValid);
+            BOOST_CHECK(pblock->hash == block.GetHash());
+        }
+        BOOST_CHECK(!reader.Next(pblock));
+    }
+
+    // a size field cutting the block short rescans from after its magic
+    {
+        CBlockImportReader reader(WriteImportFile(path, vBlocks, 5, -40), -1, 3, 8);
+        std::shared_ptr<CImportedBlock> pblock;
+        std::vector<uint256> vHash;
+        while (reader.Next(pblock)) {
+            if (pblock->fValid)
+                vHash.push_back(pblock->hash);
+        }
+        BOOST_REQUIRE_EQUAL(vHash.size(), vBlocks.size() - 1);
+        for (size_t i = 0; i < vHash.size(); i++)
+            BOOST_CHECK(vHash[i] == vBlocks[i < 5 ? i : i + 1].GetHash());
+    }
+
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
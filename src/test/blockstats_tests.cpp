@@ -0,0 +1,89 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockstats.h"
+#include "clientversion.h"
+#include "primitives/block.h"
+#include "undo.h"
+#include "test_simplicity.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockstats_tests, BasicTestingSetup)
+
+static CTransaction MakeSpend(unsigned char nPrev, unsigned int nInputs, CAmount nValueOut, CTxUndo& txundo, CAmount nValueIn)
+{
+    CMutableTransaction tx;
+    for (unsigned int i = 0; i < nInputs; i++) {
+        tx.vin.push_back(CTxIn(COutPoint(uint256(nPrev), i)));
+        txundo.vprevout.push_back(CTxInUndo(CTxOut(nValueIn / nInputs, CScript() << OP_TRUE)));
+    }
+    tx.vout.push_back(CTxOut(nValueOut, CScript() << OP_TRUE));
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(blockstats_compute)
+{
+    CBlock block;
+    CBlockUndo blockundo;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.push_back(CTxOut(50 * COIN, CScript() << OP_TRUE));
+    block.vtx.push_back(coinbase);
+
+    blockundo.vtxundo.resize(2);
+    block.vtx.push_back(MakeSpend(1, 1, 9 * COIN, blockundo.vtxundo[0], 10 * COIN));
+    block.vtx.push_back(MakeSpend(2, 4, 39 * COIN, blockundo.vtxundo[1], 40 * COIN));
+
+    CBlockStats stats;
+    BOOST_CHECK(ComputeBlockStats(block, blockundo, stats));
+    BOOST_CHECK_EQUAL(stats.nTxCountAll, 3U);
+    BOOST_CHECK_EQUAL(stats.nTxCount, 2U);
+    BOOST_CHECK_EQUAL(stats.nFee, 2 * COIN);
+    BOOST_CHECK_EQUAL(stats.nFeeAll, 2 * COIN);
+
+    int64_t nSize1 = block.vtx[1].GetSerializeSize(SER_NETWORK, CLIENT_VERSION);
+    int64_t nSize2 = block.vtx[2].GetSerializeSize(SER_NETWORK, CLIENT_VERSION);
+    BOOST_CHECK_EQUAL(stats.nTxBytes, nSize1 + nSize2);
+
+    // the larger tx pays the lower rate and covers the lower percentiles
+    BOOST_CHECK(nSize2 > nSize1);
+    BOOST_CHECK_EQUAL(stats.vFeeRatePercentiles.front(), CFeeRate(COIN, nSize2).GetFeePerK());
+    BOOST_CHECK_EQUAL(stats.vFeeRatePercentiles.back(), CFeeRate(COIN, nSize1).GetFeePerK());
+
+    // undo data of another block is rejected
+    blockundo.vtxundo.pop_back();
+    BOOST_CHECK(!ComputeBlockStats(block, blockundo, stats));
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    CBlockStats statsRead;
+    stats.nFee = 3;
+    stats.vMints[2] = 4;
+    ss << stats;
+    ss >> statsRead;
+    BOOST_CHECK_EQUAL(statsRead.nFee, 3);
+    BOOST_CHECK_EQUAL(statsRead.vMints[2], 4U);
+}
+
+BOOST_AUTO_TEST_CASE(blockstats_percentiles)
+{
+    std::vector<std::pair<CAmount, int64_t> > vFeeRates;
+    BOOST_CHECK(GetFeeRatePercentiles(vFeeRates) == std::vector<CAmount>(BLOCKSTATS_NUM_PERCENTILES, 0));
+
+    // rate 100 for 20% of the bytes, 10 for 70%, 1000 for 10%
+    vFeeRates.push_back(std::make_pair(100, 200));
+    vFeeRates.push_back(std::make_pair(1000, 100));
+    vFeeRates.push_back(std::make_pair(10, 700));
+
+    std::vector<CAmount> vPercentiles = GetFeeRatePercentiles(vFeeRates);
+    BOOST_CHECK_EQUAL(vPercentiles[0], 10);  // p10
+    BOOST_CHECK_EQUAL(vPercentiles[1], 10);  // p25
+    BOOST_CHECK_EQUAL(vPercentiles[2], 10);  // p50
+    BOOST_CHECK_EQUAL(vPercentiles[3], 100); // p75
+    BOOST_CHECK_EQUAL(vPercentiles[4], 100); // p90
+}
+
+BOOST_AUTO_TEST_SUITE_END()
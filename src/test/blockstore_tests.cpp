@@ -0,0 +1,113 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockstore.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "main.h"
+#include "streams.h"
+#include "test_simplicity.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockstore_tests, TestingSetup)
+
+static CBlock MakeBlock(int nNonce)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << nNonce << OP_0;
+    tx.vout.push_back(CTxOut(50 * COIN, CScript() << OP_TRUE));
+    CBlock block;
+    block.nNonce = nNonce;
+    block.vtx.push_back(tx);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+/** Append blocks to a block file the way WriteBlockToDisk lays them out */
+static std::vector<CDiskBlockPos> WriteBlockFile(int nFile, const std::vector<CBlock>& vBlocks)
+{
+    std::vector<CDiskBlockPos> vPos;
+    CAutoFile fileout(OpenBlockFile(CDiskBlockPos(nFile, 0)), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!fileout.IsNull());
+    for (const CBlock& block : vBlocks) {
+        fileout << FLATDATA(Params().MessageStart()) << fileout.GetSerializeSize(block);
+        vPos.push_back(CDiskBlockPos(nFile, ftell(fileout.Get())));
+        fileout << block;
+    }
+    return vPos;
+}
+
+BOOST_AUTO_TEST_CASE(blockstore_read)
+{
+    std::vector<CBlock> vBlocks;
+    for (int i = 0; i < 3; i++)
+        vBlocks.push_back(MakeBlock(i + 1));
+    std::vector<CDiskBlockPos> vPos = WriteBlockFile(100, vBlocks);
+
+    CBlockStore store;
+    store.SetLimits(1 << 20, 4, 1 << 20);
+    store.SetWriteFile(101);
+
+    // the first read starts a scan, the following ones continue it
+    for (unsigned int i = 0; i < vBlocks.size(); i++) {
+        CBlock block;
+        bool fSequential;
+        BOOST_CHECK(store.Read(vPos[i], block, fSequential));
+        BOOST_CHECK_EQUAL(fSequential, i > 0);
+        BOOST_CHECK(block.hashMerkleRoot == vBlocks[i].hashMerkleRoot);
+        BOOST_CHECK_EQUAL(block.nNonce, vBlocks[i].nNonce);
+    }
+    CBlockStoreStats stats = store.GetStats();
+    BOOST_CHECK_EQUAL(stats.nMappedReads, 3U);
+    BOOST_CHECK_EQUAL(stats.nSequentialReads, 2U);
+    BOOST_CHECK_EQUAL(stats.nMappedFiles, 1U);
+    BOOST_CHECK(stats.nBytesRead > 0);
+
+    // a file that may still be written to is read with file I/O
+    store.ForgetFile(100);
+    store.SetWriteFile(100);
+    CBlock block;
+    bool fSequential;
+    BOOST_CHECK(store.Read(vPos[1], block, fSequential));
+    BOOST_CHECK(block.hashMerkleRoot == vBlocks[1].hashMerkleRoot);
+    stats = store.GetStats();
+    BOOST_CHECK_EQUAL(stats.nMappedReads, 3U);
+    BOOST_CHECK_EQUAL(stats.nMappedFiles, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(blockstore_cache)
+{
+    CBlockStore store;
+    unsigned int nBlockSize = ::GetSerializeSize(MakeBlock(1), SER_DISK, CLIENT_VERSION);
+    store.SetLimits(nBlockSize * 4, 0, 0);
+
+    std::vector<CDiskBlockPos> vPos;
+    for (int i = 0; i < 5; i++) {
+        vPos.push_back(CDiskBlockPos(i % 2, 1000 * i));
+        store.Insert(vPos.back(), std::make_shared<const CBlock>(MakeBlock(i)));
+    }
+
+    // the least recently used block was evicted
+    BOOST_CHECK(!store.Lookup(vPos[0]));
+    for (int i = 1; i < 5; i++) {
+        CBlockRef pblock = store.Lookup(vPos[i]);
+        BOOST_REQUIRE(pblock);
+        BOOST_CHECK_EQUAL(pblock->nNonce, (unsigned int)i);
+    }
+    CBlockStoreStats stats = store.GetStats();
+    BOOST_CHECK_EQUAL(stats.nCacheHits, 4U);
+    BOOST_CHECK_EQUAL(stats.nCacheMisses, 1U);
+    BOOST_CHECK_EQUAL(stats.nCacheBlocks, 4U);
+
+    // forgetting a file drops its blocks
+    store.ForgetFile(1);
+    BOOST_CHECK(!store.Lookup(vPos[1]));
+    BOOST_CHECK(!store.Lookup(vPos[3]));
+    BOOST_CHECK(store.Lookup(vPos[2]));
+    BOOST_CHECK_EQUAL(store.GetStats().nCacheBlocks, 2U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -30,4 +30,43 @@ BOOST_AUTO_TEST_CASE(budget_value)
     CheckBudgetValue(nHeightTest, "mainnet", 43200*COIN);
 }
 
+BOOST_AUTO_TEST_CASE(budget_vote_tallies)
+{
+    CBudgetProposal proposal;
+    uint256 nProposalHash = proposal.GetHash();
+    std::string strError;
+
+    CBudgetVote voteA(CTxIn(COutPoint(uint256(1), 0)), nProposalHash, VOTE_YES);
+    CBudgetVote voteB(CTxIn(COutPoint(uint256(2), 0)), nProposalHash, VOTE_NO);
+    CBudgetVote voteC(CTxIn(COutPoint(uint256(3), 0)), nProposalHash, VOTE_YES);
+    voteC.fValid = false;
+    BOOST_CHECK(proposal.AddOrUpdateVote(voteA, strError));
+    BOOST_CHECK(proposal.AddOrUpdateVote(voteB, strError));
+    BOOST_CHECK(proposal.AddOrUpdateVote(voteC, strError));
+    BOOST_CHECK_EQUAL(proposal.GetYeas(), 1);
+    BOOST_CHECK_EQUAL(proposal.GetNays(), 1);
+    BOOST_CHECK_EQUAL(proposal.GetAbstains(), 0);
+
+    // an updated vote replaces the old one in the tally
+    CBudgetVote voteA2(voteA.vin, nProposalHash, VOTE_ABSTAIN);
+    voteA2.nTime = voteA.nTime + BUDGET_VOTE_UPDATE_MIN;
+    BOOST_CHECK(proposal.AddOrUpdateVote(voteA2, strError));
+    BOOST_CHECK_EQUAL(proposal.GetYeas(), 0);
+    BOOST_CHECK_EQUAL(proposal.GetAbstains(), 1);
+
+    // tallies survive a round trip through the serialized db format
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << proposal;
+    CBudgetProposal proposalLoaded;
+    ss >> proposalLoaded;
+    BOOST_CHECK_EQUAL(proposalLoaded.GetYeas(), 0);
+    BOOST_CHECK_EQUAL(proposalLoaded.GetNays(), 1);
+    BOOST_CHECK_EQUAL(proposalLoaded.GetAbstains(), 1);
+
+    // votes of masternodes we don't know are dropped from the tally
+    BOOST_CHECK(proposalLoaded.CleanAndRemove(false));
+    BOOST_CHECK_EQUAL(proposalLoaded.GetNays(), 0);
+    BOOST_CHECK_EQUAL(proposalLoaded.GetAbstains(), 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,118 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+#include "test/test_simplicity.h"
+
+#include <atomic>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(checkqueue_tests, BasicTestingSetup)
+
+static std::atomic<int> nChecked;
+static std::atomic<int> nDeferred;
+
+/** Fails for negative values, which it defers when run with a batch */
+struct CTestCheck {
+    int n;
+
+    CTestCheck() : n(0) {}
+    explicit CTestCheck(int nIn) : n(nIn) {}
+
+    bool operator()()
+    {
+        nChecked++;
+        return n >= 0;
+    }
+
+    void swap(CTestCheck& check) { std::swap(n, check.n); }
+};
+
+struct CTestBatch {
+    std::vector<int> vDeferred;
+
+    bool Verify()
+    {
+        bool fOk = true;
+        for (int n : vDeferred) {
+            nDeferred++;
+            fOk = fOk && n >= 0;
+        }
+        vDeferred.clear();
+        return fOk;
+    }
+    void Clear() { vDeferred.clear(); }
+};
+
+struct CTestBatchCheck : public CTestCheck {
+    CTestBatchCheck() {}
+    explicit CTestBatchCheck(int nIn) : CTestCheck(nIn) {}
+
+    bool operator()() { return CTestCheck::operator()(); }
+    bool operator()(CTestBatch& batch)
+    {
+        nChecked++;
+        batch.vDeferred.push_back(n);
+        return true;
+    }
+    void swap(CTestBatchCheck& check) { CTestCheck::swap(check); }
+};
+
+template <typename T, typename B>
+static void RunQueue(CCheckQueue<T, B>& queue, int nThreads)
+{
+    boost::thread_group workers;
+    for (int i = 1; i < nThreads; i++)
+        workers.create_thread(boost::bind(&CCheckQueue<T, B>::Thread, &queue));
+
+    for (int nRound = 0; nRound < 50; nRound++) {
+        nChecked = 0;
+        int nTotal = 0;
+        // a failing check in every third round, in a transaction of varying size
+        int nFail = nRound % 3 == 0 ? nRound % 7 : -1;
+        {
+            CCheckQueueControl<T, B> control(&queue);
+            for (int nTx = 0; nTx < 8; nTx++) {
+                std::vector<T> vChecks;
+                for (int i = 0; i < (nTx == 3 ? 1000 : nTx + 1); i++)
+                    vChecks.push_back(T(nTx == nFail && i == 0 ? -1 : i));
+                nTotal += vChecks.size();
+                control.Add(vChecks);
+            }
+            BOOST_CHECK_EQUAL(control.Wait(), nFail < 0);
+        }
+        BOOST_CHECK(queue.IsIdle());
+        // every check runs, or is skipped after a failure
+        if (nFail < 0)
+            BOOST_CHECK_EQUAL(nChecked, nTotal);
+    }
+
+    workers.interrupt_all();
+    workers.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_threads)
+{
+    const int vThreads[] = {1, 2, 4, 16, 70};
+    for (int nThreads : vThreads) {
+        CCheckQueue<CTestCheck> queue(128);
+        RunQueue(queue, nThreads);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_batch)
+{
+    const int vThreads[] = {1, 4};
+    for (int nThreads : vThreads) {
+        nDeferred = 0;
+        CCheckQueue<CTestBatchCheck, CTestBatch> queue(16);
+        RunQueue(queue, nThreads);
+        BOOST_CHECK(nDeferred > 0);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
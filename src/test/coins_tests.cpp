@@ -4,6 +4,7 @@
 
 #include "coins.h"
 #include "random.h"
+#include "streams.h"
 #include "uint256.h"
 #include "test/test_simplicity.h"
 
@@ -42,7 +43,7 @@ public:
 
     uint256 GetBestBlock() const { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsCommitment& delta)
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             map_[it->first] = it->second.coins;
@@ -176,4 +177,66 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+BOOST_AUTO_TEST_CASE(coins_commitment_test)
+{
+    std::vector<CCoins> vcoins;
+    std::vector<uint256> vtxid;
+    for (int i = 0; i < 4; i++) {
+        CCoins coins;
+        coins.nHeight = 100 + i;
+        coins.fCoinBase = (i == 0);
+        coins.vout.resize(3);
+        for (unsigned int n = 0; n < coins.vout.size(); n++) {
+            coins.vout[n].nValue = insecure_rand() % 100000000 + 1;
+            coins.vout[n].scriptPubKey.assign(insecure_rand() & 0x3F, 0);
+        }
+        vcoins.push_back(coins);
+        vtxid.push_back(GetRandHash());
+    }
+
+    // Insertion order does not matter
+    CCoinsCommitment forward, backward;
+    for (unsigned int i = 0; i < vcoins.size(); i++)
+        forward.AddCoins(vtxid[i], vcoins[i]);
+    for (unsigned int i = vcoins.size(); i-- > 0;)
+        backward.AddCoins(vtxid[i], vcoins[i]);
+    BOOST_CHECK(forward.muhash.Finalize() == backward.muhash.Finalize());
+    BOOST_CHECK_EQUAL(forward.nTransactions, 4);
+    BOOST_CHECK_EQUAL(forward.nTransactionOutputs, 12);
+    BOOST_CHECK_EQUAL(forward.nTotalAmount, backward.nTotalAmount);
+
+    // Spending an output and restoring it returns to the same commitment
+    CCoinsCommitment spent(forward);
+    spent.RemoveOutput(COutPoint(vtxid[1], 2), vcoins[1].vout[2], vcoins[1].nHeight, vcoins[1].fCoinBase);
+    BOOST_CHECK(spent.muhash.Finalize() != forward.muhash.Finalize());
+    BOOST_CHECK_EQUAL(spent.nTransactionOutputs, 11);
+    spent.AddOutput(COutPoint(vtxid[1], 2), vcoins[1].vout[2], vcoins[1].nHeight, vcoins[1].fCoinBase);
+    BOOST_CHECK(spent.muhash.Finalize() == forward.muhash.Finalize());
+
+    // A delta with removals combines with a base set, also after a serialization round trip
+    CCoinsCommitment base, delta;
+    base.AddCoins(vtxid[0], vcoins[0]);
+    base.AddCoins(vtxid[1], vcoins[1]);
+    delta.RemoveCoins(vtxid[1], vcoins[1]);
+    delta.AddCoins(vtxid[2], vcoins[2]);
+    base += delta;
+    base.muhash.Normalize();
+
+    CDataStream ss(SER_DISK, 0);
+    ss << base;
+    CCoinsCommitment loaded;
+    ss >> loaded;
+
+    CCoinsCommitment expected;
+    expected.AddCoins(vtxid[2], vcoins[2]);
+    expected.AddCoins(vtxid[0], vcoins[0]);
+    BOOST_CHECK(loaded.muhash.Finalize() == expected.muhash.Finalize());
+    BOOST_CHECK_EQUAL(loaded.nTransactions, 2);
+    BOOST_CHECK_EQUAL(loaded.nTransactionOutputs, 6);
+    BOOST_CHECK_EQUAL(loaded.nTotalAmount, expected.nTotalAmount);
+
+    // The empty set differs from a set with an element
+    BOOST_CHECK(CCoinsCommitment().muhash.Finalize() != expected.muhash.Finalize());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
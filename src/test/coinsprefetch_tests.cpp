@@ -0,0 +1,100 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsprefetch.h"
+#include "txdb.h"
+#include "utiltime.h"
+#include "test/test_simplicity.h"
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(coinsprefetch_tests, BasicTestingSetup)
+
+static CMutableTransaction MakeTx(const std::vector<COutPoint>& vPrevout, int nOutputs)
+{
+    CMutableTransaction tx;
+    for (const COutPoint& prevout : vPrevout)
+        tx.vin.push_back(CTxIn(prevout));
+    for (int i = 0; i < nOutputs; i++)
+        tx.vout.push_back(CTxOut(COIN, CScript() << OP_TRUE));
+    return tx;
+}
+
+static void WaitForRequests(const CCoinsPrefetcher& prefetcher, uint64_t nRequested)
+{
+    for (int i = 0; i < 500 && prefetcher.GetStats().nRequested < nRequested; i++)
+        MilliSleep(10);
+    BOOST_REQUIRE_EQUAL(prefetcher.GetStats().nRequested, nRequested);
+}
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_apply)
+{
+    CCoinsViewDB db(1 << 20, true);
+    std::vector<CTransaction> vFunding;
+    {
+        CCoinsViewCache cache(&db);
+        for (int i = 0; i < 3; i++) {
+            vFunding.push_back(MakeTx(std::vector<COutPoint>(1, COutPoint(GetRandHash(), 0)), 2));
+            *cache.ModifyCoins(vFunding.back().GetHash()) = CCoins(vFunding.back(), 1);
+        }
+        BOOST_REQUIRE(cache.Flush());
+    }
+
+    // spends all funding transactions, an unknown one, and an output of its own
+    CBlock block;
+    block.vtx.push_back(MakeTx(std::vector<COutPoint>(1, COutPoint()), 1));
+    std::vector<COutPoint> vPrevout;
+    for (const CTransaction& tx : vFunding)
+        vPrevout.push_back(COutPoint(tx.GetHash(), 0));
+    vPrevout.push_back(COutPoint(vFunding[0].GetHash(), 1));
+    vPrevout.push_back(COutPoint(GetRandHash(), 0));
+    block.vtx.push_back(MakeTx(vPrevout, 1));
+    block.vtx.push_back(MakeTx(std::vector<COutPoint>(1, COutPoint(block.vtx[1].GetHash(), 0)), 1));
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    BOOST_CHECK_EQUAL(GetBlockPrevouts(block).size(), 4U);
+
+    CCoinsPrefetcher prefetcher;
+    BOOST_CHECK(!prefetcher.Prefetch(block));
+    prefetcher.SetView(&db);
+    boost::thread_group threads;
+    threads.create_thread(boost::bind(&CCoinsPrefetcher::Thread, &prefetcher));
+
+    BOOST_CHECK(prefetcher.Prefetch(block));
+    BOOST_CHECK(!prefetcher.Prefetch(block));
+    WaitForRequests(prefetcher, 4);
+    BOOST_CHECK_EQUAL(prefetcher.GetStats().nFound, 3U);
+
+    // entries the cache has already are kept
+    CCoinsViewCache cache(&db);
+    BOOST_CHECK(cache.AccessCoins(vFunding[2].GetHash()));
+    BOOST_CHECK_EQUAL(prefetcher.Apply(cache), 2U);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 3U);
+    const CCoins* coins = cache.AccessCoins(vFunding[0].GetHash());
+    BOOST_REQUIRE(coins);
+    BOOST_CHECK(coins->IsAvailable(1));
+    BOOST_CHECK_EQUAL(prefetcher.Apply(cache), 0U);
+
+    // coins read before the database was written to are dropped
+    CBlock blockNext;
+    blockNext.vtx.push_back(MakeTx(std::vector<COutPoint>(1, COutPoint(vFunding[1].GetHash(), 1)), 1));
+    BOOST_CHECK(prefetcher.Prefetch(blockNext));
+    WaitForRequests(prefetcher, 5);
+    {
+        CCoinsViewCache cacheWrite(&db);
+        cacheWrite.ModifyCoins(vFunding[1].GetHash())->Spend(1);
+        BOOST_REQUIRE(cacheWrite.Flush());
+    }
+    CCoinsViewCache cacheNext(&db);
+    BOOST_CHECK_EQUAL(prefetcher.Apply(cacheNext), 0U);
+    BOOST_CHECK_EQUAL(prefetcher.GetStats().nOutdated, 1U);
+    BOOST_CHECK_EQUAL(cacheNext.GetCacheSize(), 0U);
+
+    threads.interrupt_all();
+    threads.join_all();
+    prefetcher.SetView(NULL);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
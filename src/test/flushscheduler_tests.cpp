@@ -0,0 +1,186 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "flushscheduler.h"
+#include "main.h"
+#include "txdb.h"
+#include "test/test_simplicity.h"
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+// the journals and blocks use files past the one the genesis block is written to
+BOOST_FIXTURE_TEST_SUITE(flushscheduler_tests, TestingSetup)
+
+static CBlockIndexJournal MakeJournal(const uint256& hash, int nHeight, unsigned int nSize, int nFile = 5)
+{
+    CBlockIndex index;
+    index.phashBlock = &hash;
+    index.nHeight = nHeight;
+    index.nStatus = BLOCK_HAVE_DATA;
+    index.nTx = 1;
+    index.nFile = nFile;
+    index.nDataPos = 8;
+
+    CBlockIndexJournal journal;
+    CBlockFileInfo info;
+    info.AddBlock(nHeight, 0);
+    info.nSize = nSize;
+    journal.vFiles.push_back(std::make_pair(nFile, info));
+    journal.vBlocks.push_back(std::make_pair(hash, CDiskBlockIndex(&index)));
+    return journal;
+}
+
+/** Write the header a block at position 8 of a block file starts with */
+static void WriteBlockHeader(int nFile)
+{
+    FILE* file = OpenBlockFile(CDiskBlockPos(nFile, 0));
+    BOOST_REQUIRE(file);
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    unsigned int nSize = 80;
+    fileout << FLATDATA(Params().MessageStart()) << nSize;
+}
+
+static bool FlushCoins(CCoinsViewDB& coinsdb, const uint256& hashBlock)
+{
+    CCoinsMap mapCoins;
+    return coinsdb.BatchWrite(mapCoins, hashBlock, CCoinsCommitment());
+}
+
+BOOST_AUTO_TEST_CASE(flushscheduler_replay)
+{
+    CCoinsViewDB coinsdb(1 << 20, true);
+    CBlockTreeDB blocktree(1 << 20, true);
+
+    // the coins of epoch 1 reached the disk, the block tree write before them did not
+    WriteBlockHeader(5);
+    uint256 hash = GetRandHash();
+    coinsdb.WriteJournal(1, MakeJournal(hash, 1, 1000), 0);
+    BOOST_REQUIRE(FlushCoins(coinsdb, hash));
+    BOOST_CHECK(!blocktree.Exists(std::make_pair('b', hash)));
+
+    uint64_t nEpoch = 0;
+    BOOST_REQUIRE(ReplayBlockIndexJournal(coinsdb, blocktree, nEpoch));
+    BOOST_CHECK_EQUAL(nEpoch, 1U);
+    BOOST_CHECK(blocktree.Exists(std::make_pair('b', hash)));
+    CBlockFileInfo info;
+    BOOST_CHECK(blocktree.ReadBlockFileInfo(5, info) && info.nSize == 1000);
+    uint64_t nDurable = 0;
+    BOOST_CHECK(blocktree.ReadFlushEpoch(nDurable) && nDurable == 1);
+    std::map<uint64_t, CBlockIndexJournal> mapJournal;
+    BOOST_CHECK(coinsdb.ReadJournal(mapJournal) && mapJournal.empty());
+
+    // a durable epoch is not replayed, and a later block tree write keeps its larger file
+    uint256 hashOld = GetRandHash();
+    coinsdb.WriteJournal(1, MakeJournal(hashOld, 1, 500), 0);
+    coinsdb.WriteJournal(2, MakeJournal(hash, 2, 500), 0);
+    BOOST_REQUIRE(FlushCoins(coinsdb, hash));
+    BOOST_REQUIRE(ReplayBlockIndexJournal(coinsdb, blocktree, nEpoch));
+    BOOST_CHECK_EQUAL(nEpoch, 2U);
+    BOOST_CHECK(!blocktree.Exists(std::make_pair('b', hashOld)));
+    BOOST_CHECK(blocktree.ReadBlockFileInfo(5, info) && info.nSize == 1000);
+}
+
+BOOST_AUTO_TEST_CASE(flushscheduler_replay_lost_block)
+{
+    CCoinsViewDB coinsdb(1 << 20, true);
+    CBlockTreeDB blocktree(1 << 20, true);
+
+    // the coins and journal of epoch 1 reached the disk, the block file they refer to did not
+    uint256 hash = GetRandHash();
+    coinsdb.WriteJournal(1, MakeJournal(hash, 1, 1000, 6), 0);
+    BOOST_REQUIRE(FlushCoins(coinsdb, hash));
+
+    uint64_t nEpoch = 0;
+    BOOST_CHECK(!ReplayBlockIndexJournal(coinsdb, blocktree, nEpoch));
+    BOOST_CHECK(!blocktree.Exists(std::make_pair('b', hash)));
+    CBlockFileInfo info;
+    BOOST_CHECK(!blocktree.ReadBlockFileInfo(6, info));
+    std::map<uint64_t, CBlockIndexJournal> mapJournal;
+    BOOST_CHECK(coinsdb.ReadJournal(mapJournal) && mapJournal.size() == 1);
+
+    // a file that lost the block but was preallocated holds zeros where its header was
+    FILE* file = OpenBlockFile(CDiskBlockPos(6, 0));
+    BOOST_REQUIRE(file);
+    AllocateFileRange(file, 0, 1000);
+    fclose(file);
+    BOOST_CHECK(!ReplayBlockIndexJournal(coinsdb, blocktree, nEpoch));
+    BOOST_CHECK(!blocktree.Exists(std::make_pair('b', hash)));
+
+    // once the block is there the epoch replays
+    WriteBlockHeader(6);
+    BOOST_CHECK(ReplayBlockIndexJournal(coinsdb, blocktree, nEpoch));
+    BOOST_CHECK(blocktree.Exists(std::make_pair('b', hash)));
+}
+
+BOOST_AUTO_TEST_CASE(flushscheduler_commit_block_files)
+{
+    WriteBlockHeader(7);
+    std::set<int> setFiles;
+    setFiles.insert(7);
+    // files without undo data, or without any data, are skipped
+    setFiles.insert(8);
+    std::string strError;
+    BOOST_CHECK(CommitBlockFiles(setFiles, strError));
+    BOOST_CHECK(strError.empty());
+}
+
+BOOST_AUTO_TEST_CASE(flushscheduler_journal_erased)
+{
+    CCoinsViewDB coinsdb(1 << 20, true);
+    uint256 hash = GetRandHash();
+    std::map<uint64_t, CBlockIndexJournal> mapJournal;
+
+    coinsdb.WriteJournal(1, MakeJournal(hash, 1, 100), 0);
+    BOOST_REQUIRE(FlushCoins(coinsdb, hash));
+    BOOST_CHECK(coinsdb.ReadJournal(mapJournal) && mapJournal.size() == 1 && mapJournal.count(1));
+
+    // once epoch 1 is durable its journal goes with the next batch
+    coinsdb.WriteJournal(2, MakeJournal(hash, 2, 200), 1);
+    BOOST_REQUIRE(FlushCoins(coinsdb, hash));
+    mapJournal.clear();
+    BOOST_CHECK(coinsdb.ReadJournal(mapJournal) && mapJournal.size() == 1 && mapJournal.count(2));
+    BOOST_CHECK_EQUAL(mapJournal[2].vBlocks.size(), 1U);
+    BOOST_CHECK(mapJournal[2].vBlocks[0].first == hash);
+    BOOST_CHECK_EQUAL(mapJournal[2].vBlocks[0].second.nHeight, 2);
+}
+
+BOOST_AUTO_TEST_CASE(flushscheduler_commit)
+{
+    CCoinsViewDB coinsdb(1 << 20, true);
+    CBlockTreeDB blocktree(1 << 20, true);
+    CFlushScheduler scheduler;
+    scheduler.SetDatabases(&blocktree, &coinsdb, NULL, 10);
+
+    // without a worker the caller commits
+    uint64_t nEpoch = scheduler.NewEpoch();
+    BOOST_CHECK_EQUAL(nEpoch, 11U);
+    BOOST_CHECK(scheduler.Schedule(nEpoch));
+    BOOST_CHECK_EQUAL(scheduler.GetDurableEpoch(), nEpoch);
+    uint64_t nDurable = 0;
+    BOOST_CHECK(blocktree.ReadFlushEpoch(nDurable) && nDurable == nEpoch);
+
+    boost::thread worker(boost::bind(&CFlushScheduler::Thread, &scheduler));
+    for (int i = 0; i < 20; i++) {
+        nEpoch = scheduler.NewEpoch();
+        BOOST_CHECK(scheduler.Schedule(nEpoch));
+    }
+    BOOST_CHECK(scheduler.WaitForEpoch(nEpoch));
+    BOOST_CHECK_EQUAL(scheduler.GetDurableEpoch(), nEpoch);
+    BOOST_CHECK(blocktree.ReadFlushEpoch(nDurable) && nDurable == nEpoch);
+
+    // epochs scheduled while the worker stops are committed by it or by the caller
+    nEpoch = scheduler.NewEpoch();
+    BOOST_CHECK(scheduler.Schedule(nEpoch));
+    worker.interrupt();
+    worker.join();
+    BOOST_CHECK(scheduler.WaitForEpoch(nEpoch));
+
+    CFlushSchedulerStats stats = scheduler.GetStats();
+    BOOST_CHECK_EQUAL(stats.nScheduled, 22U);
+    BOOST_CHECK_EQUAL(stats.nCommitted + stats.nMerged, stats.nScheduled);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,7 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "leveldbwrapper.h"
 #include "util.h"
 #include "test/test_simplicity.h"
 
@@ -159,4 +160,37 @@ BOOST_AUTO_TEST_CASE(boolargno)
     BOOST_CHECK(GetBoolArg("-foo", false));
 }
 
+BOOST_AUTO_TEST_CASE(dbarg)
+{
+    int64_t n = 0;
+    ResetArgs("");
+    BOOST_CHECK(!GetDBArg("-dbmaxopenfiles", "chainstate", n));
+
+    ResetArgs("-dbmaxopenfiles=100");
+    BOOST_CHECK(GetDBArg("-dbmaxopenfiles", "chainstate", n));
+    BOOST_CHECK_EQUAL(n, 100);
+
+    // a named entry wins over plain ones, whatever the order
+    ResetArgs("-dbmaxopenfiles=chainstate:500 -dbmaxopenfiles=100 -dbmaxopenfiles=blockindex:200");
+    BOOST_CHECK(GetDBArg("-dbmaxopenfiles", "chainstate", n));
+    BOOST_CHECK_EQUAL(n, 500);
+    BOOST_CHECK(GetDBArg("-dbmaxopenfiles", "blockindex", n));
+    BOOST_CHECK_EQUAL(n, 200);
+    BOOST_CHECK(GetDBArg("-dbmaxopenfiles", "zerocoin", n));
+    BOOST_CHECK_EQUAL(n, 100);
+
+    ResetArgs("-dbcompression=blockindex:1 -dbblocksize=chainstate:x");
+    BOOST_CHECK(GetDBArg("-dbcompression", "blockindex", n));
+    BOOST_CHECK_EQUAL(n, 1);
+    BOOST_CHECK(!GetDBArg("-dbcompression", "chainstate", n));
+    BOOST_CHECK(!GetDBArg("-dbblocksize", "chainstate", n));
+
+    CLevelDBOptions dboptions = DBOptionsFromArgs("blockindex", 8 << 20);
+    BOOST_CHECK(dboptions.fCompression);
+    BOOST_CHECK_EQUAL(dboptions.nBlockCacheSize, (size_t)(4 << 20));
+    BOOST_CHECK_EQUAL(dboptions.nWriteBufferSize, (size_t)(2 << 20));
+    BOOST_CHECK_EQUAL(dboptions.nMaxOpenFiles, 64);
+    ResetArgs("");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
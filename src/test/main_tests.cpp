@@ -5,9 +5,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "primitives/transaction.h"
+#include "chainparams.h"
 #include "main.h"
 #include "test_simplicity.h"
 
+#include <boost/filesystem.hpp>
 #include <boost/test/unit_test.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(main_tests, TestingSetup)
@@ -46,4 +48,67 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK(nSum == 4109975100000000ULL);
 }
 
+BOOST_AUTO_TEST_CASE(prune_block_file)
+{
+    LOCK(cs_main);
+    CBlockIndex* pindex = chainActive.Genesis();
+    BOOST_REQUIRE(pindex && (pindex->nStatus & BLOCK_HAVE_DATA));
+    BOOST_CHECK(GetPruneKeepDepth() >= (unsigned int)MIN_BLOCKS_TO_KEEP);
+    uint64_t nUsage = CalculateCurrentUsage();
+    BOOST_CHECK(nUsage > 0);
+
+    CDiskBlockPos pos(pindex->nFile, 0);
+    PruneOneBlockFile(pindex->nFile);
+    BOOST_CHECK(!(pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO)));
+    BOOST_CHECK(pindex->nTx > 0);
+    BOOST_CHECK_EQUAL(CalculateCurrentUsage(), 0U);
+
+    std::set<int> setFiles;
+    setFiles.insert(pos.nFile);
+    UnlinkPrunedFiles(setFiles);
+    BOOST_CHECK(!boost::filesystem::exists(GetBlockPosFilename(pos, "blk")));
+}
+
+BOOST_AUTO_TEST_CASE(prune_select_files)
+{
+    // ten files of 100 MiB holding 1000 blocks each, the last one is being written
+    std::vector<CBlockFileInfo> vinfo(10);
+    for (unsigned int i = 0; i < vinfo.size(); i++) {
+        vinfo[i].nSize = 100 << 20;
+        vinfo[i].nHeightFirst = i * 1000;
+        vinfo[i].nHeightLast = i * 1000 + 999;
+    }
+    const int nLastFile = vinfo.size() - 1;
+    const int nKeep = GetPruneKeepDepth();
+    std::set<int> setFiles;
+
+    // nothing while the chain is within the keep depth
+    BOOST_CHECK_EQUAL(SelectFilesToPrune(vinfo, nLastFile, nKeep, 1, setFiles), 0U);
+    BOOST_CHECK(setFiles.empty());
+
+    // the oldest files until the usage is below the target
+    BOOST_CHECK_EQUAL(SelectFilesToPrune(vinfo, nLastFile, 10000 + nKeep, MIN_DISK_SPACE_FOR_BLOCK_FILES, setFiles), 10000U);
+    BOOST_CHECK_EQUAL(setFiles.size(), 5U);
+    BOOST_CHECK(!setFiles.count(5) && setFiles.count(4));
+
+    // but never the file being written
+    setFiles.clear();
+    SelectFilesToPrune(vinfo, nLastFile, 10000 + nKeep, 1, setFiles);
+    BOOST_CHECK_EQUAL(setFiles.size(), vinfo.size() - 1);
+    BOOST_CHECK(!setFiles.count(nLastFile));
+
+    // nor a file with a block within the keep depth
+    setFiles.clear();
+    BOOST_CHECK_EQUAL(SelectFilesToPrune(vinfo, nLastFile, 4500 + nKeep, 1, setFiles), 4500U);
+    BOOST_CHECK_EQUAL(setFiles.size(), 4U);
+    BOOST_CHECK(!setFiles.count(4));
+
+    // nor one with a block from the zerocoin start height on
+    SelectParams(CBaseChainParams::REGTEST);
+    setFiles.clear();
+    BOOST_CHECK_EQUAL(SelectFilesToPrune(vinfo, nLastFile, 10000 + GetPruneKeepDepth(), 1, setFiles), (unsigned int)Params().Zerocoin_StartHeight());
+    BOOST_CHECK(setFiles.empty());
+    SelectParams(CBaseChainParams::UNITTEST);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
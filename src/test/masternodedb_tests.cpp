@@ -0,0 +1,46 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternodedb.h"
+#include "test_simplicity.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(masternodedb_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(masternodedb_incremental_dump)
+{
+    CMasternodeStateDB db(1 << 20, true);
+
+    std::map<int, std::string> mapEntries;
+    mapEntries[1] = "one";
+    mapEntries[2] = "two";
+    mapEntries[3] = "three";
+
+    db.DumpHeader("TestCache");
+    db.DumpMap('x', mapEntries);
+    db.DumpEntry(std::make_pair('y', 0), std::string("other"));
+    BOOST_CHECK(db.CommitDump("x"));
+
+    // entries dropped from the map are erased, other types are left alone
+    mapEntries.erase(2);
+    mapEntries[3] = "drei";
+    db.DumpMap('x', mapEntries);
+    BOOST_CHECK(db.CommitDump("x"));
+
+    std::string strValue;
+    BOOST_CHECK(!db.Exists(std::make_pair('x', 2)));
+    BOOST_CHECK(db.Read(std::make_pair('x', 3), strValue) && strValue == "drei");
+    BOOST_CHECK(db.Read(std::make_pair('y', 0), strValue) && strValue == "other");
+
+    std::map<int, std::string> mapLoaded;
+    BOOST_CHECK(db.LoadMap('x', mapLoaded));
+    BOOST_CHECK(mapLoaded == mapEntries);
+
+    bool fFound = false;
+    BOOST_CHECK(db.LoadHeader("TestCache", fFound) && fFound);
+    BOOST_CHECK(db.LoadHeader("OtherCache", fFound) && !fFound);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,67 @@
+// Copyright (c) 2017 The PIVX developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode-payments.h"
+#include "test_simplicity.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mnpayments_tests, TestingSetup)
+
+static CMasternodePaymentWinner MakeVote(unsigned char nVoter, int nBlockHeight, unsigned char nPayee)
+{
+    CMasternodePaymentWinner winner(CTxIn(COutPoint(uint256(nVoter), 0)));
+    winner.nBlockHeight = nBlockHeight;
+    winner.AddPayee(CScript() << nPayee, CMasternode::LevelValue::MAX, CTxIn(COutPoint(uint256(nPayee), 0)));
+    return winner;
+}
+
+BOOST_AUTO_TEST_CASE(mnpayments_vote_ring)
+{
+    std::map<uint256, CMasternodePaymentWinner> mapVotes;
+    CMasternodePaymentWinner voteOld = MakeVote(1, 100, 7);
+    CMasternodePaymentWinner voteA = MakeVote(1, 100 + MNPAYMENTS_MIN_RING_SIZE, 8);
+    CMasternodePaymentWinner voteB = MakeVote(2, 100 + MNPAYMENTS_MIN_RING_SIZE, 8);
+    CMasternodePaymentWinner voteC = MakeVote(3, 101 + MNPAYMENTS_MIN_RING_SIZE, 9);
+    mapVotes[voteOld.GetHash()] = voteOld;
+    mapVotes[voteA.GetHash()] = voteA;
+    mapVotes[voteB.GetHash()] = voteB;
+    mapVotes[voteC.GetHash()] = voteC;
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << mapVotes << std::map<int, CMasternodeBlockPayees>();
+
+    CMasternodePayments payments;
+    ss >> payments;
+
+    // the old height shares its slot with a newer one and falls out of the window
+    BOOST_CHECK(!payments.HasVote(voteOld.GetHash()));
+    BOOST_CHECK(payments.HasVote(voteA.GetHash()));
+    BOOST_CHECK(payments.HasVote(voteC.GetHash()));
+    BOOST_CHECK_EQUAL(payments.GetOldestBlock(), 100 + MNPAYMENTS_MIN_RING_SIZE);
+    BOOST_CHECK_EQUAL(payments.GetNewestBlock(), 101 + MNPAYMENTS_MIN_RING_SIZE);
+
+    CMasternodePaymentWinner winner;
+    BOOST_CHECK(payments.GetVote(voteB.GetHash(), winner));
+    BOOST_CHECK(winner.GetHash() == voteB.GetHash());
+
+    // both votes for the same payee are tallied
+    CScript payee;
+    BOOST_CHECK(payments.GetBlockPayee(100 + MNPAYMENTS_MIN_RING_SIZE, CMasternode::LevelValue::MAX, payee));
+    BOOST_CHECK(payee == voteA.payee);
+    BOOST_CHECK(payments.HasPayeeWithVotes(100 + MNPAYMENTS_MIN_RING_SIZE, voteA.payee, voteA.payeeVin, 2));
+    BOOST_CHECK(!payments.HasPayeeWithVotes(101 + MNPAYMENTS_MIN_RING_SIZE, voteC.payee, voteC.payeeVin, 2));
+
+    // a masternode votes once per height and level
+    BOOST_CHECK(!payments.CanVote(voteA.vinMasternode.prevout, voteA.nBlockHeight, CMasternode::LevelValue::MAX));
+    BOOST_CHECK(payments.CanVote(voteA.vinMasternode.prevout, voteC.nBlockHeight, CMasternode::LevelValue::MAX));
+    BOOST_CHECK(!payments.CanVote(voteA.vinMasternode.prevout, voteC.nBlockHeight, CMasternode::LevelValue::MAX));
+    BOOST_CHECK(!payments.CanVote(voteA.vinMasternode.prevout, voteOld.nBlockHeight, CMasternode::LevelValue::MAX));
+
+    payments.Clear();
+    BOOST_CHECK(!payments.HasVote(voteA.GetHash()));
+    BOOST_CHECK(!payments.GetBlockPayee(100 + MNPAYMENTS_MIN_RING_SIZE, CMasternode::LevelValue::MAX, payee));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
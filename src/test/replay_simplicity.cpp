@@ -0,0 +1,334 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/**
+ * Offline replay of a range of blocks, for measuring validation throughput without a network.
+ * The blocks of the -loadblock files are connected on top of a copy of the -datadir chainstate
+ * with a fixed -par and -dbcache, and the time spent in each stage of connecting them is
+ * printed as CSV or JSON.
+ */
+
+#include "blockstats.h"
+#include "chainparams.h"
+#include "crypto/sha256.h"
+#include "flushscheduler.h"
+#include "guiinterface.h"
+#include "key.h"
+#include "main.h"
+#include "random.h"
+#include "spork.h"
+#include "sporkdb.h"
+#include "txdb.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <stdio.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+#include <univalue.h>
+
+CClientUIInterface uiInterface;
+CWallet* pwalletMain;
+
+void StartShutdown()
+{
+    exit(0);
+}
+
+bool ShutdownRequested()
+{
+    return false;
+}
+
+static const struct {
+    const char* name;
+    int64_t CConnectBlockTimings::*pTime;
+} stages[] = {
+    {"read", &CConnectBlockTimings::nTimeReadFromDisk},
+    {"connect", &CConnectBlockTimings::nTimeConnect},
+    {"verify", &CConnectBlockTimings::nTimeVerify},
+    {"index", &CConnectBlockTimings::nTimeIndex},
+    {"callbacks", &CConnectBlockTimings::nTimeCallbacks},
+    {"connect_total", &CConnectBlockTimings::nTimeConnectTotal},
+    {"flush", &CConnectBlockTimings::nTimeFlush},
+    {"chainstate", &CConnectBlockTimings::nTimeChainState},
+    {"postconnect", &CConnectBlockTimings::nTimePostConnect},
+    {"total", &CConnectBlockTimings::nTimeTotal},
+};
+
+struct CReplayTip {
+    int nHeight;
+    //! of the blocks connected since the previous tip
+    CConnectBlockTimings timings;
+};
+
+static CCoinsViewDB* pcoinsdbview = NULL;
+static std::vector<CReplayTip> vTips;
+static CConnectBlockTimings timingsLast;
+
+static CConnectBlockTimings Subtract(const CConnectBlockTimings& a, const CConnectBlockTimings& b)
+{
+    CConnectBlockTimings timings;
+    timings.nBlocks = a.nBlocks - b.nBlocks;
+    timings.nTransactions = a.nTransactions - b.nTransactions;
+    timings.nInputs = a.nInputs - b.nInputs;
+    for (const auto& stage : stages)
+        timings.*stage.pTime = a.*stage.pTime - b.*stage.pTime;
+    return timings;
+}
+
+static void ReplayNotifyBlockTip(bool fInitialDownload, const CBlockIndex* pindex)
+{
+    LOCK(cs_main);
+    CConnectBlockTimings timings = GetConnectBlockTimings();
+    CReplayTip tip;
+    tip.nHeight = pindex->nHeight;
+    tip.timings = Subtract(timings, timingsLast);
+    vTips.push_back(tip);
+    timingsLast = timings;
+}
+
+static void CopyDirectory(const boost::filesystem::path& pathFrom, const boost::filesystem::path& pathTo)
+{
+    boost::filesystem::create_directories(pathTo);
+    const size_t nPrefix = pathFrom.string().size();
+    for (boost::filesystem::recursive_directory_iterator it(pathFrom), end; it != end; ++it) {
+        boost::filesystem::path pathDest = pathTo / it->path().string().substr(nPrefix);
+        if (boost::filesystem::is_directory(it->status()))
+            boost::filesystem::create_directories(pathDest);
+        else if (boost::filesystem::is_regular_file(it->status()))
+            boost::filesystem::copy_file(it->path(), pathDest);
+    }
+}
+
+static std::string FormatCSVRow(const std::string& strScope, int nHeight, const CConnectBlockTimings& timings)
+{
+    std::string strRow = strprintf("%s,%d,%d,%d,%d", strScope, nHeight, timings.nBlocks, timings.nTransactions, timings.nInputs);
+    for (const auto& stage : stages)
+        strRow += strprintf(",%d", timings.*stage.pTime);
+    return strRow + "\n";
+}
+
+static UniValue TimingsToJSON(int nHeight, const CConnectBlockTimings& timings)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("height", nHeight));
+    obj.push_back(Pair("blocks", timings.nBlocks));
+    obj.push_back(Pair("transactions", timings.nTransactions));
+    obj.push_back(Pair("inputs", timings.nInputs));
+    UniValue us(UniValue::VOBJ);
+    for (const auto& stage : stages)
+        us.push_back(Pair(stage.name, timings.*stage.pTime));
+    obj.push_back(Pair("us", us));
+    return obj;
+}
+
+/** Load the block index the way the node does at startup */
+static bool LoadChainstate(std::string& strError)
+{
+    uint64_t nFlushEpoch = 0;
+    if (!ReplayBlockIndexJournal(*pcoinsdbview, *pblocktree, nFlushEpoch)) {
+        strError = "Failed to replay the block index journal";
+        return false;
+    }
+    flushscheduler.SetDatabases(pblocktree, pcoinsdbview, zerocoinDB, nFlushEpoch);
+    std::string strBlockIndexError;
+    if (!LoadBlockIndex(strBlockIndexError)) {
+        strError = "Failed to load the block index: " + strBlockIndexError;
+        return false;
+    }
+    if (!InitBlockIndex()) {
+        strError = "Failed to initialize the block index";
+        return false;
+    }
+    return true;
+}
+
+static std::string HelpMessage()
+{
+    std::string strUsage = "Usage:\n  replay_simplicity [options] -loadblock=<file> ...\n\n";
+    strUsage += HelpMessageGroup("Options:");
+    strUsage += HelpMessageOpt("-?", "This help message");
+    strUsage += HelpMessageOpt("-datadir=<dir>", "Start from a copy of the chainstate and block index in <dir> (default: an empty chain)");
+    strUsage += HelpMessageOpt("-loadblock=<file>", "Replay the blocks of a blk?????.dat file, can be given more than once");
+    strUsage += HelpMessageOpt("-par=<n>", strprintf("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)", -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-dbcache=<n>", strprintf("Set database cache size in megabytes (%d to %d, default: %d)", nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-output=<format>", "Print the timings as csv or json (default: csv)");
+    strUsage += HelpMessageOpt("-perblock", "Also print the timings of each new tip (default: 0)");
+    strUsage += HelpMessageOpt("-keepdatadir", "Keep the replayed copy of the data directory (default: 0)");
+    strUsage += HelpMessageOpt("-regtest", "Replay regression test mode blocks");
+    strUsage += HelpMessageOpt("-testnet", "Replay test network blocks");
+    return strUsage;
+}
+
+int main(int argc, char** argv)
+{
+    SetupEnvironment();
+    ParseParameters(argc, argv);
+
+    if (mapArgs.count("-?") || mapArgs.count("-help")) {
+        fprintf(stdout, "%s", HelpMessage().c_str());
+        return EXIT_SUCCESS;
+    }
+    if (!mapArgs.count("-loadblock")) {
+        fprintf(stderr, "Error: No -loadblock files to replay\n");
+        return EXIT_FAILURE;
+    }
+    std::string strOutput = GetArg("-output", "csv");
+    if (strOutput != "csv" && strOutput != "json") {
+        fprintf(stderr, "Error: Unknown output format %s\n", strOutput.c_str());
+        return EXIT_FAILURE;
+    }
+    if (!SelectParamsFromCommandLine()) {
+        fprintf(stderr, "Error: Invalid combination of -regtest and -testnet.\n");
+        return EXIT_FAILURE;
+    }
+
+    // every run replays onto the same starting state
+    boost::filesystem::path pathReplay = GetTempPath() / strprintf("replay_simplicity_%lu_%i", (unsigned long)GetTime(), (int)GetRand(100000));
+    try {
+        if (mapArgs.count("-datadir")) {
+            boost::filesystem::path pathFrom = boost::filesystem::system_complete(mapArgs["-datadir"]);
+            if (!boost::filesystem::is_directory(pathFrom)) {
+                fprintf(stderr, "Error: Specified data directory \"%s\" does not exist.\n", mapArgs["-datadir"].c_str());
+                return EXIT_FAILURE;
+            }
+            CopyDirectory(pathFrom, pathReplay);
+        }
+        mapArgs["-datadir"] = pathReplay.string();
+        ClearDatadirCache();
+        boost::filesystem::create_directories(GetDataDir() / "blocks");
+    } catch (const boost::filesystem::filesystem_error& e) {
+        fprintf(stderr, "Error: Failed to copy the data directory: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    SHA256AutoDetect();
+    ECC_Start();
+    fPrintToDebugLog = false;
+
+    nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
+    if (nScriptCheckThreads <= 0)
+        nScriptCheckThreads += boost::thread::hardware_concurrency();
+    if (nScriptCheckThreads <= 1)
+        nScriptCheckThreads = 0;
+    else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
+        nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
+
+    // the split of the cache of the node without -dbcachesplit
+    size_t nTotalCache = std::max(nMinDbCache, std::min(nMaxDbCache, GetArg("-dbcache", nDefaultDbCache))) << 20;
+    size_t nBlockTreeDBCache = nTotalCache / 8;
+    size_t nCoinDBCache = (nTotalCache - nBlockTreeDBCache) / 2;
+    nCoinCacheSize = (nTotalCache - nBlockTreeDBCache - nCoinDBCache) / 300;
+
+    zerocoinDB = new CZerocoinDB(0, false, false);
+    pSporkDB = new CSporkDB(0, false, false);
+    pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, false);
+    pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, false);
+    pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+    LoadSporksFromDB();
+    fBlockStatsIndex = GetBoolArg("-blockstatsindex", true);
+
+    int nRet = EXIT_FAILURE;
+    boost::thread_group threadGroup;
+    std::string strError;
+    if (!LoadChainstate(strError)) {
+        fprintf(stderr, "Error: %s\n", strError.c_str());
+    } else {
+        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+            threadGroup.create_thread(&ThreadScriptCheck);
+
+        int nHeightStart;
+        {
+            LOCK(cs_main);
+            nHeightStart = chainActive.Height();
+            timingsLast = GetConnectBlockTimings();
+        }
+        CConnectBlockTimings timingsStart = timingsLast;
+        uiInterface.NotifyBlockTip.connect(&ReplayNotifyBlockTip);
+
+        int64_t nStart = GetTimeMicros();
+        for (const std::string& strFile : mapMultiArgs["-loadblock"]) {
+            FILE* file = fopen(strFile.c_str(), "rb");
+            if (!file) {
+                fprintf(stderr, "Warning: Could not open blocks file %s\n", strFile.c_str());
+                continue;
+            }
+            LoadExternalBlockFile(file);
+        }
+        FlushStateToDisk();
+        int64_t nWallMicros = GetTimeMicros() - nStart;
+        uiInterface.NotifyBlockTip.disconnect(&ReplayNotifyBlockTip);
+
+        CConnectBlockTimings timings;
+        int nHeight;
+        {
+            LOCK(cs_main);
+            timings = Subtract(GetConnectBlockTimings(), timingsStart);
+            nHeight = chainActive.Height();
+        }
+
+        if (strOutput == "json") {
+            UniValue result = TimingsToJSON(nHeight, timings);
+            result.push_back(Pair("start_height", nHeightStart));
+            result.push_back(Pair("par", nScriptCheckThreads));
+            result.push_back(Pair("dbcache", (int64_t)(nTotalCache >> 20)));
+            result.push_back(Pair("wall_us", nWallMicros));
+            UniValue perBlock(UniValue::VOBJ), perInput(UniValue::VOBJ);
+            for (const auto& stage : stages) {
+                perBlock.push_back(Pair(stage.name, timings.nBlocks ? (double)(timings.*stage.pTime) / timings.nBlocks : 0.0));
+                perInput.push_back(Pair(stage.name, timings.nInputs ? (double)(timings.*stage.pTime) / timings.nInputs : 0.0));
+            }
+            result.push_back(Pair("us_per_block", perBlock));
+            result.push_back(Pair("us_per_input", perInput));
+            if (GetBoolArg("-perblock", false)) {
+                UniValue tips(UniValue::VARR);
+                for (const CReplayTip& tip : vTips)
+                    tips.push_back(TimingsToJSON(tip.nHeight, tip.timings));
+                result.push_back(Pair("tips", tips));
+            }
+            fprintf(stdout, "%s\n", result.write(2).c_str());
+        } else {
+            std::string strOut = "scope,height,blocks,transactions,inputs";
+            for (const auto& stage : stages)
+                strOut += strprintf(",%s_us", stage.name);
+            strOut += "\n";
+            if (GetBoolArg("-perblock", false)) {
+                for (const CReplayTip& tip : vTips)
+                    strOut += FormatCSVRow("tip", tip.nHeight, tip.timings);
+            }
+            strOut += FormatCSVRow("total", nHeight, timings);
+            fprintf(stdout, "%s", strOut.c_str());
+        }
+        fprintf(stderr, "Replayed %d blocks from height %d to %d in %.2fs with %d script threads\n", (int)timings.nBlocks, nHeightStart, nHeight, nWallMicros * 0.000001, nScriptCheckThreads);
+        // a replay that connects nothing would report meaningless timings
+        nRet = timings.nBlocks ? EXIT_SUCCESS : EXIT_FAILURE;
+        if (!timings.nBlocks)
+            fprintf(stderr, "Error: No blocks were connected\n");
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    UnloadBlockIndex();
+    flushscheduler.SetDatabases(NULL, NULL, NULL, 0);
+    delete pcoinsTip;
+    delete pcoinsdbview;
+    delete pblocktree;
+    delete pSporkDB;
+    delete zerocoinDB;
+    pcoinsTip = NULL;
+    pcoinsdbview = NULL;
+    pblocktree = NULL;
+    pSporkDB = NULL;
+    zerocoinDB = NULL;
+    ECC_Stop();
+
+    if (!GetBoolArg("-keepdatadir", false))
+        boost::filesystem::remove_all(pathReplay);
+    else
+        fprintf(stderr, "Kept the replayed data directory %s\n", pathReplay.string().c_str());
+    return nRet;
+}
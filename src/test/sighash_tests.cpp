@@ -162,6 +162,28 @@ BOOST_AUTO_TEST_CASE(sighash_test)
     #endif
 }
 
+BOOST_AUTO_TEST_CASE(sighash_precomputed)
+{
+    seed_insecure_rand(false);
+
+    for (int i = 0; i < 5000; i++) {
+        int nHashType = insecure_rand();
+        // favour the hash types that use the precomputed state
+        if (i % 2)
+            nHashType = (nHashType & ~0x9f) | SIGHASH_ALL;
+        CMutableTransaction txTo;
+        RandomTransaction(txTo, (nHashType & 0x1f) == SIGHASH_SINGLE);
+        CScript scriptCode;
+        RandomScript(scriptCode);
+        const CTransaction tx(txTo);
+        const PrecomputedTransactionData txdata(tx);
+
+        for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++)
+            BOOST_CHECK(SignatureHash(scriptCode, tx, nIn, nHashType, &txdata) == SignatureHash(scriptCode, tx, nIn, nHashType));
+        BOOST_CHECK(SignatureHash(scriptCode, tx, tx.vin.size(), nHashType, &txdata) == SignatureHash(scriptCode, tx, tx.vin.size(), nHashType));
+    }
+}
+
 // Goal: check that SignatureHash generates correct hash
 BOOST_AUTO_TEST_CASE(sighash_from_data)
 {
@@ -0,0 +1,120 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "snapshot.h"
+#include "main.h"
+#include "txdb.h"
+#include "test/test_simplicity.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(snapshot_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(snapshot_dump_load)
+{
+    std::vector<uint256> vTxid;
+    {
+        LOCK(cs_main);
+        BOOST_REQUIRE(chainActive.Tip());
+        for (int i = 0; i < 5; i++) {
+            CMutableTransaction tx;
+            tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+            tx.vout.push_back(CTxOut((i + 1) * COIN, CScript() << OP_TRUE));
+            CCoins coins(tx, 0);
+            vTxid.push_back(CTransaction(tx).GetHash());
+            pcoinsTip->GetCommitmentDelta().AddCoins(vTxid.back(), coins);
+            *pcoinsTip->ModifyCoins(vTxid.back()) = coins;
+        }
+        BOOST_REQUIRE(pcoinsTip->Flush());
+    }
+    zerocoinDB = new CZerocoinDB(1 << 20, true);
+    BOOST_REQUIRE(zerocoinDB->WriteAccumulatorValue(7, CBigNum(1234)));
+
+    boost::filesystem::path path = pathTemp / "utxo.dat";
+    CSnapshotInfo info;
+    std::string strError;
+    BOOST_REQUIRE_MESSAGE(DumpChainstateSnapshot(path, info, strError), strError);
+    BOOST_CHECK(info.hashBase == chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK_EQUAL(info.nBlocks, 1U);
+    BOOST_CHECK_EQUAL(info.nCoins, 5U);
+    BOOST_CHECK_EQUAL(info.nZerocoinEntries, 1U);
+    BOOST_CHECK(!DumpChainstateSnapshot(path, info, strError));
+
+    {
+        CCoinsViewDB coinsdb(1 << 20, true);
+        CBlockTreeDB blocktree(1 << 20, true);
+        CZerocoinDB zerocoindb(1 << 20, true);
+        CSnapshotInfo infoLoad;
+        BOOST_REQUIRE_MESSAGE(LoadChainstateSnapshot(path, coinsdb, blocktree, zerocoindb, infoLoad, strError), strError);
+        BOOST_CHECK(infoLoad.hashSnapshot == info.hashSnapshot);
+        BOOST_CHECK(infoLoad.hashMuHash == info.hashMuHash);
+        BOOST_CHECK(coinsdb.GetBestBlock() == info.hashBase);
+
+        CCoins coins;
+        BOOST_CHECK(coinsdb.GetCoins(vTxid[0], coins) && coins.vout[0].nValue == COIN);
+        uint256 hashBase;
+        BOOST_CHECK(blocktree.ReadSnapshotBase(hashBase) && hashBase == info.hashBase);
+        bool fPruned = false;
+        BOOST_CHECK(blocktree.ReadFlag("prunedblockfiles", fPruned) && fPruned);
+        CBigNum bnValue;
+        BOOST_CHECK(zerocoindb.ReadAccumulatorValue(7, bnValue) && bnValue == CBigNum(1234));
+
+        // only new databases are bootstrapped
+        BOOST_CHECK(!LoadChainstateSnapshot(path, coinsdb, blocktree, zerocoindb, infoLoad, strError));
+    }
+
+    // a load that did not finish leaves its base without a best block and is started over
+    {
+        CCoinsViewDB coinsdb(1 << 20, true);
+        CBlockTreeDB blocktree(1 << 20, true);
+        CZerocoinDB zerocoindb(1 << 20, true);
+        BOOST_REQUIRE(blocktree.WriteSnapshotBase(info.hashBase));
+        CMutableTransaction tx;
+        tx.vout.push_back(CTxOut(COIN, CScript() << OP_TRUE));
+        uint256 txidStray = CTransaction(tx).GetHash();
+        CCoinsMap mapCoins;
+        CCoinsCommitment delta;
+        CCoinsCacheEntry& entry = mapCoins[txidStray];
+        entry.coins = CCoins(tx, 0);
+        entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+        delta.AddCoins(txidStray, entry.coins);
+        BOOST_REQUIRE(coinsdb.BatchWrite(mapCoins, uint256(0), delta));
+        BOOST_REQUIRE(zerocoindb.WriteAccumulatorValue(8, CBigNum(5678)));
+
+        CSnapshotInfo infoLoad;
+        BOOST_REQUIRE_MESSAGE(LoadChainstateSnapshot(path, coinsdb, blocktree, zerocoindb, infoLoad, strError), strError);
+        BOOST_CHECK(infoLoad.hashMuHash == info.hashMuHash);
+        BOOST_CHECK(coinsdb.GetBestBlock() == info.hashBase);
+        BOOST_CHECK(!coinsdb.HaveCoins(txidStray));
+        CBigNum bnValue;
+        BOOST_CHECK(!zerocoindb.ReadAccumulatorValue(8, bnValue));
+        BOOST_CHECK(zerocoindb.ReadAccumulatorValue(7, bnValue) && bnValue == CBigNum(1234));
+    }
+
+    // a changed byte fails the hash before anything is written
+    {
+        std::vector<char> vData(boost::filesystem::file_size(path));
+        FILE* file = fopen(path.string().c_str(), "rb");
+        BOOST_REQUIRE(file && fread(&vData[0], 1, vData.size(), file) == vData.size());
+        fclose(file);
+        vData[vData.size() / 2] ^= 1;
+        boost::filesystem::path pathCorrupt = pathTemp / "utxo_corrupt.dat";
+        file = fopen(pathCorrupt.string().c_str(), "wb");
+        BOOST_REQUIRE(file && fwrite(&vData[0], 1, vData.size(), file) == vData.size());
+        fclose(file);
+
+        CCoinsViewDB coinsdb(1 << 20, true);
+        CBlockTreeDB blocktree(1 << 20, true);
+        CZerocoinDB zerocoindb(1 << 20, true);
+        CSnapshotInfo infoLoad;
+        BOOST_CHECK(!LoadChainstateSnapshot(pathCorrupt, coinsdb, blocktree, zerocoindb, infoLoad, strError));
+        BOOST_CHECK(coinsdb.GetBestBlock() == uint256(0));
+    }
+
+    delete zerocoinDB;
+    zerocoinDB = NULL;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,6 +7,8 @@
 
 #include "test_simplicity.h"
 
+#include "crypto/sha256.h"
+#include "flushscheduler.h"
 #include "main.h"
 #include "random.h"
 #include "txdb.h"
@@ -27,6 +29,7 @@ extern void noui_connect();
 
 BasicTestingSetup::BasicTestingSetup()
 {
+        SHA256AutoDetect();
         ECC_Start();
         SetupEnvironment();
         fPrintToDebugLog = false; // don't want to write to debug.log file
@@ -50,6 +53,7 @@ TestingSetup::TestingSetup()
         pblocktree = new CBlockTreeDB(1 << 20, true);
         pcoinsdbview = new CCoinsViewDB(1 << 23, true);
         pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+        flushscheduler.SetDatabases(pblocktree, pcoinsdbview, NULL, 0);
         InitBlockIndex();
 #ifdef ENABLE_WALLET
         bool fFirstRun;
@@ -74,6 +78,7 @@ TestingSetup::~TestingSetup()
         pwalletMain = NULL;
 #endif
         UnloadBlockIndex();
+        flushscheduler.SetDatabases(NULL, NULL, NULL, 0);
         delete pcoinsTip;
         delete pcoinsdbview;
         delete pblocktree;
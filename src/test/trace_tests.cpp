@@ -0,0 +1,101 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "trace.h"
+#include "test/test_simplicity.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+#include <univalue.h>
+
+BOOST_FIXTURE_TEST_SUITE(trace_tests, BasicTestingSetup)
+
+static int CountEvents(const UniValue& trace, const std::string& strName)
+{
+    int nCount = 0;
+    const UniValue& events = trace["traceEvents"];
+    for (unsigned int i = 0; i < events.size(); i++) {
+        if (events[i]["ph"].get_str() == "X" && events[i]["name"].get_str() == strName)
+            nCount++;
+    }
+    return nCount;
+}
+
+static void TraceThread(int nEvents)
+{
+    for (int i = 0; i < nEvents; i++) {
+        CTraceScope trace("test", "thread");
+        trace.SetArg("n", i);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(trace_disabled)
+{
+    StopTrace();
+    int64_t nRecorded = TraceStatus()["recorded"].get_int64();
+    {
+        TRACE_SCOPE("test", "disabled");
+    }
+    TraceEvent("test", "disabled", GetTimeMicros(), 1);
+    BOOST_CHECK_EQUAL(TraceStatus()["recorded"].get_int64(), nRecorded);
+    BOOST_CHECK_EQUAL(CountEvents(TraceToJSON(), "disabled"), 0);
+}
+
+BOOST_AUTO_TEST_CASE(trace_session)
+{
+    StartTrace();
+    BOOST_CHECK(TraceStatus()["enabled"].get_bool());
+    {
+        CTraceScope trace("test", "scope");
+        BOOST_CHECK(trace.IsActive());
+        trace.SetName(TraceIntern("renamed"));
+        trace.SetArg("txs", 42);
+    }
+    BOOST_CHECK(TraceIntern("renamed") == TraceIntern(std::string("renamed")));
+
+    UniValue trace = TraceToJSON();
+    BOOST_CHECK_EQUAL(CountEvents(trace, "renamed"), 1);
+    const UniValue& events = trace["traceEvents"];
+    for (unsigned int i = 0; i < events.size(); i++) {
+        if (events[i]["name"].get_str() != "renamed")
+            continue;
+        BOOST_CHECK_EQUAL(events[i]["cat"].get_str(), "test");
+        BOOST_CHECK_EQUAL(events[i]["args"]["txs"].get_int64(), 42);
+        BOOST_CHECK(events[i]["dur"].get_int64() >= 0);
+    }
+
+    // a new session drops the events of the last one
+    StopTrace();
+    MilliSleep(2);
+    StartTrace();
+    BOOST_CHECK_EQUAL(CountEvents(TraceToJSON(), "renamed"), 0);
+    StopTrace();
+}
+
+BOOST_AUTO_TEST_CASE(trace_threads)
+{
+    // the buffers of threads created from now on keep four events
+    SetTraceBufferSize(4);
+    StartTrace();
+    boost::thread_group threads;
+    for (int i = 0; i < 4; i++)
+        threads.create_thread(boost::bind(&TraceThread, i == 0 ? 100 : 3));
+    threads.join_all();
+    StopTrace();
+    SetTraceBufferSize(DEFAULT_TRACE_BUFFER);
+
+    UniValue trace = TraceToJSON();
+    BOOST_CHECK_EQUAL(CountEvents(trace, "thread"), 4 + 3 * 3);
+    // the thread that overwrote its buffer kept its last four events
+    int nLast = 0;
+    const UniValue& events = trace["traceEvents"];
+    for (unsigned int i = 0; i < events.size(); i++) {
+        if (events[i]["name"].get_str() == "thread" && events[i]["args"]["n"].get_int64() >= 96)
+            nLast++;
+    }
+    BOOST_CHECK_EQUAL(nLast, 4);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
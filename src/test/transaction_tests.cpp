@@ -7,6 +7,7 @@
 #include "data/tx_valid.json.h"
 #include "test/test_simplicity.h"
 
+#include "checkqueue.h"
 #include "clientversion.h"
 #include "key.h"
 #include "keystore.h"
@@ -22,7 +23,9 @@
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/assign/list_of.hpp>
+#include <boost/bind.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 #include <boost/assign/list_of.hpp>
 
 #include <univalue.h>
@@ -394,4 +397,63 @@ BOOST_AUTO_TEST_CASE(test_IsStandard)
     BOOST_CHECK(!IsStandardTx(t, reason));
 }
 
+BOOST_AUTO_TEST_CASE(test_batched_script_checks)
+{
+    // pay-to-pubkey and pay-to-pubkey-hash defer their signature to the worker batch,
+    // multisig is checked inline
+    CBasicKeyStore keystore;
+    CMutableTransaction txFrom;
+    for (int i = 0; i < 20; i++) {
+        CKey key;
+        key.MakeNewKey(i % 2 == 0);
+        keystore.AddKey(key);
+        CScript script;
+        if (i % 5 == 4)
+            script = GetScriptForMultisig(1, std::vector<CPubKey>(1, key.GetPubKey()));
+        else if (i % 3 == 0)
+            script = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+        else
+            script = GetScriptForDestination(key.GetPubKey().GetID());
+        txFrom.vout.push_back(CTxOut(COIN, script));
+    }
+    CCoins coins(txFrom, 0);
+
+    CMutableTransaction txTo;
+    for (unsigned int i = 0; i < txFrom.vout.size(); i++)
+        txTo.vin.push_back(CTxIn(COutPoint(txFrom.GetHash(), i)));
+    txTo.vout.push_back(CTxOut(20 * COIN, CScript() << OP_TRUE));
+    for (unsigned int i = 0; i < txTo.vin.size(); i++)
+        BOOST_REQUIRE(SignSignature(keystore, txFrom, txTo, i));
+
+    // all valid, then a bad pay-to-pubkey, pay-to-pubkey-hash and multisig signature,
+    // on the master alone and with workers that each keep a batch
+    typedef CCheckQueue<CScriptCheck, CSignatureBatch> Queue;
+    const int vThreads[] = {1, 4};
+    for (int nThreads : vThreads) {
+        Queue queue(128);
+        boost::thread_group workers;
+        for (int i = 1; i < nThreads; i++)
+            workers.create_thread(boost::bind(&Queue::Thread, &queue));
+        const int vBad[] = {-1, 0, 1, 4};
+        for (int nBad : vBad) {
+            CMutableTransaction txBad(txTo);
+            // a byte of the signature's R value
+            if (nBad >= 0)
+                txBad.vin[nBad].scriptSig[nBad % 5 == 4 ? 11 : 10] ^= 1;
+            const CTransaction tx(txBad);
+            std::vector<CScriptCheck> vChecks;
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
+                CScriptCheck check(coins, tx, i, MANDATORY_SCRIPT_VERIFY_FLAGS, false);
+                vChecks.push_back(CScriptCheck());
+                check.swap(vChecks.back());
+            }
+            CCheckQueueControl<CScriptCheck, CSignatureBatch> control(&queue);
+            control.Add(vChecks);
+            BOOST_CHECK_EQUAL(control.Wait(), nBad < 0);
+        }
+        workers.interrupt_all();
+        workers.join_all();
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
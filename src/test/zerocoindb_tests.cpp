@@ -0,0 +1,75 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txdb.h"
+#include "test_simplicity.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(zerocoindb_tests, BasicTestingSetup)
+
+static std::pair<CZerocoinSpendPos, CZerocoinSpendInfo> MakeEntry(int nHeight, unsigned char nTx, uint32_t nIn)
+{
+    CZerocoinSpendInfo info;
+    info.bnSerial = CBigNum(nHeight * 1000 + nTx * 10 + nIn);
+    info.nDenomination = 5;
+    info.fPublicSpend = nIn % 2;
+    return std::make_pair(CZerocoinSpendPos(nHeight, uint256(nTx), nIn), info);
+}
+
+BOOST_AUTO_TEST_CASE(zerocoindb_spend_index)
+{
+    CZerocoinDB db(1 << 20, true);
+    BOOST_CHECK(!db.ReadSpendIndexComplete());
+
+    // heights past one byte check the big-endian key order
+    ZerocoinSpendIndex vWrite;
+    vWrite.push_back(MakeEntry(300, 2, 0));
+    vWrite.push_back(MakeEntry(2, 9, 1));
+    vWrite.push_back(MakeEntry(300, 1, 1));
+    vWrite.push_back(MakeEntry(256, 3, 0));
+    vWrite.push_back(MakeEntry(70000, 4, 0));
+    BOOST_CHECK(db.WriteSpendIndexBatch(vWrite));
+
+    ZerocoinSpendIndex vRead;
+    BOOST_CHECK(db.ReadSpendIndex(3, 300, vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), 3U);
+    BOOST_CHECK_EQUAL(vRead[0].first.nHeight, 256);
+    BOOST_CHECK(vRead[1].first.nHeight == 300 && vRead[1].first.txid == uint256(1));
+    BOOST_CHECK(vRead[2].first.nHeight == 300 && vRead[2].first.txid == uint256(2));
+    BOOST_CHECK(vRead[1].second.bnSerial == CBigNum(300011));
+    BOOST_CHECK(vRead[1].second.fPublicSpend);
+    BOOST_CHECK_EQUAL(vRead[2].second.nDenomination, 5);
+
+    BOOST_CHECK(db.EraseSpendIndex(300));
+    vRead.clear();
+    BOOST_CHECK(db.ReadSpendIndex(0, 100000, vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), 3U);
+    BOOST_CHECK_EQUAL(vRead[0].first.nHeight, 2);
+    BOOST_CHECK_EQUAL(vRead[1].first.nHeight, 256);
+    BOOST_CHECK_EQUAL(vRead[2].first.nHeight, 70000);
+
+    // the wipe only erases serial index keys
+    BOOST_CHECK(db.WriteAccumulatorValue(7, CBigNum(77)));
+    BOOST_CHECK(db.WriteSpendIndexComplete(true));
+    BOOST_CHECK(db.ReadSpendIndexComplete());
+    BOOST_CHECK(db.WipeSpendIndex());
+    BOOST_CHECK(!db.ReadSpendIndexComplete());
+    vRead.clear();
+    BOOST_CHECK(db.ReadSpendIndex(0, 100000, vRead));
+    BOOST_CHECK(vRead.empty());
+    CBigNum bnValue;
+    BOOST_CHECK(db.ReadAccumulatorValue(7, bnValue));
+    BOOST_CHECK(bnValue == CBigNum(77));
+}
+
+BOOST_AUTO_TEST_CASE(zerocoindb_spend_pos_order)
+{
+    BOOST_CHECK(CZerocoinSpendPos(2, uint256(9), 5) < CZerocoinSpendPos(3, uint256(1), 0));
+    BOOST_CHECK(CZerocoinSpendPos(3, uint256(1), 300) < CZerocoinSpendPos(3, uint256(2), 0));
+    BOOST_CHECK(CZerocoinSpendPos(3, uint256(2), 1) < CZerocoinSpendPos(3, uint256(2), 256));
+    BOOST_CHECK(!(CZerocoinSpendPos(3, uint256(2), 1) < CZerocoinSpendPos(3, uint256(2), 1)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,248 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "trace.h"
+
+#include "tinyformat.h"
+
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <vector>
+
+#if defined(HAVE_CONFIG_H)
+#include "config/simplicity-config.h"
+#endif
+
+#ifdef HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>
+#endif
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <univalue.h>
+
+std::atomic<bool> fTraceEnabled(false);
+
+namespace
+{
+struct CTraceEvent {
+    std::atomic<const char*> pszCategory;
+    std::atomic<const char*> pszName;
+    std::atomic<const char*> pszArg;
+    std::atomic<int64_t> nStart;
+    std::atomic<int64_t> nDuration;
+    std::atomic<int64_t> nArg;
+};
+
+/**
+ * Written only by its thread. nBegun is raised before an event slot is overwritten and nWritten
+ * after it, so an exporting thread can tell which of the events it copied were not changed.
+ */
+struct CTraceBuffer {
+    const int nThread;
+    const unsigned int nSize;
+    std::string strThreadName;
+    std::unique_ptr<CTraceEvent[]> events;
+    std::atomic<uint64_t> nBegun;
+    std::atomic<uint64_t> nWritten;
+
+    CTraceBuffer(int nThreadIn, unsigned int nSizeIn) : nThread(nThreadIn), nSize(nSizeIn), events(new CTraceEvent[nSizeIn]()), nBegun(0), nWritten(0) {}
+};
+
+struct CTraceEventCopy {
+    const char* pszCategory;
+    const char* pszName;
+    const char* pszArg;
+    int64_t nStart;
+    int64_t nDuration;
+    int64_t nArg;
+};
+
+boost::mutex csTrace;
+//! kept for the lifetime of the process, the threads that filled them may have exited
+std::vector<CTraceBuffer*> vTraceBuffers;
+std::set<std::string> setTraceNames;
+std::atomic<unsigned int> nTraceBufferSize(DEFAULT_TRACE_BUFFER);
+std::atomic<int64_t> nTraceSessionStart(0);
+
+void KeepTraceBuffer(CTraceBuffer*)
+{
+}
+
+boost::thread_specific_ptr<CTraceBuffer> ptrTraceBuffer(KeepTraceBuffer);
+//! set for threads that came after MAX_TRACE_THREADS
+boost::thread_specific_ptr<bool> ptrTraceUntraced;
+
+CTraceBuffer* GetTraceBuffer()
+{
+    CTraceBuffer* buffer = ptrTraceBuffer.get();
+    if (buffer || ptrTraceUntraced.get())
+        return buffer;
+
+    boost::unique_lock<boost::mutex> lock(csTrace);
+    if (vTraceBuffers.size() >= MAX_TRACE_THREADS) {
+        ptrTraceUntraced.reset(new bool(true));
+        return NULL;
+    }
+    buffer = new CTraceBuffer(vTraceBuffers.size() + 1, std::max(1U, nTraceBufferSize.load()));
+#if defined(PR_GET_NAME)
+    char name[17] = {0};
+    if (::prctl(PR_GET_NAME, name, 0, 0, 0) == 0)
+        buffer->strThreadName = name;
+#endif
+    if (buffer->strThreadName.empty())
+        buffer->strThreadName = strprintf("thread %d", buffer->nThread);
+    vTraceBuffers.push_back(buffer);
+    ptrTraceBuffer.reset(buffer);
+    return buffer;
+}
+
+/** The events of a buffer that were recorded after nSince and not overwritten while copying */
+void CopyTraceEvents(const CTraceBuffer& buffer, int64_t nSince, std::vector<CTraceEventCopy>& vEvents)
+{
+    uint64_t nEnd = buffer.nWritten.load(std::memory_order_acquire);
+    uint64_t nBegin = nEnd > buffer.nSize ? nEnd - buffer.nSize : 0;
+    std::vector<CTraceEventCopy> vCopied;
+    vCopied.reserve(nEnd - nBegin);
+    for (uint64_t n = nBegin; n < nEnd; n++) {
+        const CTraceEvent& event = buffer.events[n % buffer.nSize];
+        CTraceEventCopy copy;
+        copy.pszCategory = event.pszCategory.load(std::memory_order_relaxed);
+        copy.pszName = event.pszName.load(std::memory_order_relaxed);
+        copy.pszArg = event.pszArg.load(std::memory_order_relaxed);
+        copy.nStart = event.nStart.load(std::memory_order_relaxed);
+        copy.nDuration = event.nDuration.load(std::memory_order_relaxed);
+        copy.nArg = event.nArg.load(std::memory_order_relaxed);
+        vCopied.push_back(copy);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t nBegun = buffer.nBegun.load(std::memory_order_relaxed);
+    uint64_t nValid = nBegun > buffer.nSize ? nBegun - buffer.nSize : 0;
+    for (uint64_t n = std::max(nBegin, nValid); n < nEnd; n++) {
+        const CTraceEventCopy& copy = vCopied[n - nBegin];
+        if (copy.nStart >= nSince)
+            vEvents.push_back(copy);
+    }
+}
+}
+
+void SetTraceBufferSize(unsigned int nSize)
+{
+    nTraceBufferSize = nSize;
+}
+
+void StartTrace()
+{
+    nTraceSessionStart = GetTimeMicros();
+    fTraceEnabled = true;
+}
+
+void StopTrace()
+{
+    fTraceEnabled = false;
+}
+
+void TraceEvent(const char* pszCategory, const char* pszName, int64_t nStartMicros, int64_t nDurationMicros, const char* pszArg, int64_t nArg)
+{
+    if (!fTraceEnabled.load(std::memory_order_relaxed))
+        return;
+    CTraceBuffer* buffer = GetTraceBuffer();
+    if (!buffer)
+        return;
+
+    uint64_t n = buffer->nWritten.load(std::memory_order_relaxed);
+    buffer->nBegun.store(n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    CTraceEvent& event = buffer->events[n % buffer->nSize];
+    event.pszCategory.store(pszCategory, std::memory_order_relaxed);
+    event.pszName.store(pszName, std::memory_order_relaxed);
+    event.pszArg.store(pszArg, std::memory_order_relaxed);
+    event.nStart.store(nStartMicros, std::memory_order_relaxed);
+    event.nDuration.store(nDurationMicros, std::memory_order_relaxed);
+    event.nArg.store(nArg, std::memory_order_relaxed);
+    buffer->nWritten.store(n + 1, std::memory_order_release);
+}
+
+const char* TraceIntern(const std::string& str)
+{
+    boost::unique_lock<boost::mutex> lock(csTrace);
+    std::set<std::string>::const_iterator it = setTraceNames.find(str);
+    if (it == setTraceNames.end()) {
+        if (setTraceNames.size() >= MAX_TRACE_NAMES)
+            return "other";
+        it = setTraceNames.insert(str).first;
+    }
+    return it->c_str();
+}
+
+UniValue TraceToJSON()
+{
+    std::vector<CTraceBuffer*> vBuffers;
+    {
+        boost::unique_lock<boost::mutex> lock(csTrace);
+        vBuffers = vTraceBuffers;
+    }
+    int64_t nSince = nTraceSessionStart.load();
+
+    UniValue events(UniValue::VARR);
+    for (const CTraceBuffer* buffer : vBuffers) {
+        std::vector<CTraceEventCopy> vEvents;
+        CopyTraceEvents(*buffer, nSince, vEvents);
+        if (vEvents.empty())
+            continue;
+
+        UniValue meta(UniValue::VOBJ);
+        meta.push_back(Pair("name", "thread_name"));
+        meta.push_back(Pair("ph", "M"));
+        meta.push_back(Pair("pid", 1));
+        meta.push_back(Pair("tid", buffer->nThread));
+        UniValue metaArgs(UniValue::VOBJ);
+        metaArgs.push_back(Pair("name", buffer->strThreadName));
+        meta.push_back(Pair("args", metaArgs));
+        events.push_back(meta);
+
+        for (const CTraceEventCopy& copy : vEvents) {
+            UniValue event(UniValue::VOBJ);
+            event.push_back(Pair("name", copy.pszName));
+            event.push_back(Pair("cat", copy.pszCategory));
+            event.push_back(Pair("ph", "X"));
+            event.push_back(Pair("ts", copy.nStart));
+            event.push_back(Pair("dur", copy.nDuration));
+            event.push_back(Pair("pid", 1));
+            event.push_back(Pair("tid", buffer->nThread));
+            if (copy.pszArg) {
+                UniValue args(UniValue::VOBJ);
+                args.push_back(Pair(copy.pszArg, copy.nArg));
+                event.push_back(Pair("args", args));
+            }
+            events.push_back(event);
+        }
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("traceEvents", events));
+    result.push_back(Pair("displayTimeUnit", "ms"));
+    return result;
+}
+
+UniValue TraceStatus()
+{
+    std::vector<CTraceBuffer*> vBuffers;
+    {
+        boost::unique_lock<boost::mutex> lock(csTrace);
+        vBuffers = vTraceBuffers;
+    }
+    uint64_t nRecorded = 0;
+    for (const CTraceBuffer* buffer : vBuffers)
+        nRecorded += buffer->nWritten.load(std::memory_order_relaxed);
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("enabled", fTraceEnabled.load()));
+    result.push_back(Pair("buffersize", (int64_t)nTraceBufferSize.load()));
+    result.push_back(Pair("threads", (int64_t)vBuffers.size()));
+    result.push_back(Pair("recorded", nRecorded));
+    return result;
+}
@@ -0,0 +1,77 @@
+// Copyright (c) 2018-2019 The Simplicity developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SIMPLICITY_TRACE_H
+#define SIMPLICITY_TRACE_H
+
+#include "utiltime.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+#include <boost/preprocessor/cat.hpp>
+
+class UniValue;
+
+/** Events kept by each thread while tracing, older ones are overwritten */
+static const unsigned int DEFAULT_TRACE_BUFFER = 16384;
+/** Threads that can record events, later ones are not traced */
+static const unsigned int MAX_TRACE_THREADS = 256;
+/** Names interned for events, later ones are recorded as "other" */
+static const unsigned int MAX_TRACE_NAMES = 256;
+
+/** Read on every traced scope, so a disabled trace costs a relaxed load */
+extern std::atomic<bool> fTraceEnabled;
+
+/** Events per thread of the buffers created after this, set before tracing starts */
+void SetTraceBufferSize(unsigned int nSize);
+/** Start a trace session, the events of earlier sessions are no longer exported */
+void StartTrace();
+void StopTrace();
+
+/**
+ * Record a completed span to the ring buffer of this thread, without locking. The category,
+ * name and argument name are kept as pointers: string literals, or names from TraceIntern.
+ */
+void TraceEvent(const char* pszCategory, const char* pszName, int64_t nStartMicros, int64_t nDurationMicros, const char* pszArg = NULL, int64_t nArg = 0);
+/** A name for events that is only known at runtime, from a bounded set that no peer controls */
+const char* TraceIntern(const std::string& str);
+
+/** The events of the current session in the Chrome trace event format, which Perfetto loads */
+UniValue TraceToJSON();
+UniValue TraceStatus();
+
+/** Record the time spent in a scope while tracing is enabled */
+class CTraceScope
+{
+private:
+    const char* pszCategory;
+    const char* pszName;
+    const char* pszArg;
+    int64_t nArg;
+    int64_t nStart;
+
+public:
+    CTraceScope(const char* pszCategoryIn, const char* pszNameIn) : pszCategory(pszCategoryIn), pszName(pszNameIn), pszArg(NULL), nArg(0),
+                                                                   nStart(fTraceEnabled.load(std::memory_order_relaxed) ? GetTimeMicros() : 0) {}
+
+    ~CTraceScope()
+    {
+        if (nStart)
+            TraceEvent(pszCategory, pszName, nStart, GetTimeMicros() - nStart, pszArg, nArg);
+    }
+
+    bool IsActive() const { return nStart != 0; }
+    void SetName(const char* pszNameIn) { pszName = pszNameIn; }
+    void SetArg(const char* pszArgIn, int64_t nArgIn)
+    {
+        pszArg = pszArgIn;
+        nArg = nArgIn;
+    }
+};
+
+#define TRACE_SCOPE(category, name) CTraceScope BOOST_PP_CAT(trace_, __LINE__)(category, name)
+
+#endif // SIMPLICITY_TRACE_H
@@ -6,12 +6,14 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "txdb.h"
+#include "blockstats.h"
 
 #include "main.h"
 #include "pow.h"
 #include "uint256.h"
 #include "zspl/accumulators.h"
 
+#include <limits>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
@@ -30,8 +32,17 @@ void static BatchWriteHashBestChain(CLevelDBBatch& batch, const uint256& hash)
     batch.Write('B', hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", DBOptionsFromArgs("chainstate", nCacheSize), fMemory, fWipe), fCommitment(false), nWriteCount(0), nJournalDurable(0)
 {
+    // an empty database commits to the empty set, an older one needs a rebuild
+    std::pair<uint256, CCoinsCommitment> stored;
+    uint256 hashBestChain = GetBestBlock();
+    if (hashBestChain == uint256(0))
+        fCommitment = true;
+    else if (db.Read('M', stored) && stored.first == hashBestChain) {
+        fCommitment = true;
+        commitment = stored.second;
+    }
 }
 
 bool CCoinsViewDB::GetCoins(const uint256& txid, CCoins& coins) const
@@ -44,6 +55,24 @@ bool CCoinsViewDB::HaveCoins(const uint256& txid) const
     return db.Exists(std::make_pair('c', txid));
 }
 
+size_t CCoinsViewDB::GetCoinsMany(const std::vector<uint256>& vTxid, std::vector<std::pair<uint256, CCoins> >& vFound) const
+{
+    std::vector<std::pair<char, uint256> > vKeys;
+    vKeys.reserve(vTxid.size());
+    for (const uint256& txid : vTxid)
+        vKeys.push_back(std::make_pair('c', txid));
+
+    std::vector<std::pair<std::pair<char, uint256>, CCoins> > vRead;
+    db.ReadMany(vKeys, vRead);
+    vFound.clear();
+    vFound.reserve(vRead.size());
+    for (std::pair<std::pair<char, uint256>, CCoins>& entry : vRead) {
+        vFound.push_back(std::make_pair(entry.first.second, CCoins()));
+        vFound.back().second.swap(entry.second);
+    }
+    return vFound.size();
+}
+
 uint256 CCoinsViewDB::GetBestBlock() const
 {
     uint256 hashBestChain;
@@ -52,8 +81,9 @@ uint256 CCoinsViewDB::GetBestBlock() const
     return hashBestChain;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsCommitment& delta)
 {
+    LOCK(cs_commitment);
     CLevelDBBatch batch;
     size_t count = 0;
     size_t changed = 0;
@@ -69,11 +99,95 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
     if (hashBlock != uint256(0))
         BatchWriteHashBestChain(batch, hashBlock);
 
+    for (std::set<uint64_t>::iterator it = setJournal.begin(); it != setJournal.end() && *it <= nJournalDurable;) {
+        batch.Erase(std::make_pair('J', *it));
+        setJournal.erase(it++);
+    }
+    for (const std::pair<uint64_t, CBlockIndexJournal>& entry : vJournalPending) {
+        batch.Write(std::make_pair('J', entry.first), entry.second);
+        setJournal.insert(entry.first);
+    }
+    vJournalPending.clear();
+
+    if (fCommitment) {
+        commitment += delta;
+        commitment.muhash.Normalize();
+        uint256 hashCommitment = hashBlock != uint256(0) ? hashBlock : GetBestBlock();
+        batch.Write('M', std::make_pair(hashCommitment, commitment));
+    } else {
+        commitmentPending += delta;
+    }
+
     LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    bool ret = db.WriteBatch(batch);
+    nWriteCount++;
+    return ret;
+}
+
+bool CCoinsViewDB::Wipe()
+{
+    LOCK(cs_commitment);
+    if (!db.EraseAll())
+        return false;
+    fCommitment = true;
+    commitment = CCoinsCommitment();
+    commitmentPending = CCoinsCommitment();
+    vJournalPending.clear();
+    setJournal.clear();
+    nJournalDurable = 0;
+    nWriteCount++;
+    return true;
+}
+
+void CCoinsViewDB::WriteJournal(uint64_t nEpoch, const CBlockIndexJournal& journal, uint64_t nDurableEpoch)
+{
+    LOCK(cs_commitment);
+    vJournalPending.push_back(std::make_pair(nEpoch, journal));
+    nJournalDurable = std::max(nJournalDurable, nDurableEpoch);
+}
+
+bool CCoinsViewDB::ReadJournal(std::map<uint64_t, CBlockIndexJournal>& mapJournal) const
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << 'J';
+    pcursor->Seek(ssKeySet.str());
+
+    for (; pcursor->Valid(); pcursor->Next()) {
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != 'J')
+                break;
+            uint64_t nEpoch;
+            ssKey >> nEpoch;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            ssValue >> mapJournal[nEpoch];
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return true;
+}
+
+bool CCoinsViewDB::EraseJournal()
+{
+    LOCK(cs_commitment);
+    std::map<uint64_t, CBlockIndexJournal> mapJournal;
+    if (!ReadJournal(mapJournal))
+        return false;
+    CLevelDBBatch batch;
+    for (const std::pair<uint64_t, CBlockIndexJournal>& entry : mapJournal)
+        batch.Erase(std::make_pair('J', entry.first));
+    setJournal.clear();
+    return db.WriteBatch(batch, true);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", DBOptionsFromArgs("blockindex", nCacheSize), fMemory, fWipe)
 {
 }
 
@@ -82,6 +196,14 @@ bool CBlockTreeDB::WriteBlockIndex(const CDiskBlockIndex& blockindex)
     return Write(std::make_pair('b', blockindex.GetBlockHash()), blockindex);
 }
 
+bool CBlockTreeDB::WriteBlockIndex(const std::vector<CDiskBlockIndex>& vIndex)
+{
+    CLevelDBBatch batch;
+    for (const CDiskBlockIndex& blockindex : vIndex)
+        batch.Write(std::make_pair('b', blockindex.GetBlockHash()), blockindex);
+    return WriteBatch(batch);
+}
+
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo& info)
 {
     return Read(std::make_pair('f', nFile), info);
@@ -106,16 +228,30 @@ bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
     return Read('l', nFile);
 }
 
-bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
+bool CCoinsViewDB::GetCommitment(CCoinsCommitment& commitmentOut) const
+{
+    LOCK(cs_commitment);
+    if (!fCommitment)
+        return false;
+    commitmentOut = commitment;
+    return true;
+}
+
+bool CCoinsViewDB::HaveCommitment() const
+{
+    LOCK(cs_commitment);
+    return fCommitment;
+}
+
+bool CCoinsViewDB::ScanStats(const CLevelDBSnapshot& snapshot, CCoinsStats& stats, CCoinsCommitment& scanned) const
 {
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
-    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
+    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator(snapshot));
     pcursor->SeekToFirst();
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
     CAmount nTotalAmount = 0;
     while (pcursor->Valid()) {
@@ -148,28 +284,155 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
                 }
                 stats.nSerializedSize += 32 + slValue.size();
                 ss << VARINT(0);
+                scanned.AddCoins(txhash, coins);
             }
             pcursor->Next();
         } catch (std::exception& e) {
             return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
     }
-    stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
     stats.hashSerialized = ss.GetHash();
     stats.nTotalAmount = nTotalAmount;
+    stats.hashMuHash = scanned.muhash.Finalize();
     return true;
 }
 
-bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
+bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
+{
+    boost::scoped_ptr<CLevelDBSnapshot> snapshot;
+    {
+        LOCK(cs_commitment);
+        snapshot.reset(new CLevelDBSnapshot(db));
+        stats.hashBlock = GetBestBlock();
+        stats.fCommitment = fCommitment;
+        if (fCommitment)
+            stats.commitment = commitment;
+    }
+    CCoinsCommitment scanned;
+    return ScanStats(*snapshot, stats, scanned);
+}
+
+/** Cursor over the coins of a snapshot of the coin database */
+class CCoinsViewDBCursor : public CCoinsViewCursor
+{
+private:
+    boost::scoped_ptr<CLevelDBSnapshot> snapshot;
+    boost::scoped_ptr<leveldb::Iterator> pcursor;
+    uint256 txid;
+
+    void ReadKey()
+    {
+        txid = uint256(0);
+        if (!pcursor->Valid())
+            return;
+        leveldb::Slice slKey = pcursor->key();
+        CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+        char chType;
+        ssKey >> chType;
+        if (chType == 'c')
+            ssKey >> txid;
+    }
+
+public:
+    CCoinsViewDBCursor(CLevelDBSnapshot* snapshotIn, leveldb::Iterator* pcursorIn, const uint256& hashBlock, bool fCommitment, const CCoinsCommitment& commitment) : CCoinsViewCursor(hashBlock, fCommitment, commitment),
+                                                                                                                                                               snapshot(snapshotIn),
+                                                                                                                                                               pcursor(pcursorIn)
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey << 'c';
+        pcursor->Seek(ssKey.str());
+        ReadKey();
+    }
+
+    bool GetKey(uint256& txidOut) const
+    {
+        if (txid == 0)
+            return false;
+        txidOut = txid;
+        return true;
+    }
+
+    bool GetValue(CCoins& coins) const
+    {
+        if (txid == 0)
+            return false;
+        leveldb::Slice slValue = pcursor->value();
+        try {
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            ssValue >> coins;
+        } catch (const std::exception& e) {
+            return error("%s : Deserialize error - %s", __func__, e.what());
+        }
+        return true;
+    }
+
+    bool Valid() const { return txid != 0; }
+
+    void Next()
+    {
+        pcursor->Next();
+        ReadKey();
+    }
+};
+
+CCoinsViewCursor* CCoinsViewDB::Cursor() const
+{
+    LOCK(cs_commitment);
+    CLevelDBSnapshot* snapshot = new CLevelDBSnapshot(db);
+    leveldb::Iterator* pcursor = const_cast<CLevelDBWrapper*>(&db)->NewIterator(*snapshot);
+    return new CCoinsViewDBCursor(snapshot, pcursor, GetBestBlock(), fCommitment, commitment);
+}
+
+bool CCoinsViewDB::RebuildCommitment()
+{
+    boost::scoped_ptr<CLevelDBSnapshot> snapshot;
+    CCoinsStats stats;
+    {
+        LOCK(cs_commitment);
+        if (fCommitment)
+            return true;
+        snapshot.reset(new CLevelDBSnapshot(db));
+        stats.hashBlock = GetBestBlock();
+        commitmentPending = CCoinsCommitment();
+    }
+
+    LogPrintf("%s : computing the UTXO set commitment at block %s\n", __func__, stats.hashBlock.GetHex());
+    int64_t nStart = GetTimeMillis();
+    CCoinsCommitment scanned;
+    if (!ScanStats(*snapshot, stats, scanned))
+        return false;
+
+    LOCK(cs_commitment);
+    scanned += commitmentPending;
+    scanned.muhash.Normalize();
+    commitment = scanned;
+    commitmentPending = CCoinsCommitment();
+    fCommitment = true;
+    LogPrintf("%s : done in %dms, %d outputs\n", __func__, GetTimeMillis() - nStart, commitment.nTransactionOutputs);
+    return db.Write('M', std::make_pair(GetBestBlock(), commitment));
+}
+
+bool CBlockTreeDB::WriteJournal(const CBlockIndexJournal& journal, bool fSync)
+{
     CLevelDBBatch batch;
-    for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
-        batch.Write(std::make_pair('f', it->first), *it->second);
+    for (std::vector<std::pair<int, CBlockFileInfo> >::const_iterator it = journal.vFiles.begin(); it != journal.vFiles.end(); it++) {
+        batch.Write(std::make_pair('f', it->first), it->second);
     }
-    batch.Write('l', nLastFile);
-    for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
-        batch.Write(std::make_pair('b', (*it)->GetBlockHash()), CDiskBlockIndex(*it));
+    batch.Write('l', journal.nLastFile);
+    for (std::vector<std::pair<uint256, CDiskBlockIndex> >::const_iterator it = journal.vBlocks.begin(); it != journal.vBlocks.end(); it++) {
+        batch.Write(std::make_pair('b', it->first), it->second);
     }
-    return WriteBatch(batch, true);
+    return WriteBatch(batch, fSync);
+}
+
+bool CBlockTreeDB::WriteFlushEpoch(uint64_t nEpoch)
+{
+    return Write('E', nEpoch, true);
+}
+
+bool CBlockTreeDB::ReadFlushEpoch(uint64_t& nEpoch)
+{
+    return Read('E', nEpoch);
 }
 
 bool CBlockTreeDB::ReadTxIndex(const uint256& txid, CDiskTxPos& pos)
@@ -185,6 +448,125 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::HaveBlockStats(const uint256& hashBlock)
+{
+    return Exists(std::make_pair('S', hashBlock));
+}
+
+bool CBlockTreeDB::ReadBlockStats(const uint256& hashBlock, CBlockStats& stats)
+{
+    return Read(std::make_pair('S', hashBlock), stats);
+}
+
+bool CBlockTreeDB::WriteBlockStats(const uint256& hashBlock, const CBlockStats& stats)
+{
+    return Write(std::make_pair('S', hashBlock), stats);
+}
+
+bool CBlockTreeDB::ConnectAddressIndex(const CAddressIndexChanges& changes)
+{
+    CLevelDBBatch batch;
+    for (const std::pair<CAddressIndexKey, CAmount>& entry : changes.vAddressIndex)
+        batch.Write(std::make_pair('a', entry.first), entry.second);
+    // an output created and spent in the block ends up erased
+    for (const std::pair<CAddressUnspentKey, CAddressUnspentValue>& entry : changes.vUnspentCreated)
+        batch.Write(std::make_pair('u', entry.first), entry.second);
+    for (const std::pair<CAddressUnspentKey, CAddressUnspentValue>& entry : changes.vUnspentSpent)
+        batch.Erase(std::make_pair('u', entry.first));
+    for (const std::pair<CSpentIndexKey, CSpentIndexValue>& entry : changes.vSpentIndex)
+        batch.Write(std::make_pair('p', entry.first), entry.second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::DisconnectAddressIndex(const CAddressIndexChanges& changes)
+{
+    CLevelDBBatch batch;
+    for (const std::pair<CAddressIndexKey, CAmount>& entry : changes.vAddressIndex)
+        batch.Erase(std::make_pair('a', entry.first));
+    for (const std::pair<CAddressUnspentKey, CAddressUnspentValue>& entry : changes.vUnspentSpent)
+        batch.Write(std::make_pair('u', entry.first), entry.second);
+    for (const std::pair<CAddressUnspentKey, CAddressUnspentValue>& entry : changes.vUnspentCreated)
+        batch.Erase(std::make_pair('u', entry.first));
+    for (const std::pair<CSpentIndexKey, CSpentIndexValue>& entry : changes.vSpentIndex)
+        batch.Erase(std::make_pair('p', entry.first));
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressIndex(unsigned char nType, const uint160& hashBytes, AddressIndex& vEntries, int nStart, int nEnd)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << std::make_pair('a', CAddressIndexKey(nType, hashBytes, nStart, 0, 0, 0, false));
+    pcursor->Seek(ssKeySet.str());
+
+    for (; pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != 'a')
+                break;
+            CAddressIndexKey key;
+            ssKey >> key;
+            if (key.type != nType || key.hashBytes != hashBytes || (nEnd > 0 && key.nBlockHeight > nEnd))
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAmount nValue;
+            ssValue >> nValue;
+            vEntries.push_back(std::make_pair(key, nValue));
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(unsigned char nType, const uint160& hashBytes, AddressUnspentIndex& vEntries)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << std::make_pair('u', CAddressUnspentKey(nType, hashBytes, 0, 0));
+    pcursor->Seek(ssKeySet.str());
+
+    for (; pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != 'u')
+                break;
+            CAddressUnspentKey key;
+            ssKey >> key;
+            if (key.type != nType || key.hashBytes != hashBytes)
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAddressUnspentValue value;
+            ssValue >> value;
+            vEntries.push_back(std::make_pair(key, value));
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value)
+{
+    return Read(std::make_pair('p', key), value);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string& name, bool fValue)
 {
     return Write(std::make_pair('F', name), fValue ? '1' : '0');
@@ -209,6 +591,16 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
     return Read(std::make_pair('I', name), nValue);
 }
 
+bool CBlockTreeDB::WriteSnapshotBase(const uint256& hashBlock)
+{
+    return Write('H', hashBlock);
+}
+
+bool CBlockTreeDB::ReadSnapshotBase(uint256& hashBlock)
+{
+    return Read('H', hashBlock);
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts()
 {
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
@@ -295,7 +687,7 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
     return true;
 }
 
-CZerocoinDB::CZerocoinDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "zerocoin", nCacheSize, fMemory, fWipe)
+CZerocoinDB::CZerocoinDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "zerocoin", DBOptionsFromArgs("zerocoin", nCacheSize), fMemory, fWipe)
 {
 }
 
@@ -429,3 +821,94 @@ bool CZerocoinDB::EraseAccumulatorValue(const uint32_t& nChecksum)
     LogPrint("zero", "%s : checksum:%d\n", __func__, nChecksum);
     return Erase(std::make_pair('2', nChecksum));
 }
+
+bool CZerocoinDB::WriteSpendIndexBatch(const ZerocoinSpendIndex& vEntries)
+{
+    CLevelDBBatch batch;
+    for (const std::pair<CZerocoinSpendPos, CZerocoinSpendInfo>& entry : vEntries)
+        batch.Write(std::make_pair('h', entry.first), entry.second);
+
+    LogPrint("zero", "Writing %u serial index entries to db.\n", (unsigned int)vEntries.size());
+    return WriteBatch(batch);
+}
+
+bool CZerocoinDB::ReadSpendIndex(int nHeightStart, int nHeightEnd, ZerocoinSpendIndex& vEntries)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << std::make_pair('h', CZerocoinSpendPos(nHeightStart, 0, 0));
+    pcursor->Seek(ssKeySet.str());
+
+    for (; pcursor->Valid(); pcursor->Next()) {
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != 'h')
+                break;
+            CZerocoinSpendPos pos;
+            ssKey >> pos;
+            if (pos.nHeight > nHeightEnd)
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CZerocoinSpendInfo info;
+            ssValue >> info;
+            vEntries.push_back(std::make_pair(pos, info));
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
+bool CZerocoinDB::EraseSpendIndex(int nHeight)
+{
+    ZerocoinSpendIndex vEntries;
+    if (!ReadSpendIndex(nHeight, nHeight, vEntries))
+        return false;
+    if (vEntries.empty())
+        return true;
+
+    CLevelDBBatch batch;
+    for (const std::pair<CZerocoinSpendPos, CZerocoinSpendInfo>& entry : vEntries)
+        batch.Erase(std::make_pair('h', entry.first));
+    return WriteBatch(batch);
+}
+
+bool CZerocoinDB::WipeSpendIndex()
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << 'h';
+    pcursor->Seek(ssKeySet.str());
+
+    // only the keys are needed, the entries are not deserialized
+    CLevelDBBatch batch;
+    for (; pcursor->Valid(); pcursor->Next()) {
+        leveldb::Slice slKey = pcursor->key();
+        if (slKey.empty() || slKey[0] != 'h')
+            break;
+        batch.EraseSerialized(slKey.ToString());
+    }
+    if (!pcursor->status().ok())
+        return error("%s : iterator error - %s", __func__, pcursor->status().ToString());
+    batch.Erase(std::make_pair('F', std::string("spendindex")));
+    return WriteBatch(batch, true);
+}
+
+bool CZerocoinDB::WriteSpendIndexComplete(bool fComplete)
+{
+    return Write(std::make_pair('F', std::string("spendindex")), fComplete ? '1' : '0');
+}
+
+bool CZerocoinDB::ReadSpendIndexComplete()
+{
+    char ch;
+    return Read(std::make_pair('F', std::string("spendindex")), ch) && ch == '1';
+}
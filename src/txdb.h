@@ -7,15 +7,20 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "addressindex.h"
+#include "crypto/common.h"
 #include "leveldbwrapper.h"
 #include "main.h"
 #include "zspl/zerocoin.h"
 
+#include <atomic>
 #include <map>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
 
+class CBlockStats;
 class CCoins;
 class uint256;
 
@@ -26,20 +31,83 @@ static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 4096 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
 
+/**
+ * Block index and file info updates of one flush. They are written to the block tree
+ * without syncing and, ahead of that sync, into the same batch as the coins that refer
+ * to them, so the chainstate never gets ahead of a block index that survived a crash.
+ */
+struct CBlockIndexJournal {
+    std::vector<std::pair<int, CBlockFileInfo> > vFiles;
+    int nLastFile;
+    std::vector<std::pair<uint256, CDiskBlockIndex> > vBlocks;
+
+    CBlockIndexJournal() : nLastFile(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(vFiles);
+        READWRITE(nLastFile);
+        READWRITE(vBlocks);
+    }
+};
+
 /** CCoinsView backed by the LevelDB coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CLevelDBWrapper db;
 
+    //! orders batch writes against snapshots, so a snapshot matches a commitment
+    mutable CCriticalSection cs_commitment;
+    //! commitment of the best block, written with it
+    bool fCommitment;
+    CCoinsCommitment commitment;
+    //! changes written since the snapshot of a rebuild of the commitment
+    CCoinsCommitment commitmentPending;
+    //! batches written, counted once they are visible to readers
+    std::atomic<uint64_t> nWriteCount;
+    //! journal written with the next batch, and the epochs of those in the database
+    std::vector<std::pair<uint64_t, CBlockIndexJournal> > vJournalPending;
+    std::set<uint64_t> setJournal;
+    uint64_t nJournalDurable;
+
+    bool ScanStats(const CLevelDBSnapshot& snapshot, CCoinsStats& stats, CCoinsCommitment& scanned) const;
+
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
     bool GetCoins(const uint256& txid, CCoins& coins) const;
     bool HaveCoins(const uint256& txid) const;
     uint256 GetBestBlock() const;
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const CCoinsCommitment& delta);
+    bool GetCommitment(CCoinsCommitment& commitment) const;
+    /** Erase all coins and the journal, leaving an empty database */
+    bool Wipe();
+
+    /** Read the coins of many transactions at once, vFound holds those that exist */
+    size_t GetCoinsMany(const std::vector<uint256>& vTxid, std::vector<std::pair<uint256, CCoins> >& vFound) const;
+    /** Changes whenever a batch was written, coins read before it may be outdated */
+    uint64_t GetWriteCount() const { return nWriteCount; }
+    CCoinsViewCursor* Cursor() const;
+
+    //! Full scan of a snapshot, does not block writes
     bool GetStats(CCoinsStats& stats) const;
+
+    bool HaveCommitment() const;
+    /** Compute the commitment of a database written by a version that did not maintain it */
+    bool RebuildCommitment();
+
+    /**
+     * Write the block index journal of a flush epoch with the next BatchWrite. Journals of
+     * epochs up to nDurableEpoch are no longer needed and are erased with it.
+     */
+    void WriteJournal(uint64_t nEpoch, const CBlockIndexJournal& journal, uint64_t nDurableEpoch);
+    bool ReadJournal(std::map<uint64_t, CBlockIndexJournal>& mapJournal) const;
+    bool EraseJournal();
+    bool Sync() { return db.Sync(); }
 };
 
 /** Access to the block database (blocks/index/) */
@@ -54,20 +122,118 @@ private:
 
 public:
     bool WriteBlockIndex(const CDiskBlockIndex& blockindex);
-    bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
+    bool WriteBlockIndex(const std::vector<CDiskBlockIndex>& vIndex);
+    /** Write the updates of a flush, they are durable once a later write is synced */
+    bool WriteJournal(const CBlockIndexJournal& journal, bool fSync = false);
+    /** Last flush epoch whose block files and databases were synced */
+    bool WriteFlushEpoch(uint64_t nEpoch);
+    bool ReadFlushEpoch(uint64_t& nEpoch);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo& fileinfo);
     bool ReadLastBlockFile(int& nFile);
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool& fReindex);
     bool ReadTxIndex(const uint256& txid, CDiskTxPos& pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& list);
+    bool HaveBlockStats(const uint256& hashBlock);
+    bool ReadBlockStats(const uint256& hashBlock, CBlockStats& stats);
+    bool WriteBlockStats(const uint256& hashBlock, const CBlockStats& stats);
+    /** Write or erase the -addressindex and -spentindex entries of a block in one batch */
+    bool ConnectAddressIndex(const CAddressIndexChanges& changes);
+    bool DisconnectAddressIndex(const CAddressIndexChanges& changes);
+    /** Balance changes of an address in chain order, in the heights [nStart, nEnd] if nEnd is set */
+    bool ReadAddressIndex(unsigned char nType, const uint160& hashBytes, AddressIndex& vEntries, int nStart = 0, int nEnd = 0);
+    bool ReadAddressUnspentIndex(unsigned char nType, const uint160& hashBytes, AddressUnspentIndex& vEntries);
+    bool ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value);
     bool WriteFlag(const std::string& name, bool fValue);
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
     bool ReadInt(const std::string& name, int& nValue);
+    /** Base block of the chainstate snapshot the node was bootstrapped from */
+    bool WriteSnapshotBase(const uint256& hashBlock);
+    bool ReadSnapshotBase(uint256& hashBlock);
     bool LoadBlockIndexGuts();
 };
 
+/** Position of a zerocoin spend input, the key of the serial index.
+ * The height is serialized big-endian so the index iterates in (height, txid) order.
+ */
+class CZerocoinSpendPos
+{
+public:
+    int nHeight;
+    uint256 txid;
+    uint32_t nIn;
+
+    CZerocoinSpendPos() : nHeight(0), txid(0), nIn(0) {}
+    CZerocoinSpendPos(int nHeightIn, const uint256& txidIn, uint32_t nInIn) : nHeight(nHeightIn), txid(txidIn), nIn(nInIn) {}
+
+    friend bool operator<(const CZerocoinSpendPos& a, const CZerocoinSpendPos& b)
+    {
+        if (a.nHeight != b.nHeight)
+            return a.nHeight < b.nHeight;
+        if (a.txid != b.txid)
+            return a.txid < b.txid;
+        return a.nIn < b.nIn;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 4 + 32 + 4;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        unsigned char buf[4];
+        WriteBE32(buf, nHeight);
+        s.write((char*)buf, sizeof(buf));
+        s << txid;
+        s << nIn;
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned char buf[4];
+        s.read((char*)buf, sizeof(buf));
+        nHeight = ReadBE32(buf);
+        s >> txid;
+        s >> nIn;
+    }
+};
+
+/** Serial index entry of a zerocoin spend */
+class CZerocoinSpendInfo
+{
+public:
+    CBigNum bnSerial;
+    int nDenomination;
+    bool fPublicSpend;
+    //! first output of the spending transaction
+    CTxOut txoutSpentTo;
+
+    CZerocoinSpendInfo() : bnSerial(0), nDenomination(0), fPublicSpend(false) {}
+    CZerocoinSpendInfo(const CBigNum& bnSerialIn, libzerocoin::CoinDenomination denom, bool fPublicSpendIn, const CTransaction& tx)
+        : bnSerial(bnSerialIn), nDenomination(libzerocoin::ZerocoinDenominationToInt(denom)), fPublicSpend(fPublicSpendIn)
+    {
+        if (!tx.vout.empty())
+            txoutSpentTo = tx.vout[0];
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(bnSerial);
+        READWRITE(nDenomination);
+        READWRITE(fPublicSpend);
+        READWRITE(txoutSpentTo);
+    }
+};
+
+typedef std::vector<std::pair<CZerocoinSpendPos, CZerocoinSpendInfo> > ZerocoinSpendIndex;
+
 /** Zerocoin database (zerocoin/) */
 class CZerocoinDB : public CLevelDBWrapper
 {
@@ -93,6 +259,14 @@ public:
     bool WriteAccumulatorValue(const uint32_t& nChecksum, const CBigNum& bnValue);
     bool ReadAccumulatorValue(const uint32_t& nChecksum, CBigNum& bnValue);
     bool EraseAccumulatorValue(const uint32_t& nChecksum);
+    /** Serial index of the zSPL spends in the active chain, by height and txid */
+    bool WriteSpendIndexBatch(const ZerocoinSpendIndex& vEntries);
+    bool ReadSpendIndex(int nHeightStart, int nHeightEnd, ZerocoinSpendIndex& vEntries);
+    bool EraseSpendIndex(int nHeight);
+    bool WipeSpendIndex();
+    /** Whether the serial index covers the blocks connected before it existed */
+    bool WriteSpendIndexComplete(bool fComplete);
+    bool ReadSpendIndexComplete();
 };
 
 #endif // BITCOIN_TXDB_H
@@ -22,6 +22,7 @@
 #include "stakeinput.h"
 #include "swifttx.h"
 #include "timedata.h"
+#include "trace.h"
 #include "txdb.h"
 #include "util.h"
 #include "utilmoneystr.h"
@@ -1371,7 +1372,7 @@ void CWalletTx::RelayWalletTransaction(std::string strCommand)
             LogPrintf("Relaying wtx %s\n", hash.ToString());
 
             if (strCommand == "ix") {
-                mapTxLockReq.insert(std::make_pair(hash, (CTransaction) * this));
+                AddTxLockRequest((CTransaction) * this);
                 CreateNewLock(((CTransaction) * this));
                 RelayTransactionLockReq((CTransaction) * this, true);
             } else {
@@ -2333,6 +2334,8 @@ bool CWallet::CreateCoinStake(
         unsigned int& nTxNewTime
         )
 {
+    TRACE_SCOPE("staking", "CreateCoinStake");
+
     // The following split & combine thresholds are important to security
     // Should not be adjusted if you don't understand the consequences
     //int64_t nCombineThreshold = 0;
@@ -3714,9 +3717,9 @@ int CMerkleTx::GetTransactionLockSignatures() const
     if (!fEnableSwiftTX) return -1;
 
     //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(GetHash());
-    if (i != mapTxLocks.end()) {
-        return (*i).second.CountSignatures();
+    CTransactionLock lock;
+    if (GetTransactionLock(GetHash(), lock)) {
+        return lock.CountSignatures();
     }
 
     return -1;
@@ -3727,9 +3730,9 @@ bool CMerkleTx::IsTransactionLockTimedOut() const
     if (!fEnableSwiftTX) return 0;
 
     //compile consessus vote
-    std::map<uint256, CTransactionLock>::iterator i = mapTxLocks.find(GetHash());
-    if (i != mapTxLocks.end()) {
-        return GetTime() > (*i).second.nTimeout;
+    CTransactionLock lock;
+    if (GetTransactionLock(GetHash(), lock)) {
+        return GetTime() > lock.nTimeout;
     }
 
     return false;
@@ -12,6 +12,7 @@
 #include "accumulatorcheckpoints.h"
 #include "zsplchain.h"
 #include "tinyformat.h"
+#include "trace.h"
 
 
 std::map<uint32_t, CBigNum> mapAccumulatorValues;
@@ -529,6 +530,7 @@ void AccumulateRange(CoinWitnessData* coinWitness, int nHeightEnd)
 
 bool GenerateAccumulatorWitness(CoinWitnessData* coinWitness, AccumulatorMap& mapAccumulators, CBlockIndex* pindexCheckpoint)
 {
+    TRACE_SCOPE("zerocoin", "GenerateAccumulatorWitness");
     try {
         // Lock
         LogPrint("zero", "%s: generating\n", __func__);
@@ -804,6 +806,7 @@ bool GenerateAccumulatorWitness(
         std::string& strError,
         CBlockIndex* pindexCheckpoint)
 {
+    TRACE_SCOPE("zerocoin", "GenerateAccumulatorWitness");
     try {
         // Lock
         LogPrint("zero", "%s: generating\n", __func__);
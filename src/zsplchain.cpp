@@ -9,6 +9,8 @@
 #include "txdb.h"
 #include "guiinterface.h"
 
+#include <boost/thread.hpp>
+
 // 6 comes from OPCODE (1) + vch.size() (1) + BIGNUM size (4)
 #define SCRIPT_OFFSET 6
 // For Script size (BIGNUM/Uint256 size)
@@ -254,9 +256,39 @@ bool IsSerialInBlockchain(const uint256& hashSerial, int& nHeightTx, uint256& tx
     return IsTransactionInChain(txidSpend, nHeightTx, tx);
 }
 
+bool BlockToZerocoinSpendIndex(const CBlock& block, int nHeight, ZerocoinSpendIndex& vEntries)
+{
+    for (const CTransaction& tx : block.vtx) {
+        if (!tx.HasZerocoinSpendInputs())
+            continue;
+
+        uint256 txid = tx.GetHash();
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            const CTxIn& in = tx.vin[i];
+            bool isPublicSpend = in.IsZerocoinPublicSpend();
+            if (!in.IsZerocoinSpend() && !isPublicSpend)
+                continue;
+
+            CZerocoinSpendPos pos(nHeight, txid, i);
+            if (isPublicSpend) {
+                PublicCoinSpend publicSpend(Params().Zerocoin_Params(false));
+                CValidationState state;
+                if (!ZSPLModule::ParseZerocoinPublicSpend(in, tx, state, publicSpend))
+                    return error("%s : failed to parse public spend in tx %s", __func__, txid.GetHex());
+                vEntries.push_back(std::make_pair(pos, CZerocoinSpendInfo(publicSpend.getCoinSerialNumber(), publicSpend.getDenomination(), true, tx)));
+            } else {
+                libzerocoin::CoinSpend spend = TxInToZerocoinSpend(in);
+                vEntries.push_back(std::make_pair(pos, CZerocoinSpendInfo(spend.getCoinSerialNumber(), spend.getDenomination(), false, tx)));
+            }
+        }
+    }
+
+    return true;
+}
+
 std::string ReindexZerocoinDB()
 {
-    if (!zerocoinDB->WipeCoins("spends") || !zerocoinDB->WipeCoins("mints")) {
+    if (!zerocoinDB->WipeCoins("spends") || !zerocoinDB->WipeCoins("mints") || !zerocoinDB->WipeSpendIndex()) {
         return _("Failed to wipe zerocoinDB");
     }
 
@@ -265,6 +297,7 @@ std::string ReindexZerocoinDB()
     CBlockIndex* pindex = chainActive[Params().Zerocoin_StartHeight()];
     std::vector<std::pair<libzerocoin::CoinSpend, uint256> > vSpendInfo;
     std::vector<std::pair<libzerocoin::PublicCoin, uint256> > vMintInfo;
+    ZerocoinSpendIndex vSpendIndex;
     while (pindex) {
         uiInterface.ShowProgress(_("Reindexing zerocoin database..."), std::max(1, std::min(99, (int)((double)(pindex->nHeight - Params().Zerocoin_StartHeight()) / (double)(chainActive.Height() - Params().Zerocoin_StartHeight()) * 100))));
 
@@ -276,6 +309,9 @@ std::string ReindexZerocoinDB()
             return _("Reindexing zerocoin failed");
         }
 
+        if (!BlockToZerocoinSpendIndex(block, pindex->nHeight, vSpendIndex))
+            return _("Failed to parse public spend");
+
         for (const CTransaction& tx : block.vtx) {
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 if (tx.IsCoinBase())
@@ -322,10 +358,12 @@ std::string ReindexZerocoinDB()
 
         // Flush the zerocoinDB to disk every 100 blocks
         if (pindex->nHeight % 100 == 0) {
-            if ((!vSpendInfo.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpendInfo)) || (!vMintInfo.empty() && !zerocoinDB->WriteCoinMintBatch(vMintInfo)))
+            if ((!vSpendInfo.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpendInfo)) || (!vMintInfo.empty() && !zerocoinDB->WriteCoinMintBatch(vMintInfo)) ||
+                (!vSpendIndex.empty() && !zerocoinDB->WriteSpendIndexBatch(vSpendIndex)))
                 return _("Error writing zerocoinDB to disk");
             vSpendInfo.clear();
             vMintInfo.clear();
+            vSpendIndex.clear();
         }
 
         pindex = chainActive.Next(pindex);
@@ -333,7 +371,8 @@ std::string ReindexZerocoinDB()
     uiInterface.ShowProgress("", 100);
 
     // Final flush to disk in case any remaining information exists
-    if ((!vSpendInfo.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpendInfo)) || (!vMintInfo.empty() && !zerocoinDB->WriteCoinMintBatch(vMintInfo)))
+    if ((!vSpendInfo.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpendInfo)) || (!vMintInfo.empty() && !zerocoinDB->WriteCoinMintBatch(vMintInfo)) ||
+        (!vSpendIndex.empty() && !zerocoinDB->WriteSpendIndexBatch(vSpendIndex)) || !zerocoinDB->WriteSpendIndexComplete(true))
         return _("Error writing zerocoinDB to disk");
 
     uiInterface.ShowProgress("", 100);
@@ -341,6 +380,58 @@ std::string ReindexZerocoinDB()
     return "";
 }
 
+void ThreadZerocoinSpendIndex()
+{
+    RenameThread("simplicity-spendindex");
+
+    if (zerocoinDB->ReadSpendIndexComplete())
+        return;
+
+    while (fImporting || fReindex) {
+        boost::this_thread::interruption_point();
+        MilliSleep(1000);
+    }
+
+    // blocks connected from now on are indexed by ConnectBlock
+    int nHeightEnd;
+    {
+        LOCK(cs_main);
+        nHeightEnd = chainActive.Height();
+    }
+    LogPrintf("%s : indexing zSPL spends up to height %d\n", __func__, nHeightEnd);
+
+    for (int nHeight = Params().Zerocoin_StartHeight(); nHeight <= nHeightEnd; nHeight++) {
+        boost::this_thread::interruption_point();
+
+        CBlockIndex* pindex;
+        {
+            LOCK(cs_main);
+            pindex = chainActive[nHeight];
+        }
+        if (!pindex)
+            break;
+
+        CBlock block;
+        ZerocoinSpendIndex vEntries;
+        if (!ReadBlockFromDisk(block, pindex) || !BlockToZerocoinSpendIndex(block, nHeight, vEntries)) {
+            LogPrintf("%s : failed to index block %d, stopping\n", __func__, nHeight);
+            return;
+        }
+        if (vEntries.empty())
+            continue;
+
+        // DisconnectBlock erases the entries of a height under cs_main, don't write them back
+        LOCK(cs_main);
+        if (chainActive.Contains(pindex) && !zerocoinDB->WriteSpendIndexBatch(vEntries)) {
+            LogPrintf("%s : failed to write the entries of block %d, stopping\n", __func__, nHeight);
+            return;
+        }
+    }
+
+    zerocoinDB->WriteSpendIndexComplete(true);
+    LogPrintf("%s : done\n", __func__);
+}
+
 bool RemoveSerialFromDB(const CBigNum& bnSerial)
 {
     return zerocoinDB->EraseCoinSpend(bnSerial);